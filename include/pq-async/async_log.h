@@ -0,0 +1,170 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_async_log_h
+#define _libpq_async_async_log_h
+
+#include "log.h"
+#include "inline_cb.h"
+
+#include <atomic>
+#include <string>
+#include <tuple>
+
+/*!
+ * \brief number of records of the queue of each logging thread,
+ * a record logged while the queue is full is written synchronously
+ */
+#define PQ_ASYNC_LOG_QUEUE_CAPACITY 256
+
+/*!
+ * \brief size in bytes of the captured arguments of a deferred record
+ */
+#define PQ_ASYNC_LOG_FORMAT_CAPACITY 128
+
+/*!
+ * \brief milliseconds the log writer sleeps when every queue is empty
+ */
+#define PQ_ASYNC_LOG_IDLE_MS 10
+
+namespace pq_async{
+
+enum class log_level
+{
+    trace = 0,
+    debug = 1,
+    info = 2,
+    warn = 3,
+    error = 4,
+};
+
+/*!
+ * \brief formats a deferred record, called on the writer thread
+ */
+typedef inline_function<
+    void(std::string&), PQ_ASYNC_LOG_FORMAT_CAPACITY
+> log_format_fn;
+
+/*!
+ * \brief counters of the asynchronous logging backend
+ */
+struct async_log_stats
+{
+    /*! records written by the writer thread */
+    uint64_t written;
+    /*! records written synchronously because their queue was full */
+    uint64_t sync_fallbacks;
+    /*! queues of the threads that logged */
+    size_t queues;
+};
+
+inline std::atomic<bool>& _async_log_flag()
+{
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/*!
+ * \brief true when the records are written by the background writer
+ */
+inline bool async_logging_enabled()
+{
+    return _async_log_flag().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief starts or stops the background writer, stopping it writes the
+ * pending records first. While it is stopped the records are written
+ * synchronously by the calling thread.
+ */
+void enable_async_logging(bool enabled);
+
+/*!
+ * \brief waits until the records queued before the call by every thread
+ * are written
+ */
+void flush_async_log();
+
+async_log_stats async_logging_stats();
+
+/*!
+ * \brief writes msg to log synchronously
+ */
+void write_log(
+    const md::log::logger& log, log_level level, const std::string& msg
+);
+
+/*!
+ * \brief queues a record on the queue of the calling thread,
+ * returns false if the queue is full or the writer is stopped
+ */
+bool _push_log_record(
+    const md::log::logger& log, log_level level, log_format_fn&& fmt
+);
+
+template<typename T>
+inline const T& _log_arg(const T& v){ return v;}
+// the pointed text may be gone when the writer formats the record
+inline std::string _log_arg(const char* v){ return v ? v : "(null)";}
+inline std::string _log_arg(char* v){ return v ? v : "(null)";}
+
+/*!
+ * \brief logs a message formatted with the fmt syntax.
+ * 
+ * When the asynchronous logging is enabled the arguments are copied in a
+ * record of the queue of the calling thread, the formatting and the write
+ * are done by the background writer thread.
+ * 
+ * \code{.cpp}
+ * pq_async::log_async(log, pq_async::log_level::warn,
+ *     "connection '{}' lost: {}", conn->id(), err.what()
+ * );
+ * \endcode
+ */
+template<typename... ARGS>
+void log_async(
+    const md::log::logger& log, log_level level,
+    const char* fmt, const ARGS&... args)
+{
+    if(async_logging_enabled() && _push_log_record(log, level,
+    [fmt, a = std::make_tuple(_log_arg(args)...)](std::string& out){
+        std::apply([fmt, &out](const auto&... v){
+            out = fmt::vformat(fmt, fmt::make_format_args(v...));
+        }, a);
+    }))
+        return;
+    
+    write_log(log, level, fmt::vformat(fmt, fmt::make_format_args(args...)));
+}
+
+/*!
+ * \brief logs a text as is, the text is copied
+ */
+void log_text_async(
+    const md::log::logger& log, log_level level, const char* text
+);
+
+} //namespace pq_async
+
+#endif //_libpq_async_async_log_h
@@ -0,0 +1,85 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_bulk_h
+#define _libpq_async_data_bulk_h
+
+#include "data_common.h"
+#include "data_parameters.h"
+
+namespace pq_async{
+
+/*!
+ * \brief binds each column vector as one array parameter, $1 for the
+ * first column, $2 for the second... to be expanded with unnest
+ * 
+ * \param cols the column values, every vector must have the same size
+ * \return parameters_t 
+ */
+template<typename... COLS>
+parameters_t unnest_parameters(const std::vector<COLS>&... cols)
+{
+    static_assert(sizeof...(COLS) > 0, "at least one column is required");
+    
+    size_t sizes[] = { cols.size()... };
+    for(size_t s : sizes)
+        if(s != sizes[0])
+            throw pq_async::exception(
+                "The unnest columns must have the same size!"
+            );
+    
+    parameters_t p;
+    (p.push_back(pq_async::new_column_parameter(cols)), ...);
+    return p;
+}
+
+/*!
+ * \brief quotes an identifier the way PQescapeIdentifier does,
+ * the embedded double quotes are doubled
+ */
+std::string quote_ident(const std::string& ident);
+
+/*!
+ * \brief quotes a table name, a schema qualified table is given as
+ * "schema.table" and each part is quoted
+ */
+std::string quote_table(const std::string& table);
+
+/*!
+ * \brief builds "insert into table(columns) select * from unnest($1, ...)"
+ * 
+ * \param table the destination table, quoted by quote_table
+ * \param columns the destination columns, in the parameters order,
+ * quoted by quote_ident
+ * \param suffix appended as is, e.g. an "on conflict ... do update" clause
+ * \return std::string 
+ */
+std::string unnest_insert_sql(
+    const std::string& table,
+    const std::vector<std::string>& columns,
+    const std::string& suffix = ""
+);
+
+} //namespace pq_async
+#endif //_libpq_async_data_bulk_h
@@ -27,9 +27,17 @@ SOFTWARE.
 
 #include "stable_headers.h"
 #include "log.h"
+#include "async_log.h"
 #include "exceptions.h"
 #include "data_parameters.h"
 
+// the coroutine awaitables are available when compiled as C++20
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define PQ_ASYNC_HAS_COROUTINES 1
+#else
+#define PQ_ASYNC_HAS_COROUTINES 0
+#endif
+
 namespace pq_async{
 
 #define DEFAULT_CONNECTION_POOL_MAX_CONN 20
@@ -48,6 +56,21 @@ template< typename DATA_T >
 class strand_t;
 class database_t;
 
+template< typename T >
+class db_future;
+template< typename T >
+class future_state_t;
+
+#if PQ_ASYNC_HAS_COROUTINES
+template< typename T >
+class task;
+template< typename R >
+class db_awaitable;
+class reader_awaitable;
+class row_awaitable;
+struct reader_pull_t;
+#endif
+
 typedef std::shared_ptr< pq_async::parameters_t > parameters;
 typedef std::shared_ptr< pq_async::data_table_t > data_table;
 typedef std::shared_ptr< pq_async::data_row_t > data_row;
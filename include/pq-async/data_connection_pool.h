@@ -27,6 +27,11 @@ SOFTWARE.
 
 
 #include "data_common.h"
+#include "inline_cb.h"
+#include "reactor.h"
+#include "data_trace.h"
+#include "data_statement_stats.h"
+#include "data_slow_log.h"
 
 namespace pq_async{
 
@@ -35,10 +40,104 @@ typedef std::shared_ptr<pq_async::connection_lock_t> connection_lock;
 
 class connection_task_t;
 class connection_pool;
+struct reactor_watch_t;
 class database_t;
 
 typedef std::shared_ptr< pq_async::connection_task_t > connection_task;
 
+/*!
+ * \brief maximum number of idle connection tasks kept by the pool of
+ * each thread
+ */
+#define PQ_ASYNC_CONNECTION_TASK_POOL_DEPTH 64
+
+/*!
+ * \brief counters of the connection task pool of the calling thread
+ */
+struct connection_task_pool_stats
+{
+    /*! tasks allocated because the pool was empty */
+    uint64_t created;
+    /*! tasks taken back from the pool */
+    uint64_t reused;
+    /*! tasks currently waiting in the pool */
+    size_t idle;
+};
+
+/*!
+ * \brief connection acquisition priority class,
+ * under saturation the pending requests of a lower value are served first
+ */
+enum class connection_priority
+{
+    interactive = 0,
+    normal = 1,
+    background = 2,
+};
+#define PQ_ASYNC_PRIORITY_CLASS_COUNT 3
+
+/*!
+ * \brief number of statements sent before their results are read back
+ * by a pipelined batch
+ */
+#define PQ_ASYNC_PIPELINE_WINDOW 1000
+
+// the pipeline mode is available from libpq 14, the batches are executed
+// one statement at a time with an older libpq
+#if defined(LIBPQ_HAS_PIPELINING)
+#define PQ_ASYNC_HAS_PIPELINE 1
+#else
+#define PQ_ASYNC_HAS_PIPELINE 0
+#endif
+
+/*!
+ * \brief how the statements of a pipelined batch are synchronized
+ */
+enum class batch_mode
+{
+    /*! one Sync for the whole batch, the first error aborts the rest */
+    atomic = 0,
+    /*! one Sync per statement, a failing statement does not abort the
+     * others unless they run in an explicit transaction */
+    isolated = 1,
+};
+
+/*!
+ * \brief error of one statement of a batch
+ */
+struct batch_error
+{
+    size_t index;
+    std::string sqlstate;
+    std::string message;
+};
+
+/*!
+ * \brief aggregated result of a batch
+ */
+struct batch_result
+{
+    /*! sum of the rows affected by the succeeding statements */
+    int64_t affected;
+    /*! number of succeeding statements */
+    size_t executed;
+    /*! number of statements skipped after an error */
+    size_t aborted;
+    std::vector<batch_error> errors;
+};
+
+/*!
+ * \brief builds the sql_exception of a failed result and clears it
+ */
+inline sql_exception result_exception(PGconn* conn, PGresult* res)
+{
+    const char* state = res ?
+        PQresultErrorField(res, PG_DIAG_SQLSTATE) : nullptr;
+    sql_exception err(PQerrorMessage(conn), state ? state : "");
+    PQclear(res);
+    return err;
+}
+
 
 class connection
 {
@@ -48,7 +147,8 @@ class connection
     
 private:
     connection(connection_pool* pool, std::string connection_string
-        ): _res(0), _running(0), _id(md::num_to_str(++s_next_id)),
+        ): _res(0), _running(0), _locks(0),
+        _id(md::num_to_str(++s_next_id)),
         _pool(pool),_connection_string(connection_string), 
         is_in_transaction(false), 
         _conn(NULL), _sock_fd(-1),
@@ -132,6 +232,7 @@ public:
         PQfinish(_conn);
         _conn = NULL;
         is_in_transaction.store(false);
+        _prepared.clear();
     }
     
     void reserve(){
@@ -158,6 +259,39 @@ public:
     
     bool in_transaction(){ return is_in_transaction.load();}
     
+    /*!
+     * \brief returns true if the named statement is known to be
+     * prepared on that physical connection
+     */
+    bool is_prepared(const std::string& name) const
+    {
+        return _prepared.find(name) != _prepared.end();
+    }
+    /*!
+     * \brief returns true if the named statement is known to be
+     * prepared on that physical connection with that query
+     */
+    bool is_prepared(const std::string& name, const std::string& sql) const
+    {
+        auto it = _prepared.find(name);
+        return it != _prepared.end() && it->second == sql;
+    }
+    void set_prepared(const std::string& name, const std::string& sql)
+    {
+        _prepared[name] = sql;
+    }
+    void unset_prepared(const std::string& name){ _prepared.erase(name);}
+    
+    /*!
+     * \brief the SQLSTATE code of the last statement that failed on
+     * that physical connection, empty if none did
+     */
+    const std::string& last_sqlstate() const { return _last_sqlstate;}
+    void set_last_sqlstate(const std::string& state)
+    {
+        _last_sqlstate = state;
+    }
+    
     void begin_transaction()
     {
         if(is_in_transaction.load())
@@ -172,9 +306,7 @@ public:
             return;
         }
         
-        std::string errMsg = PQerrorMessage(_conn);
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw result_exception(_conn, res);
     }
     
     void commit_transaction()
@@ -191,9 +323,7 @@ public:
             return;
         }
         
-        std::string errMsg = PQerrorMessage(_conn);
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw result_exception(_conn, res);
     }
     
     
@@ -211,9 +341,7 @@ public:
             return;
         }
 
-        std::string errMsg = PQerrorMessage(_conn);
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw result_exception(_conn, res);
     }
 
 
@@ -280,6 +408,7 @@ private:
     
     std::atomic<int> _res;
     std::atomic<int> _running;
+    std::atomic<int> _locks;
     
     std::string _id;
     
@@ -291,20 +420,26 @@ private:
     int _sock_fd;
     
     database_t* _owner;
+    // statements prepared on this session, used by the multiplexing mode
+    // name and query of the statements prepared on the session
+    std::map<std::string, std::string> _prepared;
+    std::string _last_sqlstate;
     
     std::chrono::system_clock::time_point _last_modification_date;
 };
 
 class connection_lock_t
 {
+    friend class connection_task_t;
 public:
-    connection_lock_t(connection* conn):_conn(conn)
+    connection_lock_t(connection* conn)
+        : _conn(conn), _requested_ns(0), _trace_id(0), _trace_ts(0)
     {
         if(!_conn)
             return;
         
         if(_conn->_running.load() == 1){
-            pq_async::default_logger()->error(
+            log_async(pq_async::default_logger(), log_level::error,
                 "unable to lock the connection because it's already locked"
             );
             
@@ -315,21 +450,20 @@ public:
         }
         
         _conn->start_work();
+        ++_conn->_locks;
     }
     
-    ~connection_lock_t()
-    {
-        if(!_conn)
-            return;
-        
-        _conn->stop_work();
-    }
+    ~connection_lock_t();
     
     const connection* conn(){return _conn;}
     
 private:
     connection* _conn;
-
+    // time of the connection request, taken by the first statement
+    int64_t _requested_ns;
+    // trace of the connection request, adopted by the first statement
+    uint64_t _trace_id;
+    int64_t _trace_ts;
 };
 
 class connection_task_t
@@ -352,12 +486,12 @@ protected:
 public:
     connection_task_t(
         md::event_queue_t* owner, database db, connection_lock lock,
-        const md::callback::value_cb<PGresult*>& cb
+        inline_value_cb<PGresult*>&& cb
     );
     
     connection_task_t(
         md::event_queue_t* owner, database db, connection* conn,
-        const md::callback::value_cb<connection_lock>& cb
+        inline_value_cb<connection_lock>&& cb
     );
     
     connection_task_t(
@@ -368,10 +502,36 @@ public:
     ~connection_task_t()
     {
         if(_ev)
-            event_free(_ev);
+            event_del(_ev);
         _ev = nullptr;
+        this->_unwatch();
     }
     
+    /*!
+     * \brief returns a query task recycled from the pool of the calling
+     * thread, or a new one when the pool is empty. The task goes back to
+     * the pool when its last reference is released, keeping the capacity
+     * of its buffers so the steady state dispatch does not allocate.
+     */
+    static connection_task acquire(
+        md::event_queue_t* owner, database db, connection_lock lock,
+        inline_value_cb<PGresult*>&& cb
+    );
+    
+    /*!
+     * \brief returns a connect task recycled from the pool of the calling
+     * thread, or a new one when the pool is empty
+     */
+    static connection_task acquire(
+        md::event_queue_t* owner, database db, connection* conn,
+        inline_value_cb<connection_lock>&& lock_cb
+    );
+    
+    /*!
+     * \brief counters of the pool of the calling thread
+     */
+    static connection_task_pool_stats pool_stats();
+    
     database db(){ return _db;}
     
     void connect(const std::string& connection_string, int32_t timeout_ms)
@@ -387,7 +547,7 @@ public:
         _format = timeout_date.time_since_epoch().count();
         // force activation on connect action because no event is bond to
         // the connection socket.
-        this->_owner->activate();
+        this->_activate();
     }
 
     void send_query(const char* sql, const parameters_t& p,
@@ -397,7 +557,7 @@ public:
         _sql = sql;
         _p = p;
         _format = format;
-        this->_owner->activate();
+        this->_activate();
     }
     
     void send_query(const char* sql, parameters_t& p, int format = PG_BIN_FORMAT)
@@ -406,7 +566,7 @@ public:
         _sql = sql;
         _p = std::move(p);
         _format = format;
-        this->_owner->activate();
+        this->_activate();
     }
     
     void send_prepare(
@@ -416,7 +576,7 @@ public:
         _name = name;
         _sql = sql;
         _t = t;
-        this->_owner->activate();
+        this->_activate();
     }
     
     void send_query_prepared(
@@ -426,7 +586,7 @@ public:
         _name = name;
         _p = std::move(p);
         _format = format;
-        this->_owner->activate();
+        this->_activate();
     }
     void send_query_prepared(
         const char* name, const parameters_t& p, int format = PG_BIN_FORMAT)
@@ -435,7 +595,7 @@ public:
         _name = name;
         _p = p;
         _format = format;
-        this->_owner->activate();
+        this->_activate();
     }
     
     void cancel()
@@ -444,15 +604,17 @@ public:
             throw pq_async::exception("No command in progress!");
         
         _cmd_type = command_type::cancel;
-        this->_owner->activate();
+        this->_activate();
     }
     
     virtual PGresult* run_now()
     {
         if(_ev){
-            event_free(_ev);
+            event_del(_ev);
             _ev = nullptr;
         }
+        this->_unwatch();
+        _sync = true;
         if(_cmd_type == command_type::none)
             return nullptr;
         
@@ -476,15 +638,25 @@ public:
                     break;
             }
             _cmd_type = command_type::sent;
+            if(_trace_id)
+                this->_trace_phase(trace_phase::send);
         }
         
         PGresult* last = nullptr;
+        uint64_t rows = 0, bytes = 0;
+        bool failed = false;
         while(PGresult* r = PQgetResult(this->conn())){
+            if(_stats_ns)
+                _stats_count(r, rows, bytes, failed);
             if(last)
                 PQclear(last);
             last = r;
         }
         _completed = true;
+        if(_trace_id)
+            this->_trace_phase(trace_phase::execute);
+        if(_stats_ns)
+            this->_stats_record(failed, rows, bytes);
         
         return last;
     }
@@ -493,6 +665,7 @@ public:
     {
         if(!_cb && !_lock_cb)
             return;
+        this->_mark_loop_thread();
         
         try{
             if(_cmd_type == command_type::none)
@@ -501,6 +674,9 @@ public:
             if(_cmd_type != command_type::sent){
                 // start waiting for IO
                 
+                if(_trace_id && _cmd_type != command_type::connect)
+                    this->_trace_phase(trace_phase::queue);
+                
                 switch(_cmd_type){
                     case command_type::connect:
                         _connect();
@@ -524,16 +700,30 @@ public:
                         break;
                 }
                 _cmd_type = command_type::sent;
+                if(_trace_id)
+                    this->_trace_phase(trace_phase::send);
                 return;
             }
             
             if(!this->_consume_data())
                 return;
             _completed = true;
+            if(_trace_id)
+                this->_trace_phase(trace_phase::execute);
+            uint64_t rows = 0, bytes = 0;
+            bool failed = false;
             while(PGresult* r = PQgetResult(this->conn())){
+                if(_stats_ns)
+                    _stats_count(r, rows, bytes, failed);
                 _cb(nullptr, r);
             }
+            if(_trace_id)
+                this->_trace_phase(trace_phase::process);
+            if(_stats_ns)
+                this->_stats_record(failed, rows, bytes);
         }catch(const std::exception& err){
+            if(_stats_ns)
+                this->_stats_record(true, 0, 0);
             _cb(md::callback::cb_error(err), nullptr);
         }
     }
@@ -546,7 +736,7 @@ public:
         // must reactivate because database_t strand_t do not reactivate
         // on requeue, and no event is created for connect task
         if(_cmd_type == command_type::connect)
-            this->_owner->activate();
+            this->_activate();
         
         return md::event_requeue_pos::front;
     }
@@ -561,12 +751,106 @@ protected:
     
     void _connect();
     
-    void _create_event()
+    /*!
+     * \brief tells the database which thread drives its strand
+     */
+    void _mark_loop_thread();
+    
+    /*!
+     * \brief gives the task a trace id when the tracing is enabled, the
+     * statement continues the trace of the connection request when the
+     * lock was acquired for it
+     */
+    void _trace_start()
+    {
+        _trace_id = 0;
+        _trace_ts = 0;
+        if(!trace_enabled())
+            return;
+        if(_lock && _lock->_trace_id){
+            _trace_id = std::exchange(_lock->_trace_id, 0);
+            _trace_ts = _lock->_trace_ts;
+            return;
+        }
+        _trace_id = trace_next_id();
+        _trace_ts = trace_now();
+    }
+    
+    /*!
+     * \brief records the phase ending now, the next one starts now
+     */
+    void _trace_phase(trace_phase phase)
+    {
+        int64_t now = trace_now();
+        trace_record(_trace_id, phase, _trace_ts, now);
+        _trace_ts = now;
+    }
+    
+    /*!
+     * \brief starts the statement latency, from the connection request
+     * when the lock was acquired for this statement
+     */
+    void _stats_start()
+    {
+        _stats_ns = 0;
+        if(!statement_stats_enabled() && !slow_query_log_enabled())
+            return;
+        if(_lock && _lock->_requested_ns)
+            _stats_ns = std::exchange(_lock->_requested_ns, 0);
+        else
+            _stats_ns = trace_now();
+    }
+    
+    /*!
+     * \brief adds the rows and the value bytes of r to the counts
+     */
+    static void _stats_count(
+        const PGresult* r, uint64_t& rows, uint64_t& bytes, bool& failed
+    );
+    
+    /*!
+     * \brief adds the statement call to the statistics and to the slow
+     * query log, only once
+     */
+    void _stats_record(bool failed, uint64_t rows, uint64_t bytes);
+    
+    /*!
+     * \brief wakes the strand, through the default reactor when one is
+     * installed
+     */
+    void _activate() const;
+    
+    /*!
+     * \brief registers the socket with the default reactor, the strand
+     * is run from the reactor handler
+     */
+    void _watch(const reactor& r);
+    void _unwatch();
+    
+    /*!
+     * \brief closes a connection left in an unknown state by a failed
+     * command, it is opened again by the next lock
+     */
+    void _reset_connection();
+    
+    void _create_event(short events = EV_READ)
     {
-        _ev = event_new(
+        if(reactor r = default_reactor()){
+            this->_watch(r);
+            return;
+        }
+        
+        // the event lives in the task storage, reused by a recycled task
+        if(!_ev_storage)
+            _ev_storage.reset(new char[event_get_struct_event_size()]);
+        if(_ev)
+            event_del(_ev);
+        _ev = (event*)_ev_storage.get();
+        event_assign(
+            _ev,
             this->_owner->ev_base(),
             PQsocket(this->conn()),
-            EV_READ | EV_PERSIST,
+            events | EV_PERSIST,
             [](int fd, short events, void* arg){
                 md::event_queue_t* eq = (md::event_queue_t*)arg;
                 eq->activate();
@@ -680,12 +964,31 @@ protected:
     database _db;
 
     connection* _conn;
-    md::callback::value_cb<connection_lock> _lock_cb;
+    inline_value_cb<connection_lock> _lock_cb;
 
     connection_lock _lock;
-    md::callback::value_cb<PGresult*> _cb;
+    inline_value_cb<PGresult*> _cb;
     
     event* _ev;
+    std::unique_ptr<char[]> _ev_storage;
+    std::shared_ptr<reactor_watch_t> _reactor_watch;
+    bool _sync;
+    uint64_t _trace_id;
+    int64_t _trace_ts;
+    int64_t _stats_ns;
+    
+private:
+    struct recycler_t;
+    
+    void _reset(
+        md::event_queue_t* owner, database db, connection_lock lock,
+        inline_value_cb<PGresult*>&& cb
+    );
+    void _reset(
+        md::event_queue_t* owner, database db, connection* conn,
+        inline_value_cb<connection_lock>&& lock_cb
+    );
+    void _recycle();
 };
 
 class reader_connection_task
@@ -698,6 +1001,7 @@ public:
     
     virtual PGresult* run_now()
     {
+        _sync = true;
         if(_cmd_type == command_type::none)
             return nullptr;
         
@@ -728,12 +1032,15 @@ public:
         PGresult* r = PQgetResult(this->conn());
         if(!r)
             _completed = true;
+        if(_stats_ns)
+            this->_stats_row(r);
         
         return r;
     }
     
     virtual void run_task()
     {
+        this->_mark_loop_thread();
         try{
             if(_cmd_type == command_type::none)
                 return;
@@ -774,33 +1081,143 @@ public:
             PGresult* r = PQgetResult(this->conn());
             if(!r)
                 _completed = true;
+            if(_stats_ns)
+                this->_stats_row(r);
             _cb(nullptr, r);
             
         }catch(const std::exception& err){
+            if(_stats_ns)
+                this->_stats_record(true, _rows, _bytes);
             _cb(md::callback::cb_error(err), nullptr);
         }
     }
+    
+private:
+    /*!
+     * \brief counts the single row results, the statement is recorded
+     * with the last one
+     */
+    void _stats_row(const PGresult* r)
+    {
+        if(r){
+            _stats_count(r, _rows, _bytes, _failed);
+            return;
+        }
+        this->_stats_record(_failed, _rows, _bytes);
+        _rows = _bytes = 0;
+        _failed = false;
+    }
+    
+    uint64_t _rows;
+    uint64_t _bytes;
+    bool _failed;
+};
 
+#if PQ_ASYNC_HAS_PIPELINE
+/*!
+ * \brief sends the executions of a prepared statement in pipeline mode,
+ * the statements are sent by PQ_ASYNC_PIPELINE_WINDOW and a single
+ * round trip is paid for each window.
+ */
+class pipeline_connection_task
+    : public connection_task_t
+{
+public:
+    pipeline_connection_task(
+        md::event_queue_t* owner, database db, connection_lock lock,
+        const md::callback::value_cb<batch_result>& cb
+    );
+    pipeline_connection_task(
+        md::event_queue_t* owner, database db, connection_lock lock
+    );
+    
+    void send_batch(
+        const char* name,
+        std::shared_ptr< const std::vector<parameters_t> > batch,
+        batch_mode mode)
+    {
+        _cmd_type = command_type::query_prepared;
+        _name = name;
+        _batch = batch;
+        _mode = mode;
+        this->_activate();
+    }
+    
+    /*!
+     * \brief synchronously process the whole batch
+     */
+    batch_result run_batch();
+    
+    virtual PGresult* run_now()
+    {
+        run_batch();
+        return nullptr;
+    }
+    
+    virtual void run_task();
+    
+private:
+    void _send_window();
+    bool _flush();
+    void _wait_socket();
+    bool _read_results();
+    bool _done() const
+    {
+        return _received == _batch->size() && _syncs_received == _syncs_sent;
+    }
+    void _finish();
+    void _abort();
+    
+    std::shared_ptr< const std::vector<parameters_t> > _batch;
+    batch_mode _mode;
+    size_t _sent;
+    size_t _received;
+    size_t _syncs_sent;
+    size_t _syncs_received;
+    bool _last_null;
+    bool _writing;
+    batch_result _result;
+    md::callback::value_cb<batch_result> _batch_cb;
 };
+#endif //PQ_ASYNC_HAS_PIPELINE
 
 class connection_pool
 {
     //friend class connection;
 private:
+    struct pending_request_t
+    {
+        database_t* owner;
+        connection_priority priority;
+        uint64_t seq;
+        std::chrono::steady_clock::time_point since;
+        std::chrono::steady_clock::time_point last_poll;
+    };
+    
     connection_pool()
-        : _max_conn(DEFAULT_CONNECTION_POOL_MAX_CONN)
+        : connection_pool(DEFAULT_CONNECTION_POOL_MAX_CONN)
     {
     }
 
     connection_pool(int max_connection_pool_count)
-        : _max_conn(max_connection_pool_count)
+        : _max_conn(max_connection_pool_count),
+        _caps{0, 0, 0}, _max_pending(0), _max_wait_ms(0),
+        _next_seq(0), _rejected(0)
     {
     }
 
     connection* _get_connection(
+        database_t* owner, const std::string& connection_string, bool queue
+    );
+    connection* _try_assign(
         database_t* owner, const std::string& connection_string,
-        int32_t timeout_ms
+        std::vector<connection*>* cons
+    );
+    bool _is_capped(
+        std::vector<connection*>* cons, connection_priority priority
     );
+    void _cancel_pending(database_t* owner);
+    int32_t _get_pending_count(const std::string& connection_string);
     int32_t _get_opened_connection_count(const std::string& connection_string);
 
 public:
@@ -822,14 +1239,74 @@ public:
     static connection_pool* instance(){ return s_instance;}
     
     static int get_max_conn(){ return instance()->_max_conn;}
+    /*!
+     * \brief try once to assign a connection to the owner, throws
+     * connection_pool_assign_exception when none can be assigned
+     * 
+     * \param owner the database_t requesting the connection
+     * \param connection_string the connection string of the pool
+     * \param queue true if the caller retries on failure, the request
+     * is then kept in the pending queue to preserve its rank and is
+     * subject to the admission control
+     * \return connection* 
+     */
     static connection* get_connection(
         pq_async::database_t* owner, const std::string& connection_string,
-        int32_t timeout_ms = 5000
+        bool queue = false
         )
     {
-        return instance()->_get_connection(
-            owner, connection_string, timeout_ms
-        );
+        return instance()->_get_connection(owner, connection_string, queue);
+    }
+    
+    /*!
+     * \brief limit the number of connections of each pool that can be held
+     * by the database_t of a priority class
+     * 
+     * \param priority the priority class
+     * \param max_conn maximum connection count, 0 for no limit
+     */
+    static void set_priority_cap(connection_priority priority, int32_t max_conn)
+    {
+        instance()->_caps[(int)priority] = max_conn;
+    }
+    static int32_t get_priority_cap(connection_priority priority)
+    {
+        return instance()->_caps[(int)priority];
+    }
+    
+    /*!
+     * \brief configure the load shedding of the asynchronous requests
+     * waiting for a connection, rejected requests fail with a
+     * connection_pool_admission_exception.
+     * 
+     * \param max_pending maximum pending requests per pool, 0 for no limit
+     * \param max_wait_ms maximum time spent in the pending queue,
+     * 0 for no limit
+     */
+    static void set_admission_control(int32_t max_pending, int32_t max_wait_ms)
+    {
+        instance()->_max_pending = max_pending;
+        instance()->_max_wait_ms = max_wait_ms;
+    }
+    
+    /*!
+     * \brief remove the pending requests of the owner
+     */
+    static void cancel_pending(pq_async::database_t* owner)
+    {
+        if(instance())
+            instance()->_cancel_pending(owner);
+    }
+    static int32_t get_pending_count(const std::string& connection_string)
+    {
+        return instance()->_get_pending_count(connection_string);
+    }
+    /*!
+     * \brief number of requests rejected by the admission control
+     */
+    static int64_t get_rejected_count()
+    {
+        return instance()->_rejected.load();
     }
     static int32_t get_opened_connection_count(
         const std::string& connection_string)
@@ -840,6 +1317,11 @@ public:
     #ifdef PQ_ASYNC_THREAD_SAFE
     template<typename Lock>
     static void wait(Lock& lock){ instance()->cv.wait(lock);}
+    template<typename Lock>
+    static void wait_for(Lock& lock, int32_t timeout_ms)
+    {
+        instance()->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+    }
     static void notify_one(){ instance()->cv.notify_one();}
     static void notify_all(){ instance()->cv.notify_all();}
     #endif
@@ -860,6 +1342,13 @@ private:
 
     int _max_conn;
     std::map< std::string, std::vector< connection* >* > _pools;
+    
+    std::atomic<int32_t> _caps[PQ_ASYNC_PRIORITY_CLASS_COUNT];
+    std::atomic<int32_t> _max_pending;
+    std::atomic<int32_t> _max_wait_ms;
+    std::map< std::string, std::vector<pending_request_t> > _pending;
+    uint64_t _next_seq;
+    std::atomic<int64_t> _rejected;
 };
 
 } //namespace pq_async
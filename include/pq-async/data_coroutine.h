@@ -0,0 +1,716 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_coroutine_h
+#define _libpq_async_data_coroutine_h
+
+#include "data_common.h"
+
+#if PQ_ASYNC_HAS_COROUTINES
+
+#include "data_connection_pool.h"
+#include "database.h"
+#include "data_reader.h"
+#include "data_prepared.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+namespace pq_async{
+
+#define PQ_ASYNC_FRAME_POOL_CLASS_SIZE 64
+#define PQ_ASYNC_FRAME_POOL_CLASSES 16
+#define PQ_ASYNC_FRAME_POOL_DEPTH 64
+
+/*!
+ * \brief thread local free lists of coroutine frames by size class,
+ * the frames up to PQ_ASYNC_FRAME_POOL_CLASSES *
+ * PQ_ASYNC_FRAME_POOL_CLASS_SIZE bytes are recycled instead of being
+ * returned to the heap. A frame released on another thread than the one
+ * that allocated it joins the lists of the releasing thread.
+ */
+class frame_pool
+{
+    struct node_t
+    {
+        node_t* next;
+    };
+    
+    struct list_t
+    {
+        node_t* head;
+        size_t count;
+    };
+    
+    struct lists_t
+    {
+        list_t classes[PQ_ASYNC_FRAME_POOL_CLASSES];
+        
+        lists_t()
+        {
+            for(auto& l : classes)
+                l = list_t{nullptr, 0};
+        }
+        
+        ~lists_t()
+        {
+            for(auto& l : classes)
+                while(l.head){
+                    node_t* n = l.head;
+                    l.head = n->next;
+                    ::operator delete(n);
+                }
+        }
+    };
+    
+public:
+    static void* allocate(size_t size)
+    {
+        size_t cls = _class(size);
+        if(cls >= PQ_ASYNC_FRAME_POOL_CLASSES)
+            return ::operator new(size);
+        
+        list_t& l = _lists().classes[cls];
+        if(l.head){
+            node_t* n = l.head;
+            l.head = n->next;
+            --l.count;
+            return n;
+        }
+        return ::operator new((cls +1) * PQ_ASYNC_FRAME_POOL_CLASS_SIZE);
+    }
+    
+    static void deallocate(void* ptr, size_t size)
+    {
+        size_t cls = _class(size);
+        if(cls >= PQ_ASYNC_FRAME_POOL_CLASSES){
+            ::operator delete(ptr);
+            return;
+        }
+        
+        list_t& l = _lists().classes[cls];
+        if(l.count >= PQ_ASYNC_FRAME_POOL_DEPTH){
+            ::operator delete(ptr);
+            return;
+        }
+        node_t* n = (node_t*)ptr;
+        n->next = l.head;
+        l.head = n;
+        ++l.count;
+    }
+    
+private:
+    static size_t _class(size_t size)
+    {
+        return size == 0 ? 0 : (size -1) / PQ_ASYNC_FRAME_POOL_CLASS_SIZE;
+    }
+    
+    static lists_t& _lists()
+    {
+        static thread_local lists_t lists;
+        return lists;
+    }
+};
+
+
+/*!
+ * \brief state shared by the promises of every task<T>
+ */
+struct task_promise_base
+{
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false;}
+        
+        template<typename PROMISE>
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<PROMISE> h) noexcept
+        {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        
+        void await_resume() const noexcept {}
+    };
+    
+    std::suspend_always initial_suspend() const noexcept { return {};}
+    final_awaiter final_suspend() const noexcept { return {};}
+    
+    void unhandled_exception()
+    {
+        error = std::current_exception();
+    }
+    
+    static void* operator new(size_t size)
+    {
+        return frame_pool::allocate(size);
+    }
+    static void operator delete(void* ptr, size_t size)
+    {
+        frame_pool::deallocate(ptr, size);
+    }
+    
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+};
+
+template<typename T>
+struct task_promise
+    : public task_promise_base
+{
+    task<T> get_return_object();
+    
+    template<typename V>
+    void return_value(V&& v)
+    {
+        value.emplace(std::forward<V>(v));
+    }
+    
+    T result()
+    {
+        if(error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+    
+    std::optional<T> value;
+};
+
+template<>
+struct task_promise<void>
+    : public task_promise_base
+{
+    task<void> get_return_object();
+    
+    void return_void() const noexcept {}
+    
+    void result()
+    {
+        if(error)
+            std::rethrow_exception(error);
+    }
+};
+
+/*!
+ * \brief lazily started coroutine returning T, it runs when awaited by
+ * another coroutine or when started with start(cb).
+ * 
+ * \code{.cpp}
+ * pq_async::task<int64_t> count(pq_async::database db)
+ * {
+ *     auto tbl = co_await db->query_async("select * from tbl");
+ *     co_return (int64_t)tbl->size();
+ * }
+ * count(db).start([](const md::callback::cb_error& err, int64_t n){});
+ * \endcode
+ */
+template<typename T = void>
+class task
+{
+public:
+    typedef task_promise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+    
+    task(): _h(nullptr){}
+    explicit task(handle_type h): _h(h){}
+    task(task&& b): _h(b._h){ b._h = nullptr;}
+    task& operator=(task&& b)
+    {
+        if(this != &b){
+            if(_h)
+                _h.destroy();
+            _h = b._h;
+            b._h = nullptr;
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    
+    ~task()
+    {
+        if(_h)
+            _h.destroy();
+    }
+    
+    bool await_ready() const noexcept { return !_h || _h.done();}
+    
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+    {
+        _h.promise().continuation = awaiting;
+        return _h;
+    }
+    
+    T await_resume()
+    {
+        if(!_h)
+            throw pq_async::exception("Empty task!");
+        return _h.promise().result();
+    }
+    
+    /*!
+     * \brief start the task from a non coroutine context
+     * 
+     * \param cb void(const md::callback::cb_error&, T) called on
+     * completion, void(const md::callback::cb_error&) for task<void>
+     */
+    template<typename CB>
+    void start(CB cb)
+    {
+        _detach(std::move(*this), std::move(cb));
+    }
+    
+private:
+    struct detached_t
+    {
+        struct promise_type
+        {
+            detached_t get_return_object() const noexcept { return {};}
+            std::suspend_never initial_suspend() const noexcept { return {};}
+            std::suspend_never final_suspend() const noexcept { return {};}
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate();}
+            
+            static void* operator new(size_t size)
+            {
+                return frame_pool::allocate(size);
+            }
+            static void operator delete(void* ptr, size_t size)
+            {
+                frame_pool::deallocate(ptr, size);
+            }
+        };
+    };
+    
+    template<typename CB>
+    static detached_t _detach(task t, CB cb)
+    {
+        md::callback::cb_error err;
+        if constexpr(std::is_void<T>::value){
+            try{
+                co_await t;
+            }catch(const std::exception& ex){
+                err = md::callback::cb_error(ex);
+            }
+            cb(err);
+        }else{
+            std::optional<T> value;
+            try{
+                value.emplace(co_await t);
+            }catch(const std::exception& ex){
+                err = md::callback::cb_error(ex);
+            }
+            cb(err, value ? std::move(*value) : T());
+        }
+    }
+    
+    handle_type _h;
+};
+
+template<typename T>
+inline task<T> task_promise<T>::get_return_object()
+{
+    return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+    return task<void>(
+        std::coroutine_handle<task_promise<void>>::from_promise(*this)
+    );
+}
+
+
+/*!
+ * \brief a statement sent when awaited, the awaiting coroutine is resumed
+ * once by the connection_task_t completion with the last processed result.
+ * The server errors are rethrown as pq_async::sql_exception.
+ */
+template<typename R>
+class db_awaitable
+{
+    friend class database_t;
+    friend class data_prepared_t;
+    
+    typedef R (database_t::*process_fn)(PGresult*);
+    
+    db_awaitable(
+        database db, data_prepared prep, const char* sql,
+        parameters_t&& p, process_fn fn)
+        : _db(db), _prep(prep), _sql(sql), _p(std::move(p)), _fn(fn),
+        _resuming(false)
+    {
+    }
+    
+public:
+    db_awaitable(db_awaitable&& b) = default;
+    db_awaitable(const db_awaitable&) = delete;
+    db_awaitable& operator=(const db_awaitable&) = delete;
+    
+    bool await_ready() const noexcept { return false;}
+    
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        _h = h;
+        _db->open_connection(
+        [this](const md::callback::cb_error& err, connection_lock lock){
+            if(err){
+                this->_fail(err);
+                return;
+            }
+            if(!_prep){
+                this->_send(lock);
+                return;
+            }
+            _prep->_prepare_on(lock,
+            [this, lock](const md::callback::cb_error& err){
+                if(err){
+                    this->_fail(err);
+                    return;
+                }
+                this->_send(lock);
+            });
+        });
+    }
+    
+    R await_resume()
+    {
+        if(_err)
+            std::rethrow_exception(_err);
+        return std::move(*_value);
+    }
+    
+private:
+    void _send(connection_lock lock)
+    {
+        try{
+            auto ct = connection_task_t::acquire(
+                _db->_strand.get(), _db, lock,
+            [this](const md::callback::cb_error& err, PGresult* r){
+                if(err){
+                    this->_fail(err);
+                    return;
+                }
+                // the first error is kept, the following results are
+                // only cleared
+                if(_err){
+                    PQclear(r);
+                    return;
+                }
+                try{
+                    _value.emplace(((*_db).*_fn)(r));
+                }catch(...){
+                    _err = std::current_exception();
+                }
+                this->_resume();
+            });
+            if(_prep)
+                ct->send_query_prepared(_prep->_name.c_str(), _p);
+            else
+                ct->send_query(_sql.c_str(), _p);
+            _db->_strand->push_back(ct);
+            
+        }catch(...){
+            _err = std::current_exception();
+            this->_resume();
+        }
+    }
+    
+    void _fail(const md::callback::cb_error& err)
+    {
+        if(!_err)
+            _err = std::make_exception_ptr(pq_async::exception(err.c_str()));
+        this->_resume();
+    }
+    
+    /*!
+     * \brief the completion is called for each result, the coroutine is
+     * resumed once from the strand after PQgetResult returned NULL.
+     */
+    void _resume()
+    {
+        if(_resuming)
+            return;
+        _resuming = true;
+        _db->_strand->push_back([this](){ _h.resume();});
+    }
+    
+    database _db;
+    data_prepared _prep;
+    std::string _sql;
+    parameters_t _p;
+    process_fn _fn;
+    std::coroutine_handle<> _h;
+    std::optional<R> _value;
+    std::exception_ptr _err;
+    bool _resuming;
+};
+
+
+/*!
+ * \brief rows received by a reader and not yet awaited
+ */
+struct reader_pull_t
+{
+    std::deque<data_row> rows;
+    std::exception_ptr err;
+    bool done;
+    std::coroutine_handle<> waiting;
+};
+
+/*!
+ * \brief a reader query sent when awaited, resumed with the data_reader_t
+ * as soon as the query is sent.
+ */
+class reader_awaitable
+{
+    friend class database_t;
+    
+    reader_awaitable(database db, const char* sql, parameters_t&& p)
+        : _db(db), _sql(sql), _p(std::move(p))
+    {
+    }
+    
+public:
+    reader_awaitable(reader_awaitable&& b) = default;
+    reader_awaitable(const reader_awaitable&) = delete;
+    reader_awaitable& operator=(const reader_awaitable&) = delete;
+    
+    bool await_ready() const noexcept { return false;}
+    
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        _h = h;
+        _db->open_connection(
+        [this](const md::callback::cb_error& err, connection_lock lock){
+            if(err){
+                _err = std::make_exception_ptr(
+                    pq_async::exception(err.c_str())
+                );
+                _h.resume();
+                return;
+            }
+            
+            try{
+                auto ct = std::make_shared<reader_connection_task>(
+                    _db->_strand.get(), _db, lock
+                );
+                _reader = data_reader(new data_reader_t(ct));
+                // the rows are queued from now on, the coroutine
+                // may await something else before the first one
+                _reader->_start_pull();
+                ct->send_query(_sql.c_str(), _p);
+                _db->_strand->push_back(ct);
+                
+            }catch(...){
+                _err = std::current_exception();
+            }
+            _h.resume();
+        });
+    }
+    
+    data_reader await_resume()
+    {
+        if(_err)
+            std::rethrow_exception(_err);
+        return _reader;
+    }
+    
+private:
+    database _db;
+    std::string _sql;
+    parameters_t _p;
+    std::coroutine_handle<> _h;
+    data_reader _reader;
+    std::exception_ptr _err;
+};
+
+/*!
+ * \brief the next row of a reader, see data_reader_t::next_async
+ */
+class row_awaitable
+{
+    friend class data_reader_t;
+    
+    row_awaitable(std::shared_ptr<reader_pull_t> pull)
+        : _pull(pull)
+    {
+    }
+    
+public:
+    bool await_ready() const noexcept
+    {
+        return !_pull->rows.empty() || _pull->err || _pull->done;
+    }
+    
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        _pull->waiting = h;
+    }
+    
+    data_row await_resume()
+    {
+        if(!_pull->rows.empty()){
+            data_row row = _pull->rows.front();
+            _pull->rows.pop_front();
+            return row;
+        }
+        if(_pull->err)
+            std::rethrow_exception(_pull->err);
+        return data_row();
+    }
+    
+private:
+    std::shared_ptr<reader_pull_t> _pull;
+};
+
+
+inline void data_reader_t::_start_pull()
+{
+    if(_pull)
+        return;
+    
+    _pull = std::make_shared<reader_pull_t>();
+    _pull->done = false;
+    std::weak_ptr<reader_pull_t> wpull = _pull;
+    this->next(
+    [wpull](const md::callback::cb_error& err, data_row row){
+        auto pull = wpull.lock();
+        if(!pull)
+            return;
+        if(err)
+            pull->err = std::make_exception_ptr(
+                pq_async::exception(err.c_str())
+            );
+        else if(!row)
+            pull->done = true;
+        else
+            pull->rows.emplace_back(row);
+        
+        std::coroutine_handle<> h = pull->waiting;
+        pull->waiting = nullptr;
+        if(h)
+            h.resume();
+    });
+}
+
+inline row_awaitable data_reader_t::next_async()
+{
+    this->_start_pull();
+    return row_awaitable(_pull);
+}
+
+
+template<typename... PARAMS>
+db_awaitable<data_table> database_t::query_async(
+    const char* sql, const PARAMS&... args)
+{
+    return db_awaitable<data_table>(
+        this->shared_from_this(), data_prepared(), sql,
+        parameters_t(args...), &database_t::_process_query_result
+    );
+}
+
+template<typename... PARAMS>
+db_awaitable<data_row> database_t::query_single_async(
+    const char* sql, const PARAMS&... args)
+{
+    return db_awaitable<data_row>(
+        this->shared_from_this(), data_prepared(), sql,
+        parameters_t(args...), &database_t::_process_query_single_result
+    );
+}
+
+template<typename R, typename... PARAMS>
+db_awaitable<R> database_t::query_value_async(
+    const char* sql, const PARAMS&... args)
+{
+    return db_awaitable<R>(
+        this->shared_from_this(), data_prepared(), sql,
+        parameters_t(args...), &database_t::_process_query_value_result<R>
+    );
+}
+
+template<typename... PARAMS>
+db_awaitable<int32_t> database_t::execute_async(
+    const char* sql, const PARAMS&... args)
+{
+    return db_awaitable<int32_t>(
+        this->shared_from_this(), data_prepared(), sql,
+        parameters_t(args...), &database_t::_process_execute_result
+    );
+}
+
+template<typename... PARAMS>
+reader_awaitable database_t::query_reader_async(
+    const char* sql, const PARAMS&... args)
+{
+    return reader_awaitable(
+        this->shared_from_this(), sql, parameters_t(args...)
+    );
+}
+
+
+template<typename... PARAMS>
+db_awaitable<data_table> data_prepared_t::query_async(const PARAMS&... args)
+{
+    return db_awaitable<data_table>(
+        _db, this->shared_from_this(), "",
+        parameters_t(args...), &database_t::_process_query_result
+    );
+}
+
+template<typename... PARAMS>
+db_awaitable<data_row> data_prepared_t::query_single_async(
+    const PARAMS&... args)
+{
+    return db_awaitable<data_row>(
+        _db, this->shared_from_this(), "",
+        parameters_t(args...), &database_t::_process_query_single_result
+    );
+}
+
+template<typename R, typename... PARAMS>
+db_awaitable<R> data_prepared_t::query_value_async(const PARAMS&... args)
+{
+    return db_awaitable<R>(
+        _db, this->shared_from_this(), "",
+        parameters_t(args...), &database_t::_process_query_value_result<R>
+    );
+}
+
+template<typename... PARAMS>
+db_awaitable<int32_t> data_prepared_t::execute_async(const PARAMS&... args)
+{
+    return db_awaitable<int32_t>(
+        _db, this->shared_from_this(), "",
+        parameters_t(args...), &database_t::_process_execute_result
+    );
+}
+
+} //namespace pq_async
+
+#endif //PQ_ASYNC_HAS_COROUTINES
+#endif //_libpq_async_data_coroutine_h
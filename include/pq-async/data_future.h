@@ -0,0 +1,277 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_future_h
+#define _libpq_async_data_future_h
+
+#include "data_common.h"
+#include "data_connection_pool.h"
+#include "database.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <optional>
+
+namespace pq_async{
+
+/*!
+ * \brief the request and the result of a db_future in one allocation,
+ * it is also the strand task dispatching the query on the loop thread.
+ */
+template<typename T>
+class future_state_t
+    : public md::event_task_base_t
+{
+    friend class database_t;
+    friend class db_future<T>;
+    
+    typedef T (database_t::*process_fn)(PGresult*);
+    
+public:
+    future_state_t(
+        database db, const char* sql, parameters_t&& p, process_fn fn)
+        : md::event_task_base_t(db->_strand.get()),
+        _ready(false), _db(db), _sql(sql), _p(std::move(p)), _fn(fn)
+    {
+    }
+    
+    void run_task() override
+    {
+        auto st = _self.lock();
+        if(!st)
+            return;
+        
+        try{
+            _db->open_connection(
+            [st](const md::callback::cb_error& err, connection_lock lock){
+                if(err){
+                    st->_set_error(std::make_exception_ptr(
+                        pq_async::exception(err.c_str())
+                    ));
+                    return;
+                }
+                st->_send(lock);
+            });
+        }catch(...){
+            st->_set_error(std::current_exception());
+        }
+    }
+    
+private:
+    static std::shared_ptr<future_state_t> create(
+        database db, const char* sql, parameters_t&& p, process_fn fn)
+    {
+        auto st = std::make_shared<future_state_t>(db, sql, std::move(p), fn);
+        st->_self = st;
+        db->_strand->push_back(st);
+        return st;
+    }
+    
+    void _send(connection_lock lock)
+    {
+        auto st = _self.lock();
+        try{
+            auto ct = connection_task_t::acquire(
+                _db->_strand.get(), _db, lock,
+            [st](const md::callback::cb_error& err, PGresult* r){
+                if(err){
+                    st->_set_error(std::make_exception_ptr(
+                        pq_async::exception(err.c_str())
+                    ));
+                    return;
+                }
+                try{
+                    st->_set_value(((*st->_db).*(st->_fn))(r));
+                }catch(...){
+                    st->_set_error(std::current_exception());
+                }
+            });
+            ct->send_query(_sql.c_str(), _p);
+            _db->_strand->push_back(ct);
+            
+        }catch(...){
+            st->_set_error(std::current_exception());
+        }
+    }
+    
+    void _set_value(T&& v)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _value.emplace(std::move(v));
+        _ready = true;
+        _cv.notify_all();
+    }
+    
+    void _set_error(std::exception_ptr err)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _err = err;
+        _ready = true;
+        _cv.notify_all();
+    }
+    
+    std::weak_ptr<future_state_t> _self;
+    
+    mutable std::mutex _mutex;
+    mutable std::condition_variable _cv;
+    bool _ready;
+    std::optional<T> _value;
+    std::exception_ptr _err;
+    
+    database _db;
+    std::string _sql;
+    parameters_t _p;
+    process_fn _fn;
+};
+
+/*!
+ * \brief the result of a query issued from any thread, completed by the
+ * loop thread driving the strand of the database.
+ * 
+ * \code{.cpp}
+ * auto a = db->query_value_future<int64_t>("select count(*) from a");
+ * auto b = db->query_future("select * from b where id > $1", 10);
+ * int64_t n = a.get();
+ * data_table tbl = b.get();
+ * \endcode
+ */
+template<typename T>
+class db_future
+{
+    friend class database_t;
+    
+    db_future(std::shared_ptr< future_state_t<T> > st): _st(st){}
+    
+public:
+    db_future(): _st(){}
+    
+    /*!
+     * \brief false for a default constructed future
+     */
+    bool valid() const { return _st != nullptr;}
+    
+    /*!
+     * \brief returns true once the result or the error is available
+     */
+    bool is_ready() const
+    {
+        this->_check();
+        std::lock_guard<std::mutex> lock(_st->_mutex);
+        return _st->_ready;
+    }
+    
+    /*!
+     * \brief blocks until the query is completed
+     */
+    void wait() const
+    {
+        this->_check();
+        std::unique_lock<std::mutex> lock(_st->_mutex);
+        _st->_cv.wait(lock, [this](){ return _st->_ready;});
+    }
+    
+    /*!
+     * \brief blocks until the query is completed or timeout_ms is elapsed
+     * 
+     * \return true if the query is completed
+     */
+    bool wait_for(int32_t timeout_ms) const
+    {
+        this->_check();
+        std::unique_lock<std::mutex> lock(_st->_mutex);
+        return _st->_cv.wait_for(
+            lock, std::chrono::milliseconds(timeout_ms),
+            [this](){ return _st->_ready;}
+        );
+    }
+    
+    /*!
+     * \brief waits for the query and returns its result, the errors are
+     * rethrown, pq_async::sql_exception for the server errors.
+     * It must not be called from the thread driving the event loop.
+     */
+    T get() const
+    {
+        this->wait();
+        std::lock_guard<std::mutex> lock(_st->_mutex);
+        if(_st->_err)
+            std::rethrow_exception(_st->_err);
+        return *_st->_value;
+    }
+    
+private:
+    void _check() const
+    {
+        if(!_st)
+            throw pq_async::exception("Invalid future!");
+    }
+    
+    std::shared_ptr< future_state_t<T> > _st;
+};
+
+
+template<typename... PARAMS>
+db_future<data_table> database_t::query_future(
+    const char* sql, const PARAMS&... args)
+{
+    return db_future<data_table>(future_state_t<data_table>::create(
+        this->shared_from_this(), sql, parameters_t(args...),
+        &database_t::_process_query_result
+    ));
+}
+
+template<typename... PARAMS>
+db_future<data_row> database_t::query_single_future(
+    const char* sql, const PARAMS&... args)
+{
+    return db_future<data_row>(future_state_t<data_row>::create(
+        this->shared_from_this(), sql, parameters_t(args...),
+        &database_t::_process_query_single_result
+    ));
+}
+
+template<typename R, typename... PARAMS>
+db_future<R> database_t::query_value_future(
+    const char* sql, const PARAMS&... args)
+{
+    return db_future<R>(future_state_t<R>::create(
+        this->shared_from_this(), sql, parameters_t(args...),
+        &database_t::_process_query_value_result<R>
+    ));
+}
+
+template<typename... PARAMS>
+db_future<int32_t> database_t::execute_future(
+    const char* sql, const PARAMS&... args)
+{
+    return db_future<int32_t>(future_state_t<int32_t>::create(
+        this->shared_from_this(), sql, parameters_t(args...),
+        &database_t::_process_execute_result
+    ));
+}
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_future_h
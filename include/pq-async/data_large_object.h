@@ -42,6 +42,24 @@ SOFTWARE.
 
 namespace pq_async{
 
+#define PQ_ASYNC_LO_CHUNK_SIZE (256 * 1024)
+#define PQ_ASYNC_LO_READ_AHEAD 4
+#define PQ_ASYNC_LO_WRITE_BEHIND 4
+#define PQ_ASYNC_LO_PARALLELISM 4
+// size of the server pages of a large object (LOBLKSIZE), the transfer
+// ranges are rounded up to a multiple of it
+#define PQ_ASYNC_LO_BLOCK_SIZE 2048
+
+class lo_reader_t;
+class lo_writer_t;
+typedef std::shared_ptr< pq_async::lo_reader_t > lo_reader;
+typedef std::shared_ptr< pq_async::lo_writer_t > lo_writer;
+
+/*!
+ * \brief parallel transfer progress, bytes transferred and total bytes
+ */
+typedef std::function<void(int64_t, int64_t)> lo_progress_cb;
+
 enum class lo_mode
 {
     read = INV_READ,
@@ -58,6 +76,27 @@ enum class lo_whence
 class data_large_object_t
 {
     friend class pq_async::database_t;
+    friend class pq_async::lo_reader_t;
+    friend class pq_async::lo_writer_t;
+    
+    struct transfer_state_t
+    {
+        std::mutex mutex;
+        pq_async::oid lo_oid;
+        bool upload;
+        int64_t total;
+        int32_t chunk_size;
+        int64_t next;
+        int64_t done;
+        int32_t workers;
+        std::vector<int8_t> data;
+        // the uploaded data, shared with the caller
+        std::shared_ptr< const std::vector<int8_t> > source;
+        md::callback::cb_error err;
+        lo_progress_cb progress;
+        md::callback::value_cb< std::vector<int8_t> > download_cb;
+        md::callback::async_cb upload_cb;
+    };
     
     data_large_object_t(const database& db, const pq_async::oid& oid)
         : _db(db), _oid(oid), _opened_read(false), _opened_write(false), _fd(-1)
@@ -90,7 +129,218 @@ public:
     void close();
     void unlink();
     
+    /*!
+     * \brief asynchronously read a range of the large object using
+     * lo_get, no descriptor or transaction is required.
+     * 
+     * \param offset the position to read from
+     * \param len the number of bytes to read
+     * \param acb void(const md::callback::cb_error&, std::vector<int8_t>)
+     * callback, the data is shorter than len at the end of the object
+     */
+    template<
+        typename CB,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, std::vector<int8_t>)
+    >
+    void read(int64_t offset, int32_t len, const CB& acb)
+    {
+        md::callback::value_cb< std::vector<int8_t> > cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb< std::vector<int8_t> >,
+            std::vector<int8_t>
+        >(
+            cb, acb
+        );
+        _read(_db, _oid, offset, len, cb);
+    }
+    
+    /*!
+     * \brief asynchronously write data at offset using lo_put,
+     * no descriptor or transaction is required.
+     * 
+     * \param offset the position to write at
+     * \param data the data to write
+     * \param acb void(const md::callback::cb_error&) callback
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void write(int64_t offset, const std::vector<int8_t>& data, const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _write(_db, _oid, offset, data, cb);
+    }
+    
+    /*!
+     * \brief asynchronously get the large object size
+     * 
+     * \param acb void(const md::callback::cb_error&, int64_t) callback
+     */
+    template<typename CB, PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, int64_t)>
+    void size(const CB& acb)
+    {
+        md::callback::value_cb<int64_t> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<int64_t>, int64_t
+        >(
+            cb, acb
+        );
+        parameters_t p(_oid);
+        _db->query_value<int64_t>(
+            "select lo_lseek64(lo_open($1, 262144), 0, 2)", p, cb
+        );
+    }
+    
+    /*!
+     * \brief creates a sequential reader reading ahead up to read_ahead
+     * chunks, each chunk in flight uses its own connection so that the
+     * reads overlap.
+     * 
+     * \param offset the position to start reading from
+     * \param chunk_size the size of the chunks
+     * \param read_ahead the number of chunks requested in advance
+     * \return lo_reader 
+     */
+    lo_reader reader(
+        int64_t offset = 0,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        int32_t read_ahead = PQ_ASYNC_LO_READ_AHEAD
+    );
+    
+    /*!
+     * \brief creates a sequential writer buffering the data in chunks,
+     * up to write_behind chunks are sent on its own connection before the
+     * write callbacks are delayed.
+     * 
+     * \param offset the position to start writing at
+     * \param chunk_size the size of the chunks
+     * \param write_behind the number of chunks in flight
+     * \return lo_writer 
+     */
+    lo_writer writer(
+        int64_t offset = 0,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        int32_t write_behind = PQ_ASYNC_LO_WRITE_BEHIND
+    );
+    
+    /*!
+     * \brief asynchronously download the whole large object, the byte
+     * ranges are fetched concurrently on parallelism connections
+     * 
+     * \param acb void(const md::callback::cb_error&, std::vector<int8_t>)
+     * callback
+     * \param parallelism the number of connections used
+     * \param chunk_size the size of the ranges, rounded up to a multiple
+     * of PQ_ASYNC_LO_BLOCK_SIZE
+     * \param progress optional callback called after each range
+     */
+    template<
+        typename CB,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, std::vector<int8_t>)
+    >
+    void download(
+        const CB& acb,
+        int32_t parallelism = PQ_ASYNC_LO_PARALLELISM,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        lo_progress_cb progress = nullptr)
+    {
+        md::callback::value_cb< std::vector<int8_t> > cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb< std::vector<int8_t> >,
+            std::vector<int8_t>
+        >(
+            cb, acb
+        );
+        _download(cb, parallelism, chunk_size, progress);
+    }
+    
+    /*!
+     * \brief asynchronously upload data from the start of the large
+     * object, the byte ranges are written concurrently on parallelism
+     * connections. The data is shared, not copied, and must not be
+     * modified before the callback is called.
+     * 
+     * \param data the data to write
+     * \param acb void(const md::callback::cb_error&) callback
+     * \param parallelism the number of connections used
+     * \param chunk_size the size of the ranges, rounded up to a multiple
+     * of PQ_ASYNC_LO_BLOCK_SIZE so that the ranges never share a server
+     * page
+     * \param progress optional callback called after each range
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void upload(
+        std::shared_ptr< const std::vector<int8_t> > data,
+        const CB& acb,
+        int32_t parallelism = PQ_ASYNC_LO_PARALLELISM,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        lo_progress_cb progress = nullptr)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _upload(data, cb, parallelism, chunk_size, progress);
+    }
+    /*!
+     * \brief asynchronously upload data taken from the caller
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void upload(
+        std::vector<int8_t>&& data,
+        const CB& acb,
+        int32_t parallelism = PQ_ASYNC_LO_PARALLELISM,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        lo_progress_cb progress = nullptr)
+    {
+        upload(
+            std::make_shared< const std::vector<int8_t> >(std::move(data)),
+            acb, parallelism, chunk_size, progress
+        );
+    }
+    /*!
+     * \brief asynchronously upload a copy of data
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void upload(
+        const std::vector<int8_t>& data,
+        const CB& acb,
+        int32_t parallelism = PQ_ASYNC_LO_PARALLELISM,
+        int32_t chunk_size = PQ_ASYNC_LO_CHUNK_SIZE,
+        lo_progress_cb progress = nullptr)
+    {
+        upload(
+            std::make_shared< const std::vector<int8_t> >(data),
+            acb, parallelism, chunk_size, progress
+        );
+    }
+    
 private:
+    void _download(
+        const md::callback::value_cb< std::vector<int8_t> >& cb,
+        int32_t parallelism, int32_t chunk_size, lo_progress_cb progress
+    );
+    void _upload(
+        std::shared_ptr< const std::vector<int8_t> > data,
+        const md::callback::async_cb& cb,
+        int32_t parallelism, int32_t chunk_size, lo_progress_cb progress
+    );
+    static int32_t _block_aligned(int32_t parallelism, int32_t chunk_size);
+    static void _start_transfer(
+        database db, std::shared_ptr<transfer_state_t> st,
+        int32_t parallelism
+    );
+    static void _transfer_next(
+        std::shared_ptr<transfer_state_t> st, database db
+    );
+    static void _transfer_done(std::shared_ptr<transfer_state_t> st);
+    
+    static void _read(
+        database db, const pq_async::oid& lo_oid, int64_t offset, int32_t len,
+        const md::callback::value_cb< std::vector<int8_t> >& cb
+    );
+    static void _write(
+        database db, const pq_async::oid& lo_oid, int64_t offset,
+        const std::vector<int8_t>& data, const md::callback::async_cb& cb
+    );
+    
     database _db;
     pq_async::oid _oid;
     bool _opened_read;
@@ -98,6 +348,167 @@ private:
     int _fd;
 };
 
+
+/*!
+ * \brief sequential large object reader, the next chunks are requested
+ * while the current one is consumed. The callbacks are called on the
+ * reader strand, the strand of its first connection.
+ */
+class lo_reader_t
+    : public std::enable_shared_from_this<lo_reader_t>
+{
+    friend class data_large_object_t;
+    
+    struct slot_t
+    {
+        int64_t offset;
+        bool done;
+        md::callback::cb_error err;
+        std::vector<int8_t> data;
+    };
+    
+    lo_reader_t(
+        std::vector<database> dbs, const pq_async::oid& lo_oid,
+        int64_t offset, int32_t chunk_size
+    );
+    
+public:
+    /*!
+     * \brief asynchronously get the next chunk, an empty chunk
+     * is returned at the end of the large object
+     * 
+     * \param acb void(const md::callback::cb_error&, std::vector<int8_t>)
+     * callback
+     */
+    template<
+        typename CB,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, std::vector<int8_t>)
+    >
+    void next(const CB& acb)
+    {
+        md::callback::value_cb< std::vector<int8_t> > cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb< std::vector<int8_t> >,
+            std::vector<int8_t>
+        >(
+            cb, acb
+        );
+        _next(cb);
+    }
+    
+    /*!
+     * \brief offset of the next chunk returned by next
+     */
+    int64_t position() const;
+    bool eof() const;
+    
+private:
+    void _next(const md::callback::value_cb< std::vector<int8_t> >& cb);
+    void _fill();
+    void _deliver();
+    
+    // one database per chunk in flight, the first one owns the strand
+    std::vector<database> _dbs;
+    pq_async::oid _oid;
+    int32_t _chunk_size;
+    int32_t _read_ahead;
+    size_t _next_db;
+    
+    mutable std::mutex _mutex;
+    std::deque< std::shared_ptr<slot_t> > _slots;
+    std::deque< md::callback::value_cb< std::vector<int8_t> > > _waiting;
+    int64_t _position;
+    int64_t _next_offset;
+    bool _end_requested;
+    bool _eof;
+    md::callback::cb_error _err;
+};
+
+/*!
+ * \brief sequential large object writer, the data is buffered and sent by
+ * chunk while the next ones are produced. The callbacks are called on the
+ * writer strand.
+ */
+class lo_writer_t
+    : public std::enable_shared_from_this<lo_writer_t>
+{
+    friend class data_large_object_t;
+    
+    lo_writer_t(
+        database db, const pq_async::oid& lo_oid, int64_t offset,
+        int32_t chunk_size, int32_t write_behind
+    );
+    
+public:
+    /*!
+     * \brief asynchronously append data, the callback is called once
+     * the data is buffered and at most write_behind chunks are in flight.
+     * A failed chunk fails every following call.
+     * 
+     * \param data the data to write
+     * \param len the data length
+     * \param acb void(const md::callback::cb_error&) callback
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void write(const char* data, size_t len, const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _append(data, len, cb);
+    }
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void write(const std::vector<int8_t>& data, const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _append((const char*)data.data(), data.size(), cb);
+    }
+    
+    /*!
+     * \brief asynchronously send the buffered data and wait for
+     * every chunk in flight
+     * 
+     * \param acb void(const md::callback::cb_error&) callback
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void flush(const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _flush(cb);
+    }
+    
+    /*!
+     * \brief number of bytes accepted
+     */
+    int64_t position() const;
+    /*!
+     * \brief number of bytes stored on the server
+     */
+    int64_t written() const;
+    
+private:
+    void _append(const char* data, size_t len, const md::callback::async_cb& cb);
+    void _flush(const md::callback::async_cb& cb);
+    void _send(int64_t offset, std::vector<int8_t> chunk);
+    void _on_sent(const md::callback::cb_error& err, size_t len);
+    
+    database _db;
+    pq_async::oid _oid;
+    int32_t _chunk_size;
+    int32_t _write_behind;
+    
+    mutable std::mutex _mutex;
+    std::vector<int8_t> _buf;
+    int64_t _position;
+    int64_t _send_offset;
+    int64_t _written;
+    int32_t _in_flight;
+    md::callback::cb_error _err;
+    std::deque<md::callback::async_cb> _blocked;
+    std::vector<md::callback::async_cb> _flushing;
+};
+
 } // ns: pq_async
 
 #endif //_libpq_async_data_large_object_h
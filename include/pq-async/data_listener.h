@@ -0,0 +1,147 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_listener_h
+#define _libpq_async_data_listener_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "data_connection_pool.h"
+
+#include <map>
+
+namespace pq_async{
+
+#define PQ_ASYNC_LISTEN_RETRY_MS 1000
+
+/*!
+ * \brief a notification received on a listened channel
+ */
+struct notification
+{
+    std::string channel;
+    std::string payload;
+    int32_t be_pid;
+};
+typedef std::vector<notification> notifications;
+
+class notification_listener_t;
+typedef std::shared_ptr< pq_async::notification_listener_t > notification_listener;
+
+/*!
+ * \brief holds a dedicated pooled connection registered on the event base
+ * for LISTEN/NOTIFY, see database_t::listen.
+ * 
+ * The notifications available when the connection socket becomes readable
+ * are delivered as one batch per channel on the subscriber's strand.
+ * When the connection is lost the subscribers receive an error, the
+ * notifications sent meanwhile being lost, and the channels are listened
+ * again once reconnected, the reconnection and the LISTEN commands being
+ * sent asynchronously from the event loop.
+ */
+class notification_listener_t
+    : public std::enable_shared_from_this<notification_listener_t>
+{
+public:
+    notification_listener_t(
+        md::event_strand<int> strand,
+        const std::string& connection_string,
+        md::log::logger log = nullptr
+    );
+    
+    virtual ~notification_listener_t();
+    
+    /*!
+     * \brief synchronously start listening on channel, replaces the
+     * callback if the channel is already listened.
+     * 
+     * \param channel the channel name
+     * \param cb void(const md::callback::cb_error&, notifications) callback
+     */
+    void listen(
+        const std::string& channel,
+        const md::callback::value_cb<notifications>& cb
+    );
+    
+    /*!
+     * \brief synchronously stop listening on channel, the dedicated
+     * connection is returned to the pool with the last channel.
+     */
+    void unlisten(const std::string& channel);
+    
+    bool listening(const std::string& channel) const;
+    
+    size_t channel_count() const;
+    
+    /*!
+     * \brief true when the dedicated connection listens on the channels,
+     * false while it is being reestablished
+     */
+    bool ready() const;
+    
+    /*!
+     * \brief number of times the dedicated connection was reestablished
+     */
+    int64_t reconnections() const { return _reconnections.load();}
+    
+    /*!
+     * \brief read the connection and dispatch the pending notifications,
+     * called when the socket becomes readable.
+     * 
+     * \return the number of notifications dispatched
+     */
+    int poll();
+    
+private:
+    void _connect();
+    void _disconnect();
+    void _reconnect();
+    void _listen_pending(
+        database db, std::shared_ptr< std::set<std::string> > done
+    );
+    void _watch();
+    void _retry(const std::string& reason);
+    std::string _command(const char* cmd, const std::string& channel);
+    void _execute(const char* cmd, const std::string& channel);
+    int _dispatch();
+    
+    md::event_strand<int> _strand;
+    std::string _connection_string;
+    md::log::logger _log;
+    
+    mutable std::recursive_mutex _mutex;
+    std::map<std::string, md::callback::value_cb<notifications>> _channels;
+    
+    database _db;
+    connection_lock _lock;
+    event* _ev;
+    event* _retry_ev;
+    // the connection is being reestablished, not yet listening
+    bool _connecting;
+    std::atomic<int64_t> _reconnections;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_listener_h
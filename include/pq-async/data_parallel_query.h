@@ -0,0 +1,180 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_parallel_query_h
+#define _libpq_async_data_parallel_query_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "data_connection_pool.h"
+#include "database.h"
+
+namespace pq_async{
+
+#define PQ_ASYNC_PARALLEL_QUERY_WORKERS 4
+
+class parallel_query_t;
+typedef std::shared_ptr< pq_async::parallel_query_t > parallel_query;
+
+/*!
+ * \brief the query parameters of each partition, the bounds are
+ * passed as $1 (inclusive) and $2 (exclusive)
+ */
+typedef std::vector<parameters_t> query_partitions;
+
+/*!
+ * \brief receives the rows of every partition, the calls are serialized
+ */
+typedef std::function<void(data_row)> row_consumer;
+
+/*!
+ * \brief creates a new parallel_query_t instance
+ * 
+ * \param connection_string the database connection string
+ * \param workers the number of connections scanning the partitions
+ * \param log the logger used by the database_t instances
+ * \return parallel_query 
+ */
+parallel_query open_parallel_query(
+    const std::string& connection_string,
+    int32_t workers = PQ_ASYNC_PARALLEL_QUERY_WORKERS,
+    md::log::logger log = nullptr
+);
+
+/*!
+ * \brief runs the partitions of a query concurrently on several pooled
+ * connections. The snapshot of a coordinator transaction is exported with
+ * pg_export_snapshot and imported by every worker transaction, all the
+ * partitions see the same consistent state of the database.
+ */
+class parallel_query_t
+    : public std::enable_shared_from_this<parallel_query_t>
+{
+    friend parallel_query open_parallel_query(
+        const std::string& connection_string,
+        int32_t workers,
+        md::log::logger log
+    );
+    
+    struct run_state_t
+    {
+        std::mutex mutex;
+        std::mutex consumer_mutex;
+        std::string sql;
+        query_partitions parts;
+        row_consumer consumer;
+        md::callback::async_cb cb;
+        database coordinator;
+        size_t next;
+        int32_t workers;
+        md::callback::cb_error err;
+    };
+    
+    parallel_query_t(
+        const std::string& connection_string,
+        int32_t workers,
+        md::log::logger log
+    );
+    
+public:
+    
+    /*!
+     * \brief splits [min, max] in count key ranges
+     * 
+     * \param min the smallest key
+     * \param max the largest key
+     * \param count the number of partitions
+     * \return query_partitions of int8 bounds, e.g.
+     * "select * from t where id >= $1 and id < $2"
+     */
+    static query_partitions key_ranges(int64_t min, int64_t max, int32_t count);
+    
+    /*!
+     * \brief synchronously splits the heap pages of a table in count
+     * block ranges, the last one has no upper bound.
+     * 
+     * \param table the table name
+     * \param count the number of partitions
+     * \return query_partitions of tid bounds, e.g.
+     * "select * from t where ctid >= $1::tid and ctid < $2::tid"
+     */
+    query_partitions block_ranges(const std::string& table, int32_t count);
+    
+    /*!
+     * \brief synchronously run every partition
+     * 
+     * \param sql the query, its $1 and $2 are the partition bounds
+     * \param parts the partitions parameters
+     * \param consumer called once for each row
+     */
+    void run(
+        const char* sql, const query_partitions& parts,
+        const row_consumer& consumer
+    );
+    
+    /*!
+     * \brief asynchronously run every partition, the rows are delivered
+     * partition by partition once each one completes.
+     * 
+     * \param sql the query, its $1 and $2 are the partition bounds
+     * \param parts the partitions parameters
+     * \param consumer called once for each row
+     * \param acb void(const md::callback::cb_error&) called when every
+     * partition is done or on the first error
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void run(
+        const char* sql, const query_partitions& parts,
+        const row_consumer& consumer, const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _run(sql, parts, consumer, cb);
+    }
+    
+    int32_t workers() const { return _workers;}
+    
+private:
+    void _run(
+        const std::string& sql, const query_partitions& parts,
+        const row_consumer& consumer, const md::callback::async_cb& cb
+    );
+    void _start_worker(
+        std::shared_ptr<run_state_t> st, const std::string& snapshot
+    );
+    void _run_next(std::shared_ptr<run_state_t> st, database db);
+    void _worker_done(std::shared_ptr<run_state_t> st);
+    void _finish(std::shared_ptr<run_state_t> st);
+    void _fail(
+        std::shared_ptr<run_state_t> st, const md::callback::cb_error& err
+    );
+    
+    std::string _connection_string;
+    int32_t _workers;
+    md::log::logger _log;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_parallel_query_h
@@ -83,6 +83,9 @@ public:
         : _oid(oid), _has_oid(true), _value(value), 
         _length(length), _format(format)
     {
+        #if PQ_ASYNC_BUILD_DEBUG
+        _live().fetch_add(1, std::memory_order_relaxed);
+        #endif
     }
     
     /*!
@@ -96,6 +99,9 @@ public:
         :_oid(0), _has_oid(false), _value(value), 
         _length(length), _format(format)
     {
+        #if PQ_ASYNC_BUILD_DEBUG
+        _live().fetch_add(1, std::memory_order_relaxed);
+        #endif
     }
     
     /*!
@@ -106,8 +112,22 @@ public:
     {
         if(_value)
             delete[] _value;
+        #if PQ_ASYNC_BUILD_DEBUG
+        _live().fetch_sub(1, std::memory_order_relaxed);
+        #endif
     }
     
+    #if PQ_ASYNC_BUILD_DEBUG
+    /*!
+     * \brief number of parameter objects alive, used to track leaks,
+     * only counted by the debug builds
+     */
+    static int64_t live_count()
+    {
+        return _live().load(std::memory_order_relaxed);
+    }
+    #endif
+    
     Oid get_oid() const { return _oid;}
     bool has_oid() const { return _has_oid;}
     
@@ -116,6 +136,14 @@ public:
     int get_format() const { return _format;}
 
 private:
+    #if PQ_ASYNC_BUILD_DEBUG
+    static std::atomic<int64_t>& _live()
+    {
+        static std::atomic<int64_t> count(0);
+        return count;
+    }
+    #endif
+    
     Oid _oid;
     bool _has_oid;
     char* _value;
@@ -659,6 +687,41 @@ PQ_ASYNC_ARRAY_SPEC(pq_async::tstzrange, tstzrange);
 PQ_ASYNC_ARRAY_SPEC(pq_async::daterange, daterange);
 
 
+/*!
+ * \brief encodes a column of values as a single one dimension binary
+ * array parameter, the fixed width types and the strings are written
+ * directly in one allocation sized from the data.
+ */
+#define PQ_ASYNC_COLUMN_SPEC(__type) \
+pq_async::parameter* new_column_parameter( \
+    const std::vector<__type>& values \
+);
+
+PQ_ASYNC_COLUMN_SPEC(bool);
+PQ_ASYNC_COLUMN_SPEC(std::string);
+PQ_ASYNC_COLUMN_SPEC(int16_t);
+PQ_ASYNC_COLUMN_SPEC(int32_t);
+PQ_ASYNC_COLUMN_SPEC(int64_t);
+PQ_ASYNC_COLUMN_SPEC(float);
+PQ_ASYNC_COLUMN_SPEC(double);
+PQ_ASYNC_COLUMN_SPEC(pq_async::numeric);
+PQ_ASYNC_COLUMN_SPEC(pq_async::money);
+PQ_ASYNC_COLUMN_SPEC(pq_async::time);
+PQ_ASYNC_COLUMN_SPEC(pq_async::time_tz);
+PQ_ASYNC_COLUMN_SPEC(pq_async::timestamp);
+PQ_ASYNC_COLUMN_SPEC(pq_async::timestamp_tz);
+PQ_ASYNC_COLUMN_SPEC(pq_async::date);
+PQ_ASYNC_COLUMN_SPEC(pq_async::interval);
+PQ_ASYNC_COLUMN_SPEC(pq_async::json);
+PQ_ASYNC_COLUMN_SPEC(std::vector<int8_t>);
+PQ_ASYNC_COLUMN_SPEC(pq_async::uuid);
+PQ_ASYNC_COLUMN_SPEC(pq_async::oid);
+PQ_ASYNC_COLUMN_SPEC(pq_async::cidr);
+PQ_ASYNC_COLUMN_SPEC(pq_async::inet);
+PQ_ASYNC_COLUMN_SPEC(pq_async::macaddr);
+PQ_ASYNC_COLUMN_SPEC(pq_async::macaddr8);
+
+
 
 /*!
  * \brief Parameter container
@@ -710,6 +773,9 @@ public:
      */
     parameters_t& operator=(const parameters_t& b)
     {
+        if(this == &b)
+            return *this;
+        this->cleanup(true);
         copy_from(b);
         return *this;
     }
@@ -719,12 +785,15 @@ public:
      * \param b 
      */
     parameters_t(parameters_t&& b)
-        : _p_types(std::move(b._p_types)),
-        _p_values(std::move(b._p_values)),
-        _p_lengths(std::move(b._p_lengths)),
-        _p_formats(std::move(b._p_formats))
+        : _p(std::move(b._p)),
+        _p_types(b._p_types), _p_values(b._p_values),
+        _p_lengths(b._p_lengths), _p_formats(b._p_formats)
     {
-        _p = std::move(b._p);
+        b._p.clear();
+        b._p_types = nullptr;
+        b._p_values = nullptr;
+        b._p_lengths = nullptr;
+        b._p_formats = nullptr;
     }
     /*!
      * \brief Move assign a parameters object
@@ -734,11 +803,22 @@ public:
      */
     parameters_t& operator=(parameters_t&& b)
     {
+        if(this == &b)
+            return *this;
+        // the parameters held so far are owned by this object
+        this->cleanup(true);
+        
         _p = std::move(b._p);
-        _p_types = std::move(b._p_types);
-        _p_values = std::move(b._p_values);
-        _p_lengths = std::move(b._p_lengths);
-        _p_formats = std::move(b._p_formats);
+        _p_types = b._p_types;
+        _p_values = b._p_values;
+        _p_lengths = b._p_lengths;
+        _p_formats = b._p_formats;
+        
+        b._p.clear();
+        b._p_types = nullptr;
+        b._p_values = nullptr;
+        b._p_lengths = nullptr;
+        b._p_formats = nullptr;
         
         return *this;
     }
@@ -762,6 +842,14 @@ public:
         return (int)_p.size();
     }
     
+    /*!
+     * \brief deletes every parameter, the object can be reused
+     */
+    void clear()
+    {
+        this->cleanup(true);
+    }
+    
     Oid* types()
     {
         this->init();
@@ -794,6 +882,17 @@ public:
         _p.push_back(p);
     }
     
+    /*!
+     * \brief append a copy of every parameter of b
+     * 
+     * \param b 
+     */
+    void append(const parameters_t& b)
+    {
+        this->cleanup();
+        copy_from(b);
+    }
+    
     /*!
      * \brief the push_back method that sould only be called by the
      * variadic push_back function
@@ -894,6 +993,8 @@ public:
         if(pos >= _p.size())
             throw pq_async::exception("Index out of bound");
         
+        this->cleanup();
+        delete _p[pos];
         _p.erase(_p.begin() + pos);
     }
     
@@ -910,7 +1011,37 @@ public:
         
         return _p[pos];
     }
-    
+    const parameter* get_parameter(size_t pos) const
+    {
+        if(pos >= _p.size())
+            throw pq_async::exception("Index out of bound");
+        
+        return _p[pos];
+    }
+
+    /*!
+     * \brief appends the serialized parameters to out, their types,
+     * formats, lengths and values, two lists of parameters serialize
+     * to the same bytes only if they are identical.
+     *
+     * \param out the string the bytes are appended to
+     */
+    void serialize(std::string& out) const
+    {
+        for(const parameter* p : _p){
+            Oid oid = p->get_oid();
+            int fmt = p->get_format();
+            // null and empty values must not serialize the same
+            int len = p->get_value() ? p->get_length() : -1;
+            out.push_back('\0');
+            out.append((const char*)&oid, sizeof(oid));
+            out.append((const char*)&fmt, sizeof(fmt));
+            out.append((const char*)&len, sizeof(len));
+            if(len > 0)
+                out.append(p->get_value(), (size_t)len);
+        }
+    }
+
 private:
     void copy_from(const parameters_t& b)
     {
@@ -957,16 +1088,23 @@ private:
     
     void cleanup(bool clean_params = false)
     {
+        // init() rebuilds the arrays only once they are reset
         if(_p_types){
             delete[] _p_types;
             delete[] _p_values;
             delete[] _p_lengths;
             delete[] _p_formats;
+            _p_types = nullptr;
+            _p_values = nullptr;
+            _p_lengths = nullptr;
+            _p_formats = nullptr;
         }
         
-        if(clean_params)
-        for(size_t i = 0; i < _p.size(); ++i)
-            delete _p[i];
+        if(clean_params){
+            for(size_t i = 0; i < _p.size(); ++i)
+                delete _p[i];
+            _p.clear();
+        }
     }
     
     std::vector<parameter*> _p;
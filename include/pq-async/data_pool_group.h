@@ -0,0 +1,481 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_pool_group_h
+#define _libpq_async_data_pool_group_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "data_connection_pool.h"
+#include "database.h"
+
+namespace pq_async{
+
+#define PQ_ASYNC_POOL_GROUP_EWMA_DECAY 0.2
+
+class pool_group_member_t;
+class pool_group_t;
+typedef std::shared_ptr< pq_async::pool_group_member_t > pool_group_member;
+typedef std::shared_ptr< pq_async::pool_group_t > pool_group;
+
+/*!
+ * \brief replica selection strategy used by the pool_group_t
+ */
+enum class pool_balancing
+{
+    // pick the replica with the fewest requests in flight
+    least_outstanding = 0,
+    // pick the replica with the lowest latency moving average,
+    // weighted by the requests in flight
+    ewma_latency = 1,
+};
+
+/*!
+ * \brief per call routing override
+ */
+enum class pool_route
+{
+    // read-only calls go to a replica, writes go to the primary
+    replica = 0,
+    // always use the primary, for read-your-writes consistency
+    primary = 1,
+};
+
+/*!
+ * \brief one endpoint of a pool_group_t, either the primary or a replica
+ * 
+ */
+class pool_group_member_t
+{
+    friend class pool_group_t;
+public:
+    pool_group_member_t(const std::string& connection_string, bool primary)
+        : _connection_string(connection_string), _primary(primary),
+        _outstanding(0), _ewma_us(0), _requests(0), _errors(0)
+    {
+    }
+    
+    const std::string& connection_string() const
+    {
+        return _connection_string;
+    }
+    bool is_primary() const { return _primary;}
+    
+    /*!
+     * \brief number of requests currently in flight on that member
+     */
+    int32_t outstanding() const { return _outstanding.load();}
+    /*!
+     * \brief exponentially weighted moving average of the request latency
+     * in microseconds, 0 until the first request completes
+     */
+    int64_t ewma_latency_us() const { return _ewma_us.load();}
+    /*!
+     * \brief number of completed requests
+     */
+    int64_t requests() const { return _requests.load();}
+    /*!
+     * \brief number of requests that completed with an error
+     */
+    int64_t errors() const { return _errors.load();}
+    
+    std::chrono::steady_clock::time_point begin_request()
+    {
+        ++_outstanding;
+        return std::chrono::steady_clock::now();
+    }
+    
+    void end_request(
+        std::chrono::steady_clock::time_point start, bool failed,
+        double decay = PQ_ASYNC_POOL_GROUP_EWMA_DECAY);
+    
+private:
+    std::string _connection_string;
+    bool _primary;
+    
+    std::atomic<int32_t> _outstanding;
+    std::atomic<int64_t> _ewma_us;
+    std::atomic<int64_t> _requests;
+    std::atomic<int64_t> _errors;
+};
+
+
+#define _PQ_ASYNC_GROUP_BODY_PARAMS(__val, __fn, __read_only) \
+    parameters_t p; \
+    p.push_back<sizeof...(PARAMS) -1>(args...); \
+    auto m = this->select(route, __read_only); \
+    this->open(m)->__fn(sql, p, this->_track<__val>(m, md::get_last(args...)));
+
+#define _PQ_ASYNC_GROUP_BODY_SYNC(__fn, __read_only) \
+    auto m = this->select(route, __read_only); \
+    request_guard g(m, _decay); \
+    return g.done(this->open(m)->__fn(sql, args...));
+
+
+/*!
+ * \brief creates a new pool_group_t instance
+ * 
+ * \param primary_connection_string connection string of the primary server
+ * \param replica_connection_strings connection strings of the read replicas
+ * \param balancing replica selection strategy
+ * \param log the logger used by the database_t instances of that group
+ * \return pool_group 
+ */
+pool_group open_pool_group(
+    const std::string& primary_connection_string,
+    const std::vector<std::string>& replica_connection_strings,
+    pool_balancing balancing = pool_balancing::least_outstanding,
+    md::log::logger log = nullptr
+);
+
+/*!
+ * \brief a primary server and N read replicas, read-only calls are
+ * balanced between the replicas and writes are sent to the primary.
+ * 
+ * Each member keeps its own connection pool, keyed by its connection string,
+ * a new database_t is opened on the selected member for each call.
+ */
+class pool_group_t
+    : public std::enable_shared_from_this<pool_group_t>
+{
+    friend pool_group open_pool_group(
+        const std::string& primary_connection_string,
+        const std::vector<std::string>& replica_connection_strings,
+        pool_balancing balancing,
+        md::log::logger log
+    );
+    
+    pool_group_t(
+        const std::string& primary_connection_string,
+        const std::vector<std::string>& replica_connection_strings,
+        pool_balancing balancing,
+        md::log::logger log
+    );
+    
+    class request_guard
+    {
+    public:
+        request_guard(pool_group_member m, double decay)
+            : _m(m), _start(m->begin_request()), _decay(decay), _failed(true)
+        {
+        }
+        ~request_guard()
+        {
+            _m->end_request(_start, _failed, _decay);
+        }
+        
+        template<typename T>
+        T done(T value)
+        {
+            _failed = false;
+            return value;
+        }
+        
+    private:
+        pool_group_member _m;
+        std::chrono::steady_clock::time_point _start;
+        double _decay;
+        bool _failed;
+    };
+    
+public:
+    
+    pool_balancing balancing() const { return _balancing;}
+    void balancing(pool_balancing b){ _balancing = b;}
+    
+    /*!
+     * \brief weight of the last sample in the latency moving average,
+     * between 0 and 1, default to PQ_ASYNC_POOL_GROUP_EWMA_DECAY
+     */
+    double ewma_decay() const { return _decay;}
+    void ewma_decay(double decay)
+    {
+        if(decay <= 0 || decay > 1)
+            throw pq_async::exception("Invalid moving average decay!");
+        _decay = decay;
+    }
+    
+    pool_group_member primary_member() const { return _primary;}
+    const std::vector<pool_group_member>& replica_members() const
+    {
+        return _replicas;
+    }
+    
+    /*!
+     * \brief select the member that should serve the next call
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param read_only false if the call can modify data
+     * \return pool_group_member 
+     */
+    pool_group_member select(pool_route route, bool read_only);
+    
+    /*!
+     * \brief creates a new database_t instance bound to the specified member
+     */
+    database open(pool_group_member m)
+    {
+        return pq_async::open(m->connection_string(), _log);
+    }
+    
+    /*!
+     * \brief creates a new database_t instance bound to the primary,
+     * should be used for transactions and prepared statements
+     */
+    database primary()
+    {
+        return this->open(_primary);
+    }
+    
+    /*!
+     * \brief creates a new database_t instance bound to the replica
+     * selected by the balancing strategy, no latency is recorded for
+     * the calls made on the returned instance
+     */
+    database replica()
+    {
+        return this->open(this->select(pool_route::replica, true));
+    }
+    
+    
+    /*!
+     * \brief asynchronously process a query on the primary
+     * and returns the number of rows affected by insert, update and delete
+     * 
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is the query callback
+     * pq_async::value_cb<int>
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(int)>
+    void execute(const char* sql, const PARAMS&... args)
+    {
+        pool_route route = pool_route::primary;
+        _PQ_ASYNC_GROUP_BODY_PARAMS(int, execute, false);
+    }
+    /*!
+     * \brief synchronously process a query on the primary
+     * and returns the number of rows affected by insert, update and delete
+     * 
+     * \param sql the SQL query to process
+     * \param args query parameters
+     * \return int32_t the number of record processed
+     */
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(int)>
+    int32_t execute(const char* sql, const PARAMS&... args)
+    {
+        pool_route route = pool_route::primary;
+        _PQ_ASYNC_GROUP_BODY_SYNC(execute, false);
+    }
+    int32_t execute(const char* sql)
+    {
+        auto m = this->select(pool_route::primary, false);
+        request_guard g(m, _decay);
+        return g.done(this->open(m)->execute(sql));
+    }
+    
+    
+    /*!
+     * \brief asynchronously process a read-only query
+     * and returns a pq_async::data_table_t as the result
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is 
+     * the completion void(const md::callback::cb_error&, data_table) callback
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_table)>
+    void query(pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_PARAMS(data_table, query, true);
+    }
+    /*!
+     * \brief synchronously process a read-only query
+     * and returns a pq_async::data_table_t as the result
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters
+     * \return data_table 
+     */
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_table)>
+    data_table query(pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_SYNC(query, true);
+    }
+    data_table query(pool_route route, const char* sql)
+    {
+        auto m = this->select(route, true);
+        request_guard g(m, _decay);
+        return g.done(this->open(m)->query(sql));
+    }
+    template<typename... PARAMS>
+    decltype(auto) query(const char* sql, const PARAMS&... args)
+    {
+        return query(pool_route::replica, sql, args...);
+    }
+    
+    
+    /*!
+     * \brief asynchronously process a read-only query
+     * and returns a pq_async::data_row_t as the result
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is
+     * the completion void(const md::callback::cb_error&, data_row) callback
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_row)>
+    void query_single(pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_PARAMS(data_row, query_single, true);
+    }
+    /*!
+     * \brief synchronously process a read-only query
+     * and returns a pq_async::data_row_t as the result
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters
+     * \return data_row 
+     */
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_row)>
+    data_row query_single(
+        pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_SYNC(query_single, true);
+    }
+    data_row query_single(pool_route route, const char* sql)
+    {
+        auto m = this->select(route, true);
+        request_guard g(m, _decay);
+        return g.done(this->open(m)->query_single(sql));
+    }
+    template<typename... PARAMS>
+    decltype(auto) query_single(const char* sql, const PARAMS&... args)
+    {
+        return query_single(pool_route::replica, sql, args...);
+    }
+    
+    
+    /*!
+     * \brief asynchronously process a read-only query
+     * and returns a scalar value as the result
+     * 
+     * \tparam R the result type
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is the query callback
+     * pq_async::value_cb<R>
+     */
+    template<typename R, typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(R)>
+    void query_value(pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_PARAMS(R, template query_value<R>, true);
+    }
+    /*!
+     * \brief synchronously process a read-only query
+     * and returns a scalar value as the result
+     * 
+     * \tparam R the result type
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters
+     * \return R the scalar value
+     */
+    template<typename R, typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(R)>
+    R query_value(pool_route route, const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_GROUP_BODY_SYNC(template query_value<R>, true);
+    }
+    template<typename R>
+    R query_value(pool_route route, const char* sql)
+    {
+        auto m = this->select(route, true);
+        request_guard g(m, _decay);
+        return g.done(this->open(m)->template query_value<R>(sql));
+    }
+    template<typename R, typename... PARAMS>
+    decltype(auto) query_value(const char* sql, const PARAMS&... args)
+    {
+        return query_value<R>(pool_route::replica, sql, args...);
+    }
+    
+    
+    /*!
+     * \brief process a read-only query and returns a pq_async::data_reader_t,
+     * the reader is opened on the selected member but, because the rows are
+     * consumed by the caller, no latency is recorded.
+     * 
+     * \param route pool_route::primary to force the primary
+     * \param sql the SQL query to process
+     * \param args query parameters, if the last parameter is a callback 
+     * the reader is returned asynchronously
+     */
+    template<typename... PARAMS>
+    decltype(auto) query_reader(
+        pool_route route, const char* sql, const PARAMS&... args)
+    {
+        return this->open(this->select(route, true))->query_reader(
+            sql, args...
+        );
+    }
+    template<typename... PARAMS>
+    decltype(auto) query_reader(const char* sql, const PARAMS&... args)
+    {
+        return query_reader(pool_route::replica, sql, args...);
+    }
+    
+private:
+    
+    template<typename R, typename CB>
+    md::callback::value_cb<R> _track(pool_group_member m, const CB& acb)
+    {
+        md::callback::value_cb<R> cb;
+        md::callback::assign_value_cb<md::callback::value_cb<R>, R>(cb, acb);
+        
+        auto start = m->begin_request();
+        double decay = _decay;
+        return [m, start, decay, cb](
+            const md::callback::cb_error& err, R value
+        )-> void {
+            m->end_request(start, (bool)err, decay);
+            cb(err, value);
+        };
+    }
+    
+    pool_group_member _primary;
+    std::vector<pool_group_member> _replicas;
+    pool_balancing _balancing;
+    double _decay;
+    std::atomic<uint32_t> _next;
+    md::log::logger _log;
+};
+
+#undef _PQ_ASYNC_GROUP_BODY_PARAMS
+#undef _PQ_ASYNC_GROUP_BODY_SYNC
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_pool_group_h
@@ -41,11 +41,11 @@ namespace pq_async {
     p.push_back<sizeof...(PARAMS) -1>(args...); \
      \
     md::callback::value_cb<__val> cb; \
-    md::callback::assign_value_cb<md::callback::value_cb<__val>, __val>(cb, get_last(args...)); \
+    md::callback::assign_value_cb<md::callback::value_cb<__val>, __val>(cb, md::get_last(args...)); \
      \
     this->_db->open_connection( \
     [self=this->shared_from_this(), \
-        _p = std::move(p), \
+        _p = std::make_shared<parameters_t>(std::move(p)), \
         cb] \
     (const md::callback::cb_error& err, connection_lock lock){ \
         if(err){ \
@@ -53,29 +53,36 @@ namespace pq_async {
             return; \
         } \
          \
-        try{ \
-            auto ct = std::make_shared<connection_task_t>( \
-                self->_db->_strand.get(), self->_db, lock, \
-            [self, cb]( \
-                const md::callback::cb_error& err, PGresult* r \
-            )-> void { \
-                if(err){ \
-                    cb(err, __def_val); \
-                    return; \
-                } \
+        self->_prepare_on(lock, \
+        [self, lock, _p, cb](const md::callback::cb_error& err){ \
+            if(err){ \
+                cb(err, __def_val); \
+                return; \
+            } \
+            try{ \
+                auto ct = connection_task_t::acquire( \
+                    self->_db->_strand.get(), self->_db, lock, \
+                [self, cb]( \
+                    const md::callback::cb_error& err, PGresult* r \
+                )-> void { \
+                    if(err){ \
+                        cb(err, __def_val); \
+                        return; \
+                    } \
+                     \
+                    try{ \
+                        cb(nullptr, self->_db->__process_fn(r)); \
+                    }catch(const std::exception& err){ \
+                        cb(md::callback::cb_error(err), __def_val); \
+                    } \
+                }); \
+                ct->send_query_prepared(self->_name.c_str(), *_p); \
+                self->_db->_strand->push_back(ct); \
                  \
-                try{ \
-                    cb(nullptr, self->_db->__process_fn(r)); \
-                }catch(const std::exception& err){ \
-                    cb(md::callback::cb_error(err), __def_val); \
-                } \
-            }); \
-            ct->send_query_prepared(self->_name.c_str(), _p); \
-            self->_db->_strand->push_back(ct); \
-             \
-        }catch(const std::exception& err){ \
-            cb(md::callback::cb_error(err), __def_val); \
-        } \
+            }catch(const std::exception& err){ \
+                cb(md::callback::cb_error(err), __def_val); \
+            } \
+        }); \
     });
 
 #define _PQ_ASYNC_SEND_QRY_PREP_BODY_T(__val, __process_fn, __def_val) \
@@ -83,7 +90,7 @@ namespace pq_async {
     md::callback::assign_value_cb<md::callback::value_cb<__val>, __val>(cb, acb); \
     this->_db->open_connection( \
     [self=this->shared_from_this(), \
-        _p = std::move(p), \
+        _p = std::make_shared<parameters_t>(std::move(p)), \
         cb] \
     (const md::callback::cb_error& err, connection_lock lock){ \
         if(err){ \
@@ -91,34 +98,42 @@ namespace pq_async {
             return; \
         } \
          \
-        try{ \
-            auto ct = std::make_shared<connection_task_t>( \
-                self->_db->_strand.get(), self->_db, lock, \
-            [self, cb]( \
-                const md::callback::cb_error& err, PGresult* r \
-            )-> void { \
-                if(err){ \
-                    cb(err, __def_val); \
-                    return; \
-                } \
+        self->_prepare_on(lock, \
+        [self, lock, _p, cb](const md::callback::cb_error& err){ \
+            if(err){ \
+                cb(err, __def_val); \
+                return; \
+            } \
+            try{ \
+                auto ct = connection_task_t::acquire( \
+                    self->_db->_strand.get(), self->_db, lock, \
+                [self, cb]( \
+                    const md::callback::cb_error& err, PGresult* r \
+                )-> void { \
+                    if(err){ \
+                        cb(err, __def_val); \
+                        return; \
+                    } \
+                     \
+                    try{ \
+                        cb(nullptr, self->_db->__process_fn(r)); \
+                    }catch(const std::exception& err){ \
+                        cb(md::callback::cb_error(err), __def_val); \
+                    } \
+                }); \
+                ct->send_query_prepared(self->_name.c_str(), *_p); \
+                self->_db->_strand->push_back(ct); \
                  \
-                try{ \
-                    cb(nullptr, self->_db->__process_fn(r)); \
-                }catch(const std::exception& err){ \
-                    cb(md::callback::cb_error(err), __def_val); \
-                } \
-            }); \
-            ct->send_query_prepared(self->_name.c_str(), _p); \
-            self->_db->_strand->push_back(ct); \
-             \
-        }catch(const std::exception& err){ \
-            cb(md::callback::cb_error(err), __def_val); \
-        } \
+            }catch(const std::exception& err){ \
+                cb(md::callback::cb_error(err), __def_val); \
+            } \
+        }); \
     });
 
 #define _PQ_ASYNC_SEND_QRY_PREP_BODY_SYNC(__process_fn) \
     this->_db->wait_for_sync(); \
     auto lock = this->_db->open_connection(); \
+    this->_prepare_on(lock); \
     connection_task_t ct( \
         this->_db->_strand.get(), this->_db, lock \
     ); \
@@ -132,11 +147,16 @@ class data_prepared_t
     : public std::enable_shared_from_this<data_prepared_t>
 {
     friend database_t;
+#if PQ_ASYNC_HAS_COROUTINES
+    template< typename R > friend class db_awaitable;
+#endif
     
     data_prepared_t(
-        database db, const std::string& name, bool auto_deallocate,
+        database db, const std::string& name, const std::string& sql,
+        const std::vector<data_type>& types, bool auto_deallocate,
         connection_lock lock)
-        : _db(db), _name(name), _auto_deallocate(auto_deallocate), _lock(lock)
+        : _db(db), _name(name), _sql(sql), _types(types),
+        _auto_deallocate(auto_deallocate), _lock(lock)
     {
     }
     
@@ -150,6 +170,9 @@ public:
     
     database db(){ return _db;}
     
+    const std::string& name() const { return _name;}
+    const std::string& sql() const { return _sql;}
+    
     
     
     /*!
@@ -471,12 +494,12 @@ public:
             md::callback::value_cb<data_reader>,
             data_reader
         >(
-            cb, get_last(args...)
+            cb, md::get_last(args...)
         );
         
         this->_db->open_connection(
         [self=this->shared_from_this(),
-            _p = std::move(p),
+            _p = std::make_shared<parameters_t>(std::move(p)),
             cb]
         (const md::callback::cb_error& err, connection_lock lock){
             if(err){
@@ -484,17 +507,25 @@ public:
                 return;
             }
             
-            try{
-                auto ct = std::make_shared<reader_connection_task>(
-                    self->_db->_strand.get(), self->_db, lock
-                );
-                cb(nullptr, std::shared_ptr<data_reader_t>(new data_reader_t(ct)));
-                ct->send_query_prepared(self->_name.c_str(), _p);
-                self->_db->_strand->push_back(ct);
+            self->_prepare_on(lock,
+            [self, lock, _p, cb](const md::callback::cb_error& err){
+                if(err){
+                    cb(err, data_reader());
+                    return;
+                }
                 
-            }catch(const std::exception& err){
-                cb(md::callback::cb_error(err), data_reader());
-            }
+                try{
+                    auto ct = std::make_shared<reader_connection_task>(
+                        self->_db->_strand.get(), self->_db, lock
+                    );
+                    cb(nullptr, std::shared_ptr<data_reader_t>(new data_reader_t(ct)));
+                    ct->send_query_prepared(self->_name.c_str(), *_p);
+                    self->_db->_strand->push_back(ct);
+                    
+                }catch(const std::exception& err){
+                    cb(md::callback::cb_error(err), data_reader());
+                }
+            });
         });
     }
     /*!
@@ -517,7 +548,7 @@ public:
 
         this->_db->open_connection(
         [self=this->shared_from_this(),
-            _p = std::move(p),
+            _p = std::make_shared<parameters_t>(std::move(p)),
             cb]
         (const md::callback::cb_error& err, connection_lock lock){
             if(err){
@@ -525,17 +556,25 @@ public:
                 return;
             }
             
-            try{
-                auto ct = std::make_shared<reader_connection_task>(
-                    self->_db->_strand.get(), self->_db, lock
-                );
-                cb(nullptr, std::shared_ptr<data_reader_t>(new data_reader_t(ct)));
-                ct->send_query_prepared(self->_name.c_str(), _p);
-                self->_db->_strand->push_back(ct);
+            self->_prepare_on(lock,
+            [self, lock, _p, cb](const md::callback::cb_error& err){
+                if(err){
+                    cb(err, data_reader());
+                    return;
+                }
                 
-            }catch(const std::exception& err){
-                cb(md::callback::cb_error(err), data_reader());
-            }
+                try{
+                    auto ct = std::make_shared<reader_connection_task>(
+                        self->_db->_strand.get(), self->_db, lock
+                    );
+                    cb(nullptr, std::shared_ptr<data_reader_t>(new data_reader_t(ct)));
+                    ct->send_query_prepared(self->_name.c_str(), *_p);
+                    self->_db->_strand->push_back(ct);
+                    
+                }catch(const std::exception& err){
+                    cb(md::callback::cb_error(err), data_reader());
+                }
+            });
         });
     }
     
@@ -554,6 +593,7 @@ public:
     {
         this->_db->wait_for_sync();
         auto lock = this->_db->open_connection();
+        this->_prepare_on(lock);
         parameters_t p(args...);
         auto ct = std::make_shared<reader_connection_task>(
             this->_db->_strand.get(), this->_db, lock
@@ -571,6 +611,7 @@ public:
     {
         this->_db->wait_for_sync();
         auto lock = this->_db->open_connection();
+        this->_prepare_on(lock);
         parameters_t p;
         auto ct = std::make_shared<reader_connection_task>(
             this->_db->_strand.get(), this->_db, lock
@@ -589,6 +630,7 @@ public:
     {
         this->_db->wait_for_sync();
         auto lock = this->_db->open_connection();
+        this->_prepare_on(lock);
         auto ct = std::make_shared<reader_connection_task>(
             this->_db->_strand.get(), this->_db, lock
         );
@@ -597,9 +639,566 @@ public:
     }
     
     
+    /*!
+     * \brief synchrounously execute the statement once for each
+     * parameters tuple, every execution is pipelined on the connection
+     * 
+     * \param batch the parameters of each execution
+     * \param mode batch_mode::atomic throws on the first error,
+     * batch_mode::isolated reports the errors of each row in the result
+     * \return batch_result the aggregated affected rows count
+     */
+    batch_result execute_many(
+        const std::vector<parameters_t>& batch,
+        batch_mode mode = batch_mode::atomic)
+    {
+        if(batch.empty())
+            return batch_result{0, 0, 0, {}};
+        
+#if PQ_ASYNC_HAS_PIPELINE
+        this->_db->wait_for_sync();
+        auto lock = this->_db->open_connection();
+        this->_prepare_on(lock);
+        pipeline_connection_task ct(
+            this->_db->_strand.get(), this->_db, lock
+        );
+        ct.send_batch(
+            _name.c_str(),
+            std::shared_ptr< const std::vector<parameters_t> >(
+                &batch, [](const std::vector<parameters_t>*){}
+            ),
+            mode
+        );
+        batch_result r = ct.run_batch();
+#else
+        batch_result r = _execute_each(batch, mode);
+#endif
+        if(mode == batch_mode::atomic && !r.errors.empty())
+            throw pq_async::exception(_batch_error_message(r));
+        return r;
+    }
+    /*!
+     * \brief synchrounously execute the statement once for each tuple
+     * 
+     * \tparam ARGS the tuple values types
+     * \param rows the parameters of each execution
+     * \param mode the batch synchronization mode
+     * \return batch_result 
+     */
+    template<typename... ARGS>
+    batch_result execute_many(
+        const std::vector< std::tuple<ARGS...> >& rows,
+        batch_mode mode = batch_mode::atomic)
+    {
+        return execute_many(_to_batch(rows), mode);
+    }
+    
+    /*!
+     * \brief asynchrounously execute the statement once for each
+     * parameters tuple, every execution is pipelined on the connection
+     * 
+     * \param batch the parameters of each execution
+     * \param mode batch_mode::atomic fails on the first error,
+     * batch_mode::isolated reports the errors of each row in the result
+     * \param acb completion void(const md::callback::cb_error&, batch_result)
+     * callback
+     */
+    template<typename T, PQ_ASYNC_VALID_DB_VAL_CALLBACK(T, batch_result)>
+    void execute_many(
+        const std::vector<parameters_t>& batch, batch_mode mode, const T& acb)
+    {
+        md::callback::value_cb<batch_result> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<batch_result>, batch_result
+        >(
+            cb, acb
+        );
+        _execute_many(
+            std::make_shared< const std::vector<parameters_t> >(batch),
+            mode, cb
+        );
+    }
+    template<typename T, PQ_ASYNC_VALID_DB_VAL_CALLBACK(T, batch_result)>
+    void execute_many(const std::vector<parameters_t>& batch, const T& acb)
+    {
+        execute_many(batch, batch_mode::atomic, acb);
+    }
+    template<
+        typename T, typename... ARGS,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(T, batch_result)
+    >
+    void execute_many(
+        const std::vector< std::tuple<ARGS...> >& rows,
+        batch_mode mode, const T& acb)
+    {
+        execute_many(_to_batch(rows), mode, acb);
+    }
+    template<
+        typename T, typename... ARGS,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(T, batch_result)
+    >
+    void execute_many(
+        const std::vector< std::tuple<ARGS...> >& rows, const T& acb)
+    {
+        execute_many(_to_batch(rows), batch_mode::atomic, acb);
+    }
+    
+#if PQ_ASYNC_HAS_COROUTINES
+    /*!
+     * \brief co_await-able execution returning a pq_async::data_table_t,
+     * see database_t::query_async
+     */
+    template<typename... PARAMS>
+    db_awaitable<data_table> query_async(const PARAMS&... args);
+    
+    /*!
+     * \brief co_await-able execution returning the first row or nullptr
+     */
+    template<typename... PARAMS>
+    db_awaitable<data_row> query_single_async(const PARAMS&... args);
+    
+    /*!
+     * \brief co_await-able execution returning the first column of the
+     * first row
+     */
+    template<typename R, typename... PARAMS>
+    db_awaitable<R> query_value_async(const PARAMS&... args);
+    
+    /*!
+     * \brief co_await-able execution returning the number of rows affected
+     */
+    template<typename... PARAMS>
+    db_awaitable<int32_t> execute_async(const PARAMS&... args);
+#endif
+    
 private:
+    template<typename... ARGS>
+    static std::vector<parameters_t> _to_batch(
+        const std::vector< std::tuple<ARGS...> >& rows)
+    {
+        std::vector<parameters_t> batch;
+        batch.reserve(rows.size());
+        for(const auto& row : rows)
+            batch.emplace_back(std::apply(
+                [](const ARGS&... args)-> parameters_t {
+                    return parameters_t(args...);
+                },
+                row
+            ));
+        return batch;
+    }
+    
+    static std::string _batch_error_message(const batch_result& r)
+    {
+        const batch_error& e = r.errors.front();
+        return "batch statement " + md::num_to_str(e.index, false) +
+            " failed: " + e.message;
+    }
+    
+    void _execute_many(
+        std::shared_ptr< const std::vector<parameters_t> > batch,
+        batch_mode mode, const md::callback::value_cb<batch_result>& cb)
+    {
+        if(batch->empty()){
+            this->_db->_strand->push_back(
+                std::bind(cb, nullptr, batch_result{0, 0, 0, {}})
+            );
+            return;
+        }
+        
+#if PQ_ASYNC_HAS_PIPELINE
+        this->_db->open_connection(
+        [self=this->shared_from_this(), batch, mode, cb]
+        (const md::callback::cb_error& err, connection_lock lock){
+            if(err){
+                cb(err, batch_result{0, 0, 0, {}});
+                return;
+            }
+            
+            self->_prepare_on(lock,
+            [self, lock, batch, mode, cb](const md::callback::cb_error& err){
+                if(err){
+                    cb(err, batch_result{0, 0, 0, {}});
+                    return;
+                }
+                try{
+                    auto ct = std::make_shared<pipeline_connection_task>(
+                        self->_db->_strand.get(), self->_db, lock,
+                    [mode, cb](
+                        const md::callback::cb_error& err, batch_result r
+                    )-> void {
+                        if(!err && mode == batch_mode::atomic &&
+                            !r.errors.empty()
+                        ){
+                            cb(md::callback::cb_error(pq_async::exception(
+                                _batch_error_message(r)
+                            )), r);
+                            return;
+                        }
+                        cb(err, r);
+                    });
+                    ct->send_batch(self->_name.c_str(), batch, mode);
+                    self->_db->_strand->push_back(ct);
+                    
+                }catch(const std::exception& err){
+                    cb(md::callback::cb_error(err), batch_result{0, 0, 0, {}});
+                }
+            });
+        });
+#else
+        auto r = std::make_shared<batch_result>(batch_result{0, 0, 0, {}});
+        auto done = [mode, r, cb](const md::callback::cb_error& err){
+            if(!err && mode == batch_mode::atomic && !r->errors.empty()){
+                cb(md::callback::cb_error(pq_async::exception(
+                    _batch_error_message(*r)
+                )), *r);
+                return;
+            }
+            cb(err, *r);
+        };
+        
+        // an atomic batch runs in its own transaction unless one is opened
+        if(mode == batch_mode::atomic && !this->_db->in_transaction()){
+            auto self = this->shared_from_this();
+            this->_db->begin([self, batch, r, done](
+                const md::callback::cb_error& err
+            ){
+                if(err){
+                    done(err);
+                    return;
+                }
+                self->_execute_each(batch, batch_mode::atomic, 0, r,
+                [self, r, done](const md::callback::cb_error& err){
+                    if(err || !r->errors.empty()){
+                        self->_db->rollback(
+                        [err, done](const md::callback::cb_error& rb_err){
+                            done(err ? err : rb_err);
+                        });
+                        return;
+                    }
+                    self->_db->commit(done);
+                });
+            });
+            return;
+        }
+        _execute_each(batch, mode, 0, r, done);
+#endif
+    }
+    
+#if !PQ_ASYNC_HAS_PIPELINE
+    /*!
+     * \brief synchronously execute the batch one statement at a time,
+     * used when libpq has no pipeline mode
+     */
+    batch_result _execute_each(
+        const std::vector<parameters_t>& batch, batch_mode mode)
+    {
+        batch_result r{0, 0, 0, {}};
+        // an atomic batch runs in its own transaction unless one is opened
+        bool tx = mode == batch_mode::atomic && !this->_db->in_transaction();
+        if(tx)
+            this->_db->begin();
+        
+        for(size_t i = 0; i < batch.size(); ++i){
+            try{
+                r.affected += this->execute(batch[i]);
+                ++r.executed;
+            }catch(const sql_exception& err){
+                r.errors.emplace_back(batch_error{
+                    i, err.sqlstate(), err.what()
+                });
+                if(mode == batch_mode::atomic){
+                    r.aborted = batch.size() - i - 1;
+                    break;
+                }
+            }
+        }
+        
+        if(tx){
+            if(r.errors.empty())
+                this->_db->commit();
+            else
+                this->_db->rollback();
+        }
+        return r;
+    }
+    
+    /*!
+     * \brief asynchronously execute the batch from the statement at idx
+     */
+    void _execute_each(
+        std::shared_ptr< const std::vector<parameters_t> > batch,
+        batch_mode mode, size_t idx, std::shared_ptr<batch_result> r,
+        const md::callback::async_cb& cb)
+    {
+        if(idx == batch->size()){
+            cb(nullptr);
+            return;
+        }
+        
+        this->execute((*batch)[idx],
+        [self=this->shared_from_this(), batch, mode, idx, r, cb](
+            const md::callback::cb_error& err, int affected
+        ){
+            if(err){
+                r->errors.emplace_back(batch_error{idx, "", err.c_str()});
+                if(mode == batch_mode::atomic){
+                    r->aborted = batch->size() - idx - 1;
+                    cb(nullptr);
+                    return;
+                }
+            }else{
+                r->affected += affected;
+                ++r->executed;
+            }
+            self->_execute_each(batch, mode, idx + 1, r, cb);
+        });
+    }
+#endif
+
+    /*!
+     * \brief synchronously prepare the statement on the locked connection
+     * when it's not already prepared there, only used by the
+     * multiplexing mode since the connection can change between statements
+     */
+    void _prepare_on(connection_lock lock)
+    {
+        if(!_db->_multiplexing || _db->_conn->is_prepared(_name, _sql))
+            return;
+        
+        // the session holds another query under that name
+        if(_db->_conn->is_prepared(_name))
+            _deallocate_on(lock);
+        
+        connection_task_t ct(_db->_strand.get(), _db, lock);
+        ct.send_prepare(_name.c_str(), _sql.c_str(), _types);
+        if(_process_prepare_on_result(ct.run_now()))
+            return;
+        
+        // 42P05, prepared outside of pq_async knowledge
+        _deallocate_on(lock);
+        connection_task_t retry_ct(_db->_strand.get(), _db, lock);
+        retry_ct.send_prepare(_name.c_str(), _sql.c_str(), _types);
+        if(!_process_prepare_on_result(retry_ct.run_now()))
+            throw pq_async::exception(
+                "Unable to prepare statement \"" + _name + "\""
+            );
+    }
+    
+    /*!
+     * \brief asynchronously prepare the statement on the locked connection
+     * when it's not already prepared there, next is called immediately
+     * when no preparation is needed
+     */
+    void _prepare_on(
+        connection_lock lock, const md::callback::async_cb& next)
+    {
+        if(!_db->_multiplexing){
+            next(nullptr);
+            return;
+        }
+        _prepare_session(lock, next);
+    }
+    
+    /*!
+     * \brief asynchronously prepare the statement on the session of the
+     * locked connection, a name held by another query or prepared outside
+     * of pq_async knowledge is deallocated and prepared again
+     */
+    void _prepare_session(
+        connection_lock lock, const md::callback::async_cb& next)
+    {
+        if(_db->_conn->is_prepared(_name, _sql)){
+            next(nullptr);
+            return;
+        }
+        
+        // the session holds another query under that name
+        if(_db->_conn->is_prepared(_name)){
+            _reprepare_on(lock, next);
+            return;
+        }
+        
+        _send_prepare_on(lock,
+        [self=this->shared_from_this(), lock, next](
+            const md::callback::cb_error& err, bool ok
+        ){
+            if(err || ok){
+                next(err);
+                return;
+            }
+            // 42P05, prepared outside of pq_async knowledge
+            self->_reprepare_on(lock, next);
+        });
+    }
+    
+    /*!
+     * \brief deallocate the statement name on the locked connection
+     * and prepare it again with this query
+     */
+    void _reprepare_on(
+        connection_lock lock, const md::callback::async_cb& next)
+    {
+        _deallocate_on(lock,
+        [self=this->shared_from_this(), lock, next](
+            const md::callback::cb_error& err
+        ){
+            if(err){
+                next(err);
+                return;
+            }
+            self->_send_prepare_on(lock,
+            [self, next](const md::callback::cb_error& err, bool ok){
+                if(!err && !ok){
+                    next(md::callback::cb_error(pq_async::exception(
+                        "Unable to prepare statement \"" + self->_name + "\""
+                    )));
+                    return;
+                }
+                next(err);
+            });
+        });
+    }
+    
+    /*!
+     * \brief sends the preparation, next receives false when the name
+     * is already taken on the session
+     */
+    void _send_prepare_on(
+        connection_lock lock, const md::callback::value_cb<bool>& next)
+    {
+        try{
+            auto ct = connection_task_t::acquire(
+                _db->_strand.get(), _db, lock,
+            [self=this->shared_from_this(), next](
+                const md::callback::cb_error& err, PGresult* r
+            )-> void {
+                if(err){
+                    next(err, false);
+                    return;
+                }
+                
+                bool prepared = false;
+                try{
+                    prepared = self->_process_prepare_on_result(r);
+                }catch(const std::exception& err){
+                    next(md::callback::cb_error(err), false);
+                    return;
+                }
+                next(nullptr, prepared);
+            });
+            ct->send_prepare(_name.c_str(), _sql.c_str(), _types);
+            _db->_strand->push_back(ct);
+            
+        }catch(const std::exception& err){
+            next(md::callback::cb_error(err), false);
+        }
+    }
+    
+    /*!
+     * \brief returns false when the name is already taken on the session
+     * (42P05), prepared outside of pq_async knowledge or with another query
+     */
+    bool _process_prepare_on_result(PGresult* res)
+    {
+        if(!_db->_conn){
+            if(res)
+                PQclear(res);
+            throw pq_async::exception("connection is dead!");
+        }
+        
+        int result_status = PQresultStatus(res);
+        const char* state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+        if(result_status != PGRES_COMMAND_OK){
+            // 42P05: duplicate_prepared_statement
+            if(state && strcmp(state, "42P05") == 0){
+                PQclear(res);
+                return false;
+            }
+            throw _db->_result_error(res);
+        }
+        
+        PQclear(res);
+        _db->_conn->set_prepared(_name, _sql);
+        return true;
+    }
+    
+    std::string _deallocate_sql()
+    {
+        char* es_name = PQescapeIdentifier(
+            _db->_conn->conn(), _name.c_str(), _name.size()
+        );
+        if(!es_name)
+            throw pq_async::exception("Deallocate prepared invalid name!");
+        std::string sql("DEALLOCATE PREPARE ");
+        sql += es_name;
+        PQfreemem(es_name);
+        return sql;
+    }
+    
+    /*!
+     * \brief synchronously deallocate the statement name on the locked
+     * connection so it can be prepared with this query
+     */
+    void _deallocate_on(connection_lock lock)
+    {
+        connection_task_t ct(_db->_strand.get(), _db, lock);
+        ct.send_query(_deallocate_sql().c_str(), parameters_t());
+        _process_deallocate_on_result(ct.run_now());
+    }
+    
+    /*!
+     * \brief asynchronously deallocate the statement name on the locked
+     * connection
+     */
+    void _deallocate_on(
+        connection_lock lock, const md::callback::async_cb& next)
+    {
+        try{
+            auto ct = connection_task_t::acquire(
+                _db->_strand.get(), _db, lock,
+            [self=this->shared_from_this(), next](
+                const md::callback::cb_error& err, PGresult* r
+            )-> void {
+                if(err){
+                    next(err);
+                    return;
+                }
+                
+                try{
+                    self->_process_deallocate_on_result(r);
+                }catch(const std::exception& err){
+                    next(md::callback::cb_error(err));
+                    return;
+                }
+                next(nullptr);
+            });
+            ct->send_query(_deallocate_sql().c_str(), parameters_t());
+            _db->_strand->push_back(ct);
+            
+        }catch(const std::exception& err){
+            next(md::callback::cb_error(err));
+        }
+    }
+    
+    void _process_deallocate_on_result(PGresult* res)
+    {
+        if(!_db->_conn){
+            if(res)
+                PQclear(res);
+            throw pq_async::exception("connection is dead!");
+        }
+        if(PQresultStatus(res) != PGRES_COMMAND_OK)
+            throw _db->_result_error(res);
+        
+        PQclear(res);
+        _db->_conn->unset_prepared(_name);
+    }
+    
     database _db;
     std::string _name;
+    std::string _sql;
+    std::vector<data_type> _types;
     bool _auto_deallocate;
     connection_lock _lock;
 };
@@ -36,6 +36,10 @@ class data_reader_t
 {
     friend class database_t;
     friend class data_prepared_t;
+#if PQ_ASYNC_HAS_COROUTINES
+    friend class reader_awaitable;
+    friend class row_awaitable;
+#endif
     
     data_reader_t(connection_task ct)
         : _ct(ct), _table(), _closed(false)
@@ -159,6 +163,15 @@ public:
         };
     }
     
+#if PQ_ASYNC_HAS_COROUTINES
+    /*!
+     * \brief co_await-able next row, nullptr once the rows are exhausted.
+     * The rows received while the coroutine is not awaiting are queued,
+     * next_async and the callback next can't be mixed on a reader.
+     */
+    row_awaitable next_async();
+#endif
+    
     data_row next()
     {
         if(_closed)
@@ -263,6 +276,10 @@ private:
     connection_task _ct;
     data_table _table;
     bool _closed;
+#if PQ_ASYNC_HAS_COROUTINES
+    void _start_pull();
+    std::shared_ptr<reader_pull_t> _pull;
+#endif
 };
 
 } //namespace pq_async
@@ -0,0 +1,359 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_replication_h
+#define _libpq_async_data_replication_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include <map>
+
+namespace pq_async{
+
+#define PQ_ASYNC_REPLICATION_STATUS_INTERVAL_MS 10000
+
+class replication_relation_t;
+class replication_change_t;
+class replication_stream_t;
+typedef std::shared_ptr< const pq_async::replication_relation_t > replication_relation;
+typedef std::shared_ptr< pq_async::replication_change_t > replication_change;
+typedef std::shared_ptr< pq_async::replication_stream_t > replication_stream;
+
+/*!
+ * \brief kind of a replication stream event
+ */
+enum class replication_action
+{
+    begin = 0,
+    commit = 1,
+    insert = 2,
+    update = 3,
+    remove = 4,
+    truncate = 5,
+};
+
+/*!
+ * \brief a column of a replicated relation
+ */
+struct replication_column
+{
+    std::string name;
+    Oid type;
+    int32_t type_mod;
+    // part of the replica identity
+    bool key;
+};
+
+/*!
+ * \brief relation description sent by pgoutput before its first change
+ */
+class replication_relation_t
+{
+public:
+    uint32_t oid;
+    std::string nspname;
+    std::string relname;
+    char replica_identity;
+    std::vector<replication_column> columns;
+    
+    int32_t get_col_index(const std::string& name) const
+    {
+        for(size_t i = 0; i < columns.size(); ++i)
+            if(columns[i].name == name)
+                return (int32_t)i;
+        return -1;
+    }
+};
+
+/*!
+ * \brief a column value of a replicated tuple
+ */
+struct replication_value
+{
+    // 'n' null, 'u' unchanged toasted value, 't' text, 'b' binary
+    char kind;
+    std::string data;
+};
+
+/*!
+ * \brief a replicated row, the values are decoded with the
+ * library type converters.
+ */
+class replication_tuple
+{
+public:
+    replication_tuple(){}
+    replication_tuple(replication_relation rel): _rel(rel){}
+    
+    bool empty() const { return _values.empty();}
+    size_t size() const { return _values.size();}
+    
+    const replication_value& value(size_t i) const
+    {
+        if(i >= _values.size())
+            throw pq_async::exception("Index out of bound");
+        return _values[i];
+    }
+    
+    bool is_null(size_t i) const { return value(i).kind == 'n';}
+    /*!
+     * \brief returns true if the value is an unchanged toasted value
+     * which is not sent by the server
+     */
+    bool is_unchanged(size_t i) const { return value(i).kind == 'u';}
+    
+    template<typename T>
+    T as(size_t i) const
+    {
+        const replication_value& v = value(i);
+        if(v.kind == 'n' || v.kind == 'u')
+            return val_from_pgparam<T>(
+                _rel->columns[i].type, NULL, 0, PG_BIN_FORMAT
+            );
+        
+        return val_from_pgparam<T>(
+            _rel->columns[i].type, (char*)v.data.data(), (int)v.data.size(),
+            v.kind == 'b' ? PG_BIN_FORMAT : PG_TXT_FORMAT
+        );
+    }
+    
+    template<typename T>
+    T as(const std::string& col_name) const
+    {
+        int32_t idx = _rel->get_col_index(col_name);
+        if(idx == -1)
+            throw pq_async::exception(
+                "Column name \"" + col_name + "\" is not valid."
+            );
+        return as<T>((size_t)idx);
+    }
+    
+    std::vector<replication_value>& values(){ return _values;}
+    
+private:
+    replication_relation _rel;
+    std::vector<replication_value> _values;
+};
+
+/*!
+ * \brief a change event decoded from the replication stream
+ */
+class replication_change_t
+{
+public:
+    replication_action action;
+    // xid of the transaction
+    uint32_t xid;
+    // WAL position of the message
+    uint64_t lsn;
+    // begin: final commit LSN, commit: end of the transaction LSN
+    uint64_t end_lsn;
+    // commit timestamp, microseconds since 2000-01-01
+    int64_t commit_time;
+    
+    // insert, update, remove
+    replication_relation relation;
+    // the old values or the replica identity key, if sent by the server
+    replication_tuple old_tuple;
+    replication_tuple new_tuple;
+    
+    // truncate
+    std::vector<replication_relation> relations;
+};
+
+/*!
+ * \brief formats a LSN as %X/%X
+ */
+std::string lsn_to_str(uint64_t lsn);
+/*!
+ * \brief parses a %X/%X formatted LSN
+ */
+uint64_t str_to_lsn(const std::string& lsn);
+
+/*!
+ * \brief opens a replication stream connection,
+ * replication=database is added to the connection string
+ * 
+ * \param connection_string the connection string, the user must have
+ * the REPLICATION attribute
+ * \return replication_stream 
+ */
+replication_stream open_replication(
+    const std::string& connection_string,
+    md::log::logger log = nullptr
+);
+
+/*!
+ * \brief logical replication client consuming the pgoutput plugin.
+ * 
+ * The stream is read when its socket becomes readable, the decoded
+ * changes are delivered in order on the stream strand.
+ * The standby status updates are sent every status interval or when the
+ * server requests it, reporting the LSN confirmed by the consumer.
+ */
+class replication_stream_t
+    : public std::enable_shared_from_this<replication_stream_t>
+{
+    friend replication_stream open_replication(
+        const std::string& connection_string, md::log::logger log
+    );
+    
+    replication_stream_t(
+        md::event_strand<int> strand,
+        const std::string& connection_string,
+        md::log::logger log
+    );
+    
+public:
+    virtual ~replication_stream_t();
+    
+    /*!
+     * \brief synchronously creates a pgoutput logical replication slot
+     * 
+     * \param slot the slot name
+     * \param temporary if true the slot is dropped with the connection
+     * \return the LSN from which the slot is consistent
+     */
+    uint64_t create_slot(const std::string& slot, bool temporary = false);
+    
+    /*!
+     * \brief synchronously drops a replication slot
+     */
+    void drop_slot(const std::string& slot);
+    
+    /*!
+     * \brief synchronously starts streaming the changes of publications
+     * 
+     * \param slot the replication slot name
+     * \param publications comma separated publication names
+     * \param start_lsn the position to start from, 0 to resume from the
+     * slot confirmed position
+     * \param acb void(const md::callback::cb_error&, replication_change)
+     * callback, called on the stream strand
+     * \param binary request the binary values, ignored by the servers
+     * older than PostgreSQL 14 which send them as text, see
+     * replication_value::kind
+     */
+    template<
+        typename CB,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, replication_change)
+    >
+    void start(
+        const std::string& slot, const std::string& publications,
+        uint64_t start_lsn, const CB& acb, bool binary = true)
+    {
+        md::callback::value_cb<replication_change> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<replication_change>,
+            replication_change
+        >(
+            cb, acb
+        );
+        _start(slot, publications, start_lsn, binary, cb);
+    }
+    
+    /*!
+     * \brief stops streaming and close the connection
+     */
+    void stop();
+    
+    bool streaming() const { return _ev != nullptr;}
+    
+    /*!
+     * \brief report lsn as flushed by the consumer, the server can then
+     * recycle the WAL up to that position
+     */
+    void confirm(uint64_t lsn);
+    
+    /*!
+     * \brief if enabled, the default, each commit end LSN is confirmed
+     * once its callback returned
+     */
+    void auto_confirm(bool enabled){ _auto_confirm = enabled;}
+    bool auto_confirm() const { return _auto_confirm;}
+    
+    /*!
+     * \brief set the standby status update interval in milliseconds
+     */
+    void status_interval(int32_t ms){ _status_interval_ms = ms;}
+    
+    uint64_t received_lsn() const { return _received_lsn.load();}
+    uint64_t confirmed_lsn() const { return _confirmed_lsn.load();}
+    
+    /*!
+     * \brief read the stream and queue the decoded changes,
+     * called when the socket becomes readable.
+     * 
+     * \return the number of changes queued
+     */
+    int poll();
+    
+    /*!
+     * \brief send a standby status update now
+     */
+    void send_status(bool reply_requested = false);
+    
+private:
+    void _connect();
+    void _start(
+        const std::string& slot, const std::string& publications,
+        uint64_t start_lsn, bool binary,
+        const md::callback::value_cb<replication_change>& cb
+    );
+    void _close();
+    void _fail(const std::string& err_msg);
+    void _queue(replication_change change);
+    
+    replication_change _parse_message(
+        uint64_t lsn, const char* data, size_t len
+    );
+    void _parse_relation(const char*& p, const char* end);
+    void _parse_tuple(
+        replication_tuple& tuple, const char*& p, const char* end
+    );
+    replication_relation _get_relation(uint32_t oid) const;
+    
+    md::event_strand<int> _strand;
+    std::string _connection_string;
+    md::log::logger _log;
+    
+    mutable std::recursive_mutex _mutex;
+    PGconn* _conn;
+    event* _ev;
+    event* _status_ev;
+    md::callback::value_cb<replication_change> _cb;
+    std::map<uint32_t, replication_relation> _relations;
+    
+    // current transaction
+    uint32_t _xid;
+    
+    bool _auto_confirm;
+    int32_t _status_interval_ms;
+    std::atomic<uint64_t> _received_lsn;
+    std::atomic<uint64_t> _confirmed_lsn;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_replication_h
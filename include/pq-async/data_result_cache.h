@@ -0,0 +1,254 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_result_cache_h
+#define _libpq_async_data_result_cache_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "data_table.h"
+#include "data_listener.h"
+
+#include <list>
+#include <unordered_map>
+
+namespace pq_async{
+
+#define PQ_ASYNC_RESULT_CACHE_DEFAULT_TTL_MS 60000
+
+class result_cache_t;
+class lru_result_cache_t;
+typedef std::shared_ptr< pq_async::result_cache_t > result_cache;
+
+/*!
+ * \brief result cache counters
+ */
+struct result_cache_stats
+{
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t expirations;
+    int64_t invalidations;
+    size_t entries;
+    size_t bytes;
+    
+    /*!
+     * \brief ratio of the lookups served from the cache, 0 to 1
+     */
+    double hit_rate() const
+    {
+        int64_t total = hits + misses;
+        return total == 0 ? 0.0 : (double)hits / (double)total;
+    }
+};
+
+/*!
+ * \brief creates a new byte bounded LRU result cache
+ * 
+ * \param max_bytes the estimated size the cached tables must not exceed
+ * \param default_ttl_ms time to live of the entries in milliseconds
+ * \return result_cache 
+ */
+result_cache open_result_cache(
+    size_t max_bytes,
+    int32_t default_ttl_ms = PQ_ASYNC_RESULT_CACHE_DEFAULT_TTL_MS,
+    md::log::logger log = nullptr
+);
+
+/*!
+ * \brief query result cache interface, see database_t::result_cache.
+ * 
+ * The cached data_table instances are shared by every caller and
+ * must be treated as read only.
+ * The entries can be tagged and invalidated by tag, either directly or by
+ * NOTIFY on a channel the cache listens on, the notification payload
+ * being the tag to invalidate, an empty payload clearing the whole cache.
+ */
+class result_cache_t
+    : public std::enable_shared_from_this<result_cache_t>
+{
+public:
+    result_cache_t(md::log::logger log);
+    virtual ~result_cache_t();
+    
+    /*!
+     * \brief builds the cache key of a query from the connection string,
+     * the SQL text and the serialized parameters.
+     */
+    static std::string make_key(
+        const std::string& connection_string,
+        const char* sql, const parameters_t& p
+    );
+    
+    /*!
+     * \brief estimated memory used by a data_table in bytes
+     */
+    static size_t table_size(const data_table& tbl);
+    
+    /*!
+     * \brief returns the cached table or an empty data_table if the key
+     * is not cached or expired.
+     */
+    virtual data_table get(const std::string& key) = 0;
+    
+    /*!
+     * \brief the invalidation generation of a set of tags, it changes
+     * each time one of the tags is invalidated or the cache is cleared.
+     * It is taken when a query is issued and given back to put.
+     */
+    virtual uint64_t generation(const std::vector<std::string>& tags) const = 0;
+    
+    /*!
+     * \brief add or replace a cache entry, the table is dropped if one of
+     * its tags was invalidated since the query was issued
+     * 
+     * \param key the entry key, see make_key
+     * \param tbl the table to cache, it must not be modified afterward
+     * \param tags tags used to invalidate the entry
+     * \param generation the generation of the tags when the query
+     * was issued
+     */
+    virtual void put(
+        const std::string& key, data_table tbl,
+        const std::vector<std::string>& tags, uint64_t generation
+    ) = 0;
+    
+    /*!
+     * \brief remove all the entries having the tag
+     */
+    virtual void invalidate(const std::string& tag) = 0;
+    
+    /*!
+     * \brief remove all the entries
+     */
+    virtual void clear() = 0;
+    
+    virtual result_cache_stats stats() const = 0;
+    
+    /*!
+     * \brief start listening on a dedicated connection for the tag
+     * invalidation notifications sent on channel, see
+     * notification_listener_t.
+     * The notifications are processed by the default event_queue.
+     * 
+     * \param connection_string the connection string of the listening session
+     * \param channel the channel name
+     */
+    void listen(
+        const std::string& connection_string, const std::string& channel
+    );
+    
+    /*!
+     * \brief stop listening and close the dedicated connection
+     */
+    void unlisten();
+    
+    /*!
+     * \brief read the listening connection, returns the number of
+     * notifications queued for processing
+     */
+    int poll();
+    
+protected:
+    md::log::logger _log;
+    
+private:
+    void _process(
+        const md::callback::cb_error& err, const notifications& batch
+    );
+    
+    std::mutex _listen_mutex;
+    notification_listener _listener;
+};
+
+/*!
+ * \brief default result_cache_t implementation, a byte bounded LRU
+ * with per entry expiration.
+ */
+class lru_result_cache_t
+    : public result_cache_t
+{
+    friend result_cache open_result_cache(
+        size_t max_bytes, int32_t default_ttl_ms, md::log::logger log
+    );
+    
+    typedef std::chrono::steady_clock::time_point time_point;
+    
+    struct entry_t
+    {
+        std::string key;
+        data_table tbl;
+        std::vector<std::string> tags;
+        size_t bytes;
+        time_point expires;
+    };
+    
+    lru_result_cache_t(
+        size_t max_bytes, int32_t default_ttl_ms, md::log::logger log
+    );
+    
+public:
+    virtual ~lru_result_cache_t();
+    
+    size_t max_bytes() const { return _max_bytes;}
+    int32_t default_ttl() const { return _ttl_ms;}
+    
+    data_table get(const std::string& key) override;
+    uint64_t generation(const std::vector<std::string>& tags) const override;
+    void put(
+        const std::string& key, data_table tbl,
+        const std::vector<std::string>& tags, uint64_t generation
+    ) override;
+    void invalidate(const std::string& tag) override;
+    void clear() override;
+    result_cache_stats stats() const override;
+    
+private:
+    void _erase(std::list<entry_t>::iterator it);
+    uint64_t _generation(const std::vector<std::string>& tags) const;
+    
+    size_t _max_bytes;
+    int32_t _ttl_ms;
+    
+    mutable std::mutex _mutex;
+    // most recently used first
+    std::list<entry_t> _lru;
+    std::unordered_map<std::string, std::list<entry_t>::iterator> _index;
+    size_t _bytes;
+    // invalidation count of each tag and clear count, only growing so
+    // their sum changes whenever one of them does
+    std::unordered_map<std::string, uint64_t> _tag_generations;
+    uint64_t _clear_generation;
+    
+    int64_t _hits;
+    int64_t _misses;
+    int64_t _evictions;
+    int64_t _expirations;
+    int64_t _invalidations;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_result_cache_h
@@ -0,0 +1,411 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_sharded_h
+#define _libpq_async_data_sharded_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "data_connection_pool.h"
+#include "database.h"
+
+namespace pq_async{
+
+#define PQ_ASYNC_SHARD_VIRTUAL_NODES 128
+
+class sharded_database_t;
+typedef std::shared_ptr< pq_async::sharded_database_t > sharded_database;
+
+/*!
+ * \brief returns the shard key hash of the query parameters,
+ * the default extractor hash the serialized value of the first parameter.
+ */
+typedef std::function<uint64_t(parameters_t& p)> shard_key_extractor;
+
+/*!
+ * \brief strict weak ordering of two rows, used by the sorted merge
+ */
+typedef std::function<bool(const data_row& a, const data_row& b)> row_compare;
+
+/*!
+ * \brief 64 bits FNV-1a hash used to place keys and shards on the ring
+ */
+uint64_t shard_hash(const char* data, size_t len, uint64_t seed = 0);
+
+/*!
+ * \brief hash a value the same way it would be hashed when passed
+ * as the first query parameter
+ */
+template<typename T>
+uint64_t shard_key_hash(const T& key)
+{
+    std::unique_ptr<parameter> p(pq_async::new_parameter(key));
+    return shard_hash(p->get_value(), (size_t)p->get_length());
+}
+inline uint64_t shard_key_hash(const char* key)
+{
+    std::unique_ptr<parameter> p(pq_async::new_parameter(key));
+    return shard_hash(p->get_value(), (size_t)p->get_length());
+}
+
+/*!
+ * \brief creates a row_compare ordering the rows by the value of a column
+ *
+ * \tparam T the column value type
+ * \param col_name the column name, must be present in every shard result
+ * \param descending true to reverse the ordering
+ * \return row_compare
+ */
+template<typename T>
+row_compare order_by_column(const std::string& col_name, bool descending = false)
+{
+    return [col_name, descending](
+        const data_row& a, const data_row& b
+    )-> bool {
+        bool a_null = a->is_null(col_name.c_str());
+        bool b_null = b->is_null(col_name.c_str());
+        // nulls last, same as the PostgreSQL default for ascending order
+        if(a_null || b_null)
+            return descending ? (a_null && !b_null) : (!a_null && b_null);
+
+        T av = a->template as<T>(col_name.c_str());
+        T bv = b->template as<T>(col_name.c_str());
+        return descending ? bv < av : av < bv;
+    };
+}
+
+/*!
+ * \brief creates a new sharded_database_t instance
+ *
+ * \param shard_connection_strings connection strings of the shards,
+ * the shard names default to their position in that list
+ * \param extractor shard key extractor, nullptr for the default one
+ * \param log the logger used by the database_t instances
+ * \return sharded_database
+ */
+sharded_database open_sharded(
+    const std::vector<std::string>& shard_connection_strings,
+    shard_key_extractor extractor = nullptr,
+    md::log::logger log = nullptr
+);
+
+
+#define _PQ_ASYNC_SHARD_BODY_PARAMS(__fn) \
+    parameters_t p; \
+    p.push_back<sizeof...(PARAMS) -1>(args...); \
+    this->open(this->_key_of(p))->__fn(sql, p, md::get_last(args...));
+
+#define _PQ_ASYNC_SHARD_BODY_SYNC(__fn) \
+    parameters_t p(args...); \
+    return this->open(this->_key_of(p))->__fn(sql, p);
+
+/*!
+ * \brief client side sharding, keys are distributed between the shards
+ * with a consistent hash ring so that adding or removing a shard only
+ * moves the keys of its neighbours.
+ *
+ * Each shard keeps its own connection pool, keyed by its connection string,
+ * a new database_t is opened on the selected shard for each call.
+ */
+class sharded_database_t
+    : public std::enable_shared_from_this<sharded_database_t>
+{
+    friend sharded_database open_sharded(
+        const std::vector<std::string>& shard_connection_strings,
+        shard_key_extractor extractor,
+        md::log::logger log
+    );
+
+    sharded_database_t(shard_key_extractor extractor, md::log::logger log);
+
+    struct shard_t
+    {
+        std::string name;
+        std::string connection_string;
+        uint32_t weight;
+    };
+
+    struct scatter_state_t
+    {
+        std::mutex mutex;
+        std::vector<data_table> results;
+        size_t remaining;
+        md::callback::cb_error err;
+    };
+
+public:
+
+    /*!
+     * \brief adds a shard to the ring
+     *
+     * \param name stable shard name, used to place its virtual nodes
+     * \param connection_string the shard connection string
+     * \param weight relative capacity of the shard
+     */
+    void add_shard(
+        const std::string& name, const std::string& connection_string,
+        uint32_t weight = 1);
+
+    /*!
+     * \brief removes a shard from the ring, its keys move to the next shard
+     */
+    void remove_shard(const std::string& name);
+
+    size_t shard_count() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _shards.size();
+    }
+
+    std::vector<std::string> shard_names() const;
+
+    /*!
+     * \brief returns the connection string of the shard owning a key hash
+     */
+    std::string locate(uint64_t key_hash) const;
+
+    /*!
+     * \brief creates a new database_t instance bound to the shard
+     * owning the key hash
+     */
+    database open(uint64_t key_hash)
+    {
+        return pq_async::open(this->locate(key_hash), _log);
+    }
+
+    /*!
+     * \brief creates a new database_t instance bound to the shard
+     * owning the key, should be used for transactions
+     *
+     * \param key the shard key
+     */
+    template<typename T>
+    database shard(const T& key)
+    {
+        return this->open(shard_key_hash(key));
+    }
+
+
+    /*!
+     * \brief asynchronously process a query on the shard selected by
+     * the key extractor and returns the number of rows affected
+     *
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is the query callback
+     * pq_async::value_cb<int>
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(int)>
+    void execute(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_PARAMS(execute);
+    }
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(int)>
+    int32_t execute(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_SYNC(execute);
+    }
+
+    /*!
+     * \brief asynchronously process a query on the shard selected by
+     * the key extractor and returns a pq_async::data_table_t as the result
+     *
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is
+     * the completion void(const md::callback::cb_error&, data_table) callback
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_table)>
+    void query(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_PARAMS(query);
+    }
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_table)>
+    data_table query(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_SYNC(query);
+    }
+
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_row)>
+    void query_single(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_PARAMS(query_single);
+    }
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_row)>
+    data_row query_single(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_SYNC(query_single);
+    }
+
+    template<typename R, typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(R)>
+    void query_value(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_PARAMS(template query_value<R>);
+    }
+    template<typename R, typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(R)>
+    R query_value(const char* sql, const PARAMS&... args)
+    {
+        _PQ_ASYNC_SHARD_BODY_SYNC(template query_value<R>);
+    }
+
+    /*!
+     * \brief creates a prepared statement on the shard owning the key,
+     * the statement can only be executed on that shard
+     *
+     * \param key the shard key
+     * \param name the prepared statement name
+     * \param sql the prepared statement query
+     * \param args prepare arguments, see database_t::prepare
+     */
+    template<typename K, typename... PARAMS>
+    decltype(auto) prepare(
+        const K& key, const char* name, const char* sql,
+        const PARAMS&... args)
+    {
+        return this->shard(key)->prepare(name, sql, args...);
+    }
+
+
+    /*!
+     * \brief asynchronously process a query on every shard concurrently
+     * and returns the concatenation of the results, in shard order
+     *
+     * \param sql the SQL query to process
+     * \param args query parameters, the last parameter is
+     * the completion void(const md::callback::cb_error&, data_table) callback
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_table)>
+    void query_all(const char* sql, const PARAMS&... args)
+    {
+        parameters_t p;
+        p.push_back<sizeof...(PARAMS) -1>(args...);
+        md::callback::value_cb<data_table> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<data_table>, data_table
+        >(cb, md::get_last(args...));
+        this->_scatter(sql, p, nullptr, cb);
+    }
+    /*!
+     * \brief synchronously process a query on every shard concurrently
+     * and returns the concatenation of the results, in shard order
+     *
+     * \param sql the SQL query to process
+     * \param args query parameters
+     * \return data_table
+     */
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_table)>
+    data_table query_all(const char* sql, const PARAMS&... args)
+    {
+        parameters_t p(args...);
+        return this->_scatter_sync(sql, p, nullptr);
+    }
+    data_table query_all(const char* sql)
+    {
+        parameters_t p;
+        return this->_scatter_sync(sql, p, nullptr);
+    }
+
+    /*!
+     * \brief asynchronously process a query on every shard concurrently
+     * and k-way merge the results, each shard result must already be
+     * sorted with the same ordering as the comparator.
+     *
+     * \param order row comparator, see order_by_column
+     * \param sql the SQL query to process, should have a matching ORDER BY
+     * \param args query parameters, the last parameter is
+     * the completion void(const md::callback::cb_error&, data_table) callback
+     */
+    template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_table)>
+    void query_all_sorted(
+        const row_compare& order, const char* sql, const PARAMS&... args)
+    {
+        parameters_t p;
+        p.push_back<sizeof...(PARAMS) -1>(args...);
+        md::callback::value_cb<data_table> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<data_table>, data_table
+        >(cb, md::get_last(args...));
+        this->_scatter(sql, p, order, cb);
+    }
+    template<typename... PARAMS, PQ_ASYNC_INVALID_DB_CALLBACK(data_table)>
+    data_table query_all_sorted(
+        const row_compare& order, const char* sql, const PARAMS&... args)
+    {
+        parameters_t p(args...);
+        return this->_scatter_sync(sql, p, order);
+    }
+    data_table query_all_sorted(const row_compare& order, const char* sql)
+    {
+        parameters_t p;
+        return this->_scatter_sync(sql, p, order);
+    }
+
+    /*!
+     * \brief merge shard results, concatenated when order is null
+     * otherwise k-way merged
+     */
+    static data_table merge(
+        const std::vector<data_table>& results, const row_compare& order);
+
+private:
+    uint64_t _key_of(parameters_t& p) const
+    {
+        if(_extractor)
+            return _extractor(p);
+        if(p.size() == 0)
+            throw pq_async::exception(
+                "No parameter available to extract the shard key!"
+            );
+        const parameter* k = p.get_parameter(0);
+        return shard_hash(k->get_value(), (size_t)k->get_length());
+    }
+
+    void _build_ring();
+
+    /*!
+     * \brief opens a database_t on every shard, each with its own strand
+     */
+    std::vector<database> _open_shards();
+    void _scatter(
+        const char* sql, const parameters_t& p, row_compare order,
+        md::callback::value_cb<data_table> cb);
+    void _scatter_on(
+        const std::vector<database>& dbs,
+        const char* sql, const parameters_t& p, row_compare order,
+        md::callback::value_cb<data_table> cb);
+    data_table _scatter_sync(
+        const char* sql, const parameters_t& p, const row_compare& order);
+
+    mutable std::mutex _mutex;
+    std::vector<shard_t> _shards;
+    std::vector< std::pair<uint64_t, size_t> > _ring;
+    shard_key_extractor _extractor;
+    md::log::logger _log;
+};
+
+#undef _PQ_ASYNC_SHARD_BODY_PARAMS
+#undef _PQ_ASYNC_SHARD_BODY_SYNC
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_sharded_h
@@ -0,0 +1,129 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_single_flight_h
+#define _libpq_async_data_single_flight_h
+
+#include "data_common.h"
+
+#include <map>
+#include <typeinfo>
+
+namespace pq_async{
+
+/*!
+ * \brief builds the key identifying a coalescable query, the connection
+ * string, the result type, the SQL text and the serialized parameters.
+ */
+std::string single_flight_key(
+    const char* result_type, const std::string& connection_string,
+    const char* sql, const parameters_t& p
+);
+
+/*!
+ * \brief registry of the in flight coalesced queries returning R.
+ * 
+ * The first caller of a key is the leader and executes the query, the
+ * callers joining while it is in flight are queued and receive the
+ * leader's result once it completes.
+ */
+template<typename R>
+class single_flight_group
+{
+public:
+    static single_flight_group<R>& instance()
+    {
+        static single_flight_group<R> s_instance;
+        return s_instance;
+    }
+    
+    /*!
+     * \brief join the in flight query identified by key
+     * 
+     * \param key the query key, see single_flight_key
+     * \param cb the callback to queue if a query is already in flight
+     * \return true if the caller is the leader and must execute the query
+     */
+    bool join(const std::string& key, const md::callback::value_cb<R>& cb)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _calls.find(key);
+        if(it == _calls.end()){
+            _calls[key];
+            return true;
+        }
+        
+        it->second.emplace_back(cb);
+        ++_coalesced;
+        return false;
+    }
+    
+    /*!
+     * \brief complete the in flight query identified by key and
+     * forward its result to the queued callers
+     */
+    void complete(
+        const std::string& key, const md::callback::cb_error& err,
+        const R& value)
+    {
+        std::vector< md::callback::value_cb<R> > waiters;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _calls.find(key);
+            if(it == _calls.end())
+                return;
+            waiters.swap(it->second);
+            _calls.erase(it);
+        }
+        
+        for(auto& cb : waiters)
+            cb(err, value);
+    }
+    
+    /*!
+     * \brief number of queries currently in flight
+     */
+    size_t in_flight() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _calls.size();
+    }
+    
+    /*!
+     * \brief number of calls served by another caller's execution
+     */
+    int64_t coalesced() const { return _coalesced.load();}
+    
+private:
+    single_flight_group(): _coalesced(0){}
+    single_flight_group(const single_flight_group&) = delete;
+    single_flight_group& operator=(const single_flight_group&) = delete;
+    
+    mutable std::mutex _mutex;
+    std::map< std::string, std::vector< md::callback::value_cb<R> > > _calls;
+    std::atomic<int64_t> _coalesced;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_single_flight_h
@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_slow_log_h
+#define _libpq_async_data_slow_log_h
+
+#include "data_parameters.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*!
+ * \brief milliseconds the slow query writer sleeps when its ring is empty
+ */
+#define PQ_ASYNC_SLOW_LOG_IDLE_MS 20
+
+namespace pq_async{
+
+class database_t;
+
+/*!
+ * \brief settings of a slow query log
+ */
+struct slow_query_options
+{
+    /*! statements taking at least that long are logged, a database_t
+     * can override it with database_t::slow_query_threshold */
+    int64_t threshold_ms = 500;
+    /*! the parameters of one slow statement every sample_every are
+     * captured, 0 never captures them */
+    uint32_t sample_every = 1;
+    /*! the sql text and each parameter value are truncated to it */
+    size_t max_text_length = 2048;
+    /*! entries kept in the ring, rounded up to a power of two.
+     * The entries beyond are dropped instead of blocking the caller */
+    size_t capacity = 4096;
+};
+
+/*!
+ * \brief a slow statement, captured on the event loop thread and
+ * formatted by the writer thread
+ */
+struct slow_query_entry
+{
+    /*! system clock time of the completion in nanoseconds */
+    int64_t time_ns;
+    int64_t latency_ns;
+    uint64_t rows;
+    bool failed;
+    std::string sql;
+    /*! true if the parameters were captured */
+    bool sampled;
+    parameters_t params;
+};
+
+/*!
+ * \brief receives the formatted lines on the writer thread
+ */
+typedef std::function<void(const std::string& line)> slow_query_writer;
+
+class slow_query_log_t;
+typedef std::shared_ptr< pq_async::slow_query_log_t > slow_query_log;
+
+/*!
+ * \brief slow query log, the entries go through a bounded lock free ring
+ * and are formatted and written by a background thread so the logging
+ * never blocks the event loop.
+ * 
+ * \code{.cpp}
+ * pq_async::slow_query_options opts;
+ * opts.threshold_ms = 200;
+ * opts.sample_every = 10;
+ * pq_async::set_slow_query_log(
+ *     pq_async::open_slow_query_log("/var/log/app/slow.log", opts)
+ * );
+ * \endcode
+ */
+class slow_query_log_t
+{
+    friend slow_query_log open_slow_query_log(
+        slow_query_writer writer, const slow_query_options& opts
+    );
+    
+    struct slot_t
+    {
+        std::atomic<size_t> seq;
+        slow_query_entry entry;
+    };
+    
+    slow_query_log_t(slow_query_writer writer, const slow_query_options& opts);
+    
+public:
+    /*!
+     * \brief writes the pending entries and stops the writer thread
+     */
+    ~slow_query_log_t();
+    
+    const slow_query_options& options() const { return _opts;}
+    
+    /*!
+     * \brief captures a completed statement if it is slower than the
+     * threshold of db, or of the log when db has none
+     */
+    void record(
+        const database_t* db, const std::string& sql, const parameters_t& p,
+        bool failed, uint64_t rows, int64_t latency_ns
+    );
+    
+    /*!
+     * \brief queues an entry without blocking,
+     * returns false and drops it if the ring is full
+     */
+    bool push(slow_query_entry&& entry);
+    
+    /*!
+     * \brief waits until the entries queued before the call are written
+     */
+    void flush();
+    
+    /*!
+     * \brief number of lines written
+     */
+    uint64_t written() const { return _written.load();}
+    
+    /*!
+     * \brief number of entries dropped because the ring was full
+     */
+    uint64_t dropped() const { return _dropped.load();}
+    
+    /*!
+     * \brief formats an entry in a single line, the parameters are decoded
+     * to text
+     */
+    static std::string format(
+        const slow_query_entry& entry, size_t max_text_length = 2048
+    );
+    
+private:
+    bool _pop(slow_query_entry& entry);
+    bool _drain();
+    void _run();
+    
+    slow_query_writer _writer;
+    slow_query_options _opts;
+    
+    std::unique_ptr<slot_t[]> _slots;
+    size_t _mask;
+    std::atomic<size_t> _enqueue_pos;
+    size_t _dequeue_pos;
+    
+    std::atomic<uint64_t> _slow_count;
+    std::atomic<uint64_t> _pushed;
+    std::atomic<uint64_t> _processed;
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _dropped;
+    
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop;
+    std::thread _thread;
+};
+
+/*!
+ * \brief creates a slow query log writing its lines to writer,
+ * it is not installed
+ */
+slow_query_log open_slow_query_log(
+    slow_query_writer writer,
+    const slow_query_options& opts = slow_query_options()
+);
+
+/*!
+ * \brief creates a slow query log appending its lines to a file,
+ * throws a pq_async::exception if the file can't be opened
+ */
+slow_query_log open_slow_query_log(
+    const std::string& path,
+    const slow_query_options& opts = slow_query_options()
+);
+
+inline std::atomic<bool>& _slow_query_log_flag()
+{
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/*!
+ * \brief true when a slow query log is installed, the hooks cost one
+ * relaxed load otherwise
+ */
+inline bool slow_query_log_enabled()
+{
+    return _slow_query_log_flag().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief installs the slow query log of every database_t,
+ * nullptr disables it
+ */
+void set_slow_query_log(slow_query_log log);
+
+/*!
+ * \brief the installed slow query log or nullptr
+ */
+slow_query_log default_slow_query_log();
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_slow_log_h
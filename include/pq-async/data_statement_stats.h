@@ -0,0 +1,147 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_statement_stats_h
+#define _libpq_async_data_statement_stats_h
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief maximum number of distinct statements tracked, the calls of the
+ * statements beyond it are only counted by statement_stats_dropped
+ */
+#define PQ_ASYNC_STATEMENT_STATS_CAPACITY 4096
+
+/*!
+ * \brief number of latency buckets, bucket i counts the calls that took
+ * less than 2^i microseconds, the last one counts the slower calls
+ */
+#define PQ_ASYNC_STATEMENT_STATS_BUCKETS 32
+
+namespace pq_async{
+
+/*!
+ * \brief appends the normalized form of sql to out, the literals are
+ * replaced by '?', the comments are removed, the whitespaces are folded
+ * and the unquoted text is lower cased.
+ * 
+ * "SELECT *  FROM t WHERE id = 42 -- x" gives "select * from t where id = ?"
+ */
+void normalize_sql(const char* sql, std::string& out);
+
+/*!
+ * \brief returns the normalized form of sql
+ */
+std::string normalize_sql(const char* sql);
+
+/*!
+ * \brief returns the hash of the normalized form of sql, never 0
+ */
+uint64_t sql_fingerprint(const char* sql);
+
+/*!
+ * \brief the counters of one normalized statement
+ */
+struct statement_stat
+{
+    uint64_t fingerprint;
+    /*! normalized sql text */
+    std::string sql;
+    uint64_t calls;
+    uint64_t errors;
+    /*! rows returned */
+    uint64_t rows;
+    /*! bytes of the returned values */
+    uint64_t bytes;
+    /*! sum of the latencies, from the connection request to the end of
+     * the completion callback */
+    uint64_t total_ns;
+    uint64_t max_ns;
+    std::array<uint64_t, PQ_ASYNC_STATEMENT_STATS_BUCKETS> histogram;
+    
+    double mean_ns() const
+    {
+        return calls ? (double)total_ns / (double)calls : 0;
+    }
+    
+    /*!
+     * \brief upper bound of the bucket holding the p percentile,
+     * p is between 0 and 1
+     */
+    uint64_t percentile_ns(double p) const;
+};
+
+inline std::atomic<bool>& _statement_stats_flag()
+{
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/*!
+ * \brief true when the statistics are collected, the hooks cost one
+ * relaxed load otherwise
+ */
+inline bool statement_stats_enabled()
+{
+    return _statement_stats_flag().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief starts or stops the collection, the counters are kept
+ */
+void enable_statement_stats(bool enabled);
+
+/*!
+ * \brief adds one call of sql to its statement counters,
+ * the counters are updated without lock
+ */
+void statement_stats_record(
+    const char* sql, bool error, uint64_t rows, uint64_t bytes,
+    int64_t latency_ns
+);
+
+/*!
+ * \brief the statements called since the last reset,
+ * the counters of a statement are read one by one and may be slightly
+ * out of sync with each other while queries run
+ */
+std::vector<statement_stat> statement_stats_snapshot();
+
+/*!
+ * \brief zeroes the counters
+ */
+void statement_stats_reset();
+
+/*!
+ * \brief number of calls not recorded because the table was full
+ */
+uint64_t statement_stats_dropped();
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_statement_stats_h
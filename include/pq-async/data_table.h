@@ -45,6 +45,7 @@ class data_table_t
     : public std::vector<data_row>
 {
     friend class data_reader_t;
+    friend class sharded_database_t;
 public:
     data_table_t();
 
@@ -0,0 +1,200 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_trace_h
+#define _libpq_async_data_trace_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief default number of events kept by a ring_trace_sink_t,
+ * rounded up to a power of two
+ */
+#define PQ_ASYNC_TRACE_RING_CAPACITY 65536
+
+namespace pq_async{
+
+/*!
+ * \brief the phases of a query lifecycle
+ */
+enum class trace_phase
+{
+    /*! waiting for a connection of the pool */
+    pool_wait = 0,
+    /*! opening the physical connection */
+    connect = 1,
+    /*! queued on the strand before being sent */
+    queue = 2,
+    /*! sending the statement to the server */
+    send = 3,
+    /*! from the end of the send to the complete result */
+    execute = 4,
+    /*! result decoding and completion callback */
+    process = 5,
+};
+
+/*!
+ * \brief returns the name of a trace phase
+ */
+const char* trace_phase_name(trace_phase phase);
+
+/*!
+ * \brief one phase of one query, the times are monotonic nanoseconds
+ */
+struct trace_event
+{
+    uint64_t query_id;
+    trace_phase phase;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+class trace_sink_t;
+typedef std::shared_ptr< pq_async::trace_sink_t > trace_sink;
+
+/*!
+ * \brief receives the trace events, record is called from the threads
+ * running the queries and must be thread safe
+ */
+class trace_sink_t
+{
+public:
+    virtual ~trace_sink_t(){}
+    virtual void record(const trace_event& ev) = 0;
+};
+
+inline std::atomic<bool>& _trace_flag()
+{
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/*!
+ * \brief true when a trace sink is installed, the hooks cost one relaxed
+ * load otherwise
+ */
+inline bool trace_enabled()
+{
+    return _trace_flag().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief monotonic time in nanoseconds
+ */
+inline int64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/*!
+ * \brief installs the sink receiving the events of the queries started
+ * from now on, nullptr disables the tracing
+ */
+void set_trace_sink(trace_sink sink);
+
+/*!
+ * \brief the installed sink or nullptr
+ */
+trace_sink default_trace_sink();
+
+/*!
+ * \brief returns a new query id
+ */
+uint64_t trace_next_id();
+
+/*!
+ * \brief sends an event to the installed sink
+ */
+void trace_record(
+    uint64_t query_id, trace_phase phase, int64_t begin_ns, int64_t end_ns
+);
+
+
+class ring_trace_sink_t;
+typedef std::shared_ptr< pq_async::ring_trace_sink_t > ring_trace_sink;
+
+/*!
+ * \brief lock free ring of the last trace events, the oldest ones are
+ * overwritten. The events can be dumped in the Chrome trace JSON format,
+ * loadable in chrome://tracing or Perfetto, one row per query.
+ * 
+ * \code{.cpp}
+ * auto ring = pq_async::open_ring_trace_sink();
+ * pq_async::set_trace_sink(ring);
+ * // ...
+ * ring->dump_chrome_trace("/tmp/pq_async.trace.json");
+ * \endcode
+ */
+class ring_trace_sink_t
+    : public trace_sink_t
+{
+    friend ring_trace_sink open_ring_trace_sink(size_t capacity);
+    
+    struct slot_t
+    {
+        std::atomic<uint64_t> seq;
+        trace_event ev;
+    };
+    
+    ring_trace_sink_t(size_t capacity);
+    
+public:
+    void record(const trace_event& ev) override;
+    
+    /*!
+     * \brief the events currently in the ring, oldest first
+     */
+    std::vector<trace_event> snapshot() const;
+    
+    /*!
+     * \brief writes the events in the Chrome trace JSON format,
+     * throws a pq_async::exception if the file can't be written
+     */
+    void dump_chrome_trace(const std::string& path) const;
+    
+    size_t capacity() const { return _mask +1;}
+    
+private:
+    std::unique_ptr<slot_t[]> _slots;
+    size_t _mask;
+    std::atomic<uint64_t> _head;
+};
+
+/*!
+ * \brief creates a ring sink, it is not installed
+ */
+ring_trace_sink open_ring_trace_sink(
+    size_t capacity = PQ_ASYNC_TRACE_RING_CAPACITY
+);
+
+} //namespace pq_async
+
+#endif //_libpq_async_data_trace_h
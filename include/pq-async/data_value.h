@@ -55,6 +55,11 @@ public:
     
     bool is_null(){ return _value == NULL;}
     
+    /*!
+     * \brief length in bytes of the serialized value
+     */
+    int length() const { return _length;}
+    
     template < typename T >
     T as()
     {
@@ -0,0 +1,254 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_data_write_buffer_h
+#define _libpq_async_data_write_buffer_h
+
+#include "data_common.h"
+#include "log.h"
+
+#include "database.h"
+
+#include <deque>
+
+namespace pq_async{
+
+#define PQ_ASYNC_WRITE_BUFFER_MAX_ROWS 10000
+#define PQ_ASYNC_WRITE_BUFFER_MAX_BYTES 4194304
+#define PQ_ASYNC_WRITE_BUFFER_MAX_DELAY_MS 200
+#define PQ_ASYNC_WRITE_BUFFER_MAX_PENDING_BYTES 67108864
+// the bind message parameter count is a uint16
+#define PQ_ASYNC_MAX_STATEMENT_PARAMETERS 65535
+
+class write_buffer_t;
+typedef std::shared_ptr< pq_async::write_buffer_t > write_buffer;
+
+/*!
+ * \brief called once per flushed batch with the number of rows it held,
+ * the rows of a failed batch are not retried
+ */
+typedef std::function<
+    void(const md::callback::cb_error&, size_t)
+> write_flush_cb;
+
+/*!
+ * \brief write buffer counters
+ */
+struct write_buffer_stats
+{
+    int64_t rows_added;
+    int64_t rows_written;
+    int64_t rows_failed;
+    int64_t flushes;
+    int64_t rejected;
+    size_t buffered_rows;
+    size_t pending_bytes;
+};
+
+/*!
+ * \brief creates a new write_buffer_t instance
+ * 
+ * \param connection_string the database connection string
+ * \param table the destination table, quoted by quote_table
+ * \param columns the destination columns, in the rows values order,
+ * quoted by quote_ident
+ * \param max_rows the number of buffered rows triggering a flush
+ * \param max_bytes the buffered bytes triggering a flush
+ * \param max_delay_ms the age of the oldest buffered row triggering a flush
+ * \param max_pending_bytes the buffered and in flight bytes above which
+ * the rows are refused
+ * \param log the logger used by the database_t instance
+ * \return write_buffer 
+ */
+write_buffer open_write_buffer(
+    const std::string& connection_string,
+    const std::string& table,
+    const std::vector<std::string>& columns,
+    size_t max_rows = PQ_ASYNC_WRITE_BUFFER_MAX_ROWS,
+    size_t max_bytes = PQ_ASYNC_WRITE_BUFFER_MAX_BYTES,
+    int32_t max_delay_ms = PQ_ASYNC_WRITE_BUFFER_MAX_DELAY_MS,
+    size_t max_pending_bytes = PQ_ASYNC_WRITE_BUFFER_MAX_PENDING_BYTES,
+    md::log::logger log = nullptr
+);
+
+/*!
+ * \brief write-behind insert buffer, the rows added are accumulated
+ * in memory and written by a single multi-row insert once the row count,
+ * the size or the delay threshold is reached.
+ * 
+ * The batches are sent in order on one connection. The memory is bounded
+ * by max_pending_bytes: try_add refuses the rows above it while add
+ * delays its completion callback until enough batches are written.
+ * The rows still buffered when the instance is released are lost,
+ * flush must be called first.
+ */
+class write_buffer_t
+    : public std::enable_shared_from_this<write_buffer_t>
+{
+    friend write_buffer open_write_buffer(
+        const std::string& connection_string,
+        const std::string& table,
+        const std::vector<std::string>& columns,
+        size_t max_rows,
+        size_t max_bytes,
+        int32_t max_delay_ms,
+        size_t max_pending_bytes,
+        md::log::logger log
+    );
+    
+    struct waiting_t
+    {
+        parameters_t row;
+        size_t bytes;
+        md::callback::async_cb cb;
+    };
+    
+    write_buffer_t(
+        const std::string& connection_string,
+        const std::string& table,
+        const std::vector<std::string>& columns,
+        size_t max_rows,
+        size_t max_bytes,
+        int32_t max_delay_ms,
+        size_t max_pending_bytes,
+        md::log::logger log
+    );
+    
+public:
+    ~write_buffer_t();
+    
+    /*!
+     * \brief buffers a row made of the values
+     * 
+     * \return false if the row was refused, the memory bound is reached
+     */
+    template<typename... PARAMS>
+    bool try_add(const PARAMS&... values)
+    {
+        parameters_t row(values...);
+        return try_add(row);
+    }
+    
+    /*!
+     * \brief buffers a row, one parameter per column
+     * 
+     * \return false if the row was refused, the memory bound is reached
+     */
+    bool try_add(const parameters_t& row);
+    
+    /*!
+     * \brief buffers a row, waiting for room if the memory bound is reached.
+     * The producers should wait for acb before adding more rows.
+     * 
+     * \param row one parameter per column
+     * \param acb void(const md::callback::cb_error&) called once the
+     * row is buffered
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void add(const parameters_t& row, const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _add(row, cb);
+    }
+    
+    /*!
+     * \brief writes the buffered rows now
+     * 
+     * \param acb void(const md::callback::cb_error&) called once every
+     * row added before the call is written, with the first error since
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void flush(const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        _flush(cb);
+    }
+    
+    /*!
+     * \brief set the callback called after each batch
+     */
+    void on_flush(const write_flush_cb& cb);
+    
+    write_buffer_stats stats() const;
+    
+    const std::string& table() const { return _table;}
+    const std::vector<std::string>& columns() const { return _columns;}
+    size_t max_rows() const { return _max_rows;}
+    size_t max_bytes() const { return _max_bytes;}
+    int32_t max_delay() const { return _max_delay_ms;}
+    size_t max_pending_bytes() const { return _max_pending_bytes;}
+    
+private:
+    static size_t _row_bytes(const parameters_t& row);
+    
+    void _add(const parameters_t& row, const md::callback::async_cb& cb);
+    void _flush(const md::callback::async_cb& cb);
+    bool _fits(size_t bytes) const;
+    void _append(const parameters_t& row, size_t bytes);
+    void _send();
+    void _on_sent(
+        size_t rows, size_t bytes,
+        const md::callback::cb_error& err, int32_t count
+    );
+    bool _drained() const;
+    
+    std::string _table;
+    std::vector<std::string> _columns;
+    // "insert into table(columns) values ", the identifiers quoted
+    std::string _insert_sql;
+    size_t _max_rows;
+    size_t _max_bytes;
+    int32_t _max_delay_ms;
+    size_t _max_pending_bytes;
+    md::log::logger _log;
+    
+    database _db;
+    md::event_strand<int> _strand;
+    event* _timer;
+    bool _timer_armed;
+    
+    mutable std::recursive_mutex _mutex;
+    parameters_t _rows;
+    size_t _row_count;
+    size_t _bytes;
+    // buffered and in flight
+    size_t _pending_bytes;
+    int32_t _in_flight;
+    std::deque<waiting_t> _waiting;
+    std::vector<
+        std::pair<md::callback::async_cb, md::callback::cb_error>
+    > _drain;
+    write_flush_cb _on_flush;
+    
+    int64_t _rows_added;
+    int64_t _rows_written;
+    int64_t _rows_failed;
+    int64_t _flushes;
+    int64_t _rejected;
+};
+
+} //namespace pq_async
+#endif //_libpq_async_data_write_buffer_h
@@ -31,9 +31,14 @@ SOFTWARE.
 #include "data_connection_pool.h"
 #include "data_table.h"
 #include "data_reader.h"
+#include "data_single_flight.h"
+#include "data_result_cache.h"
+#include "data_listener.h"
 
 #include "utils.h"
 
+#include <thread>
+
 namespace pq_async{
 
 #if PQ_ASYNC_BUILD_DEBUG == 1
@@ -61,7 +66,7 @@ namespace pq_async{
         } \
          \
         try{ \
-            auto ct = std::make_shared<connection_task_t>( \
+            auto ct = connection_task_t::acquire( \
                 self->_strand.get(), self, lock, \
             [self, cb]( \
                 const md::callback::cb_error& err, PGresult* r \
@@ -103,7 +108,7 @@ namespace pq_async{
         } \
          \
         try{ \
-            auto ct = std::make_shared<connection_task_t>( \
+            auto ct = connection_task_t::acquire( \
                 self->_strand.get(), self, lock, \
             [self, cb]( \
                 const md::callback::cb_error& err, PGresult* r \
@@ -127,6 +132,24 @@ namespace pq_async{
         } \
     });
 
+#define _PQ_ASYNC_COALESCE_PARAMS(__val) \
+    if(this->_coalesce()){ \
+        parameters_t sf_p; \
+        sf_p.push_back<sizeof...(PARAMS) -1>(args...); \
+        md::callback::value_cb<__val> sf_cb; \
+        md::callback::assign_value_cb<md::callback::value_cb<__val>, __val>(sf_cb, md::get_last(args...)); \
+        this->_send_coalesced<__val>(sql, sf_p, sf_cb); \
+        return; \
+    }
+
+#define _PQ_ASYNC_COALESCE_T(__val) \
+    if(this->_coalesce()){ \
+        md::callback::value_cb<__val> sf_cb; \
+        md::callback::assign_value_cb<md::callback::value_cb<__val>, __val>(sf_cb, acb); \
+        this->_send_coalesced<__val>(sql, p, sf_cb); \
+        return; \
+    }
+
 #define _PQ_ASYNC_SEND_QRY_BODY_SYNC(__process_fn) \
     this->wait_for_sync(); \
     auto lock = open_connection(); \
@@ -163,6 +186,67 @@ database open(
 );
 
 
+/*!
+ * \brief longest time wait_for_sync blocks on the connection socket
+ * before running the strand again
+ */
+#define PQ_ASYNC_SYNC_POLL_MS 10
+
+#define PQ_ASYNC_TRANSACTION_MAX_ATTEMPTS 5
+#define PQ_ASYNC_TRANSACTION_BASE_DELAY_MS 10
+#define PQ_ASYNC_TRANSACTION_MAX_DELAY_MS 1000
+
+/*!
+ * \brief the replay policy of database_t::run_transaction
+ */
+struct transaction_policy
+{
+    /*! number of times the closure is run, the first one included */
+    int32_t max_attempts = PQ_ASYNC_TRANSACTION_MAX_ATTEMPTS;
+    /*! the backoff before the nth replay is a random delay up to
+     * base_delay_ms * 2^(n-1), capped by max_delay_ms */
+    int32_t base_delay_ms = PQ_ASYNC_TRANSACTION_BASE_DELAY_MS;
+    int32_t max_delay_ms = PQ_ASYNC_TRANSACTION_MAX_DELAY_MS;
+    /*! the SQLSTATE codes replayed, serialization_failure and
+     * deadlock_detected by default */
+    std::vector<std::string> sqlstates = { "40001", "40P01" };
+    
+    bool retryable(const std::string& sqlstate) const
+    {
+        return std::find(sqlstates.begin(), sqlstates.end(), sqlstate) !=
+            sqlstates.end();
+    }
+    
+    /*!
+     * \brief the jittered backoff before the replay following attempt
+     */
+    int32_t delay(int32_t attempt) const;
+};
+
+/*!
+ * \brief database_t::run_transaction counters
+ */
+struct transaction_stats
+{
+    int64_t attempts;
+    int64_t retries;
+    int64_t commits;
+    int64_t failures;
+};
+
+/*!
+ * \brief body of a transaction run by database_t::run_transaction,
+ * it must only issue its statements through the database it receives.
+ */
+typedef std::function<void(database)> transaction_fn;
+/*!
+ * \brief asynchronous body of a transaction, done must be called
+ * once its statements are completed, with their error if any.
+ */
+typedef std::function<
+    void(database, const md::callback::async_cb& done)
+> async_transaction_fn;
+
 /*!
  * \brief 
  * 
@@ -171,10 +255,18 @@ class database_t
     : public std::enable_shared_from_this<database_t>
 {
     friend class connection;
+    friend class connection_lock_t;
     friend class connection_task_t;
     friend class connection_pool;
     friend class data_large_object_t;
     friend class data_prepared_t;
+    friend class notification_listener_t;
+    friend class sharded_database_t;
+    template< typename T > friend class future_state_t;
+#if PQ_ASYNC_HAS_COROUTINES
+    template< typename R > friend class db_awaitable;
+    friend class reader_awaitable;
+#endif
     
     friend database open(
         const std::string& connection_string,
@@ -202,7 +294,9 @@ public:
     md::log::logger log(){ return _log;}
     
     /*!
-     * \brief synchronously try to acquire and open a connection
+     * \brief synchronously try to acquire and open a connection,
+     * the request is ranked in the pool pending queue with the
+     * asynchronous ones
      * 
      * \param timeout_ms milliseconds to wait before failure, default to 5000
      * \return connection_lock 
@@ -213,22 +307,46 @@ public:
         if(_lock)
             return _lock;
         
+        // infinite wait
+        if(timeout_ms <= 0)
+            timeout_ms = INT32_MAX;
+        auto timeout_date = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(timeout_ms);
+        
         #ifdef PQ_ASYNC_THREAD_SAFE
         std::unique_lock<std::recursive_mutex> lock(
             connection_pool::instance()->conn_pool_mutex
         );
         #endif
         
-        if(_conn == NULL)
-            _conn = connection_pool::get_connection(
-                this, _connection_string, timeout_ms
-            );
-        
-        _conn->reserve();
-        if(_conn == NULL)
-            _conn = connection_pool::get_connection(
-                this, _connection_string, timeout_ms
-            );
+        for(;;){
+            try{
+                if(_conn == NULL)
+                    _conn = connection_pool::get_connection(
+                        this, _connection_string, true
+                    );
+                
+                _conn->reserve();
+                if(_conn == NULL)
+                    _conn = connection_pool::get_connection(
+                        this, _connection_string, true
+                    );
+                break;
+                
+            }catch(const pq_async::connection_pool_assign_exception&){
+                if(std::chrono::steady_clock::now() >= timeout_date){
+                    connection_pool::cancel_pending(this);
+                    throw;
+                }
+                // the pool lock is released until a connection is
+                // returned or for 10ms
+                #ifdef PQ_ASYNC_THREAD_SAFE
+                connection_pool::wait_for(lock, 10);
+                #else
+                usleep(10000);
+                #endif
+            }
+        }
         
         connection_lock cl(new connection_lock_t(_conn));
         _conn->open_connection();
@@ -272,7 +390,7 @@ public:
         }
         
         try{
-            auto ct = std::make_shared<connection_task_t>(
+            auto ct = connection_task_t::acquire(
                 this->_strand.get(), this->shared_from_this(), this->_conn,
             [self=this->shared_from_this(), cb](
                 const md::callback::cb_error& err, connection_lock lock
@@ -325,6 +443,162 @@ public:
         #endif
     }
     
+    /*!
+     * \brief connection acquisition priority class of that database_t
+     */
+    connection_priority priority() const { return _priority;}
+    
+    /*!
+     * \brief set the connection acquisition priority class,
+     * see connection_pool::set_priority_cap and
+     * connection_pool::set_admission_control
+     * 
+     * \param priority the priority class
+     */
+    void priority(connection_priority priority){ _priority = priority;}
+    
+    /*!
+     * \brief returns true if the statement multiplexing mode is enabled
+     */
+    bool multiplexing() const { return _multiplexing;}
+    
+    /*!
+     * \brief enable or disable the statement multiplexing mode.
+     * 
+     * When enabled the physical connection is only borrowed from the pool
+     * for the duration of a statement or a transaction and is released
+     * as soon as it's completed, prepared statements are transparently
+     * prepared again on the connection that executes them.
+     * Session state other than prepared statements (SET, temporary tables,
+     * advisory locks...) is not preserved between statements.
+     * 
+     * \param enabled true to enable the multiplexing mode
+     */
+    void multiplexing(bool enabled)
+    {
+        _multiplexing = enabled;
+        if(enabled && _conn && _conn->_locks.load() == 0 &&
+            !_lock && !_conn->in_transaction()
+        )
+            this->close();
+    }
+    
+    /*!
+     * \brief returns true if the identical in flight queries are coalesced
+     */
+    bool single_flight() const { return _single_flight;}
+    
+    /*!
+     * \brief enable or disable the single flight mode.
+     * 
+     * When enabled, an asynchronous query or query_value issued while an
+     * identical one (same connection string, SQL and parameters) is in
+     * flight does not reach the server, it receives the result of the
+     * query already running. Coalesced query callers share the same
+     * data_table instance which must be treated as read only.
+     * Queries issued inside a transaction and synchronous calls are
+     * never coalesced.
+     * 
+     * \param enabled true to enable the single flight mode
+     */
+    void single_flight(bool enabled){ _single_flight = enabled;}
+    
+    /*!
+     * \brief the slow query threshold of that database_t in milliseconds,
+     * -1 when the one of the installed slow query log is used
+     */
+    int64_t slow_query_threshold() const { return _slow_query_ms.load();}
+    
+    /*!
+     * \brief overrides the threshold of the installed slow query log
+     * for the statements of that database_t.
+     * 
+     * \param ms the statements taking at least that long are logged,
+     * -1 to use the threshold of the slow query log
+     */
+    void slow_query_threshold(int64_t ms){ _slow_query_ms = ms;}
+    
+    /*!
+     * \brief the result cache used by that database_t, if any
+     */
+    pq_async::result_cache cache() const { return _cache;}
+    
+    /*!
+     * \brief set the result cache used by the query calls of that
+     * database_t, pass nullptr to disable caching.
+     * 
+     * The cached tables are shared by every caller and must be treated
+     * as read only. Queries issued inside a transaction bypass the cache.
+     * 
+     * \param cache the result cache
+     * \param tags tags of the entries added through that database_t,
+     * used by result_cache_t::invalidate
+     */
+    void cache(
+        pq_async::result_cache cache,
+        const std::vector<std::string>& tags = std::vector<std::string>())
+    {
+        _cache = cache;
+        _cache_tags = tags;
+    }
+    
+    /*!
+     * \brief synchronously start listening on a channel.
+     * 
+     * The notifications are received on a dedicated pooled connection
+     * watched by the event loop and are delivered in batches, one callback
+     * call per channel with all the notifications available, on the strand
+     * of that database_t. If the dedicated connection is lost the callback
+     * receives an error and the channels are listened again once it's
+     * reestablished, the notifications sent meanwhile are lost.
+     * 
+     * \param channel the channel name
+     * \param acb void(const md::callback::cb_error&, notifications) callback
+     */
+    template<
+        typename CB,
+        PQ_ASYNC_VALID_DB_VAL_CALLBACK(CB, notifications)
+    >
+    void listen(const std::string& channel, const CB& acb)
+    {
+        md::callback::value_cb<notifications> cb;
+        md::callback::assign_value_cb<
+            md::callback::value_cb<notifications>,
+            notifications
+        >(
+            cb, acb
+        );
+        
+        if(!_listener)
+            _listener = std::make_shared<notification_listener_t>(
+                _strand, _connection_string, _log
+            );
+        _listener->listen(channel, cb);
+    }
+    
+    /*!
+     * \brief synchronously stop listening on a channel, the dedicated
+     * connection is released with the last channel.
+     * 
+     * \param channel the channel name
+     */
+    void unlisten(const std::string& channel)
+    {
+        if(_listener)
+            _listener->unlisten(channel);
+    }
+    
+    /*!
+     * \brief the listener of that database_t, nullptr until listen is called
+     */
+    notification_listener listener() const { return _listener;}
+    
+    /*!
+     * \brief returns true if a physical connection is currently
+     * assigned to that database_t
+     */
+    bool holds_connection() const { return _conn != NULL;}
+    
     /*!
      * \brief returns true if the database_t is currently working.
      * 
@@ -497,6 +771,166 @@ public:
     }
     
     
+    /*!
+     * \brief query returning a db_future completed from the loop thread,
+     * see data_future.h. It can be called from any thread, the query is
+     * dispatched on the strand of that database_t.
+     */
+    template<typename... PARAMS>
+    db_future<data_table> query_future(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief future of the first row or nullptr
+     */
+    template<typename... PARAMS>
+    db_future<data_row> query_single_future(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief future of the first column of the first row
+     */
+    template<typename R, typename... PARAMS>
+    db_future<R> query_value_future(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief future of the number of rows affected
+     */
+    template<typename... PARAMS>
+    db_future<int32_t> execute_future(
+        const char* sql, const PARAMS&... args
+    );
+    
+#if PQ_ASYNC_HAS_COROUTINES
+    /*!
+     * \brief co_await-able query returning a pq_async::data_table_t,
+     * see data_coroutine.h. The awaiting coroutine is resumed on the
+     * strand of that database_t and the server errors are rethrown.
+     * The single flight and result cache modes are bypassed.
+     */
+    template<typename... PARAMS>
+    db_awaitable<data_table> query_async(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief co_await-able query returning the first row or nullptr
+     */
+    template<typename... PARAMS>
+    db_awaitable<data_row> query_single_async(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief co_await-able query returning the first column of the
+     * first row
+     */
+    template<typename R, typename... PARAMS>
+    db_awaitable<R> query_value_async(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief co_await-able query returning the number of rows affected
+     */
+    template<typename... PARAMS>
+    db_awaitable<int32_t> execute_async(
+        const char* sql, const PARAMS&... args
+    );
+    
+    /*!
+     * \brief co_await-able query returning a data_reader_t,
+     * its rows are read with co_await reader->next_async()
+     */
+    template<typename... PARAMS>
+    reader_awaitable query_reader_async(
+        const char* sql, const PARAMS&... args
+    );
+#endif
+    
+    /*!
+     * \brief synchronously run fn inside a transaction and commit it.
+     * When a statement or the commit fails with one of the policy
+     * SQLSTATE codes the transaction is rolled back and fn is replayed
+     * after a jittered exponential backoff, the connection is held
+     * across the attempts so they all run on the same one.
+     * Any other error rolls back the transaction and is rethrown.
+     * 
+     * \param fn the transaction body, it can be run more than once
+     * \param policy the replay policy
+     */
+    void run_transaction(
+        const transaction_fn& fn,
+        const transaction_policy& policy = transaction_policy()
+    );
+    
+    /*!
+     * \brief asynchronously run fn inside a transaction and commit it,
+     * see the synchronous run_transaction.
+     * 
+     * \tparam CB 
+     * \tparam PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB) 
+     * \param fn the transaction body, it can be run more than once
+     * \param policy the replay policy
+     * \param acb void(const md::callback::cb_error&) called once committed
+     * or with the error of the last attempt
+     */
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void run_transaction(
+        const async_transaction_fn& fn, const transaction_policy& policy,
+        const CB& acb)
+    {
+        md::callback::async_cb cb;
+        md::callback::assign_async_cb<md::callback::async_cb>(cb, acb);
+        if(this->in_transaction()){
+            this->_strand->push_back(
+                std::bind(
+                    cb,
+                    md::callback::cb_error("Already in a transaction!")
+                )
+            );
+            return;
+        }
+        
+        auto st = std::make_shared<transaction_state_t>();
+        st->fn = fn;
+        st->policy = policy;
+        st->cb = cb;
+        st->attempt = 0;
+        this->_run_transaction(st);
+    }
+    template< typename CB, PQ_ASYNC_VALID_DB_ASY_CALLBACK(CB)>
+    void run_transaction(const async_transaction_fn& fn, const CB& acb)
+    {
+        this->run_transaction(fn, transaction_policy(), acb);
+    }
+    
+    /*!
+     * \brief the SQLSTATE code of the last statement that failed on
+     * that database_t, empty if none did.
+     * The asynchronous callbacks only receive the error message.
+     */
+    std::string last_sqlstate() const
+    {
+        std::lock_guard<std::mutex> lock(_sqlstate_mutex);
+        return _last_sqlstate;
+    }
+    
+    /*!
+     * \brief the run_transaction counters
+     */
+    transaction_stats tx_stats() const
+    {
+        return transaction_stats{
+            _tx_attempts.load(), _tx_retries.load(),
+            _tx_commits.load(), _tx_failures.load()
+        };
+    }
+    
     /*!
      * \brief synchronously sets a new savepoint
      * inside the current transaction
@@ -729,6 +1163,7 @@ public:
     template<typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(data_table)>
     void query(const char* sql, const PARAMS&... args)
     {
+        _PQ_ASYNC_COALESCE_PARAMS(data_table);
         _PQ_ASYNC_SEND_QRY_BODY_PARAMS(
             data_table, _process_query_result, data_table()
         );
@@ -746,6 +1181,7 @@ public:
     template<typename T, PQ_ASYNC_VALID_DB_VAL_CALLBACK(T, data_table)>
     void query(const char* sql, const parameters_t& p, const T& acb)
     {
+        _PQ_ASYNC_COALESCE_T(data_table);
         _PQ_ASYNC_SEND_QRY_BODY_T(
             data_table, _process_query_result, data_table()
         );
@@ -765,6 +1201,8 @@ public:
     data_table query(const char* sql, const PARAMS&... args)
     {
         parameters_t p(args...);
+        if(this->_use_cache())
+            return this->_cached_query(sql, p);
         _PQ_ASYNC_SEND_QRY_BODY_SYNC(_process_query_result);
     }
     /*!
@@ -777,6 +1215,8 @@ public:
     data_table query(const char* sql)
     {
         parameters_t p;
+        if(this->_use_cache())
+            return this->_cached_query(sql, p);
         _PQ_ASYNC_SEND_QRY_BODY_SYNC(_process_query_result);
     }
     /*!
@@ -789,6 +1229,8 @@ public:
      */
     data_table query(const char* sql, const parameters_t& p)
     {
+        if(this->_use_cache())
+            return this->_cached_query(sql, p);
         _PQ_ASYNC_SEND_QRY_BODY_SYNC(_process_query_result);
     }
     
@@ -883,6 +1325,7 @@ public:
     template<typename R, typename... PARAMS, PQ_ASYNC_VALID_DB_CALLBACK(R)>
     void query_value(const char* sql, const PARAMS&... args)
     {
+        _PQ_ASYNC_COALESCE_PARAMS(R);
         _PQ_ASYNC_SEND_QRY_BODY_PARAMS(
             R, _process_query_value_result<R>, R()
         );
@@ -904,6 +1347,7 @@ public:
     >
     void query_value(const char* sql, const parameters_t& p, const T& acb)
     {
+        _PQ_ASYNC_COALESCE_T(R);
         _PQ_ASYNC_SEND_QRY_BODY_T(
             R, _process_query_value_result<R>, R()
         );
@@ -1206,16 +1650,25 @@ public:
             this->_strand.get(), this->shared_from_this(), lock
         );
         
-        if(this->query_value<bool>(
-            "select exists"
-            "(select 1 from pg_prepared_statements where name = $1)",
+        std::vector<data_type> t(types.begin(), types.end());
+        data_row prev = this->query_single(
+            "select statement from pg_prepared_statements where name = $1",
             name
-        ))
-            return this->_new_prepared(name, auto_deallocate, lock);
+        );
+        if(prev){
+            std::string prev_sql = prev->as<std::string>(0);
+            _conn->set_prepared(name, prev_sql);
+            if(prev_sql == sql)
+                return this->_new_prepared(
+                    name, sql, t, auto_deallocate, lock
+                );
+            // the name holds another query, it is replaced
+            this->deallocate_prepared(name);
+        }
         
-        ct.send_prepare(name, sql, types);
+        ct.send_prepare(name, sql, t);
         return _process_send_prepare_result(
-            name, auto_deallocate, lock, ct.run_now()
+            name, sql, t, auto_deallocate, lock, ct.run_now()
         );
     }
     
@@ -1279,56 +1732,23 @@ public:
     void prepare(
         const char* name, const char* sql, bool auto_deallocate,
         const std::vector<data_type>& types,
-        md::callback::value_cb<data_prepared> cb)
-    {
-        this->open_connection(
-        [self=this->shared_from_this(),
-            _name = std::string(name), _sql = std::string(sql),
-            auto_deallocate, types, cb]
-        (const md::callback::cb_error& err, connection_lock lock){
-            if(err){
-                cb(err, data_prepared());
-                return;
-            }
-            
-            try{
-                auto ct = std::make_shared<connection_task_t>(
-                    self->_strand.get(), self, lock,
-                [self, lock, _name, auto_deallocate, cb]
-                (const md::callback::cb_error& err, PGresult* r)-> void {
-                    if(err){
-                        cb(err, data_prepared());
-                        return;
-                    }
-                    
-                    try{
-                        cb(
-                            nullptr,
-                            self->_process_send_prepare_result(
-                                _name.c_str(), auto_deallocate, lock, r
-                            )
-                        );
-                    }catch(const std::exception& err){
-                        cb(md::callback::cb_error(err), data_prepared());
-                    }
-                });
-                ct->send_prepare(_name.c_str(), _sql.c_str(), types);
-                self->_strand->push_back(ct);
-                
-            }catch(const std::exception& err){
-                cb(md::callback::cb_error(err), data_prepared());
-            }
-        });
-    }
+        md::callback::value_cb<data_prepared> cb
+    );
     
     /*!
-     * \brief synchronously delete a prepared statement
+     * \brief synchronously delete a prepared statement, in multiplexing
+     * mode only the connection currently borrowed is affected, the other
+     * copies are dropped with their session.
      * 
      * \param name the prepared statement name
      */
     void deallocate_prepared(const char* name)
     {
         auto lock = this->open_connection();
+        // multiplexed, the statement was not prepared on this connection
+        if(_multiplexing && !_conn->is_prepared(name))
+            return;
+        
         char* es_name = PQescapeIdentifier(
             this->_conn->_conn, name, strnlen(name, 255)
         );
@@ -1337,9 +1757,13 @@ public:
         std::string sql("DEALLOCATE PREPARE ");
         sql += es_name;
         PQfreemem(es_name);
-        lock.reset();
+        // when multiplexed the lock is kept so that the connection is not
+        // released before the statement is deallocated.
+        if(!_multiplexing)
+            lock.reset();
         
         this->execute(sql.c_str());
+        _conn->unset_prepared(name);
     }
     
     /*!
@@ -1365,6 +1789,10 @@ public:
                 cb(err);
                 return;
             }
+            if(self->_multiplexing && !self->_conn->is_prepared(_name)){
+                cb(nullptr);
+                return;
+            }
             
             char* es_name = PQescapeIdentifier(
                 self->_conn->_conn, _name.c_str(), _name.size()
@@ -1377,15 +1805,18 @@ public:
             std::string sql = "DEALLOCATE PREPARE ";
             sql += es_name;
             PQfreemem(es_name);
-            lock.reset();
+            if(!self->_multiplexing)
+                lock.reset();
             
             self->execute(sql.c_str(), 
-            [self, cb](const md::callback::cb_error& err){
+            [self, lock, _name, cb](const md::callback::cb_error& err){
                 if(err){
                     cb(err);
                     return;
                 }
                 
+                if(self->_conn)
+                    self->_conn->unset_prepared(_name);
                 cb(nullptr);
             });
             
@@ -1400,7 +1831,8 @@ public:
     
 private:
     data_prepared _new_prepared(
-        const char* name, bool auto_deallocate,
+        const std::string& name, const std::string& sql,
+        const std::vector<data_type>& types, bool auto_deallocate,
         connection_lock lock
     );
 
@@ -1434,19 +1866,78 @@ private:
         _build_prepared<SIZE -1>(v, args...);
     }
     
-    void wait_for_sync()
+    /*!
+     * \brief blocks until the pending asynchronous work of the database is
+     * completed, without spinning. When another thread drives the event
+     * loop the caller sleeps on a condition variable until the connection
+     * is released or that thread exits, otherwise it runs the strand
+     * itself and polls the connection socket in between.
+     */
+    void wait_for_sync();
+    
+    /*!
+     * \brief wakes the threads blocked in wait_for_sync,
+     * called when a connection lock is released
+     */
+    void _notify_sync()
     {
-        while(this->working() && this->_strand->size() > 0){
-            this->_strand->run_n();
-            usleep(10);
-        }
+        std::lock_guard<std::mutex> lock(_sync_mutex);
+        _sync_cv.notify_all();
+    }
+    
+    /*!
+     * \brief records the thread running the tasks of the strand
+     */
+    void _mark_loop_thread()
+    {
+        auto id = std::this_thread::get_id();
+        if(_loop_thread.exchange(id) != id)
+            this->_watch_loop_thread();
+    }
+    
+    struct loop_thread_dbs_t;
+    
+    /*!
+     * \brief clears _loop_thread when the calling thread exits
+     */
+    void _watch_loop_thread();
+    void _loop_thread_exited(std::thread::id id);
+    
+    struct transaction_state_t
+    {
+        async_transaction_fn fn;
+        transaction_policy policy;
+        md::callback::async_cb cb;
+        int32_t attempt;
+        // the connection held across the attempts
+        connection_lock lock;
+    };
+    
+    void _run_transaction(std::shared_ptr<transaction_state_t> st);
+    void _replay_transaction(
+        std::shared_ptr<transaction_state_t> st,
+        const md::callback::cb_error& err
+    );
+    
+    /*!
+     * \brief records the SQLSTATE of a failed result, clears it
+     * and returns the exception to throw
+     */
+    sql_exception _result_error(PGresult* res)
+    {
+        sql_exception err = result_exception(_conn->conn(), res);
+        _conn->set_last_sqlstate(err.sqlstate());
+        std::lock_guard<std::mutex> lock(_sqlstate_mutex);
+        _last_sqlstate = err.sqlstate();
+        return err;
     }
     
     int _process_execute_result(PGresult* res);
     data_table _process_query_result(PGresult* res);
     data_row _process_query_single_result(PGresult* res);
     data_prepared _process_send_prepare_result(
-        const std::string& name, bool auto_deallocate,
+        const std::string& name, const std::string& sql,
+        const std::vector<data_type>& types, bool auto_deallocate,
         connection_lock lock, PGresult* res
     );
     
@@ -1466,9 +1957,7 @@ private:
             result_status != PGRES_SINGLE_TUPLE &&
             result_status != PGRES_TUPLES_OK
         ){
-            std::string errMsg = PQerrorMessage(_conn->conn());
-            PQclear(res);
-            throw pq_async::exception(errMsg);
+            throw this->_result_error(res);
         }
         
         if(result_status == PGRES_EMPTY_QUERY){
@@ -1494,17 +1983,192 @@ private:
     }
     
     
+    bool _coalesce()
+    {
+        return (_single_flight || _cache) &&
+            !_lock && !this->in_transaction();
+    }
+    
+    bool _use_cache()
+    {
+        return _cache && !_lock && !this->in_transaction();
+    }
+    
+    template<typename R>
+    void _send_coalesced(
+        const char* sql, const parameters_t& p,
+        const md::callback::value_cb<R>& scb)
+    {
+        if(this->_cache_lookup(sql, p, scb))
+            return;
+        
+        std::string key;
+        if(_single_flight){
+            key = single_flight_key(
+                typeid(R).name(), _connection_string, sql, p
+            );
+            
+            // the waiters are resumed on their own strand
+            bool leader = single_flight_group<R>::instance().join(key,
+            [self=this->shared_from_this(), scb](
+                const md::callback::cb_error& err, R value
+            )-> void {
+                self->_strand->push_back(std::bind(scb, err, value));
+            });
+            if(!leader)
+                return;
+        }
+        
+        md::callback::value_cb<R> done = [key, scb](
+            const md::callback::cb_error& err, R value
+        )-> void {
+            if(!key.empty())
+                single_flight_group<R>::instance().complete(key, err, value);
+            scb(err, value);
+        };
+        // cached before the waiters are released
+        auto acb = this->_cache_store(sql, p, done);
+        _PQ_ASYNC_SEND_QRY_BODY_T(R, _process_single_flight_result<R>, R());
+    }
+    
+    bool _cache_lookup(
+        const char* sql, const parameters_t& p,
+        const md::callback::value_cb<data_table>& cb)
+    {
+        if(!_cache)
+            return false;
+        
+        data_table tbl = _cache->get(
+            result_cache_t::make_key(_connection_string, sql, p)
+        );
+        if(!tbl)
+            return false;
+        
+        this->_strand->push_back(std::bind(cb, nullptr, tbl));
+        return true;
+    }
+    template<typename R>
+    bool _cache_lookup(
+        const char* /*sql*/, const parameters_t& /*p*/,
+        const md::callback::value_cb<R>& /*cb*/)
+    {
+        return false;
+    }
+    
+    md::callback::value_cb<data_table> _cache_store(
+        const char* sql, const parameters_t& p,
+        const md::callback::value_cb<data_table>& cb)
+    {
+        if(!_cache)
+            return cb;
+        
+        return [cache = _cache, tags = _cache_tags,
+            gen = _cache->generation(_cache_tags),
+            key = result_cache_t::make_key(_connection_string, sql, p), cb](
+            const md::callback::cb_error& err, data_table tbl
+        )-> void {
+            if(!err && tbl)
+                cache->put(key, tbl, tags, gen);
+            cb(err, tbl);
+        };
+    }
+    template<typename R>
+    md::callback::value_cb<R> _cache_store(
+        const char* /*sql*/, const parameters_t& /*p*/,
+        const md::callback::value_cb<R>& cb)
+    {
+        return cb;
+    }
+    
+    data_table _cached_query(const char* sql, const parameters_t& p)
+    {
+        std::string key = result_cache_t::make_key(
+            _connection_string, sql, p
+        );
+        data_table tbl = _cache->get(key);
+        if(tbl)
+            return tbl;
+        
+        uint64_t gen = _cache->generation(_cache_tags);
+        {
+            this->wait_for_sync();
+            auto lock = open_connection();
+            connection_task_t ct(
+                this->_strand.get(), this->shared_from_this(), lock
+            );
+            ct.send_query(sql, p);
+            tbl = _process_query_result(ct.run_now());
+        }
+        _cache->put(key, tbl, _cache_tags, gen);
+        return tbl;
+    }
+    
+    template<typename R>
+    R _process_single_flight_result(PGresult* res)
+    {
+        return _process_single_flight_result(res, (R*)nullptr);
+    }
+    data_table _process_single_flight_result(PGresult* res, data_table*)
+    {
+        return _process_query_result(res);
+    }
+    template<typename R>
+    R _process_single_flight_result(PGresult* res, R*)
+    {
+        return _process_query_value_result<R>(res);
+    }
+    
+    void _release_multiplexed(connection* conn)
+    {
+        #ifdef PQ_ASYNC_THREAD_SAFE
+        std::unique_lock<std::recursive_mutex> lock(
+            connection_pool::instance()->conn_pool_mutex
+        );
+        #endif
+        
+        // a new lock or a transaction may have been started meanwhile
+        if(_conn != conn || _lock || conn->_locks.load() > 0 ||
+            conn->in_transaction()
+        )
+            return;
+        
+        PQ_ASYNC_TRACE(_log,
+            "releasing multiplexed connection '{}'", conn->id()
+        );
+        this->close();
+    }
+    
     std::string _connection_string;
     
     connection* _conn;
     md::event_strand<int> _strand;
     connection_lock _lock;
     md::log::logger _log;
+    bool _multiplexing;
+    connection_priority _priority;
+    bool _single_flight;
+    std::atomic<int64_t> _slow_query_ms;
+    pq_async::result_cache _cache;
+    std::vector<std::string> _cache_tags;
+    notification_listener _listener;
+    
+    mutable std::mutex _sqlstate_mutex;
+    std::string _last_sqlstate;
+    std::atomic<int64_t> _tx_attempts;
+    std::atomic<int64_t> _tx_retries;
+    std::atomic<int64_t> _tx_commits;
+    std::atomic<int64_t> _tx_failures;
+    
+    std::mutex _sync_mutex;
+    std::condition_variable _sync_cv;
+    std::atomic<std::thread::id> _loop_thread;
 };
 
 
 #undef _PQ_ASYNC_SEND_QRY_BODY_PARAMS
 #undef _PQ_ASYNC_SEND_QRY_BODY_T
 #undef _PQ_ASYNC_SEND_QRY_BODY_SYNC
+#undef _PQ_ASYNC_COALESCE_PARAMS
+#undef _PQ_ASYNC_COALESCE_T
 } // ns: pq_async
 #endif //_libpq_async_database_h
@@ -69,6 +69,38 @@ public:
     virtual ~connection_pool_assign_exception();
 };
 
+/*!
+ * \brief thrown when a connection request is rejected by the pool
+ * admission control, the pending queue is full or the wait budget
+ * is exhausted. Unlike connection_pool_assign_exception it's never retried.
+ */
+class connection_pool_admission_exception : public pq_async::exception
+{
+public:
+    connection_pool_admission_exception(const std::string& message);
+    connection_pool_admission_exception(const char* message);
+    virtual ~connection_pool_admission_exception();
+};
+
+/*!
+ * \brief thrown when the server reports an error for a statement
+ */
+class sql_exception : public pq_async::exception
+{
+public:
+    sql_exception(const std::string& message, const std::string& sqlstate);
+    virtual ~sql_exception();
+    
+    /*!
+     * \brief the PG_DIAG_SQLSTATE error code, e.g. "40001",
+     * empty if the server did not report one
+     */
+    const std::string& sqlstate() const { return _sqlstate;}
+    
+private:
+    std::string _sqlstate;
+};
+
 
 // class md::callback::cb_error
 // {
@@ -0,0 +1,196 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_inline_cb_h
+#define _libpq_async_inline_cb_h
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "tools-md/tools-md.h"
+
+/*!
+ * \brief size in bytes of the storage of an inline_function, enough for
+ * a lambda capturing a shared_ptr and a std::function
+ */
+#define PQ_ASYNC_INLINE_CB_CAPACITY 64
+
+namespace pq_async{
+
+template<typename SIG, size_t CAPACITY = PQ_ASYNC_INLINE_CB_CAPACITY>
+class inline_function;
+
+/*!
+ * \brief move only callable stored in a fixed size buffer, it never
+ * allocates, a callable larger than CAPACITY is a compile time error.
+ */
+template<typename R, typename... ARGS, size_t CAPACITY>
+class inline_function<R(ARGS...), CAPACITY>
+{
+    template<typename F>
+    using enable_callable = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, inline_function>::value &&
+        !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value &&
+        std::is_invocable_r<R, typename std::decay<F>::type&, ARGS...>::value
+    , int>::type;
+    
+    struct ops_t
+    {
+        R (*invoke)(void*, ARGS&&...);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+    
+    template<typename F>
+    struct ops_for
+    {
+        static R invoke(void* f, ARGS&&... args)
+        {
+            return (*(F*)f)(std::forward<ARGS>(args)...);
+        }
+        static void move(void* dst, void* src)
+        {
+            new(dst) F(std::move(*(F*)src));
+            ((F*)src)->~F();
+        }
+        static void destroy(void* f)
+        {
+            ((F*)f)->~F();
+        }
+        static constexpr ops_t ops = { &invoke, &move, &destroy };
+    };
+    
+public:
+    inline_function() noexcept: _ops(nullptr){}
+    inline_function(std::nullptr_t) noexcept: _ops(nullptr){}
+    
+    template<typename F, enable_callable<F> = 0>
+    inline_function(F&& f): _ops(nullptr)
+    {
+        this->_assign(std::forward<F>(f));
+    }
+    
+    inline_function(inline_function&& b) noexcept: _ops(nullptr)
+    {
+        this->_take(b);
+    }
+    
+    inline_function(const inline_function&) = delete;
+    inline_function& operator=(const inline_function&) = delete;
+    
+    ~inline_function()
+    {
+        this->reset();
+    }
+    
+    inline_function& operator=(inline_function&& b) noexcept
+    {
+        if(this != &b){
+            this->reset();
+            this->_take(b);
+        }
+        return *this;
+    }
+    
+    inline_function& operator=(std::nullptr_t) noexcept
+    {
+        this->reset();
+        return *this;
+    }
+    
+    template<typename F, enable_callable<F> = 0>
+    inline_function& operator=(F&& f)
+    {
+        this->reset();
+        this->_assign(std::forward<F>(f));
+        return *this;
+    }
+    
+    /*!
+     * \brief destroys the stored callable, the callable may reset the
+     * inline_function holding it as long as it touches none of its
+     * captures afterward.
+     */
+    void reset() noexcept
+    {
+        if(!_ops)
+            return;
+        const ops_t* ops = _ops;
+        _ops = nullptr;
+        ops->destroy(_buf);
+    }
+    
+    explicit operator bool() const noexcept { return _ops != nullptr;}
+    
+    R operator()(ARGS... args) const
+    {
+        if(!_ops)
+            throw std::bad_function_call();
+        return _ops->invoke(_buf, std::forward<ARGS>(args)...);
+    }
+    
+private:
+    template<typename F>
+    void _assign(F&& f)
+    {
+        typedef typename std::decay<F>::type fn_t;
+        static_assert(
+            sizeof(fn_t) <= CAPACITY,
+            "The callable captures exceed the inline_function capacity!"
+        );
+        static_assert(
+            alignof(fn_t) <= alignof(std::max_align_t),
+            "The callable alignment exceeds the inline_function storage!"
+        );
+        new(_buf) fn_t(std::forward<F>(f));
+        _ops = &ops_for<fn_t>::ops;
+    }
+    
+    void _take(inline_function& b) noexcept
+    {
+        if(!b._ops)
+            return;
+        b._ops->move(_buf, b._buf);
+        _ops = b._ops;
+        b._ops = nullptr;
+    }
+    
+    const ops_t* _ops;
+    alignas(std::max_align_t) mutable unsigned char _buf[CAPACITY];
+};
+
+/*!
+ * \brief inline counterpart of md::callback::value_cb
+ */
+template<typename T>
+using inline_value_cb = inline_function<
+    void(const md::callback::cb_error&, T)
+>;
+
+} //namespace pq_async
+
+#endif //_libpq_async_inline_cb_h
@@ -27,6 +27,16 @@ SOFTWARE.
 
 #include "data_connection_pool.h"
 #include "database.h"
+#include "data_large_object.h"
 #include "data_prepared.h"
+#include "data_pool_group.h"
+#include "data_sharded.h"
+#include "data_replication.h"
+#include "data_parallel_query.h"
+#include "data_bulk.h"
+#include "data_write_buffer.h"
+#include "data_future.h"
+#include "data_coroutine.h"
+#include "reactor_epoll.h"
 
 #endif //_libpq_async_h
\ No newline at end of file
@@ -0,0 +1,122 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_reactor_h
+#define _libpq_async_reactor_h
+
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace pq_async{
+
+class reactor_t;
+typedef std::shared_ptr< pq_async::reactor_t > reactor;
+
+/*!
+ * \brief the minimal contract of a host event loop. When a reactor is
+ * installed with set_default_reactor the connection tasks register their
+ * socket with it instead of libevent and run their strand from the
+ * handler, directly on the host loop thread.
+ */
+class reactor_t
+{
+public:
+    typedef std::function<void()> handler_t;
+    
+    virtual ~reactor_t(){}
+    
+    /*!
+     * \brief watches fd, or changes the interest of an already watched
+     * fd. The handler is called from the host loop each time the socket
+     * is ready, level triggered, until unwatch is called.
+     * 
+     * \param fd the socket
+     * \param want_read wait for the socket to be readable
+     * \param want_write wait for the socket to be writable
+     * \param on_ready readiness handler
+     */
+    virtual void watch(
+        int fd, bool want_read, bool want_write, handler_t on_ready
+    ) = 0;
+    
+    /*!
+     * \brief stops watching fd, the fd is not closed
+     */
+    virtual void unwatch(int fd) = 0;
+    
+    /*!
+     * \brief calls on_timeout once from the host loop after timeout_ms
+     */
+    virtual void add_timer(int32_t timeout_ms, handler_t on_timeout) = 0;
+};
+
+inline std::mutex& _reactor_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+inline reactor& _reactor_slot()
+{
+    static reactor r;
+    return r;
+}
+
+// set while a reactor is installed, read without the mutex so the
+// libevent configuration does not pay for it on every task
+inline std::atomic<bool>& _reactor_installed()
+{
+    static std::atomic<bool> installed(false);
+    return installed;
+}
+
+/*!
+ * \brief installs the reactor used by the connection tasks created from
+ * now on, nullptr restores the libevent loop of the event queues
+ */
+inline void set_default_reactor(reactor r)
+{
+    std::lock_guard<std::mutex> lock(_reactor_mutex());
+    _reactor_slot() = r;
+    _reactor_installed().store(r != nullptr, std::memory_order_release);
+}
+
+/*!
+ * \brief the installed reactor or nullptr
+ */
+inline reactor default_reactor()
+{
+    if(!_reactor_installed().load(std::memory_order_acquire))
+        return reactor();
+    
+    std::lock_guard<std::mutex> lock(_reactor_mutex());
+    return _reactor_slot();
+}
+
+} //namespace pq_async
+
+#endif //_libpq_async_reactor_h
@@ -0,0 +1,167 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_reactor_asio_h
+#define _libpq_async_reactor_asio_h
+
+#include "reactor.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+namespace pq_async{
+
+class asio_reactor_t;
+typedef std::shared_ptr< pq_async::asio_reactor_t > asio_reactor;
+
+/*!
+ * \brief reactor_t running the pq_async handlers on a Boost.Asio
+ * io_context. That header is not included by pq_async.h, the
+ * application including it links Boost.
+ * 
+ * \code{.cpp}
+ * boost::asio::io_context io;
+ * pq_async::set_default_reactor(pq_async::open_asio_reactor(io));
+ * io.run();
+ * \endcode
+ */
+class asio_reactor_t
+    : public reactor_t,
+    public std::enable_shared_from_this<asio_reactor_t>
+{
+    friend asio_reactor open_asio_reactor(boost::asio::io_context& io);
+    
+    typedef boost::asio::posix::stream_descriptor descriptor_t;
+    
+    struct entry_t
+    {
+        std::unique_ptr<descriptor_t> sd;
+        handler_t handler;
+        uint64_t gen;
+        bool active;
+    };
+    
+    asio_reactor_t(boost::asio::io_context& io): _io(io){}
+    
+public:
+    ~asio_reactor_t()
+    {
+        for(auto& it : _watched)
+            it.second->sd->release();
+    }
+    
+    void watch(
+        int fd, bool want_read, bool want_write, handler_t on_ready
+    ) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& e = _watched[fd];
+        if(!e){
+            e = std::make_shared<entry_t>();
+            e->sd.reset(new descriptor_t(_io, fd));
+            e->gen = 0;
+        }else{
+            // the waits armed for the previous interest are aborted
+            e->sd->cancel();
+        }
+        e->handler = on_ready;
+        e->active = true;
+        uint64_t gen = ++e->gen;
+        if(want_read)
+            this->_arm(e, descriptor_t::wait_read, gen);
+        if(want_write)
+            this->_arm(e, descriptor_t::wait_write, gen);
+    }
+    
+    void unwatch(int fd) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _watched.find(fd);
+        if(it == _watched.end())
+            return;
+        it->second->active = false;
+        it->second->sd->cancel();
+        // the descriptor belongs to libpq, it must not be closed here
+        it->second->sd->release();
+        _watched.erase(it);
+    }
+    
+    void add_timer(int32_t timeout_ms, handler_t on_timeout) override
+    {
+        auto t = std::make_shared<boost::asio::steady_timer>(
+            _io, std::chrono::milliseconds(timeout_ms)
+        );
+        t->async_wait([t, on_timeout](const boost::system::error_code& ec){
+            if(!ec)
+                on_timeout();
+        });
+    }
+    
+private:
+    void _arm(
+        std::shared_ptr<entry_t> e, descriptor_t::wait_type type,
+        uint64_t gen)
+    {
+        std::weak_ptr<asio_reactor_t> wself = this->shared_from_this();
+        e->sd->async_wait(type,
+        [wself, e, type, gen](const boost::system::error_code& ec){
+            auto self = wself.lock();
+            if(!self || ec)
+                return;
+            
+            handler_t h;
+            {
+                std::lock_guard<std::mutex> lock(self->_mutex);
+                if(!e->active || e->gen != gen)
+                    return;
+                h = e->handler;
+            }
+            h();
+            
+            // level triggered, wait again while the interest is unchanged
+            std::lock_guard<std::mutex> lock(self->_mutex);
+            if(e->active && e->gen == gen)
+                self->_arm(e, type, gen);
+        });
+    }
+    
+    boost::asio::io_context& _io;
+    std::mutex _mutex;
+    std::unordered_map< int, std::shared_ptr<entry_t> > _watched;
+};
+
+/*!
+ * \brief creates a reactor over io, it is not installed
+ */
+inline asio_reactor open_asio_reactor(boost::asio::io_context& io)
+{
+    return asio_reactor(new asio_reactor_t(io));
+}
+
+} //namespace pq_async
+
+#endif //_libpq_async_reactor_asio_h
@@ -0,0 +1,118 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _libpq_async_reactor_epoll_h
+#define _libpq_async_reactor_epoll_h
+
+#include "reactor.h"
+
+#ifdef __linux__
+
+#include <chrono>
+#include <map>
+#include <unordered_map>
+
+namespace pq_async{
+
+class epoll_reactor_t;
+typedef std::shared_ptr< pq_async::epoll_reactor_t > epoll_reactor;
+
+/*!
+ * \brief reactor_t over a raw epoll instance. Its descriptor can be
+ * nested in the epoll set of the host loop, run_once is then called when
+ * it becomes readable, or the host can call run_once directly. The timers
+ * expire through a timerfd watched by the same epoll instance.
+ * 
+ * \code{.cpp}
+ * auto r = pq_async::open_epoll_reactor();
+ * pq_async::set_default_reactor(r);
+ * 
+ * epoll_event ev{};
+ * ev.events = EPOLLIN;
+ * ev.data.ptr = r.get();
+ * epoll_ctl(host_epfd, EPOLL_CTL_ADD, r->fd(), &ev);
+ * // in the host loop, when r->fd() is readable or on each iteration
+ * r->run_once(0);
+ * \endcode
+ */
+class epoll_reactor_t
+    : public reactor_t
+{
+    friend epoll_reactor open_epoll_reactor();
+    
+    epoll_reactor_t();
+    
+public:
+    ~epoll_reactor_t();
+    
+    void watch(
+        int fd, bool want_read, bool want_write, handler_t on_ready
+    ) override;
+    void unwatch(int fd) override;
+    void add_timer(int32_t timeout_ms, handler_t on_timeout) override;
+    
+    /*!
+     * \brief the epoll descriptor, readable when an event is pending
+     */
+    int fd() const { return _epfd;}
+    
+    /*!
+     * \brief waits up to timeout_ms, or until the next timer, for the
+     * watched sockets and calls the handlers of the ready ones and of the
+     * expired timers. A timeout of 0 does not block, -1 waits forever.
+     * 
+     * \return the number of handlers called
+     */
+    size_t run_once(int32_t timeout_ms = 0);
+    
+    /*!
+     * \brief number of watched sockets and pending timers
+     */
+    size_t size() const;
+    
+private:
+    typedef std::chrono::steady_clock clock_t;
+    
+    /*!
+     * \brief sets the timerfd to the earliest timer, or disarms it,
+     * called locked
+     */
+    void _arm_timer();
+    
+    int _epfd;
+    int _tfd;
+    mutable std::mutex _mutex;
+    std::unordered_map<int, handler_t> _watched;
+    std::multimap<clock_t::time_point, handler_t> _timers;
+};
+
+/*!
+ * \brief creates an epoll reactor, it is not installed
+ */
+epoll_reactor open_epoll_reactor();
+
+} //namespace pq_async
+
+#endif //__linux__
+#endif //_libpq_async_reactor_epoll_h
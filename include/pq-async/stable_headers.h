@@ -34,6 +34,8 @@ SOFTWARE.
 #include <atomic>
 #include <algorithm>
 #include <deque>
+#include <set>
+#include <map>
 
 #include "tools-md/tools-md.h"
 #include "log.h"
\ No newline at end of file
@@ -44,6 +44,12 @@ void swap2(const int16_t* inp, int16_t* outp, bool to_network);
 void swap4(const int32_t* inp, int32_t* outp, bool to_network);
 void swap8(const int64_t* inp, int64_t* outp, bool to_network);
 
+/*!
+ * \brief 64 bits FNV-1a hash of data finished with a bit mixer,
+ * FNV alone spreads short keys poorly
+ */
+uint64_t hash_bytes(const char* data, size_t len, uint64_t seed = 0);
+
 } //namespace pq_async
 
 #endif //_libpq_async_utils_h
\ No newline at end of file
@@ -26,6 +26,7 @@ SOFTWARE.
 #define _pq_async_db_test_base_h
 
 #include <gmock/gmock.h>
+#include <unistd.h>
 #include "pq-async/pq_async.h"
 
 extern std::string pq_async_connection_string;
@@ -50,6 +51,28 @@ namespace pq_async{ namespace tests{
             // before the destructor).
             db.reset();
         }
+        
+        /*!
+         * \brief runs the default event queue until pred returns true,
+         * step is called before each run.
+         */
+        template<typename PRED, typename STEP>
+        void wait_until(
+            const PRED& pred, const STEP& step,
+            int tries = 500, useconds_t interval = 2000)
+        {
+            for(int i = 0; i < tries && !pred(); ++i){
+                step();
+                md::event_queue_t::get_default()->run_n();
+                usleep(interval);
+            }
+        }
+        
+        template<typename PRED>
+        void wait_until(const PRED& pred)
+        {
+            wait_until(pred, [](){});
+        }
     };
     
 }} //namespace pq_async::tests
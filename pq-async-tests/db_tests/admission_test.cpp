@@ -0,0 +1,125 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+extern int pq_async_max_pool_size;
+
+namespace pq_async{ namespace tests{
+
+class admission_test
+    : public db_test_base
+{
+public:
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+    }
+    
+    void TearDown() override
+    {
+        for(auto& h : holders)
+            if(h->in_transaction())
+                h->rollback();
+        holders.clear();
+        
+        connection_pool::set_admission_control(0, 0);
+        connection_pool::set_priority_cap(connection_priority::interactive, 0);
+        connection_pool::set_priority_cap(connection_priority::normal, 0);
+        connection_pool::set_priority_cap(connection_priority::background, 0);
+        db_test_base::TearDown();
+    }
+    
+    // transactions can't be stolen, this keeps the connections busy
+    void hold(int count, connection_priority priority)
+    {
+        for(int i = 0; i < count; ++i){
+            auto h = pq_async::open(connection_string());
+            h->priority(priority);
+            h->begin();
+            holders.emplace_back(h);
+        }
+    }
+    
+    std::vector<pq_async::database> holders;
+};
+
+
+TEST_F(admission_test, priority_cap_test)
+{
+    connection_pool::set_priority_cap(connection_priority::background, 1);
+    
+    this->hold(1, connection_priority::background);
+    
+    auto bg = pq_async::open(connection_string());
+    bg->priority(connection_priority::background);
+    // waits for a background connection during 100ms
+    ASSERT_THROW(
+        bg->open_connection(100), pq_async::connection_pool_assign_exception
+    );
+    ASSERT_THAT(
+        connection_pool::get_pending_count(connection_string()),
+        testing::Eq(0)
+    );
+    
+    // the other classes are not affected by the background cap
+    auto it = pq_async::open(connection_string());
+    it->priority(connection_priority::interactive);
+    ASSERT_NO_THROW(it->begin());
+    it->rollback();
+}
+
+TEST_F(admission_test, load_shedding_test)
+{
+    this->hold(pq_async_max_pool_size, connection_priority::normal);
+    
+    int64_t rejected = connection_pool::get_rejected_count();
+    connection_pool::set_admission_control(1, 100);
+    
+    int failed = 0;
+    std::vector<pq_async::database> dbs;
+    for(int i = 0; i < 2; ++i){
+        dbs.emplace_back(pq_async::open(connection_string()));
+        dbs.back()->query_value<int32_t>("select 1",
+        [&failed](const md::callback::cb_error& err, int32_t /*v*/){
+            // one is rejected because the queue is full, the other one
+            // after its 100ms wait budget.
+            ASSERT_THAT((bool)err, testing::Eq(true));
+            ++failed;
+        });
+    }
+    
+    md::event_queue_t::get_default()->run();
+    ASSERT_THAT(failed, testing::Eq(2));
+    ASSERT_THAT(
+        connection_pool::get_rejected_count() - rejected, testing::Eq(2)
+    );
+    ASSERT_THAT(
+        connection_pool::get_pending_count(connection_string()),
+        testing::Eq(0)
+    );
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+#include <thread>
+
+namespace pq_async{ namespace tests{
+
+class async_log_test
+    : public db_test_base
+{
+public:
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        pq_async::enable_async_logging(true);
+    }
+    
+    void TearDown() override
+    {
+        pq_async::enable_async_logging(false);
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(async_log_test, threads_test)
+{
+    try{
+        ASSERT_TRUE(pq_async::async_logging_enabled());
+        auto before = pq_async::async_logging_stats();
+        
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t)
+            threads.emplace_back([t](){
+                for(int i = 0; i < 100; ++i){
+                    // the text must be copied, the buffer is reused
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "thread %d", t);
+                    pq_async::log_async(
+                        pq_async::default_logger(),
+                        pq_async::log_level::trace,
+                        "{} record {}", buf, i
+                    );
+                }
+            });
+        for(auto& th : threads)
+            th.join();
+        pq_async::flush_async_log();
+        
+        auto after = pq_async::async_logging_stats();
+        ASSERT_THAT(
+            (after.written - before.written) +
+            (after.sync_fallbacks - before.sync_fallbacks),
+            testing::Eq(400u)
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(async_log_test, notice_test)
+{
+    try{
+        auto before = pq_async::async_logging_stats();
+        db->execute(
+            "do $$ begin "
+            "for i in 1..10 loop raise notice 'notice %', i; end loop; "
+            "end $$"
+        );
+        pq_async::flush_async_log();
+        
+        auto after = pq_async::async_logging_stats();
+        ASSERT_THAT(after.written - before.written, testing::Ge(10u));
+        
+        // once stopped the records are written by the calling thread
+        pq_async::enable_async_logging(false);
+        ASSERT_FALSE(pq_async::async_logging_enabled());
+        uint64_t written = pq_async::async_logging_stats().written;
+        db->execute("do $$ begin raise notice 'sync'; end $$");
+        ASSERT_THAT(
+            pq_async::async_logging_stats().written, testing::Eq(written)
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
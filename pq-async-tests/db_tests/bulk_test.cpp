@@ -0,0 +1,169 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class bulk_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists bulk_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table bulk_test("
+            "id int8 primary key, name text, score float8, flag bool"
+            ");"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+    }
+    
+    void TearDown() override
+    {
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(bulk_test, column_parameter_test)
+{
+    try{
+        std::vector<int32_t> ints = { 1, -2, 3 };
+        auto arr = db->query_value<arr_int32>(
+            "select $1::int4[]", unnest_parameters(ints)
+        );
+        ASSERT_THAT(arr.size(), testing::Eq(3u));
+        ASSERT_THAT(arr[1], testing::Eq(-2));
+        
+        std::vector<std::string> empty;
+        auto len = db->query_value<int32_t>(
+            "select coalesce(array_length($1, 1), 0)",
+            unnest_parameters(empty)
+        );
+        ASSERT_THAT(len, testing::Eq(0));
+        
+        std::vector<int64_t> a = { 1, 2 };
+        std::vector<int64_t> b = { 1 };
+        ASSERT_THROW(unnest_parameters(a, b), pq_async::exception);
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(bulk_test, unnest_insert_test)
+{
+    try{
+        std::vector<int64_t> ids;
+        std::vector<std::string> names;
+        std::vector<double> scores;
+        std::vector<bool> flags;
+        for(int64_t i = 0; i < 5000; ++i){
+            ids.emplace_back(i);
+            names.emplace_back("name " + md::num_to_str(i, false));
+            scores.emplace_back(i / 2.0);
+            flags.emplace_back(i % 2 == 0);
+        }
+        
+        std::string sql = unnest_insert_sql(
+            "bulk_test", { "id", "name", "score", "flag" }
+        );
+        auto n = db->execute(
+            sql.c_str(), unnest_parameters(ids, names, scores, flags)
+        );
+        ASSERT_THAT(n, testing::Eq(5000));
+        
+        auto r = db->query_single(
+            "select name, score, flag from bulk_test where id = 4999"
+        );
+        ASSERT_THAT(r->as_text("name"), testing::Eq("name 4999"));
+        ASSERT_THAT(r->as_double("score"), testing::Eq(2499.5));
+        ASSERT_THAT(r->as_bool("flag"), testing::Eq(false));
+        
+        // upsert
+        std::vector<int64_t> up_ids = { 1, 6000 };
+        std::vector<std::string> up_names = { "one", "six thousand" };
+        sql = unnest_insert_sql(
+            "bulk_test", { "id", "name" },
+            "on conflict (id) do update set name = excluded.name"
+        );
+        bool done = false;
+        db->execute(sql.c_str(), unnest_parameters(up_ids, up_names),
+        [&done](const md::callback::cb_error& err, int n){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(n, testing::Eq(2));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(
+            db->query_value<std::string>(
+                "select name from bulk_test where id = 1"
+            ),
+            testing::Eq("one")
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(bulk_test, quote_ident_test)
+{
+    try{
+        ASSERT_THAT(
+            unnest_insert_sql("public.Bulk", { "id", "a\"b" }),
+            testing::Eq(
+                "insert into \"public\".\"Bulk\"(\"id\", \"a\"\"b\") "
+                "select * from unnest($1, $2)"
+            )
+        );
+        ASSERT_THROW(quote_ident(""), pq_async::exception);
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
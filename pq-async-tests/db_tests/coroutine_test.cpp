@@ -0,0 +1,186 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+#if PQ_ASYNC_REQUIRE_COROUTINES && !PQ_ASYNC_HAS_COROUTINES
+#error "the coroutine tests require a C++20 compiler"
+#endif
+
+#if PQ_ASYNC_HAS_COROUTINES
+
+namespace pq_async{ namespace tests{
+
+class coroutine_test
+    : public db_test_base
+{
+public:
+    void run(pq_async::task<void> t)
+    {
+        bool done = false;
+        t.start([&done](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            done = true;
+        });
+        wait_until([&done](){ return done;});
+        ASSERT_THAT(done, testing::Eq(true));
+    }
+};
+
+static pq_async::task<int64_t> count_rows(database db, int32_t n)
+{
+    auto tbl = co_await db->query_async(
+        "select generate_series(1, $1) as i", n
+    );
+    co_return (int64_t)tbl->size();
+}
+
+static pq_async::task<void> queries(database db)
+{
+    int64_t n = co_await count_rows(db, 25);
+    EXPECT_THAT(n, testing::Eq(25));
+    
+    auto r = co_await db->query_single_async(
+        "select $1::int8 as a, $2::text as b", (int64_t)7, "seven"
+    );
+    EXPECT_THAT(r->as_int64("a"), testing::Eq(7));
+    EXPECT_THAT(r->as_text("b"), testing::Eq("seven"));
+    
+    int64_t v = co_await db->query_value_async<int64_t>(
+        "select $1::int8 * 2", (int64_t)21
+    );
+    EXPECT_THAT(v, testing::Eq(42));
+    
+    int32_t affected = co_await db->execute_async(
+        "update coroutine_test set v = v + 1"
+    );
+    EXPECT_THAT(affected, testing::Eq(3));
+}
+
+static pq_async::task<void> reader_rows(database db)
+{
+    auto reader = co_await db->query_reader_async(
+        "select generate_series(1, 100)::int8 as i"
+    );
+    int64_t sum = 0;
+    int64_t cnt = 0;
+    while(auto row = co_await reader->next_async()){
+        sum += row->as_int64("i");
+        ++cnt;
+    }
+    EXPECT_THAT(cnt, testing::Eq(100));
+    EXPECT_THAT(sum, testing::Eq(5050));
+}
+
+static pq_async::task<void> prepared(database db)
+{
+    auto dp = db->prepare(
+        "coroutine_prepared", "select $1 a, $2 b", false,
+        data_type::bigint, data_type::text
+    );
+    auto r = co_await dp->query_single_async((int64_t)64, "abc");
+    EXPECT_THAT(r->as_int64("a"), testing::Eq(64));
+    EXPECT_THAT(r->as_text("b"), testing::Eq("abc"));
+    
+    int64_t v = co_await dp->query_value_async<int64_t>((int64_t)3, "x");
+    EXPECT_THAT(v, testing::Eq(3));
+}
+
+static pq_async::task<void> sql_error(database db)
+{
+    bool thrown = false;
+    try{
+        co_await db->execute_async("select * from no_such_coroutine_table");
+    }catch(const pq_async::sql_exception& err){
+        EXPECT_THAT(err.sqlstate(), testing::Eq("42P01"));
+        thrown = true;
+    }
+    EXPECT_THAT(thrown, testing::Eq(true));
+    
+    // the connection is still usable after the error
+    int64_t v = co_await db->query_value_async<int64_t>("select 1::int8");
+    EXPECT_THAT(v, testing::Eq(1));
+}
+
+
+TEST_F(coroutine_test, query_test)
+{
+    try{
+        db->execute("drop table if exists coroutine_test");
+        db->execute("create table coroutine_test(id int4, v int4)");
+        db->execute("insert into coroutine_test values(1,1),(2,2),(3,3)");
+        
+        this->run(queries(db));
+        ASSERT_THAT(
+            db->query_value<int64_t>("select sum(v) from coroutine_test"),
+            testing::Eq(9)
+        );
+        db->execute("drop table if exists coroutine_test");
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(coroutine_test, reader_test)
+{
+    try{
+        this->run(reader_rows(db));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(coroutine_test, prepared_test)
+{
+    try{
+        this->run(prepared(db));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(coroutine_test, sql_error_test)
+{
+    try{
+        this->run(sql_error(db));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
+
+#endif //PQ_ASYNC_HAS_COROUTINES
@@ -119,5 +119,69 @@ TEST_F(data_prepared_test, data_prepared_test)
     }
 }
 
+TEST_F(data_prepared_test, execute_many_test)
+{
+    try{
+        auto dp = db->prepare(
+            "ins_many", "insert into data_prepared_test(id, value) "
+            "values($1, $2)", true,
+            data_type::integer, data_type::text
+        );
+        
+        std::vector< std::tuple<int32_t, std::string> > rows;
+        for(int32_t i = 1; i <= 2500; ++i)
+            rows.emplace_back(i, "v" + md::num_to_str(i, false));
+        
+        auto r = dp->execute_many(rows);
+        ASSERT_THAT(r.affected, testing::Eq(2500));
+        ASSERT_THAT(r.executed, testing::Eq(2500u));
+        ASSERT_THAT(r.errors.size(), testing::Eq(0u));
+        ASSERT_THAT(
+            db->query_value<int64_t>("select count(*) from data_prepared_test"),
+            testing::Eq(2500)
+        );
+        
+        // duplicate key on the second row, the others are kept
+        std::vector<parameters_t> batch;
+        batch.emplace_back(parameters_t(3000, std::string("a")));
+        batch.emplace_back(parameters_t(1, std::string("dup")));
+        batch.emplace_back(parameters_t(3001, std::string("b")));
+        r = dp->execute_many(batch, batch_mode::isolated);
+        ASSERT_THAT(r.affected, testing::Eq(2));
+        ASSERT_THAT(r.errors.size(), testing::Eq(1u));
+        ASSERT_THAT(r.errors[0].index, testing::Eq(1u));
+        ASSERT_THAT(r.errors[0].sqlstate, testing::Eq("23505"));
+        
+        // a single implicit transaction, nothing is inserted
+        batch[0] = parameters_t(4000, std::string("c"));
+        batch[2] = parameters_t(4001, std::string("d"));
+        ASSERT_THROW(dp->execute_many(batch), pq_async::exception);
+        ASSERT_THAT(
+            db->query_value<int64_t>(
+                "select count(*) from data_prepared_test where id >= 4000"
+            ),
+            testing::Eq(0)
+        );
+        
+        bool done = false;
+        dp->execute_many(batch, batch_mode::isolated,
+        [&done](const md::callback::cb_error& err, batch_result r){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(r.affected, testing::Eq(2));
+            ASSERT_THAT(r.errors.size(), testing::Eq(1u));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(done, testing::Eq(true));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
 
 }} //namespace pq_async::tests
\ No newline at end of file
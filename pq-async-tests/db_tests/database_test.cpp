@@ -25,6 +25,31 @@ SOFTWARE.
 #include <gmock/gmock.h>
 #include "../db_test_base.h"
 
+#include <cstdlib>
+
+// counts the allocations of the calling thread while enabled
+static thread_local bool s_count_new = false;
+static thread_local int64_t s_new_count = 0;
+
+void* operator new(size_t n)
+{
+    if(s_count_new)
+        ++s_new_count;
+    if(void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
 namespace pq_async{ namespace tests{
 
 class database_test
@@ -256,4 +281,337 @@ TEST_F(database_test, max_connection_async2_test)
 }
 
 
+TEST_F(database_test, run_transaction_test)
+{
+    try{
+        int calls = 0;
+        db->run_transaction([&calls](database tdb){
+            tdb->execute(
+                "insert into database_test(value) values ($1)",
+                std::string("tx")
+            );
+            if(++calls == 1)
+                tdb->execute(
+                    "do $$ begin raise exception 'conflict' "
+                    "using errcode = 'serialization_failure'; end $$"
+                );
+        });
+        ASSERT_THAT(calls, testing::Eq(2));
+        ASSERT_THAT(db->in_transaction(), testing::Eq(false));
+        ASSERT_THAT(
+            db->query_value<int64_t>(
+                "select count(*) from database_test where value = 'tx'"
+            ),
+            testing::Eq(1)
+        );
+        
+        auto st = db->tx_stats();
+        ASSERT_THAT(st.attempts, testing::Eq(2));
+        ASSERT_THAT(st.retries, testing::Eq(1));
+        ASSERT_THAT(st.commits, testing::Eq(1));
+        
+        // other errors are not replayed
+        calls = 0;
+        try{
+            db->run_transaction([&calls](database tdb){
+                ++calls;
+                tdb->execute("select 1/0");
+            });
+            FAIL();
+        }catch(const sql_exception& err){
+            ASSERT_THAT(err.sqlstate(), testing::Eq("22012"));
+        }
+        ASSERT_THAT(calls, testing::Eq(1));
+        ASSERT_THAT(db->tx_stats().failures, testing::Eq(1));
+        
+        // the attempts are bounded
+        transaction_policy policy;
+        policy.max_attempts = 3;
+        policy.base_delay_ms = 1;
+        calls = 0;
+        ASSERT_THROW(
+            db->run_transaction([&calls](database tdb){
+                ++calls;
+                tdb->execute(
+                    "do $$ begin raise exception 'deadlock' "
+                    "using errcode = 'deadlock_detected'; end $$"
+                );
+            }, policy),
+            sql_exception
+        );
+        ASSERT_THAT(calls, testing::Eq(3));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(database_test, run_transaction_async_test)
+{
+    try{
+        int calls = 0;
+        bool done = false;
+        db->run_transaction(
+        [&calls](database tdb, const md::callback::async_cb& tx_done){
+            const char* sql = ++calls == 1 ?
+                "do $$ begin raise exception 'conflict' "
+                "using errcode = 'serialization_failure'; end $$" :
+                "insert into database_test(value) values ('async tx')";
+            tdb->execute(sql, [tx_done](const md::callback::cb_error& err){
+                tx_done(err);
+            });
+        },
+        [&done](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            done = true;
+        });
+        
+        for(int i = 0; i < 500 && !done; ++i){
+            md::event_queue_t::get_default()->run_n();
+            usleep(2000);
+        }
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(calls, testing::Eq(2));
+        ASSERT_THAT(db->tx_stats().retries, testing::Eq(1));
+        ASSERT_THAT(
+            db->query_value<int64_t>(
+                "select count(*) from database_test where value = 'async tx'"
+            ),
+            testing::Eq(1)
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(database_test, connection_task_pool_test)
+{
+    try{
+        int done = 0;
+        std::function<void()> next;
+        next = [this, &done, &next](){
+            db->query_value<int64_t>("select $1::int8", (int64_t)done,
+            [&done, &next](const md::callback::cb_error& err, int64_t v){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                }
+                ASSERT_THAT(v, testing::Eq(done));
+                if(++done < 200)
+                    next();
+            });
+        };
+        
+        auto before = connection_task_t::pool_stats();
+        next();
+        for(int i = 0; i < 2000 && done < 200; ++i){
+            md::event_queue_t::get_default()->run_n();
+            usleep(500);
+        }
+        ASSERT_THAT(done, testing::Eq(200));
+        
+        // the sequential queries run on recycled tasks
+        auto after = connection_task_t::pool_stats();
+        ASSERT_THAT(after.created - before.created, testing::Le(2u));
+        ASSERT_THAT(after.reused - before.reused, testing::Ge(198u));
+        ASSERT_THAT(after.idle, testing::Gt(0u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+
+TEST_F(database_test, connection_task_alloc_test)
+{
+    try{
+        auto cycle = [this](){
+            auto ct = connection_task_t::acquire(
+                db->get_strand().get(), db, nullptr,
+            [self=db](const md::callback::cb_error&, connection_lock){});
+            ct.reset();
+            auto qt = connection_task_t::acquire(
+                db->get_strand().get(), db, connection_lock(),
+            [self=db](const md::callback::cb_error&, PGresult*){});
+            qt.reset();
+        };
+        // fills the pool of this thread
+        cycle();
+        
+        s_new_count = 0;
+        s_count_new = true;
+        for(int i = 0; i < 100; ++i)
+            cycle();
+        s_count_new = false;
+        
+        // the steady state connect and query tasks don't allocate
+        ASSERT_THAT(s_new_count, testing::Eq(0));
+        
+    }catch(const std::exception& err){
+        s_count_new = false;
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+
+TEST_F(database_test, connection_task_params_leak_test)
+{
+    try{
+        // moving and copying parameters must not leak or double free them,
+        // the live parameters are only counted by the debug builds
+        #if PQ_ASYNC_BUILD_DEBUG
+        int64_t base = parameter::live_count();
+        #endif
+        {
+            parameters_t a((int64_t)1, std::string("a"));
+            parameters_t b((int64_t)2);
+            a.types();
+            b = std::move(a);
+            ASSERT_THAT(b.size(), testing::Eq(2));
+            ASSERT_THAT(a.size(), testing::Eq(0));
+            parameters_t c(std::move(b));
+            b = c;
+            b = c;
+            ASSERT_THAT(b.size(), testing::Eq(2));
+            #if PQ_ASYNC_BUILD_DEBUG
+            ASSERT_THAT(parameter::live_count() - base, testing::Eq(4));
+            #endif
+        }
+        #if PQ_ASYNC_BUILD_DEBUG
+        ASSERT_THAT(parameter::live_count(), testing::Eq(base));
+        #endif
+        
+        int done = 0;
+        std::function<void()> next;
+        next = [this, &done, &next](){
+            db->query_value<int64_t>(
+                "select $1::int8 + length($2)", (int64_t)done,
+                std::string("leak"),
+            [&done, &next](const md::callback::cb_error& err, int64_t v){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                }
+                ASSERT_THAT(v, testing::Eq(done + 4));
+                if(++done < 100)
+                    next();
+            });
+        };
+        
+        next();
+        for(int i = 0; i < 2000 && done < 100; ++i){
+            md::event_queue_t::get_default()->run_n();
+            usleep(500);
+        }
+        ASSERT_THAT(done, testing::Eq(100));
+        md::event_queue_t::get_default()->run();
+        
+        // the recycled tasks released the parameters of every query
+        #if PQ_ASYNC_BUILD_DEBUG
+        ASSERT_THAT(parameter::live_count(), testing::Eq(base));
+        #endif
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+
+TEST_F(database_test, wait_for_sync_test)
+{
+    try{
+        bool done = false;
+        db->execute("select pg_sleep(0.3)",
+        [&done](const md::callback::cb_error& err, int32_t){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            done = true;
+        });
+        
+        // the sync call waits for the pending async query without
+        // burning a core
+        std::clock_t cpu_start = std::clock();
+        auto start = std::chrono::steady_clock::now();
+        auto v = db->query_value<int64_t>("select 42::int8");
+        auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+        double cpu_ms = (std::clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+        
+        ASSERT_THAT(v, testing::Eq(42));
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(wall_ms, testing::Ge(250));
+        ASSERT_THAT(cpu_ms, testing::Lt(wall_ms / 2.0));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(database_test, future_test)
+{
+    try{
+        std::atomic<bool> worker_done(false);
+        std::exception_ptr worker_err;
+        int64_t sum = 0;
+        
+        // the worker issues every query before joining any of them
+        std::thread worker([this, &worker_done, &worker_err, &sum](){
+            try{
+                std::vector< db_future<int64_t> > values;
+                for(int64_t i = 0; i < 20; ++i)
+                    values.emplace_back(
+                        db->query_value_future<int64_t>("select $1::int8", i)
+                    );
+                auto tbl = db->query_future(
+                    "select generate_series(1, 10) as i"
+                );
+                auto bad = db->execute_future("select * from no_such_table");
+                
+                for(auto& v : values)
+                    sum += v.get();
+                if(tbl.get()->size() != 10)
+                    throw pq_async::exception("invalid row count");
+                try{
+                    bad.get();
+                    throw pq_async::exception("no error raised");
+                }catch(const pq_async::sql_exception& err){
+                    if(err.sqlstate() != "42P01")
+                        throw;
+                }
+            }catch(...){
+                worker_err = std::current_exception();
+            }
+            worker_done = true;
+        });
+        
+        for(int i = 0; i < 2000 && !worker_done; ++i){
+            md::event_queue_t::get_default()->run_n();
+            usleep(500);
+        }
+        worker.join();
+        if(worker_err)
+            std::rethrow_exception(worker_err);
+        ASSERT_THAT(sum, testing::Eq(190));
+        
+        ASSERT_THAT(db_future<int32_t>().valid(), testing::Eq(false));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
 }} //namespace pq_async::tests
\ No newline at end of file
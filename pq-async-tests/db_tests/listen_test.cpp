@@ -0,0 +1,130 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class listen_test
+    : public db_test_base
+{
+public:
+    using db_test_base::wait_until;
+    
+    template<typename PRED>
+    void wait_until(pq_async::database ldb, const PRED& pred)
+    {
+        wait_until(pred, [&ldb](){ ldb->listener()->poll();}, 200, 10000);
+    }
+};
+
+
+TEST_F(listen_test, batch_test)
+{
+    try{
+        auto ldb = pq_async::open(connection_string());
+        
+        int calls = 0;
+        std::vector<std::string> payloads;
+        ldb->listen("listen_test",
+        [&calls, &payloads](
+            const md::callback::cb_error& err, notifications batch
+        ){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            ++calls;
+            for(auto& n : batch){
+                ASSERT_THAT(n.channel, testing::Eq("listen_test"));
+                payloads.emplace_back(n.payload);
+            }
+        });
+        ASSERT_THAT(ldb->listener()->listening("listen_test"), testing::Eq(true));
+        
+        // delivered together on commit
+        db->begin();
+        db->execute("select pg_notify('listen_test', 'a')");
+        db->execute("select pg_notify('listen_test', 'b')");
+        db->execute("select pg_notify('listen_test', 'c')");
+        db->commit();
+        
+        this->wait_until(ldb, [&payloads](){ return payloads.size() >= 3;});
+        ASSERT_THAT(payloads, testing::ElementsAre("a", "b", "c"));
+        ASSERT_THAT(calls, testing::Le(3));
+        
+        ldb->unlisten("listen_test");
+        ASSERT_THAT(ldb->listener()->channel_count(), testing::Eq(0u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(listen_test, reconnect_test)
+{
+    try{
+        auto ldb = pq_async::open(connection_string());
+        
+        int errors = 0;
+        std::vector<std::string> payloads;
+        ldb->listen("listen_reconnect_test",
+        [&errors, &payloads](
+            const md::callback::cb_error& err, notifications batch
+        ){
+            if(err){
+                ++errors;
+                return;
+            }
+            for(auto& n : batch)
+                payloads.emplace_back(n.payload);
+        });
+        
+        db->execute(
+            "select pg_terminate_backend(pid) from pg_stat_activity "
+            "where query = 'LISTEN \"listen_reconnect_test\"' "
+            "and pid <> pg_backend_pid()"
+        );
+        this->wait_until(ldb, [&errors](){ return errors > 0;});
+        ASSERT_THAT(errors, testing::Eq(1));
+        ASSERT_THAT(ldb->listener()->reconnections(), testing::Eq(1));
+        
+        // the channel is listened again asynchronously
+        this->wait_until(ldb, [&ldb](){ return ldb->listener()->ready();});
+        ASSERT_THAT(ldb->listener()->ready(), testing::Eq(true));
+        
+        db->execute("select pg_notify('listen_reconnect_test', 'after')");
+        this->wait_until(ldb, [&payloads](){ return !payloads.empty();});
+        ASSERT_THAT(payloads, testing::ElementsAre("after"));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,240 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class lo_stream_test
+    : public db_test_base
+{
+};
+
+
+TEST_F(lo_stream_test, write_read_test)
+{
+    try{
+        auto lo = db->create_lo();
+        
+        std::vector<int8_t> src(10000);
+        for(size_t i = 0; i < src.size(); ++i)
+            src[i] = (int8_t)(i % 251);
+        
+        auto w = lo->writer(0, 1024, 2);
+        int written = 0;
+        bool flushed = false;
+        for(size_t i = 0; i < src.size(); i += 700){
+            size_t n = std::min<size_t>(700, src.size() - i);
+            w->write((const char*)src.data() + i, n,
+            [&written](const md::callback::cb_error& err){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                    return;
+                }
+                ++written;
+            });
+        }
+        w->flush([&flushed](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            flushed = true;
+        });
+        this->wait_until([&flushed](){ return flushed;});
+        ASSERT_THAT(flushed, testing::Eq(true));
+        ASSERT_THAT(written, testing::Eq(15));
+        ASSERT_THAT(w->written(), testing::Eq((int64_t)src.size()));
+        
+        int64_t size = -1;
+        lo->size([&size](const md::callback::cb_error& err, int64_t val){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            size = val;
+        });
+        this->wait_until([&size](){ return size != -1;});
+        ASSERT_THAT(size, testing::Eq((int64_t)src.size()));
+        
+        auto r = lo->reader(0, 1024, 3);
+        std::vector<int8_t> dst;
+        bool done = false;
+        std::function<void()> next;
+        next = [&](){
+            r->next([&](
+                const md::callback::cb_error& err, std::vector<int8_t> chunk
+            ){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    done = true;
+                    FAIL();
+                    return;
+                }
+                if(chunk.empty()){
+                    done = true;
+                    return;
+                }
+                dst.insert(dst.end(), chunk.begin(), chunk.end());
+                next();
+            });
+        };
+        next();
+        this->wait_until([&done](){ return done;});
+        ASSERT_THAT(r->eof(), testing::Eq(true));
+        ASSERT_THAT(dst.size(), testing::Eq(src.size()));
+        ASSERT_THAT(dst == src, testing::Eq(true));
+        
+        std::vector<int8_t> part;
+        bool part_done = false;
+        lo->read(9990, 100,
+        [&part, &part_done](
+            const md::callback::cb_error& err, std::vector<int8_t> data
+        ){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            part = data;
+            part_done = true;
+        });
+        this->wait_until([&part_done](){ return part_done;});
+        ASSERT_THAT(part.size(), testing::Eq(10u));
+        
+        lo->unlink();
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(lo_stream_test, parallel_transfer_test)
+{
+    try{
+        auto lo = db->create_lo();
+        
+        std::vector<int8_t> src(20000);
+        for(size_t i = 0; i < src.size(); ++i)
+            src[i] = (int8_t)(i % 241);
+        
+        int64_t progress = 0;
+        bool uploaded = false;
+        lo->upload(src, [&uploaded](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            uploaded = true;
+        }, 3, 2048,
+        [&progress](int64_t done, int64_t total){
+            ASSERT_THAT(done, testing::Gt(progress));
+            ASSERT_THAT(total, testing::Eq(20000));
+            progress = done;
+        });
+        this->wait_until([&uploaded](){ return uploaded;});
+        ASSERT_THAT(progress, testing::Eq((int64_t)src.size()));
+        
+        std::vector<int8_t> dst;
+        bool downloaded = false;
+        lo->download([&dst, &downloaded](
+            const md::callback::cb_error& err, std::vector<int8_t> data
+        ){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            dst = std::move(data);
+            downloaded = true;
+        }, 4, 4096);
+        this->wait_until([&downloaded](){ return downloaded;});
+        ASSERT_THAT(dst.size(), testing::Eq(src.size()));
+        ASSERT_THAT(dst == src, testing::Eq(true));
+        
+        lo->unlink();
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(lo_stream_test, shared_upload_test)
+{
+    try{
+        auto lo = db->create_lo();
+        
+        auto src = std::make_shared< std::vector<int8_t> >(10000);
+        for(size_t i = 0; i < src->size(); ++i)
+            (*src)[i] = (int8_t)(i % 239);
+        
+        std::vector<int64_t> steps;
+        bool uploaded = false;
+        // 1000 is rounded up to the 2048 bytes of a server page
+        lo->upload(std::shared_ptr< const std::vector<int8_t> >(src),
+        [&uploaded](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            uploaded = true;
+        }, 1, 1000,
+        [&steps](int64_t done, int64_t total){
+            steps.push_back(done);
+        });
+        this->wait_until([&uploaded](){ return uploaded;});
+        ASSERT_THAT(
+            steps, testing::ElementsAre(2048, 4096, 6144, 8192, 10000)
+        );
+        // the data is shared, not copied, and released once uploaded
+        ASSERT_THAT(src.use_count(), testing::Eq(1));
+        
+        std::vector<int8_t> dst;
+        bool downloaded = false;
+        lo->download([&dst, &downloaded](
+            const md::callback::cb_error& err, std::vector<int8_t> data
+        ){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            dst = std::move(data);
+            downloaded = true;
+        });
+        this->wait_until([&downloaded](){ return downloaded;});
+        ASSERT_THAT(dst == *src, testing::Eq(true));
+        
+        lo->unlink();
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,247 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class multiplexing_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists multiplexing_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table multiplexing_test("
+            "id serial primary key, value text"
+            ");"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+    }
+    
+    void TearDown() override
+    {
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(multiplexing_test, release_test)
+{
+    try{
+        auto mdb = pq_async::open(connection_string());
+        mdb->multiplexing(true);
+        
+        mdb->execute(
+            "insert into multiplexing_test(value) values ($1)",
+            std::string("abc")
+        );
+        ASSERT_THAT(mdb->holds_connection(), testing::Eq(false));
+        
+        mdb->begin();
+        mdb->execute(
+            "insert into multiplexing_test(value) values ($1)",
+            std::string("def")
+        );
+        // the connection is pinned until the end of the transaction
+        ASSERT_THAT(mdb->holds_connection(), testing::Eq(true));
+        mdb->commit();
+        ASSERT_THAT(mdb->holds_connection(), testing::Eq(false));
+        
+        auto cnt = mdb->query_value<int64_t>(
+            "select count(*) from multiplexing_test"
+        );
+        ASSERT_THAT(cnt, testing::Eq(2));
+        ASSERT_THAT(mdb->holds_connection(), testing::Eq(false));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(multiplexing_test, many_sessions_test)
+{
+    try{
+        std::vector<pq_async::database> dbs;
+        for(int i = 0; i < 200; ++i){
+            dbs.emplace_back(pq_async::open(connection_string()));
+            dbs.back()->multiplexing(true);
+        }
+        
+        int completed = 0;
+        for(int32_t i = 0; i < (int32_t)dbs.size(); ++i)
+            dbs[i]->query_value<int32_t>("select $1::int4", i,
+            [&completed, i](const md::callback::cb_error& err, int32_t v){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                    return;
+                }
+                ASSERT_THAT(v, testing::Eq(i));
+                ++completed;
+            });
+        
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(completed, testing::Eq((int)dbs.size()));
+        for(auto& d : dbs)
+            ASSERT_THAT(d->holds_connection(), testing::Eq(false));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(multiplexing_test, reprepare_test)
+{
+    try{
+        auto mdb = pq_async::open(connection_string());
+        mdb->multiplexing(true);
+        
+        auto dp = mdb->prepare(
+            "multiplexing_ins",
+            "insert into multiplexing_test(value) values ($1)", true,
+            data_type::text
+        );
+        ASSERT_THAT(mdb->holds_connection(), testing::Eq(false));
+        
+        for(int i = 0; i < 10; ++i){
+            // borrow the connections in a different order so that
+            // the statement is executed on a fresh session.
+            auto other = pq_async::open(connection_string());
+            other->begin();
+            dp->execute(std::string("v") + md::num_to_str(i, false));
+            other->rollback();
+        }
+        
+        auto cnt = db->query_value<int64_t>(
+            "select count(*) from multiplexing_test"
+        );
+        ASSERT_THAT(cnt, testing::Eq(10));
+        
+        bool done = false;
+        dp->execute(std::string("async"),
+        [&done](const md::callback::cb_error& err, int32_t n){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            ASSERT_THAT(n, testing::Eq(1));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(done, testing::Eq(true));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(multiplexing_test, same_name_other_sql_test)
+{
+    try{
+        // both sessions share the physical connections of the pool
+        auto db1 = pq_async::open(connection_string());
+        db1->multiplexing(true);
+        auto db2 = pq_async::open(connection_string());
+        db2->multiplexing(true);
+        
+        auto dp1 = db1->prepare(
+            "multiplexing_same", "select 1::int4 as v", true
+        );
+        auto dp2 = db2->prepare(
+            "multiplexing_same", "select 2::int4 as v", true
+        );
+        
+        for(int i = 0; i < 5; ++i){
+            ASSERT_THAT(dp1->query_value<int32_t>(), testing::Eq(1));
+            ASSERT_THAT(dp2->query_value<int32_t>(), testing::Eq(2));
+        }
+        
+        int32_t v1 = 0, v2 = 0;
+        dp1->query_value<int32_t>(
+        [&v1](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            v1 = v;
+        });
+        dp2->query_value<int32_t>(
+        [&v2](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            v2 = v;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(v1, testing::Eq(1));
+        ASSERT_THAT(v2, testing::Eq(2));
+        
+        // the asynchronous prepare replaces the name held by db1 as well
+        auto db3 = pq_async::open(connection_string());
+        db3->multiplexing(true);
+        data_prepared dp3;
+        db3->prepare("multiplexing_same", "select 3::int4 as v", true,
+        [&dp3](const md::callback::cb_error& err, data_prepared dp){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            dp3 = dp;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT((bool)dp3, testing::Eq(true));
+        for(int i = 0; i < 5; ++i){
+            ASSERT_THAT(dp3->query_value<int32_t>(), testing::Eq(3));
+            ASSERT_THAT(dp1->query_value<int32_t>(), testing::Eq(1));
+        }
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
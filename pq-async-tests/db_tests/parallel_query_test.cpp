@@ -0,0 +1,144 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class parallel_query_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists parallel_query_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table parallel_query_test("
+            "id int8 primary key, value int8"
+            ");"
+        );
+        db->execute(
+            "insert into parallel_query_test "
+            "select i, i * 2 from generate_series(1, 1000) i"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+        pq = pq_async::open_parallel_query(pq_async_connection_string, 3);
+    }
+    
+    void TearDown() override
+    {
+        pq.reset();
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+    
+    pq_async::parallel_query pq;
+};
+
+
+TEST_F(parallel_query_test, key_ranges_test)
+{
+    auto parts = pq_async::parallel_query_t::key_ranges(1, 1000, 7);
+    ASSERT_THAT(parts.size(), testing::Eq(7u));
+    
+    auto one = pq_async::parallel_query_t::key_ranges(5, 5, 4);
+    ASSERT_THAT(one.size(), testing::Eq(1u));
+    
+    ASSERT_THROW(
+        pq_async::parallel_query_t::key_ranges(10, 1, 4),
+        pq_async::exception
+    );
+}
+
+TEST_F(parallel_query_test, sync_key_ranges_test)
+{
+    try{
+        std::set<int64_t> ids;
+        int64_t sum = 0;
+        pq->run(
+            "select id, value from parallel_query_test "
+            "where id >= $1 and id < $2",
+            pq_async::parallel_query_t::key_ranges(1, 1000, 10),
+        [&ids, &sum](data_row row){
+            ids.insert(row->as<int64_t>("id"));
+            sum += row->as<int64_t>("value");
+        });
+        
+        ASSERT_THAT(ids.size(), testing::Eq(1000u));
+        ASSERT_THAT(sum, testing::Eq(1001000));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(parallel_query_test, async_block_ranges_test)
+{
+    try{
+        auto parts = pq->block_ranges("parallel_query_test", 4);
+        ASSERT_THAT(parts.size(), testing::Ge(1u));
+        
+        std::set<int64_t> ids;
+        bool done = false;
+        pq->run(
+            "select id from parallel_query_test "
+            "where ctid >= $1::tid and ctid < $2::tid",
+            parts,
+        [&ids](data_row row){
+            ids.insert(row->as<int64_t>("id"));
+        },
+        [&done](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            done = true;
+        });
+        
+        for(int i = 0; i < 500 && !done; ++i){
+            md::event_queue_t::get_default()->run_n();
+            usleep(2000);
+        }
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(ids.size(), testing::Eq(1000u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,142 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class pool_group_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists pool_group_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table pool_group_test("
+            "id serial primary key, value text"
+            ");"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+        
+        // the same server is used as primary and replicas,
+        // each member still get its own routing statistics.
+        grp = pq_async::open_pool_group(
+            pq_async_connection_string,
+            { pq_async_connection_string, pq_async_connection_string }
+        );
+    }
+    
+    void TearDown() override
+    {
+        grp.reset();
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+    
+    pq_async::pool_group grp;
+};
+
+
+TEST_F(pool_group_test, routing_sync_test)
+{
+    try{
+        grp->execute(
+            "insert into pool_group_test(value) values ($1)",
+            std::string("abc")
+        );
+        ASSERT_THAT(grp->primary_member()->requests(), testing::Eq(1));
+        
+        for(int i = 0; i < 4; ++i){
+            auto tbl = grp->query("select * from pool_group_test");
+            ASSERT_THAT(tbl->size(), testing::Eq(1u));
+        }
+        
+        auto cnt = grp->query_value<int64_t>(
+            pool_route::primary, "select count(*) from pool_group_test"
+        );
+        ASSERT_THAT(cnt, testing::Eq(1));
+        ASSERT_THAT(grp->primary_member()->requests(), testing::Eq(2));
+        
+        int64_t replica_requests = 0;
+        for(auto m : grp->replica_members()){
+            ASSERT_THAT(m->outstanding(), testing::Eq(0));
+            // least outstanding spread the sequential calls
+            ASSERT_THAT(m->requests(), testing::Gt(0));
+            replica_requests += m->requests();
+        }
+        ASSERT_THAT(replica_requests, testing::Eq(4));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(pool_group_test, routing_async_test)
+{
+    try{
+        grp->balancing(pool_balancing::ewma_latency);
+        
+        int completed = 0;
+        for(int i = 0; i < 10; ++i){
+            grp->query_value<int32_t>(
+                "select $1::int4", i,
+            [&completed, i](const md::callback::cb_error& err, int32_t v){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                    return;
+                }
+                ASSERT_THAT(v, testing::Eq(i));
+                ++completed;
+            });
+        }
+        
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(completed, testing::Eq(10));
+        
+        for(auto m : grp->replica_members()){
+            ASSERT_THAT(m->outstanding(), testing::Eq(0));
+            if(m->requests() > 0)
+                ASSERT_THAT(m->ewma_latency_us(), testing::Gt(0));
+        }
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <thread>
+
+namespace pq_async{ namespace tests{
+
+class reactor_test
+    : public db_test_base
+{
+public:
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        r = pq_async::open_epoll_reactor();
+        pq_async::set_default_reactor(r);
+    }
+    
+    void TearDown() override
+    {
+        pq_async::set_default_reactor(nullptr);
+        db_test_base::TearDown();
+    }
+    
+    template<typename PRED>
+    void run_until(const PRED& pred)
+    {
+        for(int i = 0; i < 1000 && !pred(); ++i)
+            r->run_once(5);
+    }
+    
+    epoll_reactor r;
+};
+
+
+TEST_F(reactor_test, epoll_query_test)
+{
+    try{
+        int done = 0;
+        for(int64_t i = 0; i < 5; ++i)
+            db->query_value<int64_t>("select $1::int8 * 2", i,
+            [&done, i](const md::callback::cb_error& err, int64_t v){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                }
+                ASSERT_THAT(v, testing::Eq(i * 2));
+                ++done;
+            });
+        
+        // only the epoll reactor drives the queries
+        run_until([&done](){ return done == 5;});
+        ASSERT_THAT(done, testing::Eq(5));
+        
+        run_until([this](){ return r->size() == 0;});
+        ASSERT_THAT(r->size(), testing::Eq(0u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(reactor_test, epoll_timer_test)
+{
+    try{
+        int fired = 0;
+        auto start = std::chrono::steady_clock::now();
+        r->add_timer(30, [&fired](){ ++fired;});
+        r->add_timer(0, [&fired](){ ++fired;});
+        
+        ASSERT_THAT(r->run_once(0), testing::Eq(1u));
+        run_until([&fired](){ return fired == 2;});
+        ASSERT_THAT(fired, testing::Eq(2));
+        ASSERT_THAT(
+            std::chrono::steady_clock::now() - start,
+            testing::Ge(std::chrono::milliseconds(30))
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(reactor_test, epoll_nested_fd_test)
+{
+    try{
+        // the host loop only waits on the reactor descriptor
+        int host = epoll_create1(EPOLL_CLOEXEC);
+        ASSERT_THAT(host, testing::Ge(0));
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = r->fd();
+        ASSERT_THAT(
+            epoll_ctl(host, EPOLL_CTL_ADD, r->fd(), &ev), testing::Eq(0)
+        );
+        auto pump = [this, host](const std::function<bool()>& pred){
+            epoll_event out;
+            for(int i = 0; i < 200 && !pred(); ++i)
+                if(epoll_wait(host, &out, 1, 50) > 0)
+                    r->run_once(0);
+        };
+        
+        int fired = 0;
+        r->add_timer(20, [&fired](){ ++fired;});
+        pump([&fired](){ return fired == 1;});
+        ASSERT_THAT(fired, testing::Eq(1));
+        
+        int done = 0;
+        db->query_value<int64_t>("select 21::int8 * 2",
+        [&done](const md::callback::cb_error& err, int64_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(v, testing::Eq(42));
+            ++done;
+        });
+        pump([&done](){ return done == 1;});
+        ASSERT_THAT(done, testing::Eq(1));
+        
+        // a timer added from another thread wakes a blocked run_once
+        std::thread t([this](){
+            usleep(20000);
+            r->add_timer(0, [](){});
+        });
+        ASSERT_THAT(r->run_once(-1), testing::Ge(1u));
+        t.join();
+        ::close(host);
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
+
+#endif //__linux__
@@ -0,0 +1,146 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class replication_test
+    : public db_test_base
+{
+public:
+    bool logical_enabled()
+    {
+        return db->query_value<std::string>("show wal_level") == "logical";
+    }
+    
+    void drop_objects()
+    {
+        db->execute("drop publication if exists replication_test_pub");
+        db->execute("drop table if exists replication_test");
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->drop_objects();
+        db->execute(
+            "create table replication_test("
+            "id int4 primary key, value text"
+            ");"
+        );
+        db->execute(
+            "create publication replication_test_pub "
+            "for table replication_test"
+        );
+    }
+    
+    void TearDown() override
+    {
+        this->drop_objects();
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(replication_test, lsn_test)
+{
+    ASSERT_THAT(lsn_to_str(0x16B3748ULL), testing::Eq("0/16B3748"));
+    ASSERT_THAT(str_to_lsn("1/16B3748"), testing::Eq(0x1016B3748ULL));
+    ASSERT_THROW(str_to_lsn("invalid"), pq_async::exception);
+}
+
+TEST_F(replication_test, stream_test)
+{
+    try{
+        if(!this->logical_enabled()){
+            std::cout << "wal_level is not logical, skipped" << std::endl;
+            return;
+        }
+        
+        auto rs = pq_async::open_replication(connection_string());
+        uint64_t start = rs->create_slot("replication_test_slot", true);
+        ASSERT_THAT(start, testing::Gt(0u));
+        
+        std::vector<replication_change> changes;
+        rs->start("replication_test_slot", "replication_test_pub", 0,
+        [&changes](const md::callback::cb_error& err, replication_change c){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            changes.emplace_back(c);
+        });
+        
+        db->execute(
+            "insert into replication_test(id, value) values ($1, $2)",
+            1, std::string("abc")
+        );
+        db->execute(
+            "update replication_test set value = $1 where id = $2",
+            std::string("def"), 1
+        );
+        db->execute("delete from replication_test where id = $1", 1);
+        
+        for(int i = 0; i < 500 && changes.size() < 9; ++i){
+            rs->poll();
+            md::event_queue_t::get_default()->run_n();
+            usleep(10000);
+        }
+        
+        // begin, change, commit for each statement
+        ASSERT_THAT(changes.size(), testing::Eq(9u));
+        ASSERT_THAT(changes[0]->action, testing::Eq(replication_action::begin));
+        ASSERT_THAT(changes[2]->action, testing::Eq(replication_action::commit));
+        
+        auto ins = changes[1];
+        ASSERT_THAT(ins->action, testing::Eq(replication_action::insert));
+        ASSERT_THAT(ins->relation->relname, testing::Eq("replication_test"));
+        ASSERT_THAT(ins->new_tuple.as<int32_t>("id"), testing::Eq(1));
+        ASSERT_THAT(
+            ins->new_tuple.as<std::string>("value"), testing::Eq("abc")
+        );
+        
+        auto upd = changes[4];
+        ASSERT_THAT(upd->action, testing::Eq(replication_action::update));
+        ASSERT_THAT(
+            upd->new_tuple.as<std::string>("value"), testing::Eq("def")
+        );
+        
+        auto del = changes[7];
+        ASSERT_THAT(del->action, testing::Eq(replication_action::remove));
+        ASSERT_THAT(del->old_tuple.as<int32_t>("id"), testing::Eq(1));
+        
+        ASSERT_THAT(rs->confirmed_lsn(), testing::Eq(changes[8]->end_lsn));
+        rs->stop();
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
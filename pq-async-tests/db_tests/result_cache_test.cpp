@@ -0,0 +1,161 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class result_cache_test
+    : public db_test_base
+{
+};
+
+
+TEST_F(result_cache_test, hit_test)
+{
+    try{
+        auto cache = pq_async::open_result_cache(1024 * 1024);
+        auto cdb = pq_async::open(connection_string());
+        cdb->cache(cache, {"ref"});
+        
+        auto a = cdb->query("select $1::int4 as v", 7);
+        auto b = cdb->query("select $1::int4 as v", 7);
+        auto c = cdb->query("select $1::int4 as v", 8);
+        ASSERT_THAT(b.get(), testing::Eq(a.get()));
+        ASSERT_THAT(c.get(), testing::Ne(a.get()));
+        ASSERT_THAT(c->as_int32(0, "v"), testing::Eq(8));
+        
+        data_table d;
+        cdb->query("select $1::int4 as v", 7,
+        [&d](const md::callback::cb_error& err, data_table tbl){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            d = tbl;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(d.get(), testing::Eq(a.get()));
+        
+        auto s = cache->stats();
+        ASSERT_THAT(s.hits, testing::Eq(2));
+        ASSERT_THAT(s.misses, testing::Eq(2));
+        ASSERT_THAT(s.entries, testing::Eq(2u));
+        ASSERT_THAT(s.hit_rate(), testing::DoubleEq(0.5));
+        
+        cache->invalidate("ref");
+        ASSERT_THAT(cache->stats().entries, testing::Eq(0u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(result_cache_test, ttl_and_eviction_test)
+{
+    try{
+        auto probe = db->query("select $1::int4 as v", 1);
+        size_t entry_size = result_cache_t::table_size(probe) + 256;
+        
+        auto cache = pq_async::open_result_cache(entry_size * 2, 50);
+        auto cdb = pq_async::open(connection_string());
+        cdb->cache(cache);
+        
+        cdb->query("select $1::int4 as v", 1);
+        cdb->query("select $1::int4 as v", 2);
+        cdb->query("select $1::int4 as v", 3);
+        auto s = cache->stats();
+        ASSERT_THAT(s.evictions, testing::Ge(1));
+        ASSERT_THAT(s.bytes, testing::Le(entry_size * 2));
+        
+        usleep(100000);
+        cdb->query("select $1::int4 as v", 3);
+        ASSERT_THAT(cache->stats().expirations, testing::Eq(1));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(result_cache_test, notify_invalidation_test)
+{
+    try{
+        auto cache = pq_async::open_result_cache(1024 * 1024);
+        cache->listen(connection_string(), "result_cache_test");
+        
+        auto cdb = pq_async::open(connection_string());
+        cdb->cache(cache, {"countries"});
+        cdb->query("select 'ca'::text as code");
+        ASSERT_THAT(cache->stats().entries, testing::Eq(1u));
+        
+        db->execute("select pg_notify('result_cache_test', 'cities')");
+        db->execute("select pg_notify('result_cache_test', 'countries')");
+        
+        for(int i = 0; i < 100 && cache->stats().entries > 0; ++i){
+            cache->poll();
+            md::event_queue_t::get_default()->run_n();
+            usleep(10000);
+        }
+        ASSERT_THAT(cache->stats().entries, testing::Eq(0u));
+        ASSERT_THAT(cache->stats().invalidations, testing::Eq(1));
+        
+        cache->unlisten();
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(result_cache_test, stale_put_test)
+{
+    try{
+        auto cache = pq_async::open_result_cache(1024 * 1024);
+        auto tbl = db->query("select $1::int4 as v", 1);
+        std::vector<std::string> tags{"countries"};
+        
+        uint64_t gen = cache->generation(tags);
+        cache->invalidate("countries");
+        cache->put("stale", tbl, tags, gen);
+        ASSERT_FALSE(cache->get("stale"));
+        
+        cache->put("fresh", tbl, tags, cache->generation(tags));
+        ASSERT_TRUE(cache->get("fresh"));
+        
+        gen = cache->generation(tags);
+        cache->clear();
+        cache->put("cleared", tbl, tags, gen);
+        ASSERT_FALSE(cache->get("cleared"));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class sharded_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists sharded_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table sharded_test("
+            "id int4 primary key, value text"
+            ");"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+        
+        // both shards point to the same server, the scatter-gather
+        // results are therefore duplicated.
+        sdb = pq_async::open_sharded(
+            { pq_async_connection_string, pq_async_connection_string }
+        );
+    }
+    
+    void TearDown() override
+    {
+        sdb.reset();
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+    
+    pq_async::sharded_database sdb;
+};
+
+
+TEST_F(sharded_test, ring_test)
+{
+    auto ring = pq_async::open_sharded(
+        { "host=shard0", "host=shard1", "host=shard2" }
+    );
+    
+    std::map<std::string, int> counts;
+    std::vector<std::string> before;
+    for(int32_t i = 0; i < 3000; ++i){
+        before.emplace_back(ring->locate(shard_key_hash(i)));
+        ++counts[before.back()];
+    }
+    ASSERT_THAT(counts.size(), testing::Eq(3u));
+    for(auto& c : counts)
+        ASSERT_THAT(c.second, testing::Gt(500));
+    
+    ring->remove_shard("1");
+    for(int32_t i = 0; i < 3000; ++i){
+        std::string cs = ring->locate(shard_key_hash(i));
+        ASSERT_THAT(cs, testing::Ne("host=shard1"));
+        // keys of the remaining shards must not move
+        if(before[i] != "host=shard1")
+            ASSERT_THAT(cs, testing::Eq(before[i]));
+    }
+}
+
+TEST_F(sharded_test, routing_sync_test)
+{
+    try{
+        for(int32_t i = 0; i < 10; ++i)
+            sdb->execute(
+                "insert into sharded_test(id, value) values ($1, $2)",
+                i, std::string("v") + md::num_to_str(i, false)
+            );
+        
+        auto v = sdb->query_value<std::string>(
+            "select value from sharded_test where id = $1", (int32_t)3
+        );
+        ASSERT_THAT(v, testing::Eq("v3"));
+        
+        auto all = sdb->query_all("select * from sharded_test");
+        ASSERT_THAT(all->size(), testing::Eq(20u));
+        
+        auto sorted = sdb->query_all_sorted(
+            order_by_column<int32_t>("id", true),
+            "select * from sharded_test order by id desc"
+        );
+        ASSERT_THAT(sorted->size(), testing::Eq(20u));
+        for(size_t i = 1; i < sorted->size(); ++i)
+            ASSERT_THAT(
+                sorted->as_int32(i -1, "id"),
+                testing::Ge(sorted->as_int32(i, "id"))
+            );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(sharded_test, scatter_async_test)
+{
+    try{
+        for(int32_t i = 0; i < 10; ++i)
+            db->execute(
+                "insert into sharded_test(id, value) values ($1, $2)",
+                i, std::string("v")
+            );
+        
+        bool done = false;
+        sdb->query_all_sorted(
+            order_by_column<int32_t>("id"),
+            "select * from sharded_test where id < $1 order by id",
+            (int32_t)5,
+        [&done](const md::callback::cb_error& err, data_table tbl){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            ASSERT_THAT(tbl->size(), testing::Eq(10u));
+            ASSERT_THAT(tbl->as_int32(0, "id"), testing::Eq(0));
+            ASSERT_THAT(tbl->as_int32(1, "id"), testing::Eq(0));
+            ASSERT_THAT(tbl->as_int32(9, "id"), testing::Eq(4));
+            done = true;
+        });
+        
+        md::event_queue_t::get_default()->run();
+        ASSERT_THAT(done, testing::Eq(true));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
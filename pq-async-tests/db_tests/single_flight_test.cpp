@@ -0,0 +1,148 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class single_flight_test
+    : public db_test_base
+{
+};
+
+
+TEST_F(single_flight_test, coalesce_test)
+{
+    try{
+        auto& group = single_flight_group<data_table>::instance();
+        int64_t coalesced = group.coalesced();
+        
+        std::vector<pq_async::database> dbs;
+        for(int i = 0; i < 20; ++i){
+            dbs.emplace_back(pq_async::open(connection_string()));
+            dbs.back()->single_flight(true);
+        }
+        
+        std::vector<data_table> results;
+        for(auto& d : dbs)
+            d->query("select $1::int4 as v, pg_sleep(0.05)", 42,
+            [&results](const md::callback::cb_error& err, data_table tbl){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                    return;
+                }
+                results.emplace_back(tbl);
+            });
+        
+        md::event_queue_t::get_default()->run();
+        
+        ASSERT_THAT(results.size(), testing::Eq(dbs.size()));
+        ASSERT_THAT(group.coalesced() - coalesced, testing::Eq(19));
+        ASSERT_THAT(group.in_flight(), testing::Eq(0u));
+        for(auto& tbl : results){
+            ASSERT_THAT(tbl.get(), testing::Eq(results[0].get()));
+            ASSERT_THAT(tbl->get_value(0, "v")->as_int32(), testing::Eq(42));
+        }
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(single_flight_test, distinct_params_test)
+{
+    try{
+        auto& group = single_flight_group<int32_t>::instance();
+        int64_t coalesced = group.coalesced();
+        
+        auto db_a = pq_async::open(connection_string());
+        auto db_b = pq_async::open(connection_string());
+        db_a->single_flight(true);
+        db_b->single_flight(true);
+        
+        int32_t a = 0;
+        int32_t b = 0;
+        db_a->query_value<int32_t>("select $1::int4", 1,
+        [&a](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            a = v;
+        });
+        db_b->query_value<int32_t>("select $1::int4", 2,
+        [&b](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+                return;
+            }
+            b = v;
+        });
+        
+        md::event_queue_t::get_default()->run();
+        
+        ASSERT_THAT(a, testing::Eq(1));
+        ASSERT_THAT(b, testing::Eq(2));
+        ASSERT_THAT(group.coalesced(), testing::Eq(coalesced));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(single_flight_test, key_test)
+{
+    try{
+        const char* sql = "select $1::text, $2::text";
+        auto key = [sql](const parameters_t& p)-> std::string {
+            return single_flight_key("t", "cs", sql, p);
+        };
+        
+        ASSERT_THAT(
+            key(parameters_t(std::string("a"), std::string("b"))),
+            testing::Eq(key(parameters_t(std::string("a"), std::string("b"))))
+        );
+        // the values are part of the key, not a hash of them
+        ASSERT_THAT(
+            key(parameters_t(std::string("ab"), std::string(""))),
+            testing::Ne(key(parameters_t(std::string("a"), std::string("b"))))
+        );
+        ASSERT_THAT(
+            key(parameters_t(std::string(""), nullptr)),
+            testing::Ne(key(parameters_t(std::string(""), std::string(""))))
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
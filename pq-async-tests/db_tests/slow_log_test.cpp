@@ -0,0 +1,126 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class slow_log_test
+    : public db_test_base
+{
+public:
+    void TearDown() override
+    {
+        pq_async::set_slow_query_log(nullptr);
+        db_test_base::TearDown();
+    }
+    
+    slow_query_log install(const slow_query_options& opts)
+    {
+        auto log = pq_async::open_slow_query_log(
+        [this](const std::string& line)-> void {
+            std::lock_guard<std::mutex> lock(mutex);
+            lines.emplace_back(line);
+        }, opts);
+        pq_async::set_slow_query_log(log);
+        return log;
+    }
+    
+    std::mutex mutex;
+    std::vector<std::string> lines;
+};
+
+
+TEST_F(slow_log_test, threshold_test)
+{
+    try{
+        slow_query_options opts;
+        opts.threshold_ms = 20;
+        auto log = install(opts);
+        
+        db->execute("select pg_sleep(0.05)");
+        ASSERT_THAT(db->query_value<int32_t>("select $1::int4 + 1", 41),
+            testing::Eq(42)
+        );
+        log->flush();
+        
+        ASSERT_THAT(lines.size(), testing::Eq(1u));
+        ASSERT_THAT(lines[0], testing::HasSubstr(" slow query "));
+        ASSERT_THAT(lines[0],
+            testing::HasSubstr("sql: select pg_sleep(0.05)")
+        );
+        ASSERT_THAT(log->written(), testing::Eq(1u));
+        ASSERT_THAT(log->dropped(), testing::Eq(0u));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(slow_log_test, database_threshold_test)
+{
+    try{
+        slow_query_options opts;
+        opts.threshold_ms = 60000;
+        opts.sample_every = 2;
+        auto log = install(opts);
+        
+        db->query_value<int32_t>("select $1::int4 + 1", 1);
+        log->flush();
+        ASSERT_THAT(lines.size(), testing::Eq(0u));
+        
+        db->slow_query_threshold(0);
+        ASSERT_THAT(db->slow_query_threshold(), testing::Eq(0));
+        bool done = false;
+        db->query_value<int32_t>("select $1::int4 + 1", 41,
+        [&done](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(v, testing::Eq(42));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_TRUE(done);
+        db->query_value<int32_t>("select $1::int4 + 1", 43);
+        log->flush();
+        
+        // only the first slow statement of every two is sampled
+        ASSERT_THAT(lines.size(), testing::Eq(2u));
+        ASSERT_THAT(lines[0], testing::HasSubstr("rows=1"));
+        ASSERT_THAT(lines[0], testing::HasSubstr("params: $1='41'"));
+        ASSERT_THAT(lines[1], testing::Not(testing::HasSubstr("params:")));
+        
+        db->slow_query_threshold(-1);
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
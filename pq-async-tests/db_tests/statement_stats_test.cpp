@@ -0,0 +1,148 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class statement_stats_test
+    : public db_test_base
+{
+public:
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        pq_async::statement_stats_reset();
+        pq_async::enable_statement_stats(true);
+    }
+    
+    void TearDown() override
+    {
+        pq_async::enable_statement_stats(false);
+        pq_async::statement_stats_reset();
+        db_test_base::TearDown();
+    }
+    
+    statement_stat find(const std::string& sql)
+    {
+        for(const auto& s : pq_async::statement_stats_snapshot())
+            if(s.sql == sql)
+                return s;
+        return statement_stat{0, "", 0, 0, 0, 0, 0, 0, {}};
+    }
+};
+
+
+TEST_F(statement_stats_test, normalize_test)
+{
+    try{
+        ASSERT_THAT(
+            pq_async::normalize_sql(
+                "SELECT *  FROM t\n WHERE id = 42 -- trailing"
+            ),
+            testing::Eq("select * from t where id = ?")
+        );
+        ASSERT_THAT(
+            pq_async::normalize_sql(
+                "select 'it''s', E'a\\'b', $$x$$, 1.5e3 /* c */ from \"T\""
+            ),
+            testing::Eq("select ?, ?, ?, ? from \"T\"")
+        );
+        ASSERT_THAT(
+            pq_async::normalize_sql("select col1 from t2 where a = $1"),
+            testing::Eq("select col1 from t2 where a = $1")
+        );
+        ASSERT_THAT(
+            pq_async::sql_fingerprint("select 1"),
+            testing::Eq(pq_async::sql_fingerprint("SELECT   2"))
+        );
+        ASSERT_THAT(
+            pq_async::sql_fingerprint("select 1"),
+            testing::Ne(pq_async::sql_fingerprint("select 1 from t"))
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(statement_stats_test, query_counters_test)
+{
+    try{
+        for(int i = 0; i < 3; ++i)
+            db->query(
+                ("select generate_series(1, " + std::to_string(i +1) +
+                ")::int4").c_str()
+            );
+        
+        bool done = false;
+        db->query("select generate_series(1, 4)::int4",
+        [&done](const md::callback::cb_error& err, data_table tbl){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(tbl->size(), testing::Eq(4u));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_TRUE(done);
+        
+        try{
+            db->execute("select * from pq_async_missing_table");
+        }catch(const std::exception&){
+        }
+        
+        auto s = find("select generate_series(?, ?)::int4");
+        ASSERT_THAT(s.calls, testing::Eq(4u));
+        ASSERT_THAT(s.errors, testing::Eq(0u));
+        ASSERT_THAT(s.rows, testing::Eq(1u + 2u + 3u + 4u));
+        ASSERT_THAT(s.bytes, testing::Eq(s.rows * 4));
+        ASSERT_THAT(s.total_ns, testing::Gt(0u));
+        ASSERT_THAT(s.max_ns, testing::Le(s.total_ns));
+        ASSERT_THAT(s.percentile_ns(0.5), testing::Le(s.max_ns));
+        
+        uint64_t in_buckets = 0;
+        for(auto n : s.histogram)
+            in_buckets += n;
+        ASSERT_THAT(in_buckets, testing::Eq(s.calls));
+        
+        auto e = find("select * from pq_async_missing_table");
+        ASSERT_THAT(e.calls, testing::Eq(1u));
+        ASSERT_THAT(e.errors, testing::Eq(1u));
+        
+        pq_async::statement_stats_reset();
+        ASSERT_THAT(
+            find("select generate_series(?, ?)::int4").calls, testing::Eq(0u)
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,123 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+#include <fstream>
+#include <set>
+
+namespace pq_async{ namespace tests{
+
+class trace_test
+    : public db_test_base
+{
+public:
+    void TearDown() override
+    {
+        pq_async::set_trace_sink(nullptr);
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(trace_test, ring_overwrite_test)
+{
+    try{
+        auto ring = pq_async::open_ring_trace_sink(4);
+        ASSERT_THAT(ring->capacity(), testing::Eq(4u));
+        
+        for(int64_t i = 0; i < 10; ++i)
+            ring->record({(uint64_t)i +1, trace_phase::send, i, i +1});
+        
+        auto evs = ring->snapshot();
+        ASSERT_THAT(evs.size(), testing::Eq(4u));
+        for(size_t i = 0; i < evs.size(); ++i)
+            ASSERT_THAT(evs[i].query_id, testing::Eq(i +7));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(trace_test, query_phases_test)
+{
+    try{
+        auto ring = pq_async::open_ring_trace_sink(1024);
+        pq_async::set_trace_sink(ring);
+        ASSERT_TRUE(pq_async::trace_enabled());
+        
+        bool done = false;
+        db->query_value<int32_t>("select 1::int4",
+        [&done](const md::callback::cb_error& err, int32_t v){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            ASSERT_THAT(v, testing::Eq(1));
+            done = true;
+        });
+        md::event_queue_t::get_default()->run();
+        ASSERT_TRUE(done);
+        
+        pq_async::set_trace_sink(nullptr);
+        ASSERT_FALSE(pq_async::trace_enabled());
+        
+        bool waited = false, sent = false, executed = false;
+        bool processed = false;
+        std::set<uint64_t> ids;
+        for(const auto& ev : ring->snapshot()){
+            ASSERT_THAT(ev.query_id, testing::Gt(0u));
+            ASSERT_THAT(ev.end_ns, testing::Ge(ev.begin_ns));
+            ids.insert(ev.query_id);
+            waited |= ev.phase == trace_phase::pool_wait;
+            sent |= ev.phase == trace_phase::send;
+            executed |= ev.phase == trace_phase::execute;
+            processed |= ev.phase == trace_phase::process;
+        }
+        ASSERT_TRUE(waited);
+        ASSERT_TRUE(sent);
+        ASSERT_TRUE(executed);
+        ASSERT_TRUE(processed);
+        // the connection request and the query share one trace
+        ASSERT_THAT(ids.size(), testing::Eq(1u));
+        
+        std::string path = "/tmp/pq_async_trace_test.json";
+        ring->dump_chrome_trace(path);
+        std::ifstream in(path);
+        std::string content(
+            (std::istreambuf_iterator<char>(in)),
+            std::istreambuf_iterator<char>()
+        );
+        ASSERT_THAT(content, testing::StartsWith("{\"traceEvents\":["));
+        ASSERT_THAT(content, testing::HasSubstr("\"execute\""));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -0,0 +1,187 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <gmock/gmock.h>
+#include "../db_test_base.h"
+
+namespace pq_async{ namespace tests{
+
+class write_buffer_test
+    : public db_test_base
+{
+public:
+    void drop_table()
+    {
+        db->execute("drop table if exists write_buffer_test");
+    }
+    
+    void create_table()
+    {
+        this->drop_table();
+        db->execute(
+            "create table write_buffer_test("
+            "id int8 primary key, name text, score float8"
+            ");"
+        );
+    }
+    
+    void SetUp() override
+    {
+        db_test_base::SetUp();
+        this->create_table();
+    }
+    
+    void TearDown() override
+    {
+        this->drop_table();
+        db_test_base::TearDown();
+    }
+};
+
+
+TEST_F(write_buffer_test, threshold_test)
+{
+    try{
+        auto wb = pq_async::open_write_buffer(
+            connection_string(), "write_buffer_test",
+            { "id", "name", "score" }, 100
+        );
+        
+        size_t flushed = 0;
+        int64_t batches = 0;
+        wb->on_flush(
+        [&flushed, &batches](const md::callback::cb_error& err, size_t rows){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            flushed += rows;
+            ++batches;
+        });
+        
+        for(int64_t i = 0; i < 1050; ++i)
+            ASSERT_THAT(
+                wb->try_add(i, "name " + md::num_to_str(i, false), i / 2.0),
+                testing::Eq(true)
+            );
+        ASSERT_THROW(wb->try_add((int64_t)1), pq_async::exception);
+        
+        // the row count threshold sent 10 batches, the delay sends the rest
+        wait_until([&flushed](){ return flushed == 1050;});
+        ASSERT_THAT(flushed, testing::Eq(1050u));
+        ASSERT_THAT(batches, testing::Eq(11));
+        
+        auto s = wb->stats();
+        ASSERT_THAT(s.rows_written, testing::Eq(1050));
+        ASSERT_THAT(s.buffered_rows, testing::Eq(0u));
+        ASSERT_THAT(s.pending_bytes, testing::Eq(0u));
+        
+        auto r = db->query_single(
+            "select count(*) as cnt, max(score) as mx from write_buffer_test"
+        );
+        ASSERT_THAT(r->as_int64("cnt"), testing::Eq(1050));
+        ASSERT_THAT(r->as_double("mx"), testing::Eq(524.5));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(write_buffer_test, back_pressure_test)
+{
+    try{
+        auto wb = pq_async::open_write_buffer(
+            connection_string(), "write_buffer_test",
+            { "id", "name" }, 10, 1024, 1000, 2048
+        );
+        
+        int64_t next = 0;
+        while(wb->try_add(next, std::string(100, 'x')))
+            ++next;
+        ASSERT_THAT(next, testing::Gt(0));
+        ASSERT_THAT(wb->stats().rejected, testing::Eq(1));
+        
+        // add waits for room instead of refusing
+        int64_t added = 0;
+        for(int64_t i = 0; i < 50; ++i){
+            parameters_t row(next + i, std::string(100, 'y'));
+            wb->add(row, [&added](const md::callback::cb_error& err){
+                if(err){
+                    std::cout << "err: " << err << std::endl;
+                    FAIL();
+                }
+                ++added;
+            });
+        }
+        ASSERT_THAT(wb->try_add(next + 50, "z"), testing::Eq(false));
+        
+        bool done = false;
+        wb->flush([&done](const md::callback::cb_error& err){
+            if(err){
+                std::cout << "err: " << err << std::endl;
+                FAIL();
+            }
+            done = true;
+        });
+        wait_until([&done](){ return done;});
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(added, testing::Eq(50));
+        ASSERT_THAT(
+            db->query_value<int64_t>("select count(*) from write_buffer_test"),
+            testing::Eq(next + 50)
+        );
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+TEST_F(write_buffer_test, error_test)
+{
+    try{
+        auto wb = pq_async::open_write_buffer(
+            connection_string(), "write_buffer_test", { "id", "name" }
+        );
+        
+        ASSERT_THAT(wb->try_add((int64_t)1, "one"), testing::Eq(true));
+        ASSERT_THAT(wb->try_add((int64_t)1, "dup"), testing::Eq(true));
+        
+        bool done = false;
+        wb->flush([&done](const md::callback::cb_error& err){
+            ASSERT_THAT((bool)err, testing::Eq(true));
+            done = true;
+        });
+        wait_until([&done](){ return done;});
+        ASSERT_THAT(done, testing::Eq(true));
+        ASSERT_THAT(wb->stats().rows_failed, testing::Eq(2));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
+}} //namespace pq_async::tests
@@ -170,4 +170,47 @@ TEST_F(cb_test, auto_cb_test)
 }
 
 
+TEST_F(cb_test, inline_cb_test)
+{
+    try{
+        auto counter = std::make_shared<int>(0);
+        
+        inline_value_cb<int32_t> a(
+        [counter](const md::callback::cb_error& err, int32_t v){
+            *counter += v;
+        });
+        ASSERT_THAT((bool)a, testing::Eq(true));
+        ASSERT_THAT(counter.use_count(), testing::Eq(2));
+        
+        a(nullptr, 2);
+        inline_value_cb<int32_t> b(std::move(a));
+        ASSERT_THAT((bool)a, testing::Eq(false));
+        b(nullptr, 3);
+        ASSERT_THAT(*counter, testing::Eq(5));
+        ASSERT_THAT(counter.use_count(), testing::Eq(2));
+        
+        ASSERT_THROW(a(nullptr, 1), std::bad_function_call);
+        
+        b = nullptr;
+        ASSERT_THAT(counter.use_count(), testing::Eq(1));
+        
+        // a callback may release itself as its last action
+        inline_value_cb<int32_t> self_reset;
+        self_reset = [counter, &self_reset](
+            const md::callback::cb_error& err, int32_t v
+        ){
+            *counter += v;
+            self_reset = nullptr;
+        };
+        self_reset(nullptr, 10);
+        ASSERT_THAT((bool)self_reset, testing::Eq(false));
+        ASSERT_THAT(*counter, testing::Eq(15));
+        ASSERT_THAT(counter.use_count(), testing::Eq(1));
+        
+    }catch(const std::exception& err){
+        std::cout << "Error: " << err.what() << std::endl;
+        FAIL();
+    }
+}
+
 }} //ns: pq_async::tests
\ No newline at end of file
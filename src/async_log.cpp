@@ -0,0 +1,317 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "async_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pq_async{
+
+static_assert(
+    (PQ_ASYNC_LOG_QUEUE_CAPACITY & (PQ_ASYNC_LOG_QUEUE_CAPACITY -1)) == 0,
+    "PQ_ASYNC_LOG_QUEUE_CAPACITY must be a power of two"
+);
+
+namespace{
+
+struct log_record_t
+{
+    log_level level;
+    md::log::logger log;
+    log_format_fn fmt;
+};
+
+/*!
+ * \brief single producer single consumer ring, the producer is the thread
+ * owning the queue and the consumer the writer
+ */
+struct log_queue_t
+{
+    log_queue_t()
+        : slots(new log_record_t[PQ_ASYNC_LOG_QUEUE_CAPACITY]),
+        head(0), tail(0), closed(false)
+    {
+    }
+    
+    std::unique_ptr<log_record_t[]> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    // set when the producer thread exits, the queue is dropped once empty
+    std::atomic<bool> closed;
+};
+
+struct log_backend_t
+{
+    log_backend_t()
+        : pushed(0), processed(0), written(0), fallbacks(0), stop(false)
+    {
+    }
+    
+    ~log_backend_t()
+    {
+        this->stop_writer();
+    }
+    
+    void start_writer()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(thread.joinable())
+            return;
+        stop = false;
+        thread = std::thread(&log_backend_t::run, this);
+    }
+    
+    void stop_writer()
+    {
+        std::thread t;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            t = std::move(thread);
+        }
+        cv.notify_all();
+        if(t.joinable())
+            t.join();
+        // records pushed while the writer was stopping
+        this->drain();
+    }
+    
+    bool drain()
+    {
+        std::lock_guard<std::mutex> consumer(consumer_mutex);
+        std::vector< std::shared_ptr<log_queue_t> > qs;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            qs = queues;
+        }
+        
+        bool any = false;
+        std::string msg;
+        for(auto& q : qs){
+            bool closed = q->closed.load(std::memory_order_acquire);
+            size_t t = q->tail.load(std::memory_order_relaxed);
+            size_t h = q->head.load(std::memory_order_acquire);
+            for(; t != h; ++t){
+                log_record_t& r =
+                    q->slots[t & (PQ_ASYNC_LOG_QUEUE_CAPACITY -1)];
+                try{
+                    msg.clear();
+                    r.fmt(msg);
+                    write_log(r.log, r.level, msg);
+                    written.fetch_add(1, std::memory_order_relaxed);
+                }catch(const std::exception&){
+                }
+                r.fmt = nullptr;
+                r.log.reset();
+                q->tail.store(t +1, std::memory_order_release);
+                processed.fetch_add(1, std::memory_order_release);
+                any = true;
+            }
+            
+            if(closed){
+                std::lock_guard<std::mutex> lock(mutex);
+                queues.erase(
+                    std::remove(queues.begin(), queues.end(), q),
+                    queues.end()
+                );
+            }
+        }
+        return any;
+    }
+    
+    void run()
+    {
+        for(;;){
+            bool stopping = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = stop;
+            }
+            bool any = this->drain();
+            
+            std::unique_lock<std::mutex> lock(mutex);
+            if(any || stopping)
+                cv.notify_all();
+            if(stopping)
+                return;
+            // producers only signal a half full queue, the event loops
+            // don't pay a syscall per record
+            if(!stop)
+                cv.wait_for(
+                    lock, std::chrono::milliseconds(PQ_ASYNC_LOG_IDLE_MS)
+                );
+        }
+    }
+    
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> fallbacks;
+    
+    std::mutex mutex;
+    std::mutex consumer_mutex;
+    std::condition_variable cv;
+    std::vector< std::shared_ptr<log_queue_t> > queues;
+    std::thread thread;
+    bool stop;
+};
+
+log_backend_t& log_backend()
+{
+    static log_backend_t backend;
+    return backend;
+}
+
+struct thread_queue_t
+{
+    ~thread_queue_t()
+    {
+        if(q)
+            q->closed.store(true, std::memory_order_release);
+    }
+    
+    std::shared_ptr<log_queue_t> q;
+};
+
+log_queue_t* thread_log_queue()
+{
+    thread_local thread_queue_t tq;
+    if(!tq.q){
+        tq.q = std::make_shared<log_queue_t>();
+        log_backend_t& b = log_backend();
+        std::lock_guard<std::mutex> lock(b.mutex);
+        b.queues.emplace_back(tq.q);
+    }
+    return tq.q.get();
+}
+
+} //namespace
+
+
+void write_log(
+    const md::log::logger& log, log_level level, const std::string& msg)
+{
+    switch(level){
+        case log_level::trace:
+            log->trace("{}", msg);
+            break;
+        case log_level::debug:
+            log->debug("{}", msg);
+            break;
+        case log_level::info:
+            log->info("{}", msg);
+            break;
+        case log_level::warn:
+            log->warn("{}", msg);
+            break;
+        case log_level::error:
+            log->error("{}", msg);
+            break;
+    }
+}
+
+bool _push_log_record(
+    const md::log::logger& log, log_level level, log_format_fn&& fmt)
+{
+    log_backend_t& b = log_backend();
+    log_queue_t* q = thread_log_queue();
+    
+    size_t h = q->head.load(std::memory_order_relaxed);
+    if(h - q->tail.load(std::memory_order_acquire) >=
+        PQ_ASYNC_LOG_QUEUE_CAPACITY
+    ){
+        b.fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    log_record_t& r = q->slots[h & (PQ_ASYNC_LOG_QUEUE_CAPACITY -1)];
+    r.level = level;
+    r.log = log;
+    r.fmt = std::move(fmt);
+    q->head.store(h +1, std::memory_order_release);
+    b.pushed.fetch_add(1, std::memory_order_release);
+    
+    // the writer is only woken up when the queue fills up
+    if(h - q->tail.load(std::memory_order_relaxed) ==
+        PQ_ASYNC_LOG_QUEUE_CAPACITY / 2
+    )
+        b.cv.notify_all();
+    return true;
+}
+
+void log_text_async(
+    const md::log::logger& log, log_level level, const char* text)
+{
+    log_async(log, level, "{}", text);
+}
+
+void enable_async_logging(bool enabled)
+{
+    log_backend_t& b = log_backend();
+    if(enabled){
+        b.start_writer();
+        _async_log_flag().store(true, std::memory_order_release);
+        return;
+    }
+    
+    _async_log_flag().store(false, std::memory_order_release);
+    b.stop_writer();
+}
+
+void flush_async_log()
+{
+    log_backend_t& b = log_backend();
+    uint64_t target = b.pushed.load(std::memory_order_acquire);
+    
+    std::unique_lock<std::mutex> lock(b.mutex);
+    if(!b.thread.joinable()){
+        // no writer, the records are written by the caller
+        lock.unlock();
+        b.drain();
+        return;
+    }
+    b.cv.notify_all();
+    b.cv.wait(lock, [&b, target]()-> bool {
+        return b.processed.load() >= target || b.stop;
+    });
+}
+
+async_log_stats async_logging_stats()
+{
+    log_backend_t& b = log_backend();
+    async_log_stats s;
+    s.written = b.written.load(std::memory_order_relaxed);
+    s.sync_fallbacks = b.fallbacks.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(b.mutex);
+    s.queues = b.queues.size();
+    return s;
+}
+
+} //namespace pq_async
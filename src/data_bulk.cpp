@@ -0,0 +1,83 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_bulk.h"
+
+namespace pq_async{
+
+std::string quote_ident(const std::string& ident)
+{
+    // PQescapeIdentifier needs a connection for the client encoding,
+    // the statements are built before one is acquired
+    if(ident.empty() || ident.find('\0') != std::string::npos)
+        throw pq_async::exception("Invalid identifier!");
+    
+    std::string s("\"");
+    for(char c : ident){
+        if(c == '"')
+            s.push_back('"');
+        s.push_back(c);
+    }
+    s.push_back('"');
+    return s;
+}
+
+std::string quote_table(const std::string& table)
+{
+    size_t dot = table.find('.');
+    if(dot == std::string::npos)
+        return quote_ident(table);
+    return quote_ident(table.substr(0, dot)) + "." +
+        quote_ident(table.substr(dot +1));
+}
+
+std::string unnest_insert_sql(
+    const std::string& table,
+    const std::vector<std::string>& columns,
+    const std::string& suffix)
+{
+    if(columns.empty())
+        throw pq_async::exception("At least one column is required!");
+    
+    std::string cols;
+    std::string params;
+    for(size_t i = 0; i < columns.size(); ++i){
+        if(i > 0){
+            cols.append(", ");
+            params.append(", ");
+        }
+        cols.append(quote_ident(columns[i]));
+        params.append("$" + md::num_to_str(i +1, false));
+    }
+    
+    std::string sql(
+        "insert into " + quote_table(table) + "(" + cols + ") "
+        "select * from unnest(" + params + ")"
+    );
+    if(!suffix.empty())
+        sql.append(" " + suffix);
+    return sql;
+}
+
+} //namespace pq_async
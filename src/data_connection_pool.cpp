@@ -25,6 +25,9 @@ SOFTWARE.
 #include "data_connection_pool.h"
 #include "database.h"
 
+#include <cstring>
+#include <poll.h>
+
 namespace pq_async{
 
 std::atomic<int> pq_async::connection::s_next_id(-1);
@@ -34,29 +37,27 @@ static void pqasync_notice_processor(void *arg, const char *message)
     /*
         DEBUG, LOG, INFO, NOTICE, WARNING, and EXCEPTION
     */
-    std::string s(message);
-    std::string d("DEBUG:");
-    std::string l("LOG:");
-    std::string i("INFO:");
-    std::string n("NOTICE:");
-    std::string w("WARNING:");
-    std::string e("EXCEPTION:");
-    
-    if(s.compare(0, d.length(), d) == 0){
-        pq_async::default_logger()->trace("{}", message);
-    }else if(s.compare(0, l.length(), l) == 0){
-        pq_async::default_logger()->debug("{}", message);
-    }else if(s.compare(0, i.length(), i) == 0){
-        pq_async::default_logger()->info("{}", message);
-    }else if(s.compare(0, n.length(), n) == 0){
-        pq_async::default_logger()->warn("{}", message);
-    }else if(s.compare(0, w.length(), w) == 0){
-        pq_async::default_logger()->warn("{}", message);
-    }else if(s.compare(0, e.length(), e) == 0){
-        pq_async::default_logger()->error("{}", message);
-    }else{
-        pq_async::default_logger()->warn("{}", message);
-    }
+    static const struct{
+        const char* prefix;
+        size_t len;
+        pq_async::log_level level;
+    } severities[] = {
+        {"DEBUG:", 6, pq_async::log_level::trace},
+        {"LOG:", 4, pq_async::log_level::debug},
+        {"INFO:", 5, pq_async::log_level::info},
+        {"NOTICE:", 7, pq_async::log_level::warn},
+        {"WARNING:", 8, pq_async::log_level::warn},
+        {"EXCEPTION:", 10, pq_async::log_level::error},
+    };
+    
+    // chatty functions raise many notices, the prefix is matched in place
+    pq_async::log_level level = pq_async::log_level::warn;
+    for(const auto& s : severities)
+        if(std::strncmp(message, s.prefix, s.len) == 0){
+            level = s.level;
+            break;
+        }
+    pq_async::log_text_async(pq_async::default_logger(), level, message);
 }
 
 void pq_async::connection::set_notice_processor()
@@ -105,6 +106,23 @@ void pq_async::connection::release()
     return;
 }
 
+connection_lock_t::~connection_lock_t()
+{
+    if(!_conn)
+        return;
+    
+    _conn->stop_work();
+    if(_conn->_owner)
+        _conn->_owner->_notify_sync();
+    
+    // in multiplexing mode the physical connection goes back to the pool
+    // as soon as the last statement outside of a transaction is completed.
+    if(--_conn->_locks == 0 && _conn->_owner &&
+        _conn->_owner->_multiplexing && !_conn->in_transaction()
+    )
+        _conn->_owner->_release_multiplexed(_conn);
+}
+
 md::event_strand<int> connection::strand()
 {
     if(!this->_owner)
@@ -129,30 +147,34 @@ bool pq_async::connection::is_dead()
 
 connection_task_t::connection_task_t(
     md::event_queue_t* owner, database db, connection_lock lock,
-    const md::callback::value_cb<PGresult*>& cb)
+    inline_value_cb<PGresult*>&& cb)
     : event_task_base_t(owner), 
     _cmd_type(command_type::none),
     _completed(false), _db(db),
     
     _conn(nullptr), _lock_cb(),
-    _lock(lock), _cb(cb),
+    _lock(lock), _cb(std::move(cb)),
 
-    _ev(nullptr)
+    _ev(nullptr), _reactor_watch(), _sync(false)
 {
+    this->_trace_start();
+    this->_stats_start();
 }
 
 connection_task_t::connection_task_t(
     md::event_queue_t* owner, database db, connection* conn,
-    const md::callback::value_cb<connection_lock>& lock_cb)
+    inline_value_cb<connection_lock>&& lock_cb)
     : event_task_base_t(owner), 
     _cmd_type(command_type::none),
     _completed(false), _db(db),
     
-    _conn(conn), _lock_cb(lock_cb),
+    _conn(conn), _lock_cb(std::move(lock_cb)),
     _lock(), _cb(),
     
-    _ev(nullptr)
+    _ev(nullptr), _reactor_watch(), _sync(false)
 {
+    this->_trace_start();
+    this->_stats_start();
 }
 
 connection_task_t::connection_task_t(
@@ -164,8 +186,10 @@ connection_task_t::connection_task_t(
     _conn(nullptr), _lock_cb(),
     _lock(lock), _cb(),
 
-    _ev(nullptr)
+    _ev(nullptr), _reactor_watch(), _sync(false)
 {
+    this->_trace_start();
+    this->_stats_start();
 }
 
 connection_task_t::connection_task_t(
@@ -177,10 +201,267 @@ connection_task_t::connection_task_t(
     _conn(conn), _lock_cb(),
     _lock(), _cb(),
 
-    _ev(nullptr)
+    _ev(nullptr), _reactor_watch(), _sync(false)
 {
+    this->_trace_start();
+    this->_stats_start();
 }
 
+namespace{
+
+struct connection_task_free_list;
+
+// trivially destructible, still readable while the thread_local objects
+// of an exiting thread are destroyed
+thread_local connection_task_free_list* t_free_list = nullptr;
+
+/*!
+ * \brief idle query tasks and recycled shared_ptr control blocks of the
+ * calling thread, owned together so the tasks are deleted before the
+ * blocks they release at thread exit
+ */
+struct connection_task_free_list
+{
+    std::vector<connection_task_t*> tasks;
+    std::vector<void*> blocks;
+    connection_task_pool_stats stats{0, 0, 0};
+    
+    connection_task_free_list()
+    {
+        tasks.reserve(PQ_ASYNC_CONNECTION_TASK_POOL_DEPTH);
+        blocks.reserve(PQ_ASYNC_CONNECTION_TASK_POOL_DEPTH);
+        t_free_list = this;
+    }
+    
+    ~connection_task_free_list()
+    {
+        // their control blocks go back to blocks
+        for(auto t : tasks)
+            delete t;
+        tasks.clear();
+        for(auto b : blocks)
+            ::operator delete(b);
+        blocks.clear();
+        t_free_list = nullptr;
+    }
+};
+
+/*!
+ * \brief the free list of the calling thread, nullptr once destroyed
+ */
+connection_task_free_list* task_free_list()
+{
+    static thread_local connection_task_free_list lst;
+    return t_free_list;
+}
+
+/*!
+ * \brief recycles the shared_ptr control blocks of the pooled tasks,
+ * it is only rebound to the control block type of connection_task so
+ * all the recycled blocks share one size
+ */
+template<typename T>
+struct control_block_allocator
+{
+    typedef T value_type;
+    
+    control_block_allocator() = default;
+    template<typename U>
+    control_block_allocator(const control_block_allocator<U>&){}
+    
+    T* allocate(size_t n)
+    {
+        auto lst = task_free_list();
+        if(n == 1 && lst && !lst->blocks.empty()){
+            T* b = (T*)lst->blocks.back();
+            lst->blocks.pop_back();
+            return b;
+        }
+        return (T*)::operator new(n * sizeof(T));
+    }
+    
+    void deallocate(T* p, size_t n)
+    {
+        auto lst = task_free_list();
+        if(n == 1 && lst &&
+            lst->blocks.size() < PQ_ASYNC_CONNECTION_TASK_POOL_DEPTH
+        ){
+            lst->blocks.emplace_back(p);
+            return;
+        }
+        ::operator delete(p);
+    }
+    
+    template<typename U>
+    bool operator==(const control_block_allocator<U>&) const { return true;}
+    template<typename U>
+    bool operator!=(const control_block_allocator<U>&) const { return false;}
+};
+
+} //namespace
+
+struct connection_task_t::recycler_t
+{
+    void operator()(connection_task_t* t) const
+    {
+        t->_recycle();
+        auto lst = task_free_list();
+        if(!lst || lst->tasks.size() >= PQ_ASYNC_CONNECTION_TASK_POOL_DEPTH){
+            delete t;
+            return;
+        }
+        lst->tasks.emplace_back(t);
+    }
+};
+
+connection_task connection_task_t::acquire(
+    md::event_queue_t* owner, database db, connection_lock lock,
+    inline_value_cb<PGresult*>&& cb)
+{
+    auto lst = task_free_list();
+    connection_task_t* t = nullptr;
+    if(!lst || lst->tasks.empty()){
+        t = new connection_task_t(owner, db, lock, std::move(cb));
+        if(lst)
+            ++lst->stats.created;
+    }else{
+        t = lst->tasks.back();
+        lst->tasks.pop_back();
+        t->_reset(owner, db, lock, std::move(cb));
+        ++lst->stats.reused;
+    }
+    return connection_task(
+        t, recycler_t(), control_block_allocator<connection_task_t>()
+    );
+}
+
+connection_task connection_task_t::acquire(
+    md::event_queue_t* owner, database db, connection* conn,
+    inline_value_cb<connection_lock>&& lock_cb)
+{
+    auto lst = task_free_list();
+    connection_task_t* t = nullptr;
+    if(!lst || lst->tasks.empty()){
+        t = new connection_task_t(owner, db, conn, std::move(lock_cb));
+        if(lst)
+            ++lst->stats.created;
+    }else{
+        t = lst->tasks.back();
+        lst->tasks.pop_back();
+        t->_reset(owner, db, conn, std::move(lock_cb));
+        ++lst->stats.reused;
+    }
+    return connection_task(
+        t, recycler_t(), control_block_allocator<connection_task_t>()
+    );
+}
+
+connection_task_pool_stats connection_task_t::pool_stats()
+{
+    auto lst = task_free_list();
+    if(!lst)
+        return connection_task_pool_stats{0, 0, 0};
+    connection_task_pool_stats s = lst->stats;
+    s.idle = lst->tasks.size();
+    return s;
+}
+
+void connection_task_t::_reset(
+    md::event_queue_t* owner, database db, connection_lock lock,
+    inline_value_cb<PGresult*>&& cb)
+{
+    this->_owner = owner;
+    _cmd_type = command_type::none;
+    _completed = false;
+    _db = db;
+    _lock = lock;
+    _cb = std::move(cb);
+    _sync = false;
+    this->_trace_start();
+    this->_stats_start();
+}
+
+void connection_task_t::_reset(
+    md::event_queue_t* owner, database db, connection* conn,
+    inline_value_cb<connection_lock>&& lock_cb)
+{
+    this->_owner = owner;
+    _cmd_type = command_type::none;
+    _completed = false;
+    _db = db;
+    _conn = conn;
+    _lock_cb = std::move(lock_cb);
+    _sync = false;
+    this->_trace_start();
+    this->_stats_start();
+}
+
+void connection_task_t::_stats_count(
+    const PGresult* r, uint64_t& rows, uint64_t& bytes, bool& failed)
+{
+    ExecStatusType st = PQresultStatus(r);
+    if(st == PGRES_FATAL_ERROR || st == PGRES_BAD_RESPONSE){
+        failed = true;
+        return;
+    }
+    
+    int nrows = PQntuples(r);
+    rows += nrows;
+    // the slow query log only needs the rows
+    if(!statement_stats_enabled())
+        return;
+    
+    int nfields = PQnfields(r);
+    for(int i = 0; i < nrows; ++i)
+        for(int j = 0; j < nfields; ++j)
+            bytes += PQgetlength(r, i, j);
+}
+
+void connection_task_t::_stats_record(
+    bool failed, uint64_t rows, uint64_t bytes)
+{
+    int64_t latency = trace_now() - _stats_ns;
+    _stats_ns = 0;
+    
+    // prepared executions only know the statement name
+    std::string exec_name;
+    const std::string* sql = &_sql;
+    if(_sql.empty()){
+        if(_name.empty())
+            return;
+        exec_name = "execute " + _name;
+        sql = &exec_name;
+    }
+    
+    if(statement_stats_enabled())
+        statement_stats_record(sql->c_str(), failed, rows, bytes, latency);
+    
+    if(slow_query_log_enabled())
+        if(slow_query_log log = default_slow_query_log())
+            log->record(_db.get(), *sql, _p, failed, rows, latency);
+}
+
+void connection_task_t::_recycle()
+{
+    if(_ev)
+        event_del(_ev);
+    _ev = nullptr;
+    this->_unwatch();
+    
+    // the strings keep their capacity, the references are dropped now so
+    // the connection and the callback captures are not held by the pool
+    _sql.clear();
+    _name.clear();
+    _t.clear();
+    _p.clear();
+    _db.reset();
+    _lock.reset();
+    _cb = nullptr;
+    _lock_cb = nullptr;
+    _conn = nullptr;
+}
+
+
 void pq_async::connection_task_t::_connect()
 {
     PQ_ASYNC_DBG(
@@ -190,6 +471,7 @@ void pq_async::connection_task_t::_connect()
     );
     
     if(_format < std::chrono::system_clock::now().time_since_epoch().count()){
+        connection_pool::cancel_pending(_db.get());
         _completed = true;
         _lock_cb(
             md::callback::cb_error(
@@ -209,16 +491,20 @@ void pq_async::connection_task_t::_connect()
         
         if(_db->_conn == NULL)
             _db->_conn = connection_pool::get_connection(
-                _db.get(), _sql, 1
+                _db.get(), _sql, true
             );
         
         _db->_conn->reserve();
         if(_db->_conn == NULL)
             _db->_conn = connection_pool::get_connection(
-                _db.get(), _sql, 1
+                _db.get(), _sql, true
             );
+        if(_trace_id)
+            this->_trace_phase(trace_phase::pool_wait);
         
         _db->_conn->open_connection();
+        if(_trace_id)
+            this->_trace_phase(trace_phase::connect);
         
         #ifdef PQ_ASYNC_THREAD_SAFE
         lock.unlock();
@@ -226,10 +512,15 @@ void pq_async::connection_task_t::_connect()
         #endif
         
         connection_lock cl(new connection_lock_t(_db->_conn));
+        cl->_requested_ns = _stats_ns;
+        cl->_trace_id = _trace_id;
+        cl->_trace_ts = _trace_ts;
         _completed = true;
         _lock_cb(nullptr, cl);
     
     }catch(const pq_async::connection_pool_assign_exception& /*err*/){
+        // retried by the queue, sleep for 10ms without the pool lock
+        usleep(10000);
         return;
     }catch(const std::exception& err){
         _completed = true;
@@ -239,13 +530,354 @@ void pq_async::connection_task_t::_connect()
 
 reader_connection_task::reader_connection_task(
     md::event_queue_t* owner, database db, connection_lock lock)
-    : connection_task_t(owner, db, lock)
+    : connection_task_t(owner, db, lock), _rows(0), _bytes(0), _failed(false)
+{
+}
+
+#if PQ_ASYNC_HAS_PIPELINE
+pipeline_connection_task::pipeline_connection_task(
+    md::event_queue_t* owner, database db, connection_lock lock,
+    const md::callback::value_cb<batch_result>& cb)
+    : connection_task_t(owner, db, lock),
+    _batch(), _mode(batch_mode::atomic), _sent(0), _received(0),
+    _syncs_sent(0), _syncs_received(0), _last_null(false), _writing(false),
+    _result{0, 0, 0, {}}, _batch_cb(cb)
+{
+}
+
+pipeline_connection_task::pipeline_connection_task(
+    md::event_queue_t* owner, database db, connection_lock lock)
+    : pipeline_connection_task(owner, db, lock, nullptr)
+{
+}
+
+batch_result pipeline_connection_task::run_batch()
+{
+    if(_cmd_type == command_type::none)
+        return _result;
+    
+    _sync = true;
+    try{
+        _send_window();
+        _cmd_type = command_type::sent;
+        while(!_read_results()){
+            if(_received == _sent && _sent < _batch->size()){
+                _send_window();
+                continue;
+            }
+            
+            pollfd pfd = { PQsocket(this->conn()), POLLIN, 0 };
+            if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+                throw pq_async::exception(
+                    "Unable to wait for the batch results"
+                );
+            if(!PQconsumeInput(this->conn()))
+                throw pq_async::exception("Unable to consume input data");
+        }
+        _finish();
+        
+    }catch(...){
+        _completed = true;
+        _abort();
+        throw;
+    }
+    return _result;
+}
+
+void pipeline_connection_task::run_task()
 {
+    if(_completed || _cmd_type == command_type::none)
+        return;
+    this->_mark_loop_thread();
+    
+    try{
+        if(_cmd_type != command_type::sent){
+            _send_window();
+            _cmd_type = command_type::sent;
+            _wait_socket();
+            return;
+        }
+        
+        // the socket was full, the rest of the window is sent first
+        if(_writing){
+            if(!_flush())
+                return;
+            _wait_socket();
+        }
+        
+        if(!PQconsumeInput(this->conn()))
+            throw pq_async::exception("Unable to consume input data");
+        
+        while(!_read_results()){
+            // the next window is sent once the previous one is drained
+            if(_received != _sent || _sent == _batch->size())
+                return;
+            _send_window();
+            if(_writing){
+                _wait_socket();
+                return;
+            }
+        }
+        _finish();
+        if(_batch_cb)
+            _batch_cb(nullptr, _result);
+        
+    }catch(const std::exception& err){
+        _completed = true;
+        _abort();
+        if(_batch_cb)
+            _batch_cb(md::callback::cb_error(err), _result);
+    }
 }
 
+void pipeline_connection_task::_send_window()
+{
+    PGconn* c = this->conn();
+    if(PQpipelineStatus(c) == PQ_PIPELINE_OFF && !PQenterPipelineMode(c)){
+        std::string errMsg = PQerrorMessage(c);
+        throw pq_async::exception(errMsg);
+    }
+    
+    size_t count = _batch->size();
+    if(_mode == batch_mode::atomic && !_result.errors.empty()){
+        // the server would abort them anyway, skip the remaining windows
+        _result.aborted += count - _sent;
+        _received += count - _sent;
+        _sent = count;
+    }
+    
+    size_t end = std::min(_sent + PQ_ASYNC_PIPELINE_WINDOW, count);
+    for(; _sent < end; ++_sent){
+        parameters_t& p = const_cast<parameters_t&>((*_batch)[_sent]);
+        if(!PQsendQueryPrepared(
+            c, _name.c_str(), p.size(),
+            p.values(), p.lengths(), p.formats(),
+            PG_BIN_FORMAT
+        )){
+            std::string errMsg = PQerrorMessage(c);
+            throw pq_async::exception(errMsg);
+        }
+        if(_mode == batch_mode::isolated){
+            if(!PQpipelineSync(c)){
+                std::string errMsg = PQerrorMessage(c);
+                throw pq_async::exception(errMsg);
+            }
+            ++_syncs_sent;
+        }
+    }
+    
+    if(_mode == batch_mode::atomic){
+        if(_sent == count){
+            if(!PQpipelineSync(c)){
+                std::string errMsg = PQerrorMessage(c);
+                throw pq_async::exception(errMsg);
+            }
+            ++_syncs_sent;
+        }else if(!PQsendFlushRequest(c)){
+            std::string errMsg = PQerrorMessage(c);
+            throw pq_async::exception(errMsg);
+        }
+    }
+    
+    _flush();
+}
+
+bool pipeline_connection_task::_flush()
+{
+    PGconn* c = this->conn();
+    for(;;){
+        int r = PQflush(c);
+        if(r < 0){
+            std::string errMsg = PQerrorMessage(c);
+            throw pq_async::exception(errMsg);
+        }
+        _writing = r == 1;
+        if(!_writing)
+            return true;
+        
+        // keep reading while the socket is full so the server never
+        // blocks on its own output
+        if(!PQconsumeInput(c))
+            throw pq_async::exception("Unable to consume input data");
+        
+        // the event loop resumes the flush once the socket is writable
+        if(!_sync)
+            return false;
+        
+        pollfd pfd = { PQsocket(c), POLLIN | POLLOUT, 0 };
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            throw pq_async::exception("Unable to flush the batch");
+    }
+}
+
+void pipeline_connection_task::_wait_socket()
+{
+    this->_create_event(_writing ? EV_READ | EV_WRITE : EV_READ);
+}
+
+bool pipeline_connection_task::_read_results()
+{
+    PGconn* c = this->conn();
+    while(!_done()){
+        if(PQisBusy(c))
+            return false;
+        
+        PGresult* r = PQgetResult(c);
+        if(!r){
+            // a NULL ends each statement, two in a row means idle
+            if(_last_null)
+                return false;
+            _last_null = true;
+            continue;
+        }
+        _last_null = false;
+        
+        switch(PQresultStatus(r)){
+            case PGRES_PIPELINE_SYNC:
+                ++_syncs_received;
+                break;
+            
+            case PGRES_COMMAND_OK:
+            case PGRES_TUPLES_OK:{
+                const char* n = PQcmdTuples(r);
+                if(n && *n)
+                    _result.affected += atoll(n);
+                ++_result.executed;
+                ++_received;
+                break;
+            }
+            
+            case PGRES_PIPELINE_ABORTED:
+                ++_result.aborted;
+                ++_received;
+                break;
+            
+            default:{
+                const char* state = PQresultErrorField(r, PG_DIAG_SQLSTATE);
+                _result.errors.emplace_back(batch_error{
+                    _received, state ? state : "", PQresultErrorMessage(r)
+                });
+                ++_received;
+                break;
+            }
+        }
+        PQclear(r);
+    }
+    return true;
+}
+
+void pipeline_connection_task::_finish()
+{
+    _completed = true;
+    if(!PQexitPipelineMode(this->conn())){
+        std::string errMsg = PQerrorMessage(this->conn());
+        throw pq_async::exception(errMsg);
+    }
+}
+
+void pipeline_connection_task::_abort()
+{
+    PGconn* c = this->conn();
+    if(!c || PQpipelineStatus(c) == PQ_PIPELINE_OFF)
+        return;
+    
+    // the pipeline can only be left once every result up to the last
+    // sync was read, otherwise the next command on that connection would
+    // receive them
+    if(_done() && !_writing && PQexitPipelineMode(c))
+        return;
+    
+    log_async(pq_async::default_logger(), log_level::warn,
+        "pipelined batch left unfinished results, resetting the connection"
+    );
+    this->_reset_connection();
+}
+#endif //PQ_ASYNC_HAS_PIPELINE
+
 
 PGconn* connection_task_t::conn(){ return _db->_conn->conn();}
 
+void connection_task_t::_mark_loop_thread(){ _db->_mark_loop_thread();}
+
+void connection_task_t::_reset_connection()
+{
+    if(_ev)
+        event_del(_ev);
+    _ev = nullptr;
+    this->_unwatch();
+    _db->_conn->close_connection();
+}
+
+
+/*!
+ * \brief a socket registered with a reactor, shared with its handler so
+ * a handler already dequeued by the reactor sees the task is gone
+ */
+struct reactor_watch_t
+{
+    reactor r;
+    PGconn* conn;
+    int fd;
+    database db;
+    bool writing;
+    std::atomic<bool> active;
+};
+
+static void reactor_watch_ready(std::shared_ptr<reactor_watch_t> w)
+{
+    if(!w->active.load())
+        return;
+    
+    // the query is sent, only the results are waited for now
+    if(w->writing && PQflush(w->conn) == 0){
+        w->writing = false;
+        w->r->watch(w->fd, true, false, [w](){ reactor_watch_ready(w);});
+    }
+    w->db->get_strand()->run_n();
+}
+
+void connection_task_t::_activate() const
+{
+    if(_sync || !_db){
+        this->_owner->activate();
+        return;
+    }
+    reactor r = default_reactor();
+    if(!r){
+        this->_owner->activate();
+        return;
+    }
+    database db = _db;
+    r->add_timer(0, [db](){ db->get_strand()->run_n();});
+}
+
+void connection_task_t::_watch(const reactor& r)
+{
+    // the synchronous calls wait in PQgetResult
+    if(_sync)
+        return;
+    
+    this->_unwatch();
+    auto w = std::make_shared<reactor_watch_t>();
+    w->r = r;
+    w->conn = this->conn();
+    w->fd = PQsocket(w->conn);
+    w->db = _db;
+    w->writing = PQflush(w->conn) == 1;
+    w->active = true;
+    r->watch(w->fd, true, w->writing, [w](){ reactor_watch_ready(w);});
+    _reactor_watch = w;
+}
+
+void connection_task_t::_unwatch()
+{
+    if(!_reactor_watch)
+        return;
+    _reactor_watch->active = false;
+    _reactor_watch->r->unwatch(_reactor_watch->fd);
+    _reactor_watch.reset();
+}
+
 std::string pq_async::connection_pool::last_stolen_conn_id = "";
 pq_async::connection_pool *pq_async::connection_pool::s_instance = NULL;
 bool pq_async::connection_pool::s_init = false;
@@ -355,7 +987,7 @@ int32_t pq_async::connection_pool::_get_opened_connection_count(
 
 
 pq_async::connection* pq_async::connection_pool::_get_connection(
-    database_t* owner, const std::string& connection_string, int32_t timeout_ms)
+    database_t* owner, const std::string& connection_string, bool queue)
 {
     #ifdef PQ_ASYNC_THREAD_SAFE
     std::unique_lock<std::recursive_mutex> lock(conn_pool_mutex);
@@ -396,6 +1028,133 @@ pq_async::connection* pq_async::connection_pool::_get_connection(
             }
         }
     
+    connection_priority priority = owner ?
+        owner->_priority : connection_priority::normal;
+    std::vector<pending_request_t>& pending = _pending[connection_string];
+    auto now = std::chrono::steady_clock::now();
+    
+    // drop the requests abandoned by their owner
+    pending.erase(
+        std::remove_if(pending.begin(), pending.end(),
+        [&now](const pending_request_t& r)-> bool {
+            return r.last_poll + std::chrono::seconds(1) < now;
+        }),
+        pending.end()
+    );
+    
+    auto me = std::find_if(pending.begin(), pending.end(),
+        [owner](const pending_request_t& r)-> bool { return r.owner == owner;}
+    );
+    
+    // only the first eligible request of the highest priority class
+    // can be served, requests of a capped class don't block the others.
+    bool first = !_is_capped(cons, priority);
+    for(size_t i = 0; first && i < pending.size(); ++i){
+        const pending_request_t& r = pending[i];
+        if(r.owner == owner || _is_capped(cons, r.priority))
+            continue;
+        if(r.priority < priority ||
+            (r.priority == priority && (me == pending.end() || r.seq < me->seq))
+        )
+            first = false;
+    }
+    
+    if(first){
+        connection* conn = _try_assign(owner, connection_string, cons);
+        if(conn){
+            if(me != pending.end())
+                pending.erase(me);
+            return conn;
+        }
+    }
+    
+    if(queue){
+        if(me == pending.end()){
+            if(_max_pending > 0 && (int32_t)pending.size() >= _max_pending){
+                ++_rejected;
+                throw pq_async::connection_pool_admission_exception(
+                    "connection request rejected, the pending queue is full"
+                );
+            }
+            pending.emplace_back(
+                pending_request_t{owner, priority, ++_next_seq, now, now}
+            );
+        
+        }else{
+            me->last_poll = now;
+            if(_max_wait_ms > 0 &&
+                me->since + std::chrono::milliseconds(_max_wait_ms) < now
+            ){
+                pending.erase(me);
+                ++_rejected;
+                throw pq_async::connection_pool_admission_exception(
+                    "connection request rejected, the wait budget is exhausted"
+                );
+            }
+        }
+    }
+    
+    // no connection can be steal so throw an error
+    std::string err_msg( //TODO: need to put error strings in const...
+        "unable to assign a connection because max connection "
+        "count reached, connection count is '"
+    );
+    err_msg += md::num_to_str(
+        _get_opened_connection_count(connection_string)
+    );
+    err_msg += "'";
+    throw pq_async::connection_pool_assign_exception(err_msg);
+}
+
+bool pq_async::connection_pool::_is_capped(
+    std::vector<connection*>* cons, connection_priority priority)
+{
+    int32_t cap = _caps[(int)priority];
+    if(cap <= 0)
+        return false;
+    
+    int32_t held = 0;
+    for(size_t i = 0; i < cons->size(); ++i){
+        connection* con = (*cons)[i];
+        if(con->_res.load() == 1 && con->_owner &&
+            con->_owner->_priority == priority
+        )
+            ++held;
+    }
+    return held >= cap;
+}
+
+void pq_async::connection_pool::_cancel_pending(database_t* owner)
+{
+    #ifdef PQ_ASYNC_THREAD_SAFE
+    std::unique_lock<std::recursive_mutex> lock(conn_pool_mutex);
+    #endif
+    
+    for(auto& it : _pending)
+        it.second.erase(
+            std::remove_if(it.second.begin(), it.second.end(),
+            [owner](const pending_request_t& r)-> bool {
+                return r.owner == owner;
+            }),
+            it.second.end()
+        );
+}
+
+int32_t pq_async::connection_pool::_get_pending_count(
+    const std::string& connection_string)
+{
+    #ifdef PQ_ASYNC_THREAD_SAFE
+    std::unique_lock<std::recursive_mutex> lock(conn_pool_mutex);
+    #endif
+    
+    auto it = _pending.find(connection_string);
+    return it == _pending.end() ? 0 : (int32_t)it->second.size();
+}
+
+pq_async::connection* pq_async::connection_pool::_try_assign(
+    database_t* owner, const std::string& connection_string,
+    std::vector<connection*>* cons)
+{
     // init first conns if it doesn't exist
     int con_size = cons->size();
     if(con_size == 0){
@@ -429,6 +1188,7 @@ pq_async::connection* pq_async::connection_pool::_get_connection(
         cons->push_back(conn);
         
         if(conn->lock()){
+            conn->_owner = owner;
             return conn;
         } else {
             std::string err_msg(
@@ -441,16 +1201,6 @@ pq_async::connection* pq_async::connection_pool::_get_connection(
     // finally try to steal a connection starting with 
     //   last id higher than last stolen index
     
-    // infinite wait
-    if(timeout_ms <= 0)
-        timeout_ms = INT32_MAX;
-    // connection stealing will timeout in timeout_ms milliseconds
-    std::chrono::system_clock::time_point
-        timeout_date(
-            std::chrono::system_clock::now() -
-            std::chrono::milliseconds(timeout_ms)
-        );
-    
     // sort steelable connections
     std::vector<connection*> scons;
     scons.reserve(cons->size());
@@ -463,42 +1213,27 @@ pq_async::connection* pq_async::connection_pool::_get_connection(
         if((*cons)[i]->id() <= pq_async::connection_pool::last_stolen_conn_id)
             scons.emplace_back((*cons)[i]);
     
-    do{
-    //while(timeout_date > std::chrono::system_clock::now()){
-        for(size_t i = 0; i < scons.size(); ++i){
-            connection* con = scons[i];
-            if(con->can_be_stolen()){
-                // reasign the connection
-                if(con->_owner)
-                    con->_owner->_conn = NULL;
-                con->_owner = owner;
-                con->reserve();
-                
-                pq_async::connection_pool::last_stolen_conn_id = con->id();
-                
-                PQ_ASYNC_DEF_DBG(
-                    "connection '{}' was stolen, "
-                    "connection count is '{}'", 
-                    con->id(), (int)cons->size()
-                );
-                return con;
-            }
+    for(size_t i = 0; i < scons.size(); ++i){
+        connection* con = scons[i];
+        if(con->can_be_stolen()){
+            // reasign the connection
+            if(con->_owner)
+                con->_owner->_conn = NULL;
+            con->_owner = owner;
+            con->reserve();
+            
+            pq_async::connection_pool::last_stolen_conn_id = con->id();
+            
+            PQ_ASYNC_DEF_DBG(
+                "connection '{}' was stolen, "
+                "connection count is '{}'", 
+                con->id(), (int)cons->size()
+            );
+            return con;
         }
-        
-        // sleep for 10ms
-        usleep(10000);
-    } while(timeout_date > std::chrono::system_clock::now());
+    }
     
-    // no connection can be steal so throw an error
-    std::string err_msg( //TODO: need to put error strings in const...
-        "unable to assign a connection because max connection "
-        "count reached, connection count is '"
-    );
-    err_msg += md::num_to_str(
-        _get_opened_connection_count(connection_string)
-    );
-    err_msg += "'";
-    throw pq_async::connection_pool_assign_exception(err_msg);
+    return nullptr;
 }
 
 
@@ -149,5 +149,463 @@ void data_large_object_t::unlink()
     lo_unlink(_db->_conn->conn(), this->_oid);
 }
 
+void data_large_object_t::_read(
+    database db, const pq_async::oid& lo_oid, int64_t offset, int32_t len,
+    const md::callback::value_cb< std::vector<int8_t> >& cb)
+{
+    parameters_t p(lo_oid, offset, len);
+    db->query_value< std::vector<int8_t> >(
+        "select lo_get($1, $2, $3)", p, cb
+    );
+}
+
+void data_large_object_t::_write(
+    database db, const pq_async::oid& lo_oid, int64_t offset,
+    const std::vector<int8_t>& data, const md::callback::async_cb& cb)
+{
+    parameters_t p(lo_oid, offset, data);
+    db->execute("select lo_put($1, $2, $3)", p,
+    [cb](const md::callback::cb_error& err, int)-> void {
+        cb(err);
+    });
+}
+
+lo_reader data_large_object_t::reader(
+    int64_t offset, int32_t chunk_size, int32_t read_ahead)
+{
+    if(offset < 0 || chunk_size <= 0 || read_ahead <= 0)
+        throw pq_async::exception("Invalid large object reader settings!");
+    
+    // dedicated connections let the reads overlap each other and the
+    // caller queries
+    std::vector<database> dbs;
+    for(int32_t i = 0; i < read_ahead; ++i)
+        dbs.emplace_back(pq_async::open(_db->_connection_string, _db->_log));
+    lo_reader r(new lo_reader_t(dbs, _oid, offset, chunk_size));
+    r->_fill();
+    return r;
+}
+
+lo_writer data_large_object_t::writer(
+    int64_t offset, int32_t chunk_size, int32_t write_behind)
+{
+    if(offset < 0 || chunk_size <= 0 || write_behind <= 0)
+        throw pq_async::exception("Invalid large object writer settings!");
+    
+    return lo_writer(new lo_writer_t(
+        pq_async::open(_db->_connection_string, _db->_log),
+        _oid, offset, chunk_size, write_behind
+    ));
+}
+
+int32_t data_large_object_t::_block_aligned(
+    int32_t parallelism, int32_t chunk_size)
+{
+    int64_t aligned = ((int64_t)chunk_size + PQ_ASYNC_LO_BLOCK_SIZE -1) /
+        PQ_ASYNC_LO_BLOCK_SIZE * PQ_ASYNC_LO_BLOCK_SIZE;
+    if(parallelism <= 0 || chunk_size <= 0 || aligned > INT32_MAX)
+        throw pq_async::exception("Invalid large object transfer settings!");
+    return (int32_t)aligned;
+}
+
+void data_large_object_t::_download(
+    const md::callback::value_cb< std::vector<int8_t> >& cb,
+    int32_t parallelism, int32_t chunk_size, lo_progress_cb progress)
+{
+    auto st = std::make_shared<transfer_state_t>();
+    st->lo_oid = _oid;
+    st->upload = false;
+    st->chunk_size = _block_aligned(parallelism, chunk_size);
+    st->next = st->done = 0;
+    st->workers = 0;
+    st->progress = progress;
+    st->download_cb = cb;
+    
+    this->size(
+    [db=_db, st, parallelism](
+        const md::callback::cb_error& err, int64_t total
+    )-> void {
+        if(err){
+            st->download_cb(err, std::vector<int8_t>());
+            return;
+        }
+        st->total = total;
+        try{
+            st->data.resize(total);
+        }catch(const std::exception& alloc_err){
+            st->download_cb(
+                md::callback::cb_error(alloc_err), std::vector<int8_t>()
+            );
+            return;
+        }
+        _start_transfer(db, st, parallelism);
+    });
+}
+
+void data_large_object_t::_upload(
+    std::shared_ptr< const std::vector<int8_t> > data,
+    const md::callback::async_cb& cb,
+    int32_t parallelism, int32_t chunk_size, lo_progress_cb progress)
+{
+    if(!data)
+        throw pq_async::exception("Invalid large object upload data!");
+    
+    auto st = std::make_shared<transfer_state_t>();
+    st->lo_oid = _oid;
+    st->upload = true;
+    st->total = data->size();
+    st->chunk_size = _block_aligned(parallelism, chunk_size);
+    st->next = st->done = 0;
+    st->workers = 0;
+    st->source = data;
+    st->progress = progress;
+    st->upload_cb = cb;
+    
+    _start_transfer(_db, st, parallelism);
+}
+
+void data_large_object_t::_start_transfer(
+    database db, std::shared_ptr<transfer_state_t> st, int32_t parallelism)
+{
+    int64_t chunks = (st->total + st->chunk_size -1) / st->chunk_size;
+    st->workers = (int32_t)std::min<int64_t>(parallelism, chunks);
+    if(st->workers == 0){
+        md::event_queue_t::get_default()->push_back(
+            std::bind(&data_large_object_t::_transfer_done, st)
+        );
+        return;
+    }
+    
+    // one database per worker, each range uses its own pooled connection
+    int32_t workers = st->workers;
+    for(int32_t i = 0; i < workers; ++i)
+        _transfer_next(
+            st, pq_async::open(db->_connection_string, db->_log)
+        );
+}
+
+void data_large_object_t::_transfer_next(
+    std::shared_ptr<transfer_state_t> st, database db)
+{
+    int64_t offset = 0;
+    int32_t len = 0;
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        if(st->err || st->next >= st->total)
+            last = --st->workers == 0;
+        else{
+            offset = st->next;
+            len = (int32_t)std::min<int64_t>(
+                st->chunk_size, st->total - offset
+            );
+            st->next += len;
+        }
+    }
+    if(len == 0){
+        if(last)
+            _transfer_done(st);
+        return;
+    }
+    
+    auto range_done = [st, db, len](const md::callback::cb_error& err){
+        int64_t done = 0;
+        {
+            std::lock_guard<std::mutex> lock(st->mutex);
+            if(err && !st->err)
+                st->err = err;
+            done = st->done += len;
+        }
+        if(!err && st->progress)
+            st->progress(done, st->total);
+        _transfer_next(st, db);
+    };
+    
+    if(st->upload){
+        std::vector<int8_t> chunk(
+            st->source->begin() + offset, st->source->begin() + offset + len
+        );
+        _write(db, st->lo_oid, offset, chunk, range_done);
+        return;
+    }
+    
+    _read(db, st->lo_oid, offset, len,
+    [st, offset, len, range_done](
+        const md::callback::cb_error& err, std::vector<int8_t> chunk
+    )-> void {
+        if(err){
+            range_done(err);
+            return;
+        }
+        if((int32_t)chunk.size() != len){
+            range_done(md::callback::cb_error(pq_async::exception(
+                "Large object size changed during the download!"
+            )));
+            return;
+        }
+        // the ranges are disjoint, no lock is needed for the copy
+        memcpy(st->data.data() + offset, chunk.data(), len);
+        range_done(nullptr);
+    });
+}
+
+void data_large_object_t::_transfer_done(std::shared_ptr<transfer_state_t> st)
+{
+    if(st->upload){
+        st->source.reset();
+        st->upload_cb(st->err);
+        return;
+    }
+    if(st->err)
+        st->download_cb(st->err, std::vector<int8_t>());
+    else
+        st->download_cb(nullptr, std::move(st->data));
+}
+
+
+lo_reader_t::lo_reader_t(
+    std::vector<database> dbs, const pq_async::oid& lo_oid, int64_t offset,
+    int32_t chunk_size)
+    : _dbs(dbs), _oid(lo_oid), _chunk_size(chunk_size),
+    _read_ahead((int32_t)dbs.size()), _next_db(0),
+    _position(offset), _next_offset(offset),
+    _end_requested(false), _eof(false)
+{
+}
+
+int64_t lo_reader_t::position() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _position;
+}
+
+bool lo_reader_t::eof() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _eof;
+}
+
+void lo_reader_t::_next(
+    const md::callback::value_cb< std::vector<int8_t> >& cb)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _waiting.emplace_back(cb);
+    }
+    _fill();
+    _deliver();
+}
+
+void lo_reader_t::_fill()
+{
+    std::vector< std::pair<database, std::shared_ptr<slot_t> > > pending;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        while(!_end_requested && (int32_t)_slots.size() < _read_ahead){
+            auto s = std::make_shared<slot_t>();
+            s->offset = _next_offset;
+            s->done = false;
+            _next_offset += _chunk_size;
+            _slots.emplace_back(s);
+            // a slot is only added once the oldest one was delivered,
+            // the database it used is free again
+            pending.emplace_back(_dbs[_next_db], s);
+            _next_db = (_next_db +1) % _dbs.size();
+        }
+    }
+    
+    // requests are sent outside of the lock, the callback may be immediate
+    for(auto& p : pending)
+        data_large_object_t::_read(
+            p.first, _oid, p.second->offset, _chunk_size,
+        [self=this->shared_from_this(), s=p.second](
+            const md::callback::cb_error& err, std::vector<int8_t> data
+        )-> void {
+            {
+                std::lock_guard<std::mutex> lock(self->_mutex);
+                s->done = true;
+                s->err = err;
+                s->data = std::move(data);
+                if(err || (int32_t)s->data.size() < self->_chunk_size)
+                    self->_end_requested = true;
+            }
+            self->_fill();
+            self->_deliver();
+        });
+}
+
+void lo_reader_t::_deliver()
+{
+    for(;;){
+        md::callback::value_cb< std::vector<int8_t> > cb;
+        md::callback::cb_error err;
+        std::vector<int8_t> data;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(_waiting.empty())
+                return;
+            
+            if(!_eof){
+                if(_slots.empty() || !_slots.front()->done)
+                    return;
+                
+                auto s = _slots.front();
+                _slots.pop_front();
+                if(s->err)
+                    _err = s->err;
+                else
+                    data = std::move(s->data);
+                _position += data.size();
+                _eof = _err || data.empty();
+            }
+            
+            err = _err;
+            cb = _waiting.front();
+            _waiting.pop_front();
+        }
+        
+        _dbs.front()->get_strand()->push_back(
+            std::bind(cb, err, std::move(data))
+        );
+    }
+}
+
+
+lo_writer_t::lo_writer_t(
+    database db, const pq_async::oid& lo_oid, int64_t offset,
+    int32_t chunk_size, int32_t write_behind)
+    : _db(db), _oid(lo_oid), _chunk_size(chunk_size),
+    _write_behind(write_behind), _position(offset), _send_offset(offset),
+    _written(0), _in_flight(0)
+{
+    _buf.reserve(chunk_size);
+}
+
+int64_t lo_writer_t::position() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _position;
+}
+
+int64_t lo_writer_t::written() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _written;
+}
+
+void lo_writer_t::_append(
+    const char* data, size_t len, const md::callback::async_cb& cb)
+{
+    std::vector< std::pair<int64_t, std::vector<int8_t> > > chunks;
+    md::callback::cb_error err;
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_err){
+            err = _err;
+            ready = true;
+            
+        }else{
+            _position += len;
+            while(len > 0){
+                size_t n = std::min(len, _chunk_size - _buf.size());
+                _buf.insert(_buf.end(), data, data + n);
+                data += n;
+                len -= n;
+                if(_buf.size() < (size_t)_chunk_size)
+                    break;
+                
+                chunks.emplace_back(_send_offset, std::move(_buf));
+                _send_offset += _chunk_size;
+                _buf = std::vector<int8_t>();
+                _buf.reserve(_chunk_size);
+                ++_in_flight;
+            }
+            
+            // backpressure, the caller resumes when a chunk is stored
+            if(_in_flight <= _write_behind)
+                ready = true;
+            else
+                _blocked.emplace_back(cb);
+        }
+    }
+    
+    for(auto& c : chunks)
+        _send(c.first, std::move(c.second));
+    
+    if(ready)
+        _db->get_strand()->push_back(std::bind(cb, err));
+}
+
+void lo_writer_t::_flush(const md::callback::async_cb& cb)
+{
+    int64_t offset = 0;
+    std::vector<int8_t> chunk;
+    md::callback::cb_error err;
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!_err && !_buf.empty()){
+            offset = _send_offset;
+            _send_offset += _buf.size();
+            chunk = std::move(_buf);
+            _buf = std::vector<int8_t>();
+            _buf.reserve(_chunk_size);
+            ++_in_flight;
+        }
+        
+        if(_in_flight == 0){
+            err = _err;
+            ready = true;
+        }else
+            _flushing.emplace_back(cb);
+    }
+    
+    if(!chunk.empty())
+        _send(offset, std::move(chunk));
+    
+    if(ready)
+        _db->get_strand()->push_back(std::bind(cb, err));
+}
+
+void lo_writer_t::_send(int64_t offset, std::vector<int8_t> chunk)
+{
+    size_t len = chunk.size();
+    data_large_object_t::_write(_db, _oid, offset, chunk,
+    [self=this->shared_from_this(), len](
+        const md::callback::cb_error& err
+    )-> void {
+        self->_on_sent(err, len);
+    });
+}
+
+void lo_writer_t::_on_sent(const md::callback::cb_error& err, size_t len)
+{
+    std::vector<md::callback::async_cb> resumed;
+    std::vector<md::callback::async_cb> flushed;
+    md::callback::cb_error res_err;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_in_flight;
+        if(err){
+            if(!_err)
+                _err = err;
+        }else
+            _written += len;
+        
+        while(!_blocked.empty() && (_err || _in_flight <= _write_behind)){
+            resumed.emplace_back(_blocked.front());
+            _blocked.pop_front();
+        }
+        if(_in_flight == 0)
+            flushed.swap(_flushing);
+        res_err = _err;
+    }
+    
+    for(auto& cb : resumed)
+        _db->get_strand()->push_back(std::bind(cb, res_err));
+    for(auto& cb : flushed)
+        _db->get_strand()->push_back(std::bind(cb, res_err));
+}
 
 } // ns: pq_async
\ No newline at end of file
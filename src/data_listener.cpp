@@ -0,0 +1,327 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_listener.h"
+#include "database.h"
+
+namespace pq_async{
+
+notification_listener_t::notification_listener_t(
+    md::event_strand<int> strand,
+    const std::string& connection_string,
+    md::log::logger log)
+    : _strand(strand), _connection_string(connection_string),
+    _log(log ? log : pq_async::default_logger()),
+    _ev(nullptr), _retry_ev(nullptr), _connecting(false), _reconnections(0)
+{
+}
+
+notification_listener_t::~notification_listener_t()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_retry_ev){
+        event_free(_retry_ev);
+        _retry_ev = nullptr;
+    }
+    this->_disconnect();
+}
+
+void notification_listener_t::listen(
+    const std::string& channel,
+    const md::callback::value_cb<notifications>& cb)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    bool added = _channels.find(channel) == _channels.end();
+    _channels[channel] = cb;
+    
+    if(!_db){
+        if(_retry_ev)
+            return;
+        try{
+            this->_connect();
+        }catch(...){
+            _channels.erase(channel);
+            this->_disconnect();
+            throw;
+        }
+    }else if(added && !_connecting){
+        try{
+            this->_execute("LISTEN ", channel);
+        }catch(...){
+            _channels.erase(channel);
+            throw;
+        }
+    }
+    
+    this->_dispatch();
+}
+
+void notification_listener_t::unlisten(const std::string& channel)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    auto it = _channels.find(channel);
+    if(it == _channels.end())
+        return;
+    
+    _channels.erase(it);
+    if(!_db)
+        return;
+    
+    if(_channels.empty()){
+        this->_disconnect();
+        return;
+    }
+    // a notification received meanwhile is dropped by _dispatch
+    if(_connecting)
+        return;
+    this->_execute("UNLISTEN ", channel);
+    this->_dispatch();
+}
+
+bool notification_listener_t::listening(const std::string& channel) const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _channels.find(channel) != _channels.end();
+}
+
+bool notification_listener_t::ready() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _db && !_connecting;
+}
+
+size_t notification_listener_t::channel_count() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _channels.size();
+}
+
+int notification_listener_t::poll()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(!_db || !_db->_conn || _connecting)
+        return 0;
+    
+    PGconn* conn = _db->_conn->conn();
+    if(!PQconsumeInput(conn) || PQstatus(conn) != CONNECTION_OK){
+        log_async(_log, log_level::warn,
+            "listen connection lost: {}", PQerrorMessage(conn)
+        );
+        
+        for(auto& c : _channels)
+            _strand->push_back(std::bind(
+                c.second,
+                md::callback::cb_error(
+                    pq_async::exception("The listen connection was lost!")
+                ),
+                notifications()
+            ));
+        
+        this->_reconnect();
+        return 0;
+    }
+    
+    return this->_dispatch();
+}
+
+void notification_listener_t::_connect()
+{
+    _db = pq_async::open(_connection_string, _log);
+    _lock = _db->open_connection();
+    
+    for(auto& c : _channels)
+        this->_execute("LISTEN ", c.first);
+    
+    this->_watch();
+}
+
+void notification_listener_t::_watch()
+{
+    _ev = event_new(
+        _strand->ev_base(),
+        PQsocket(_db->_conn->conn()),
+        EV_READ | EV_PERSIST,
+        [](evutil_socket_t fd, short events, void* arg){
+            ((notification_listener_t*)arg)->poll();
+        },
+        this
+    );
+    event_add(_ev, nullptr);
+}
+
+void notification_listener_t::_disconnect()
+{
+    if(_ev){
+        event_free(_ev);
+        _ev = nullptr;
+    }
+    _connecting = false;
+    _lock.reset();
+    _db.reset();
+}
+
+void notification_listener_t::_reconnect()
+{
+    this->_disconnect();
+    ++_reconnections;
+    
+    // called from the event loop, nothing is waited for synchronously
+    auto db = pq_async::open(_connection_string, _log);
+    _db = db;
+    _connecting = true;
+    std::weak_ptr<notification_listener_t> wself = this->shared_from_this();
+    db->open_connection(
+    [wself, db](const md::callback::cb_error& err, connection_lock lock){
+        auto self = wself.lock();
+        if(!self)
+            return;
+        std::lock_guard<std::recursive_mutex> g(self->_mutex);
+        // disconnected or reconnected meanwhile
+        if(self->_db != db)
+            return;
+        
+        if(err){
+            self->_retry(err.c_str());
+            return;
+        }
+        self->_lock = lock;
+        self->_listen_pending(
+            db, std::make_shared< std::set<std::string> >()
+        );
+    });
+}
+
+void notification_listener_t::_listen_pending(
+    database db, std::shared_ptr< std::set<std::string> > done)
+{
+    for(auto& c : _channels){
+        if(!done->insert(c.first).second)
+            continue;
+        
+        std::string sql;
+        try{
+            sql = this->_command("LISTEN ", c.first);
+        }catch(const std::exception& err){
+            this->_retry(err.what());
+            return;
+        }
+        
+        std::weak_ptr<notification_listener_t> wself =
+            this->shared_from_this();
+        db->execute(sql.c_str(),
+        [wself, db, done](const md::callback::cb_error& err){
+            auto self = wself.lock();
+            if(!self)
+                return;
+            std::lock_guard<std::recursive_mutex> g(self->_mutex);
+            if(self->_db != db)
+                return;
+            
+            if(err){
+                self->_retry(err.c_str());
+                return;
+            }
+            // the channels added while listening are listened as well
+            self->_listen_pending(db, done);
+        });
+        return;
+    }
+    
+    _connecting = false;
+    this->_watch();
+    this->_dispatch();
+}
+
+void notification_listener_t::_retry(const std::string& reason)
+{
+    log_async(_log, log_level::error,
+        "unable to listen again: {}", reason
+    );
+    this->_disconnect();
+    
+    if(!_retry_ev)
+        _retry_ev = evtimer_new(
+            _strand->ev_base(),
+            [](evutil_socket_t fd, short events, void* arg){
+                auto self = (notification_listener_t*)arg;
+                std::lock_guard<std::recursive_mutex> lock(self->_mutex);
+                event_free(self->_retry_ev);
+                self->_retry_ev = nullptr;
+                if(!self->_channels.empty())
+                    self->_reconnect();
+            },
+            this
+        );
+    timeval tv{
+        PQ_ASYNC_LISTEN_RETRY_MS / 1000,
+        (PQ_ASYNC_LISTEN_RETRY_MS % 1000) * 1000
+    };
+    evtimer_add(_retry_ev, &tv);
+}
+
+std::string notification_listener_t::_command(
+    const char* cmd, const std::string& channel)
+{
+    char* es_channel = PQescapeIdentifier(
+        _db->_conn->conn(), channel.c_str(), channel.size()
+    );
+    if(!es_channel)
+        throw pq_async::exception("Invalid listen channel name!");
+    
+    std::string sql(cmd);
+    sql += es_channel;
+    PQfreemem(es_channel);
+    return sql;
+}
+
+void notification_listener_t::_execute(
+    const char* cmd, const std::string& channel)
+{
+    _db->execute(this->_command(cmd, channel).c_str());
+}
+
+int notification_listener_t::_dispatch()
+{
+    std::map<std::string, notifications> batches;
+    int count = 0;
+    while(PGnotify* n = PQnotifies(_db->_conn->conn())){
+        batches[n->relname].emplace_back(notification{
+            n->relname, n->extra ? n->extra : "", n->be_pid
+        });
+        PQfreemem(n);
+        ++count;
+    }
+    
+    for(auto& b : batches){
+        auto it = _channels.find(b.first);
+        // notification received before the UNLISTEN completed
+        if(it == _channels.end())
+            continue;
+        
+        _strand->push_back(std::bind(it->second, nullptr, b.second));
+    }
+    return count;
+}
+
+} //namespace pq_async
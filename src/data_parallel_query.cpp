@@ -0,0 +1,323 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_parallel_query.h"
+
+#include <future>
+
+namespace pq_async{
+
+#define PQ_ASYNC_PARALLEL_QUERY_ISOLATION \
+    "set transaction isolation level repeatable read, read only"
+
+parallel_query open_parallel_query(
+    const std::string& connection_string,
+    int32_t workers,
+    md::log::logger log)
+{
+    if(workers <= 0)
+        throw pq_async::exception("Invalid parallel query workers count!");
+    return parallel_query(
+        new parallel_query_t(connection_string, workers, log)
+    );
+}
+
+parallel_query_t::parallel_query_t(
+    const std::string& connection_string,
+    int32_t workers,
+    md::log::logger log)
+    : _connection_string(connection_string), _workers(workers),
+    _log(log ? log : pq_async::default_logger())
+{
+}
+
+query_partitions parallel_query_t::key_ranges(
+    int64_t min, int64_t max, int32_t count)
+{
+    if(count <= 0 || max < min || max == INT64_MAX)
+        throw pq_async::exception("Invalid key range partitions!");
+    
+    uint64_t step = ((uint64_t)max - (uint64_t)min) / (uint64_t)count + 1;
+    query_partitions parts;
+    uint64_t lower = (uint64_t)min;
+    for(int32_t i = 0; i < count && (int64_t)lower <= max; ++i){
+        uint64_t upper = lower + step;
+        if(i == count -1 || (int64_t)upper > max)
+            upper = (uint64_t)max + 1;
+        parts.emplace_back(parameters_t((int64_t)lower, (int64_t)upper));
+        lower = upper;
+    }
+    return parts;
+}
+
+query_partitions parallel_query_t::block_ranges(
+    const std::string& table, int32_t count)
+{
+    if(count <= 0)
+        throw pq_async::exception("Invalid block range partitions!");
+    
+    int64_t blocks = pq_async::open(_connection_string, _log)
+        ->query_value<int64_t>(
+            "select (pg_relation_size($1::regclass) / "
+            "current_setting('block_size')::int8)::int8",
+            table
+        );
+    int64_t step = std::max<int64_t>(1, (blocks + count -1) / count);
+    
+    query_partitions parts;
+    for(int64_t lower = 0; (int32_t)parts.size() < count; lower += step){
+        // the table may grow before the snapshot, the last range is open
+        bool last = (int32_t)parts.size() == count -1 || lower + step >= blocks;
+        int64_t upper = last ? 4294967295LL : lower + step;
+        parts.emplace_back(parameters_t(
+            "(" + md::num_to_str(lower, false) + ",0)",
+            "(" + md::num_to_str(upper, false) + ",0)"
+        ));
+        if(last)
+            break;
+    }
+    return parts;
+}
+
+void parallel_query_t::run(
+    const char* sql, const query_partitions& parts,
+    const row_consumer& consumer)
+{
+    if(parts.empty())
+        return;
+    
+    database coordinator = pq_async::open(_connection_string, _log);
+    coordinator->begin();
+    std::string snapshot;
+    try{
+        coordinator->execute(PQ_ASYNC_PARALLEL_QUERY_ISOLATION);
+        snapshot = coordinator->query_value<std::string>(
+            "select pg_export_snapshot()"
+        );
+    }catch(...){
+        coordinator->rollback();
+        throw;
+    }
+    
+    std::string qry(sql);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex consumer_mutex;
+    int32_t count = (int32_t)std::min<size_t>(_workers, parts.size());
+    std::vector< std::future<void> > pending;
+    for(int32_t w = 0; w < count; ++w)
+        pending.emplace_back(std::async(std::launch::async,
+        [this, &qry, &parts, &consumer, &snapshot,
+            &next, &failed, &consumer_mutex]()-> void {
+            database db = pq_async::open(_connection_string, _log);
+            db->begin();
+            try{
+                db->execute(PQ_ASYNC_PARALLEL_QUERY_ISOLATION);
+                db->execute(
+                    ("set transaction snapshot '" + snapshot + "'").c_str()
+                );
+                for(size_t i = next++; i < parts.size() && !failed; i = next++){
+                    data_reader r = db->query_reader(qry.c_str(), parts[i]);
+                    while(data_row row = r->next()){
+                        std::lock_guard<std::mutex> lock(consumer_mutex);
+                        consumer(row);
+                    }
+                }
+            }catch(...){
+                failed = true;
+                db->rollback();
+                throw;
+            }
+            db->rollback();
+        }));
+    
+    // wait for every worker so the snapshot outlives all the imports
+    std::exception_ptr first_err;
+    for(auto& f : pending){
+        try{
+            f.get();
+        }catch(...){
+            if(!first_err)
+                first_err = std::current_exception();
+        }
+    }
+    coordinator->rollback();
+    if(first_err)
+        std::rethrow_exception(first_err);
+}
+
+void parallel_query_t::_run(
+    const std::string& sql, const query_partitions& parts,
+    const row_consumer& consumer, const md::callback::async_cb& cb)
+{
+    if(parts.empty()){
+        md::event_queue_t::get_default()->push_back(std::bind(cb, nullptr));
+        return;
+    }
+    
+    auto st = std::make_shared<run_state_t>();
+    st->sql = sql;
+    st->parts = parts;
+    st->consumer = consumer;
+    st->cb = cb;
+    st->next = 0;
+    st->workers = 0;
+    st->coordinator = pq_async::open(_connection_string, _log);
+    
+    auto self = this->shared_from_this();
+    st->coordinator->begin([self, st](const md::callback::cb_error& err){
+        if(err){
+            self->_fail(st, err);
+            self->_finish(st);
+            return;
+        }
+        st->coordinator->execute(PQ_ASYNC_PARALLEL_QUERY_ISOLATION,
+        [self, st](const md::callback::cb_error& err){
+            if(err){
+                self->_fail(st, err);
+                self->_finish(st);
+                return;
+            }
+            st->coordinator->query_value<std::string>(
+                "select pg_export_snapshot()",
+            [self, st](const md::callback::cb_error& err, std::string snapshot){
+                if(err){
+                    self->_fail(st, err);
+                    self->_finish(st);
+                    return;
+                }
+                
+                int32_t count = (int32_t)std::min<size_t>(
+                    self->_workers, st->parts.size()
+                );
+                {
+                    std::lock_guard<std::mutex> lock(st->mutex);
+                    st->workers = count;
+                }
+                for(int32_t w = 0; w < count; ++w)
+                    self->_start_worker(st, snapshot);
+            });
+        });
+    });
+}
+
+void parallel_query_t::_start_worker(
+    std::shared_ptr<run_state_t> st, const std::string& snapshot)
+{
+    auto self = this->shared_from_this();
+    database db = pq_async::open(_connection_string, _log);
+    db->begin([self, st, db, snapshot](const md::callback::cb_error& err){
+        if(err){
+            self->_fail(st, err);
+            self->_worker_done(st);
+            return;
+        }
+        db->execute(PQ_ASYNC_PARALLEL_QUERY_ISOLATION,
+        [self, st, db, snapshot](const md::callback::cb_error& err){
+            if(err){
+                self->_fail(st, err);
+                self->_run_next(st, db);
+                return;
+            }
+            std::string set_snapshot(
+                "set transaction snapshot '" + snapshot + "'"
+            );
+            db->execute(set_snapshot.c_str(),
+            [self, st, db](const md::callback::cb_error& err){
+                if(err)
+                    self->_fail(st, err);
+                self->_run_next(st, db);
+            });
+        });
+    });
+}
+
+void parallel_query_t::_run_next(std::shared_ptr<run_state_t> st, database db)
+{
+    size_t i = 0;
+    bool stop = false;
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        stop = st->err || st->next >= st->parts.size();
+        if(!stop)
+            i = st->next++;
+    }
+    
+    auto self = this->shared_from_this();
+    if(stop){
+        db->rollback([self, st](const md::callback::cb_error& err){
+            self->_worker_done(st);
+        });
+        return;
+    }
+    
+    db->query(st->sql.c_str(), st->parts[i],
+    [self, st, db](const md::callback::cb_error& err, data_table tbl){
+        if(err){
+            self->_fail(st, err);
+            self->_run_next(st, db);
+            return;
+        }
+        try{
+            std::lock_guard<std::mutex> lock(st->consumer_mutex);
+            for(auto& row : *tbl)
+                st->consumer(row);
+        }catch(const std::exception& consumer_err){
+            self->_fail(st, md::callback::cb_error(consumer_err));
+        }
+        self->_run_next(st, db);
+    });
+}
+
+void parallel_query_t::_worker_done(std::shared_ptr<run_state_t> st)
+{
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        last = --st->workers == 0;
+    }
+    if(last)
+        _finish(st);
+}
+
+void parallel_query_t::_finish(std::shared_ptr<run_state_t> st)
+{
+    if(!st->coordinator->in_transaction()){
+        st->cb(st->err);
+        return;
+    }
+    st->coordinator->rollback([st](const md::callback::cb_error& err){
+        st->cb(st->err);
+    });
+}
+
+void parallel_query_t::_fail(
+    std::shared_ptr<run_state_t> st, const md::callback::cb_error& err)
+{
+    std::lock_guard<std::mutex> lock(st->mutex);
+    if(!st->err)
+        st->err = err;
+}
+
+} //namespace pq_async
@@ -1558,6 +1558,218 @@ pq_async::parameter* new_parameter(const pq_async::daterange& value)
 
 
 
+
+static inline void column_write_int32(char*& p, int32_t value)
+{
+    int32_t out = 0;
+    pq_async::swap4(&value, &out, true);
+    memcpy(p, &out, sizeof(int32_t));
+    p += sizeof(int32_t);
+}
+
+static size_t column_header_size(size_t count)
+{
+    return count ? 5 * sizeof(int32_t) : 3 * sizeof(int32_t);
+}
+
+static char* column_header(char* p, size_t count, int32_t ele_oid)
+{
+    if(count > (size_t)INT32_MAX)
+        throw pq_async::exception("Too many values for an array parameter!");
+    
+    column_write_int32(p, count ? 1 : 0);
+    // the null flag is not checked by array_recv
+    column_write_int32(p, 0);
+    column_write_int32(p, ele_oid);
+    if(count){
+        column_write_int32(p, (int32_t)count);
+        column_write_int32(p, 1);
+    }
+    return p;
+}
+
+static inline void column_swap(const int8_t* in, int8_t* out)
+{
+    *out = *in;
+}
+static inline void column_swap(const int16_t* in, int16_t* out)
+{
+    pq_async::swap2(in, out, true);
+}
+static inline void column_swap(const int32_t* in, int32_t* out)
+{
+    pq_async::swap4(in, out, true);
+}
+static inline void column_swap(const int64_t* in, int64_t* out)
+{
+    pq_async::swap8(in, out, true);
+}
+
+template<typename T, typename I>
+static pq_async::parameter* column_fixed(
+    const std::vector<T>& values, int32_t ele_oid, int32_t arr_oid)
+{
+    static_assert(sizeof(T) == sizeof(I), "invalid column int type");
+    
+    size_t size = column_header_size(values.size()) +
+        values.size() * (sizeof(int32_t) + sizeof(T));
+    char* buf = new char[size];
+    char* p = column_header(buf, values.size(), ele_oid);
+    for(const T& v : values){
+        column_write_int32(p, (int32_t)sizeof(T));
+        I in;
+        I out;
+        memcpy(&in, &v, sizeof(T));
+        column_swap(&in, &out);
+        memcpy(p, &out, sizeof(T));
+        p += sizeof(T);
+    }
+    return new pq_async::parameter(arr_oid, buf, (int)size, 1);
+}
+
+template<typename T>
+static pq_async::parameter* column_gen(
+    const std::vector<T>& values, int32_t ele_oid, int32_t arr_oid)
+{
+    std::vector<char> membuf;
+    membuf.resize(column_header_size(values.size()));
+    column_header(membuf.data(), values.size(), ele_oid);
+    
+    for(const T& v : values){
+        std::unique_ptr<pq_async::parameter> param(
+            pq_async::new_parameter(v)
+        );
+        if(param->get_format() != 1)
+            throw pq_async::exception(
+                "Column element type has no binary encoding!"
+            );
+        int32_t len = param->get_value() ? param->get_length() : -1;
+        size_t pos = membuf.size();
+        membuf.resize(pos + sizeof(int32_t) + (len > 0 ? len : 0));
+        char* p = membuf.data() + pos;
+        column_write_int32(p, len);
+        if(len > 0)
+            memcpy(p, param->get_value(), len);
+    }
+    
+    char* buf = new char[membuf.size()];
+    memcpy(buf, membuf.data(), membuf.size());
+    return new pq_async::parameter(arr_oid, buf, (int)membuf.size(), 1);
+}
+
+pq_async::parameter* new_column_parameter(const std::vector<bool>& values)
+{
+    size_t size = column_header_size(values.size()) +
+        values.size() * (sizeof(int32_t) + 1);
+    char* buf = new char[size];
+    char* p = column_header(buf, values.size(), BOOLOID);
+    for(bool v : values){
+        column_write_int32(p, 1);
+        *p++ = v ? 1 : 0;
+    }
+    return new pq_async::parameter(BOOLARRAYOID, buf, (int)size, 1);
+}
+
+pq_async::parameter* new_column_parameter(
+    const std::vector<std::string>& values)
+{
+    size_t size = column_header_size(values.size());
+    for(const auto& v : values)
+        size += sizeof(int32_t) + v.size();
+    
+    char* buf = new char[size];
+    char* p = column_header(buf, values.size(), TEXTOID);
+    for(const auto& v : values){
+        column_write_int32(p, (int32_t)v.size());
+        memcpy(p, v.data(), v.size());
+        p += v.size();
+    }
+    return new pq_async::parameter(TEXTARRAYOID, buf, (int)size, 1);
+}
+
+pq_async::parameter* new_column_parameter(const std::vector<int16_t>& values)
+{
+    return column_fixed<int16_t, int16_t>(values, INT2OID, INT2ARRAYOID);
+}
+pq_async::parameter* new_column_parameter(const std::vector<int32_t>& values)
+{
+    return column_fixed<int32_t, int32_t>(values, INT4OID, INT4ARRAYOID);
+}
+pq_async::parameter* new_column_parameter(const std::vector<int64_t>& values)
+{
+    return column_fixed<int64_t, int64_t>(values, INT8OID, INT8ARRAYOID);
+}
+pq_async::parameter* new_column_parameter(const std::vector<float>& values)
+{
+    return column_fixed<float, int32_t>(values, FLOAT4OID, FLOAT4ARRAYOID);
+}
+pq_async::parameter* new_column_parameter(const std::vector<double>& values)
+{
+    return column_fixed<double, int64_t>(values, FLOAT8OID, FLOAT8ARRAYOID);
+}
+
+#define PQ_ASYNC_COLUMN_GEN_DEF(__type, __oid, __arroid) \
+pq_async::parameter* new_column_parameter( \
+    const std::vector<__type>& values) \
+{ \
+    return column_gen<__type>(values, __oid, __arroid); \
+}
+
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::numeric, NUMERICOID, NUMERICARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::money, CASHOID, MONEYARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::time, TIMEOID, TIMEARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::time_tz, TIMETZOID, TIMETZARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::timestamp, TIMESTAMPOID, TIMESTAMPARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(
+    pq_async::timestamp_tz, TIMESTAMPTZOID, TIMESTAMPTZARRAYOID
+)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::date, DATEOID, DATEARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::interval, INTERVALOID, INTERVALARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::json, JSONBOID, JSONBARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::oid, OIDOID, OIDARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::cidr, CIDROID, CIDRARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::inet, INETOID, INETARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::macaddr, MACADDROID, MACADDRARRAYOID)
+PQ_ASYNC_COLUMN_GEN_DEF(pq_async::macaddr8, MACADDR8OID, MACADDR8ARRAYOID)
+
+#undef PQ_ASYNC_COLUMN_GEN_DEF
+
+// bytea and uuid single parameters are sent as text,
+// the array elements must be written in their binary form
+pq_async::parameter* new_column_parameter(
+    const std::vector< std::vector<int8_t> >& values)
+{
+    size_t size = column_header_size(values.size());
+    for(const auto& v : values)
+        size += sizeof(int32_t) + v.size();
+    
+    char* buf = new char[size];
+    char* p = column_header(buf, values.size(), BYTEAOID);
+    for(const auto& v : values){
+        column_write_int32(p, (int32_t)v.size());
+        if(!v.empty())
+            memcpy(p, v.data(), v.size());
+        p += v.size();
+    }
+    return new pq_async::parameter(BYTEAARRAYOID, buf, (int)size, 1);
+}
+
+pq_async::parameter* new_column_parameter(
+    const std::vector<pq_async::uuid>& values)
+{
+    size_t size = column_header_size(values.size()) +
+        values.size() * (sizeof(int32_t) + 16);
+    char* buf = new char[size];
+    char* p = column_header(buf, values.size(), UUIDOID);
+    for(const auto& v : values){
+        column_write_int32(p, 16);
+        memcpy(p, v.data(), 16);
+        p += 16;
+    }
+    return new pq_async::parameter(UUIDARRAYOID, buf, (int)size, 1);
+}
+
+
 void vec_append(std::vector<char> &vec, char* buf, int len)
 {
     std::vector<char>::iterator it = vec.begin();
@@ -0,0 +1,127 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_pool_group.h"
+
+namespace pq_async{
+
+void pool_group_member_t::end_request(
+    std::chrono::steady_clock::time_point start, bool failed, double decay)
+{
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    int64_t cur = _ewma_us.load();
+    int64_t next = 0;
+    do{
+        if(cur == 0)
+            next = elapsed > 0 ? elapsed : 1;
+        else
+            next = (int64_t)(decay * elapsed + (1.0 - decay) * cur);
+    }while(!_ewma_us.compare_exchange_weak(cur, next));
+    
+    ++_requests;
+    if(failed)
+        ++_errors;
+    --_outstanding;
+}
+
+
+pool_group open_pool_group(
+    const std::string& primary_connection_string,
+    const std::vector<std::string>& replica_connection_strings,
+    pool_balancing balancing,
+    md::log::logger log)
+{
+    pool_group grp(
+        new pool_group_t(
+            primary_connection_string, replica_connection_strings,
+            balancing, log
+        )
+    );
+    return grp;
+}
+
+pool_group_t::pool_group_t(
+    const std::string& primary_connection_string,
+    const std::vector<std::string>& replica_connection_strings,
+    pool_balancing balancing,
+    md::log::logger log)
+    : _primary(
+        std::make_shared<pool_group_member_t>(primary_connection_string, true)
+    ),
+    _replicas(), _balancing(balancing),
+    _decay(PQ_ASYNC_POOL_GROUP_EWMA_DECAY), _next(0),
+    _log(log ? log : pq_async::default_logger())
+{
+    _replicas.reserve(replica_connection_strings.size());
+    for(const auto& cs : replica_connection_strings)
+        _replicas.emplace_back(
+            std::make_shared<pool_group_member_t>(cs, false)
+        );
+}
+
+pool_group_member pool_group_t::select(pool_route route, bool read_only)
+{
+    if(!read_only || route == pool_route::primary || _replicas.empty())
+        return _primary;
+    
+    // start from a rotating offset so that ties are spread between replicas
+    size_t count = _replicas.size();
+    size_t offset = (size_t)(_next++ % count);
+    
+    pool_group_member best = nullptr;
+    double best_score = 0;
+    for(size_t i = 0; i < count; ++i){
+        const pool_group_member& m = _replicas[(offset + i) % count];
+        double score = 0;
+        
+        switch(_balancing){
+            case pool_balancing::ewma_latency:
+                // a replica without samples gets a chance to be measured
+                score = (double)m->ewma_latency_us() * (m->outstanding() + 1);
+                break;
+            case pool_balancing::least_outstanding:
+            default:
+                score = (double)m->outstanding();
+                break;
+        }
+        
+        if(!best || score < best_score){
+            best = m;
+            best_score = score;
+        }
+    }
+    
+    PQ_ASYNC_DBG(_log,
+        "pool group selected replica, outstanding: {}, ewma: {}us",
+        best->outstanding(),
+        best->ewma_latency_us()
+    );
+    
+    return best;
+}
+
+} //namespace pq_async
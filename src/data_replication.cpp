@@ -0,0 +1,577 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_replication.h"
+
+#include <cinttypes>
+
+namespace pq_async{
+
+namespace{
+
+// microseconds between the unix and the PostgreSQL epochs
+const int64_t s_pg_epoch_us = 946684800000000LL;
+
+void check_len(const char* p, const char* end, size_t n)
+{
+    if(p > end || (size_t)(end - p) < n)
+        throw pq_async::exception("Truncated replication message!");
+}
+
+uint8_t read_u8(const char*& p, const char* end)
+{
+    check_len(p, end, 1);
+    return (uint8_t)*p++;
+}
+
+int16_t read_i16(const char*& p, const char* end)
+{
+    check_len(p, end, 2);
+    int16_t v;
+    swap2((const int16_t*)p, &v, false);
+    p += 2;
+    return v;
+}
+
+int32_t read_i32(const char*& p, const char* end)
+{
+    check_len(p, end, 4);
+    int32_t v;
+    swap4((const int32_t*)p, &v, false);
+    p += 4;
+    return v;
+}
+
+int64_t read_i64(const char*& p, const char* end)
+{
+    check_len(p, end, 8);
+    int64_t v;
+    swap8((const int64_t*)p, &v, false);
+    p += 8;
+    return v;
+}
+
+std::string read_str(const char*& p, const char* end)
+{
+    const char* z = (const char*)memchr(p, '\0', end - p);
+    if(!z)
+        throw pq_async::exception("Truncated replication message!");
+    std::string s(p, z - p);
+    p = z + 1;
+    return s;
+}
+
+void write_i64(char* p, int64_t v)
+{
+    swap8(&v, (int64_t*)p, true);
+}
+
+std::string quote_ident(PGconn* conn, const std::string& ident)
+{
+    char* es = PQescapeIdentifier(conn, ident.c_str(), ident.size());
+    if(!es)
+        throw pq_async::exception(PQerrorMessage(conn));
+    std::string s(es);
+    PQfreemem(es);
+    return s;
+}
+
+} //namespace
+
+
+std::string lsn_to_str(uint64_t lsn)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%X/%X",
+        (uint32_t)(lsn >> 32), (uint32_t)lsn
+    );
+    return std::string(buf);
+}
+
+uint64_t str_to_lsn(const std::string& lsn)
+{
+    uint32_t hi = 0;
+    uint32_t lo = 0;
+    if(sscanf(lsn.c_str(), "%X/%X", &hi, &lo) != 2)
+        throw pq_async::exception("Invalid LSN: \"" + lsn + "\"");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+
+replication_stream open_replication(
+    const std::string& connection_string, md::log::logger log)
+{
+    return replication_stream(
+        new replication_stream_t(
+            md::event_queue_t::get_default()->new_strand<int>(),
+            connection_string, log
+        )
+    );
+}
+
+replication_stream_t::replication_stream_t(
+    md::event_strand<int> strand,
+    const std::string& connection_string,
+    md::log::logger log)
+    : _strand(strand), _connection_string(connection_string),
+    _log(log ? log : pq_async::default_logger()),
+    _conn(nullptr), _ev(nullptr), _status_ev(nullptr),
+    _xid(0), _auto_confirm(true),
+    _status_interval_ms(PQ_ASYNC_REPLICATION_STATUS_INTERVAL_MS),
+    _received_lsn(0), _confirmed_lsn(0)
+{
+}
+
+replication_stream_t::~replication_stream_t()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    this->_close();
+}
+
+void replication_stream_t::_connect()
+{
+    if(_conn)
+        return;
+    
+    // the connection string is expanded, replication overrides it
+    const char* keywords[] = {"dbname", "replication", nullptr};
+    const char* values[] = {
+        _connection_string.c_str(), "database", nullptr
+    };
+    _conn = PQconnectdbParams(keywords, values, 1);
+    if(PQstatus(_conn) != CONNECTION_OK){
+        std::string err_msg = PQerrorMessage(_conn);
+        this->_close();
+        throw pq_async::exception(err_msg);
+    }
+}
+
+uint64_t replication_stream_t::create_slot(
+    const std::string& slot, bool temporary)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_ev)
+        throw pq_async::exception("The replication stream is started!");
+    this->_connect();
+    
+    std::string sql("CREATE_REPLICATION_SLOT ");
+    sql += quote_ident(_conn, slot);
+    if(temporary)
+        sql += " TEMPORARY";
+    sql += " LOGICAL pgoutput NOEXPORT_SNAPSHOT";
+    
+    PGresult* res = PQexec(_conn, sql.c_str());
+    if(PQresultStatus(res) != PGRES_TUPLES_OK){
+        std::string err_msg = PQerrorMessage(_conn);
+        PQclear(res);
+        throw pq_async::exception(err_msg);
+    }
+    uint64_t lsn = str_to_lsn(PQgetvalue(res, 0, 1));
+    PQclear(res);
+    
+    return lsn;
+}
+
+void replication_stream_t::drop_slot(const std::string& slot)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_ev)
+        throw pq_async::exception("The replication stream is started!");
+    this->_connect();
+    
+    std::string sql("DROP_REPLICATION_SLOT ");
+    sql += quote_ident(_conn, slot);
+    
+    PGresult* res = PQexec(_conn, sql.c_str());
+    if(PQresultStatus(res) != PGRES_COMMAND_OK){
+        std::string err_msg = PQerrorMessage(_conn);
+        PQclear(res);
+        throw pq_async::exception(err_msg);
+    }
+    PQclear(res);
+}
+
+void replication_stream_t::_start(
+    const std::string& slot, const std::string& publications,
+    uint64_t start_lsn, bool binary,
+    const md::callback::value_cb<replication_change>& cb)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_ev)
+        throw pq_async::exception("The replication stream is started!");
+    this->_connect();
+    
+    char* es_pubs = PQescapeLiteral(
+        _conn, publications.c_str(), publications.size()
+    );
+    if(!es_pubs)
+        throw pq_async::exception(PQerrorMessage(_conn));
+    
+    std::string sql("START_REPLICATION SLOT ");
+    sql += quote_ident(_conn, slot);
+    sql += " LOGICAL ";
+    sql += lsn_to_str(start_lsn);
+    sql += " (proto_version '1', publication_names ";
+    sql += es_pubs;
+    // the binary option of pgoutput was added in PostgreSQL 14, an older
+    // server sends the values as text
+    if(binary && PQserverVersion(_conn) >= 140000)
+        sql += ", binary 'true'";
+    sql += ")";
+    PQfreemem(es_pubs);
+    
+    PGresult* res = PQexec(_conn, sql.c_str());
+    if(PQresultStatus(res) != PGRES_COPY_BOTH){
+        std::string err_msg = PQerrorMessage(_conn);
+        PQclear(res);
+        throw pq_async::exception(err_msg);
+    }
+    PQclear(res);
+    
+    if(PQsetnonblocking(_conn, 1) != 0)
+        throw pq_async::exception(PQerrorMessage(_conn));
+    
+    _cb = cb;
+    if(start_lsn > _received_lsn.load())
+        _received_lsn = start_lsn;
+    if(start_lsn > _confirmed_lsn.load())
+        _confirmed_lsn = start_lsn;
+    
+    _ev = event_new(
+        _strand->ev_base(),
+        PQsocket(_conn),
+        EV_READ | EV_PERSIST,
+        [](evutil_socket_t fd, short events, void* arg){
+            ((replication_stream_t*)arg)->poll();
+        },
+        this
+    );
+    event_add(_ev, nullptr);
+    
+    _status_ev = event_new(
+        _strand->ev_base(), -1, EV_PERSIST,
+        [](evutil_socket_t fd, short events, void* arg){
+            ((replication_stream_t*)arg)->send_status();
+        },
+        this
+    );
+    timeval tv{
+        _status_interval_ms / 1000, (_status_interval_ms % 1000) * 1000
+    };
+    event_add(_status_ev, &tv);
+}
+
+void replication_stream_t::stop()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_conn && _ev)
+        this->send_status();
+    this->_close();
+}
+
+void replication_stream_t::_close()
+{
+    if(_ev){
+        event_free(_ev);
+        _ev = nullptr;
+    }
+    if(_status_ev){
+        event_free(_status_ev);
+        _status_ev = nullptr;
+    }
+    if(_conn){
+        PQfinish(_conn);
+        _conn = nullptr;
+    }
+    _relations.clear();
+}
+
+void replication_stream_t::_fail(const std::string& err_msg)
+{
+    log_async(_log, log_level::error,
+        "replication stream failed: {}", err_msg
+    );
+    if(_cb)
+        _strand->push_back(std::bind(
+            _cb,
+            md::callback::cb_error(pq_async::exception(err_msg)),
+            replication_change()
+        ));
+    this->_close();
+}
+
+void replication_stream_t::confirm(uint64_t lsn)
+{
+    uint64_t cur = _confirmed_lsn.load();
+    while(lsn > cur && !_confirmed_lsn.compare_exchange_weak(cur, lsn));
+}
+
+void replication_stream_t::send_status(bool reply_requested)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(!_conn || !_ev)
+        return;
+    
+    uint64_t flushed = _confirmed_lsn.load();
+    uint64_t written = std::max(_received_lsn.load(), flushed);
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count() - s_pg_epoch_us;
+    
+    char buf[34];
+    buf[0] = 'r';
+    write_i64(buf + 1, (int64_t)written);
+    write_i64(buf + 9, (int64_t)flushed);
+    write_i64(buf + 17, (int64_t)flushed);
+    write_i64(buf + 25, now);
+    buf[33] = reply_requested ? 1 : 0;
+    
+    // non blocking, what is not flushed now is sent with the next write
+    if(PQputCopyData(_conn, buf, sizeof(buf)) <= 0 || PQflush(_conn) < 0)
+        this->_fail(PQerrorMessage(_conn));
+}
+
+int replication_stream_t::poll()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(!_conn || !_ev)
+        return 0;
+    
+    if(!PQconsumeInput(_conn)){
+        this->_fail(PQerrorMessage(_conn));
+        return 0;
+    }
+    
+    int count = 0;
+    for(;;){
+        char* buf = nullptr;
+        int len = PQgetCopyData(_conn, &buf, 1);
+        if(len == 0)
+            break;
+        if(len == -1){
+            PGresult* res = PQgetResult(_conn);
+            std::string err_msg = res && PQresultErrorMessage(res)[0] ?
+                PQresultErrorMessage(res) :
+                "The replication stream was ended by the server!";
+            if(res)
+                PQclear(res);
+            this->_fail(err_msg);
+            break;
+        }
+        if(len < 0){
+            this->_fail(PQerrorMessage(_conn));
+            break;
+        }
+        
+        try{
+            const char* p = buf;
+            const char* end = buf + len;
+            char type = (char)read_u8(p, end);
+            if(type == 'w'){
+                uint64_t start = (uint64_t)read_i64(p, end);
+                read_i64(p, end); // wal end
+                read_i64(p, end); // send time
+                
+                replication_change change =
+                    this->_parse_message(start, p, (size_t)(end - p));
+                if(start > _received_lsn.load())
+                    _received_lsn = start;
+                if(change){
+                    this->_queue(change);
+                    ++count;
+                }
+                
+            }else if(type == 'k'){
+                read_i64(p, end); // wal end
+                read_i64(p, end); // send time
+                if(read_u8(p, end))
+                    this->send_status();
+            }
+            PQfreemem(buf);
+            
+        }catch(const std::exception& err){
+            PQfreemem(buf);
+            this->_fail(err.what());
+            break;
+        }
+        
+        if(!_conn)
+            break;
+    }
+    
+    return count;
+}
+
+void replication_stream_t::_queue(replication_change change)
+{
+    auto self = this->shared_from_this();
+    auto cb = _cb;
+    _strand->push_back([self, cb, change](){
+        cb(nullptr, change);
+        if(self->_auto_confirm && change->action == replication_action::commit)
+            self->confirm(change->end_lsn);
+    });
+}
+
+replication_change replication_stream_t::_parse_message(
+    uint64_t lsn, const char* data, size_t len)
+{
+    const char* p = data;
+    const char* end = data + len;
+    char type = (char)read_u8(p, end);
+    
+    replication_change change(new replication_change_t());
+    change->lsn = lsn;
+    change->xid = _xid;
+    change->end_lsn = 0;
+    change->commit_time = 0;
+    
+    switch(type){
+        case 'B':
+            change->action = replication_action::begin;
+            change->end_lsn = (uint64_t)read_i64(p, end);
+            change->commit_time = read_i64(p, end);
+            _xid = change->xid = (uint32_t)read_i32(p, end);
+            return change;
+            
+        case 'C':
+            change->action = replication_action::commit;
+            read_u8(p, end); // flags
+            change->lsn = (uint64_t)read_i64(p, end);
+            change->end_lsn = (uint64_t)read_i64(p, end);
+            change->commit_time = read_i64(p, end);
+            return change;
+            
+        case 'R':
+            this->_parse_relation(p, end);
+            return replication_change();
+            
+        case 'I':{
+            change->action = replication_action::insert;
+            change->relation = _get_relation((uint32_t)read_i32(p, end));
+            if(read_u8(p, end) != 'N')
+                throw pq_async::exception("Invalid insert message!");
+            change->new_tuple = replication_tuple(change->relation);
+            this->_parse_tuple(change->new_tuple, p, end);
+            return change;
+        }
+        case 'U':{
+            change->action = replication_action::update;
+            change->relation = _get_relation((uint32_t)read_i32(p, end));
+            char kind = (char)read_u8(p, end);
+            if(kind == 'K' || kind == 'O'){
+                change->old_tuple = replication_tuple(change->relation);
+                this->_parse_tuple(change->old_tuple, p, end);
+                kind = (char)read_u8(p, end);
+            }
+            if(kind != 'N')
+                throw pq_async::exception("Invalid update message!");
+            change->new_tuple = replication_tuple(change->relation);
+            this->_parse_tuple(change->new_tuple, p, end);
+            return change;
+        }
+        case 'D':{
+            change->action = replication_action::remove;
+            change->relation = _get_relation((uint32_t)read_i32(p, end));
+            char kind = (char)read_u8(p, end);
+            if(kind != 'K' && kind != 'O')
+                throw pq_async::exception("Invalid delete message!");
+            change->old_tuple = replication_tuple(change->relation);
+            this->_parse_tuple(change->old_tuple, p, end);
+            return change;
+        }
+        case 'T':{
+            change->action = replication_action::truncate;
+            int32_t count = read_i32(p, end);
+            read_u8(p, end); // options
+            for(int32_t i = 0; i < count; ++i)
+                change->relations.emplace_back(
+                    _get_relation((uint32_t)read_i32(p, end))
+                );
+            return change;
+        }
+        default:
+            // type, origin and logical decoding messages are not forwarded
+            return replication_change();
+    }
+}
+
+void replication_stream_t::_parse_relation(const char*& p, const char* end)
+{
+    std::shared_ptr<replication_relation_t> rel(new replication_relation_t());
+    rel->oid = (uint32_t)read_i32(p, end);
+    rel->nspname = read_str(p, end);
+    rel->relname = read_str(p, end);
+    rel->replica_identity = (char)read_u8(p, end);
+    
+    int16_t ncols = read_i16(p, end);
+    if(ncols < 0)
+        throw pq_async::exception("Invalid relation message!");
+    rel->columns.reserve(ncols);
+    for(int16_t i = 0; i < ncols; ++i){
+        replication_column col;
+        col.key = (read_u8(p, end) & 1) != 0;
+        col.name = read_str(p, end);
+        col.type = (Oid)read_i32(p, end);
+        col.type_mod = read_i32(p, end);
+        rel->columns.emplace_back(col);
+    }
+    
+    // the changes already decoded keep the previous definition
+    _relations[rel->oid] = rel;
+}
+
+void replication_stream_t::_parse_tuple(
+    replication_tuple& tuple, const char*& p, const char* end)
+{
+    int16_t ncols = read_i16(p, end);
+    if(ncols < 0)
+        throw pq_async::exception("Invalid tuple message!");
+    auto& values = tuple.values();
+    values.reserve(ncols);
+    for(int16_t i = 0; i < ncols; ++i){
+        replication_value v;
+        v.kind = (char)read_u8(p, end);
+        if(v.kind == 't' || v.kind == 'b'){
+            int32_t len = read_i32(p, end);
+            check_len(p, end, (size_t)len);
+            v.data.assign(p, (size_t)len);
+            p += len;
+        }else if(v.kind != 'n' && v.kind != 'u')
+            throw pq_async::exception("Invalid tuple value kind!");
+        values.emplace_back(std::move(v));
+    }
+}
+
+replication_relation replication_stream_t::_get_relation(uint32_t oid) const
+{
+    auto it = _relations.find(oid);
+    if(it == _relations.end())
+        throw pq_async::exception(
+            "Unknown relation oid: " + md::num_to_str(oid, false)
+        );
+    return it->second;
+}
+
+} //namespace pq_async
@@ -0,0 +1,274 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_result_cache.h"
+
+namespace pq_async{
+
+result_cache open_result_cache(
+    size_t max_bytes, int32_t default_ttl_ms, md::log::logger log)
+{
+    if(max_bytes == 0)
+        throw pq_async::exception("Invalid result cache size!");
+    if(default_ttl_ms <= 0)
+        throw pq_async::exception("Invalid result cache ttl!");
+    
+    return result_cache(
+        new lru_result_cache_t(max_bytes, default_ttl_ms, log)
+    );
+}
+
+
+result_cache_t::result_cache_t(md::log::logger log)
+    : _log(log ? log : pq_async::default_logger())
+{
+}
+
+result_cache_t::~result_cache_t()
+{
+    this->unlisten();
+}
+
+std::string result_cache_t::make_key(
+    const std::string& connection_string,
+    const char* sql, const parameters_t& p)
+{
+    std::string key(connection_string);
+    key.push_back('\0');
+    key.append(sql);
+    p.serialize(key);
+    return key;
+}
+
+size_t result_cache_t::table_size(const data_table& tbl)
+{
+    if(!tbl)
+        return 0;
+    
+    size_t cols = tbl->col_count();
+    size_t bytes = sizeof(data_table_t) + cols * sizeof(data_column_t);
+    for(const auto& row : *tbl){
+        bytes += sizeof(data_row_t) + sizeof(data_row);
+        for(size_t i = 0; i < cols; ++i){
+            // value, its control block and the shared_ptr in the row
+            bytes += sizeof(data_value_t) + 2 * sizeof(data_value);
+            int len = row->get_value((uint32_t)i)->length();
+            if(len > 0)
+                bytes += (size_t)len;
+        }
+    }
+    return bytes;
+}
+
+void result_cache_t::listen(
+    const std::string& connection_string, const std::string& channel)
+{
+    std::lock_guard<std::mutex> lock(_listen_mutex);
+    if(_listener)
+        throw pq_async::exception("The result cache is already listening!");
+    
+    auto listener = std::make_shared<notification_listener_t>(
+        md::event_queue_t::get_default()->new_strand<int>(),
+        connection_string, _log
+    );
+    std::weak_ptr<result_cache_t> self = this->shared_from_this();
+    listener->listen(channel,
+    [self](const md::callback::cb_error& err, const notifications& batch){
+        if(auto cache = self.lock())
+            cache->_process(err, batch);
+    });
+    _listener = listener;
+}
+
+void result_cache_t::unlisten()
+{
+    std::lock_guard<std::mutex> lock(_listen_mutex);
+    _listener.reset();
+}
+
+int result_cache_t::poll()
+{
+    notification_listener listener;
+    {
+        std::lock_guard<std::mutex> lock(_listen_mutex);
+        listener = _listener;
+    }
+    return listener ? listener->poll() : 0;
+}
+
+void result_cache_t::_process(
+    const md::callback::cb_error& err, const notifications& batch)
+{
+    // the notifications sent while disconnected are lost
+    if(err){
+        log_async(_log, log_level::warn,
+            "listen connection lost, clearing the result cache"
+        );
+        this->clear();
+        return;
+    }
+    
+    for(const auto& n : batch){
+        if(n.payload.empty())
+            this->clear();
+        else
+            this->invalidate(n.payload);
+    }
+}
+
+
+lru_result_cache_t::lru_result_cache_t(
+    size_t max_bytes, int32_t default_ttl_ms, md::log::logger log)
+    : result_cache_t(log),
+    _max_bytes(max_bytes), _ttl_ms(default_ttl_ms), _bytes(0),
+    _tag_generations(), _clear_generation(0),
+    _hits(0), _misses(0), _evictions(0), _expirations(0), _invalidations(0)
+{
+}
+
+lru_result_cache_t::~lru_result_cache_t()
+{
+    // stop the notifications before the entries are destroyed
+    this->unlisten();
+}
+
+data_table lru_result_cache_t::get(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if(it == _index.end()){
+        ++_misses;
+        return data_table();
+    }
+    
+    if(it->second->expires <= std::chrono::steady_clock::now()){
+        ++_expirations;
+        ++_misses;
+        this->_erase(it->second);
+        return data_table();
+    }
+    
+    _lru.splice(_lru.begin(), _lru, it->second);
+    ++_hits;
+    return it->second->tbl;
+}
+
+uint64_t lru_result_cache_t::generation(
+    const std::vector<std::string>& tags) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return this->_generation(tags);
+}
+
+void lru_result_cache_t::put(
+    const std::string& key, data_table tbl,
+    const std::vector<std::string>& tags, uint64_t generation)
+{
+    if(!tbl)
+        return;
+    
+    size_t bytes = result_cache_t::table_size(tbl) + key.size();
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    // the query started before an invalidation, its table may be stale
+    if(this->_generation(tags) != generation)
+        return;
+    
+    auto it = _index.find(key);
+    if(it != _index.end())
+        this->_erase(it->second);
+    
+    if(bytes > _max_bytes)
+        return;
+    
+    while(_bytes + bytes > _max_bytes && !_lru.empty()){
+        ++_evictions;
+        this->_erase(std::prev(_lru.end()));
+    }
+    
+    _lru.emplace_front(entry_t{
+        key, tbl, tags, bytes,
+        std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(_ttl_ms)
+    });
+    _index[key] = _lru.begin();
+    _bytes += bytes;
+}
+
+void lru_result_cache_t::invalidate(const std::string& tag)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_tag_generations[tag];
+    // invalidations are rare, a scan is cheaper than a tag index on puts
+    for(auto it = _lru.begin(); it != _lru.end();){
+        auto cur = it++;
+        if(std::find(cur->tags.begin(), cur->tags.end(), tag) ==
+            cur->tags.end()
+        )
+            continue;
+        
+        ++_invalidations;
+        this->_erase(cur);
+    }
+}
+
+void lru_result_cache_t::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_clear_generation;
+    _invalidations += (int64_t)_lru.size();
+    _index.clear();
+    _lru.clear();
+    _bytes = 0;
+}
+
+result_cache_stats lru_result_cache_t::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return result_cache_stats{
+        _hits, _misses, _evictions, _expirations, _invalidations,
+        _lru.size(), _bytes
+    };
+}
+
+uint64_t lru_result_cache_t::_generation(
+    const std::vector<std::string>& tags) const
+{
+    uint64_t g = _clear_generation;
+    for(const auto& t : tags){
+        auto it = _tag_generations.find(t);
+        if(it != _tag_generations.end())
+            g += it->second;
+    }
+    return g;
+}
+
+void lru_result_cache_t::_erase(std::list<entry_t>::iterator it)
+{
+    _bytes -= it->bytes;
+    _index.erase(it->key);
+    _lru.erase(it);
+}
+
+} //namespace pq_async
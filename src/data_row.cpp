@@ -281,7 +281,7 @@ void data_row_t::to_json(pq_async::json& row_obj) const
                 )
 
                 default:
-                    pq_async::default_logger()->warn(
+                    log_async(pq_async::default_logger(), log_level::warn,
                         "Unsupported OID: {} for field: {}",
                         oid, name
                     );
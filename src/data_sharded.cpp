@@ -0,0 +1,333 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_sharded.h"
+
+#include <condition_variable>
+#include <poll.h>
+#include <queue>
+#include <thread>
+
+namespace pq_async{
+
+uint64_t shard_hash(const char* data, size_t len, uint64_t seed)
+{
+    return hash_bytes(data, len, seed);
+}
+
+
+sharded_database open_sharded(
+    const std::vector<std::string>& shard_connection_strings,
+    shard_key_extractor extractor,
+    md::log::logger log)
+{
+    sharded_database db(new sharded_database_t(extractor, log));
+    for(size_t i = 0; i < shard_connection_strings.size(); ++i)
+        db->add_shard(md::num_to_str(i, false), shard_connection_strings[i]);
+    return db;
+}
+
+sharded_database_t::sharded_database_t(
+    shard_key_extractor extractor, md::log::logger log)
+    : _extractor(extractor),
+    _log(log ? log : pq_async::default_logger())
+{
+}
+
+void sharded_database_t::add_shard(
+    const std::string& name, const std::string& connection_string,
+    uint32_t weight)
+{
+    if(weight == 0)
+        throw pq_async::exception("Invalid shard weight!");
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(const auto& s : _shards)
+        if(s.name == name)
+            throw pq_async::exception("Shard \"" + name + "\" already exists!");
+
+    _shards.emplace_back(shard_t{name, connection_string, weight});
+    _build_ring();
+}
+
+void sharded_database_t::remove_shard(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find_if(_shards.begin(), _shards.end(),
+        [&name](const shard_t& s)-> bool { return s.name == name;}
+    );
+    if(it == _shards.end())
+        throw pq_async::exception("Shard \"" + name + "\" not found!");
+
+    _shards.erase(it);
+    _build_ring();
+}
+
+std::vector<std::string> sharded_database_t::shard_names() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> names;
+    names.reserve(_shards.size());
+    for(const auto& s : _shards)
+        names.emplace_back(s.name);
+    return names;
+}
+
+void sharded_database_t::_build_ring()
+{
+    _ring.clear();
+    for(size_t i = 0; i < _shards.size(); ++i){
+        const shard_t& s = _shards[i];
+        uint32_t nodes = PQ_ASYNC_SHARD_VIRTUAL_NODES * s.weight;
+        for(uint32_t n = 0; n < nodes; ++n)
+            _ring.emplace_back(
+                shard_hash(s.name.c_str(), s.name.size(), n), i
+            );
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+std::string sharded_database_t::locate(uint64_t key_hash) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_ring.empty())
+        throw pq_async::exception("No shard available!");
+
+    auto it = std::lower_bound(
+        _ring.begin(), _ring.end(), key_hash,
+        [](const std::pair<uint64_t, size_t>& node, uint64_t h)-> bool {
+            return node.first < h;
+        }
+    );
+    if(it == _ring.end())
+        it = _ring.begin();
+
+    return _shards[it->second].connection_string;
+}
+
+
+data_table sharded_database_t::merge(
+    const std::vector<data_table>& results, const row_compare& order)
+{
+    data_table tbl(new data_table_t());
+
+    size_t total = 0;
+    for(const auto& r : results){
+        if(!r)
+            continue;
+        if(tbl->_cols->size() == 0 && r->_cols->size() > 0)
+            tbl->_cols = r->_cols;
+        total += r->size();
+    }
+    tbl->reserve(total);
+
+    if(!order){
+        for(const auto& r : results)
+            if(r)
+                tbl->insert(tbl->end(), r->begin(), r->end());
+        return tbl;
+    }
+
+    // k-way merge, the heap holds the next row of each shard result
+    typedef std::pair<size_t, size_t> cursor_t;
+    auto greater = [&results, &order](
+        const cursor_t& a, const cursor_t& b
+    )-> bool {
+        const data_row& ra = (*results[a.first])[a.second];
+        const data_row& rb = (*results[b.first])[b.second];
+        if(order(rb, ra))
+            return true;
+        if(order(ra, rb))
+            return false;
+        // keep the merge stable between shards
+        return a.first > b.first;
+    };
+    std::priority_queue<
+        cursor_t, std::vector<cursor_t>, decltype(greater)
+    > heap(greater);
+
+    for(size_t i = 0; i < results.size(); ++i)
+        if(results[i] && !results[i]->empty())
+            heap.emplace(i, 0);
+
+    while(!heap.empty()){
+        cursor_t c = heap.top();
+        heap.pop();
+        tbl->emplace_back((*results[c.first])[c.second]);
+        if(++c.second < results[c.first]->size())
+            heap.push(c);
+    }
+
+    return tbl;
+}
+
+std::vector<database> sharded_database_t::_open_shards()
+{
+    std::vector<std::string> shards;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(const auto& s : _shards)
+            shards.emplace_back(s.connection_string);
+    }
+    
+    std::vector<database> dbs;
+    dbs.reserve(shards.size());
+    for(const auto& cs : shards)
+        dbs.emplace_back(pq_async::open(cs, _log));
+    return dbs;
+}
+
+void sharded_database_t::_scatter(
+    const char* sql, const parameters_t& p, row_compare order,
+    md::callback::value_cb<data_table> cb)
+{
+    std::vector<database> dbs = this->_open_shards();
+    if(dbs.empty()){
+        md::event_queue_t::get_default()->push_back(
+            std::bind(cb,
+                md::callback::cb_error("No shard available!"), data_table()
+            )
+        );
+        return;
+    }
+    this->_scatter_on(dbs, sql, p, order, cb);
+}
+
+void sharded_database_t::_scatter_on(
+    const std::vector<database>& dbs,
+    const char* sql, const parameters_t& p, row_compare order,
+    md::callback::value_cb<data_table> cb)
+{
+    auto state = std::make_shared<scatter_state_t>();
+    state->results.resize(dbs.size());
+    state->remaining = dbs.size();
+
+    for(size_t i = 0; i < dbs.size(); ++i){
+        dbs[i]->query(sql, p,
+        [state, i, order, cb](
+            const md::callback::cb_error& err, data_table tbl
+        )-> void {
+            bool last = false;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if(err && !state->err)
+                    state->err = err;
+                state->results[i] = tbl;
+                last = --state->remaining == 0;
+            }
+            if(!last)
+                return;
+
+            if(state->err){
+                cb(state->err, data_table());
+                return;
+            }
+            try{
+                cb(nullptr, sharded_database_t::merge(state->results, order));
+            }catch(const std::exception& merge_err){
+                cb(md::callback::cb_error(merge_err), data_table());
+            }
+        });
+    }
+}
+
+data_table sharded_database_t::_scatter_sync(
+    const char* sql, const parameters_t& p, const row_compare& order)
+{
+    std::vector<database> dbs = this->_open_shards();
+    if(dbs.empty())
+        throw pq_async::exception("No shard available!");
+
+    struct sync_result_t
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done;
+        md::callback::cb_error err;
+        data_table tbl;
+    };
+    auto res = std::make_shared<sync_result_t>();
+    res->done = false;
+    this->_scatter_on(dbs, sql, p, order,
+    [res](const md::callback::cb_error& err, data_table tbl){
+        std::lock_guard<std::mutex> lock(res->mutex);
+        res->err = err;
+        res->tbl = tbl;
+        res->done = true;
+        res->cv.notify_all();
+    });
+
+    // like database_t::wait_for_sync, the strands are run from here
+    // unless another thread drives their event loop, all of them in
+    // turn so the shards are still queried concurrently
+    std::vector<pollfd> fds;
+    std::unique_lock<std::mutex> lock(res->mutex);
+    while(!res->done){
+        lock.unlock();
+        fds.clear();
+        for(const auto& db : dbs){
+            std::thread::id loop_thread = db->_loop_thread.load();
+            if(loop_thread != std::thread::id() &&
+                loop_thread != std::this_thread::get_id()
+            )
+                continue;
+            if(db->_strand->size() == 0)
+                continue;
+            
+            db->_strand->run_n();
+            connection* conn = db->_conn;
+            if(conn && conn->conn())
+                fds.push_back(pollfd{ PQsocket(conn->conn()), POLLIN, 0 });
+        }
+        lock.lock();
+        if(res->done)
+            break;
+        
+        if(fds.empty()){
+            // the loop thread completes the queries
+            res->cv.wait_for(lock,
+                std::chrono::milliseconds(PQ_ASYNC_SYNC_POLL_MS),
+                [&res](){ return res->done;}
+            );
+            continue;
+        }
+        lock.unlock();
+        poll(fds.data(), fds.size(), PQ_ASYNC_SYNC_POLL_MS);
+        lock.lock();
+    }
+
+    if(res->err){
+        // the callbacks only carry the message, the SQLSTATE is kept by
+        // the database_t of the shard that failed
+        for(const auto& db : dbs){
+            std::string state = db->last_sqlstate();
+            if(!state.empty())
+                throw sql_exception(res->err.c_str(), state);
+        }
+        throw pq_async::exception(res->err.c_str());
+    }
+    return res->tbl;
+}
+
+} //namespace pq_async
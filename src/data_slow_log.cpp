@@ -0,0 +1,288 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_slow_log.h"
+#include "database.h"
+#include "exceptions.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace pq_async{
+
+static std::mutex& slow_query_log_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+static slow_query_log& slow_query_log_slot()
+{
+    static slow_query_log log;
+    return log;
+}
+
+void set_slow_query_log(slow_query_log log)
+{
+    std::lock_guard<std::mutex> lock(slow_query_log_mutex());
+    slow_query_log_slot() = log;
+    _slow_query_log_flag().store(log != nullptr, std::memory_order_release);
+}
+
+slow_query_log default_slow_query_log()
+{
+    std::lock_guard<std::mutex> lock(slow_query_log_mutex());
+    return slow_query_log_slot();
+}
+
+
+slow_query_log open_slow_query_log(
+    slow_query_writer writer, const slow_query_options& opts)
+{
+    if(!writer)
+        throw pq_async::exception("Invalid slow query writer!");
+    return slow_query_log(new slow_query_log_t(writer, opts));
+}
+
+slow_query_log open_slow_query_log(
+    const std::string& path, const slow_query_options& opts)
+{
+    auto out = std::make_shared<std::ofstream>(path, std::ios::app);
+    if(!out->is_open())
+        throw pq_async::exception(
+            "Unable to open the slow query log \"" + path + "\"!"
+        );
+    
+    return open_slow_query_log(
+    [out](const std::string& line)-> void {
+        *out << line << '\n';
+        out->flush();
+    }, opts);
+}
+
+
+slow_query_log_t::slow_query_log_t(
+    slow_query_writer writer, const slow_query_options& opts)
+    : _writer(writer), _opts(opts),
+    _slots(), _mask(0), _enqueue_pos(0), _dequeue_pos(0),
+    _slow_count(0), _pushed(0), _processed(0), _written(0), _dropped(0),
+    _mutex(), _cv(), _stop(false), _thread()
+{
+    size_t cap = 2;
+    while(cap < opts.capacity)
+        cap <<= 1;
+    _mask = cap -1;
+    _slots.reset(new slot_t[cap]);
+    for(size_t i = 0; i < cap; ++i)
+        _slots[i].seq.store(i, std::memory_order_relaxed);
+    
+    _thread = std::thread(&slow_query_log_t::_run, this);
+}
+
+slow_query_log_t::~slow_query_log_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if(_thread.joinable())
+        _thread.join();
+}
+
+void slow_query_log_t::record(
+    const database_t* db, const std::string& sql, const parameters_t& p,
+    bool failed, uint64_t rows, int64_t latency_ns)
+{
+    int64_t threshold_ms = db ? db->slow_query_threshold() : -1;
+    if(threshold_ms < 0)
+        threshold_ms = _opts.threshold_ms;
+    if(latency_ns < threshold_ms * 1000000)
+        return;
+    
+    slow_query_entry entry;
+    entry.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+    entry.latency_ns = latency_ns;
+    entry.rows = rows;
+    entry.failed = failed;
+    entry.sql = sql.size() > _opts.max_text_length ?
+        sql.substr(0, _opts.max_text_length) : sql;
+    
+    uint64_t n = _slow_count.fetch_add(1, std::memory_order_relaxed);
+    entry.sampled = _opts.sample_every > 0 && n % _opts.sample_every == 0;
+    // the values are only copied here, decoding them is left to the writer
+    if(entry.sampled)
+        entry.params = p;
+    
+    this->push(std::move(entry));
+}
+
+bool slow_query_log_t::push(slow_query_entry&& entry)
+{
+    size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    for(;;){
+        slot_t& s = _slots[pos & _mask];
+        size_t seq = s.seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if(dif == 0){
+            if(_enqueue_pos.compare_exchange_weak(
+                pos, pos +1, std::memory_order_relaxed
+            )){
+                s.entry = std::move(entry);
+                s.seq.store(pos +1, std::memory_order_release);
+                _pushed.fetch_add(1, std::memory_order_release);
+                return true;
+            }
+        }else if(dif < 0){
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }else
+            pos = _enqueue_pos.load(std::memory_order_relaxed);
+    }
+}
+
+bool slow_query_log_t::_pop(slow_query_entry& entry)
+{
+    slot_t& s = _slots[_dequeue_pos & _mask];
+    size_t seq = s.seq.load(std::memory_order_acquire);
+    if(seq != _dequeue_pos +1)
+        return false;
+    
+    entry = std::move(s.entry);
+    s.entry.sql.clear();
+    s.entry.params.clear();
+    s.seq.store(_dequeue_pos + _mask +1, std::memory_order_release);
+    ++_dequeue_pos;
+    return true;
+}
+
+void slow_query_log_t::flush()
+{
+    uint64_t target = _pushed.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.notify_all();
+    _cv.wait(lock, [this, target]()-> bool {
+        return _processed.load() >= target || _stop;
+    });
+}
+
+bool slow_query_log_t::_drain()
+{
+    bool any = false;
+    for(;;){
+        // a fresh entry each time, no parameters outlive their line
+        slow_query_entry entry;
+        if(!this->_pop(entry))
+            break;
+        any = true;
+        try{
+            _writer(format(entry, _opts.max_text_length));
+            _written.fetch_add(1, std::memory_order_relaxed);
+        }catch(const std::exception& err){
+            pq_async::default_logger()->error(
+                "slow query log write failed: {}", err.what()
+            );
+        }
+        _processed.fetch_add(1, std::memory_order_release);
+    }
+    return any;
+}
+
+void slow_query_log_t::_run()
+{
+    for(;;){
+        bool stop = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stop = _stop;
+        }
+        // when stopping, that pass writes everything pushed before the stop
+        bool any = this->_drain();
+        
+        std::unique_lock<std::mutex> lock(_mutex);
+        if(any || stop)
+            _cv.notify_all();
+        if(stop)
+            return;
+        // producers never signal, waking up is cheaper for the event loop
+        if(!_stop)
+            _cv.wait_for(
+                lock, std::chrono::milliseconds(PQ_ASYNC_SLOW_LOG_IDLE_MS)
+            );
+    }
+}
+
+std::string slow_query_log_t::format(
+    const slow_query_entry& entry, size_t max_text_length)
+{
+    std::ostringstream ss;
+    
+    std::time_t secs = (std::time_t)(entry.time_ns / 1000000000);
+    std::tm tm_utc;
+    gmtime_r(&secs, &tm_utc);
+    ss << std::put_time(&tm_utc, "%Y-%m-%dT%H:%M:%S")
+        << '.' << std::setfill('0') << std::setw(3)
+        << (entry.time_ns / 1000000) % 1000 << 'Z' << std::setfill(' ');
+    
+    ss << " slow query " << std::fixed << std::setprecision(3)
+        << (double)entry.latency_ns / 1000000.0 << " ms"
+        << " rows=" << entry.rows;
+    if(entry.failed)
+        ss << " failed";
+    ss << " sql: " << entry.sql;
+    
+    if(!entry.sampled)
+        return ss.str();
+    
+    ss << " params:";
+    for(int i = 0; i < entry.params.size(); ++i){
+        const parameter* p = entry.params.get_parameter(i);
+        ss << (i ? ", $" : " $") << (i +1) << '=';
+        if(!p || !p->get_value()){
+            ss << "NULL";
+            continue;
+        }
+        try{
+            std::string val = val_from_pgparam<std::string>(
+                p->get_oid(), (char*)p->get_value(), p->get_length(),
+                p->get_format()
+            );
+            if(val.size() > max_text_length)
+                val = val.substr(0, max_text_length) + "...";
+            ss << '\'' << val << '\'';
+        }catch(const std::exception&){
+            ss << "<oid " << p->get_oid() << ", "
+                << p->get_length() << " bytes>";
+        }
+    }
+    
+    return ss.str();
+}
+
+} //namespace pq_async
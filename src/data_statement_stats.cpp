@@ -0,0 +1,408 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_statement_stats.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+
+namespace pq_async{
+
+namespace{
+
+bool is_ident_char(char c)
+{
+    return std::isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+const char* skip_string_literal(const char* p, bool backslash_escapes)
+{
+    // p is on the opening quote
+    ++p;
+    while(*p){
+        if(backslash_escapes && *p == '\\' && p[1]){
+            p += 2;
+            continue;
+        }
+        if(*p == '\''){
+            if(p[1] == '\''){
+                p += 2;
+                continue;
+            }
+            return p +1;
+        }
+        ++p;
+    }
+    return p;
+}
+
+const char* skip_dollar_literal(const char* p)
+{
+    // p is on the opening $, returns nullptr if it is not a dollar quote
+    const char* q = p +1;
+    while(*q && (std::isalnum((unsigned char)*q) || *q == '_'))
+        ++q;
+    if(*q != '$')
+        return nullptr;
+    
+    std::string tag(p, q +1);
+    const char* end = std::strstr(q +1, tag.c_str());
+    return end ? end + tag.size() : q + std::strlen(q);
+}
+
+uint64_t fingerprint_hash(const std::string& norm)
+{
+    uint64_t h = hash_bytes(norm.data(), norm.size());
+    // 0 marks a free slot of the table
+    return h ? h : 1;
+}
+
+struct stat_slot_t
+{
+    std::atomic<uint64_t> key;
+    std::atomic<std::string*> sql;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> rows;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> histogram[PQ_ASYNC_STATEMENT_STATS_BUCKETS];
+};
+
+static_assert(
+    (PQ_ASYNC_STATEMENT_STATS_CAPACITY & (PQ_ASYNC_STATEMENT_STATS_CAPACITY -1))
+        == 0,
+    "PQ_ASYNC_STATEMENT_STATS_CAPACITY must be a power of two"
+);
+
+/*!
+ * \brief open addressing table, a slot is claimed once with a CAS on its
+ * key and is never released, the reset only zeroes the counters
+ */
+struct stat_table_t
+{
+    stat_table_t()
+        : slots(new stat_slot_t[PQ_ASYNC_STATEMENT_STATS_CAPACITY]()),
+        dropped(0)
+    {
+    }
+    
+    ~stat_table_t()
+    {
+        for(size_t i = 0; i < PQ_ASYNC_STATEMENT_STATS_CAPACITY; ++i)
+            delete slots[i].sql.load();
+    }
+    
+    stat_slot_t* find(uint64_t fp, const std::string& norm)
+    {
+        for(size_t n = 0; n < PQ_ASYNC_STATEMENT_STATS_CAPACITY; ++n){
+            stat_slot_t& s =
+                slots[(fp + n) & (PQ_ASYNC_STATEMENT_STATS_CAPACITY -1)];
+            uint64_t k = s.key.load(std::memory_order_acquire);
+            if(k == fp)
+                return &s;
+            if(k != 0)
+                continue;
+            
+            if(s.key.compare_exchange_strong(
+                k, fp, std::memory_order_acq_rel
+            )){
+                s.sql.store(new std::string(norm), std::memory_order_release);
+                return &s;
+            }
+            if(k == fp)
+                return &s;
+        }
+        return nullptr;
+    }
+    
+    std::unique_ptr<stat_slot_t[]> slots;
+    std::atomic<uint64_t> dropped;
+};
+
+stat_table_t& stat_table()
+{
+    static stat_table_t table;
+    return table;
+}
+
+size_t latency_bucket(int64_t latency_ns)
+{
+    uint64_t us = latency_ns > 0 ? (uint64_t)latency_ns / 1000 : 0;
+    size_t b = 0;
+    while(us && b < PQ_ASYNC_STATEMENT_STATS_BUCKETS -1){
+        us >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+} //namespace
+
+
+void normalize_sql(const char* sql, std::string& out)
+{
+    const size_t start = out.size();
+    bool space = false;
+    
+    auto prev_ident = [&]()-> bool {
+        return !space && out.size() > start && is_ident_char(out.back());
+    };
+    auto emit = [&](char c){
+        if(space && out.size() > start)
+            out.push_back(' ');
+        space = false;
+        out.push_back(c);
+    };
+    
+    const char* p = sql;
+    while(p && *p){
+        char c = *p;
+        if(std::isspace((unsigned char)c)){
+            space = true;
+            ++p;
+            continue;
+        }
+        
+        if(c == '-' && p[1] == '-'){
+            while(*p && *p != '\n')
+                ++p;
+            space = true;
+            continue;
+        }
+        if(c == '/' && p[1] == '*'){
+            p += 2;
+            int depth = 1;
+            while(*p && depth){
+                if(p[0] == '/' && p[1] == '*'){
+                    ++depth;
+                    p += 2;
+                }else if(p[0] == '*' && p[1] == '/'){
+                    --depth;
+                    p += 2;
+                }else
+                    ++p;
+            }
+            space = true;
+            continue;
+        }
+        
+        if(c == '\''){
+            p = skip_string_literal(p, false);
+            emit('?');
+            continue;
+        }
+        if((c == 'e' || c == 'E') && p[1] == '\'' && !prev_ident()){
+            p = skip_string_literal(p +1, true);
+            emit('?');
+            continue;
+        }
+        
+        if(c == '"'){
+            // quoted identifiers are case sensitive, they are kept as is
+            emit('"');
+            ++p;
+            while(*p){
+                if(*p == '"' && p[1] != '"')
+                    break;
+                if(*p == '"')
+                    out.push_back(*p++);
+                out.push_back(*p++);
+            }
+            if(*p){
+                out.push_back('"');
+                ++p;
+            }
+            continue;
+        }
+        
+        if(c == '$' && !prev_ident()){
+            if(std::isdigit((unsigned char)p[1])){
+                // parameter placeholder
+                emit('$');
+                ++p;
+                while(std::isdigit((unsigned char)*p))
+                    out.push_back(*p++);
+                continue;
+            }
+            if(const char* end = skip_dollar_literal(p)){
+                p = end;
+                emit('?');
+                continue;
+            }
+        }
+        
+        if(!prev_ident() && (
+            std::isdigit((unsigned char)c) ||
+            (c == '.' && std::isdigit((unsigned char)p[1]))
+        )){
+            while(std::isdigit((unsigned char)*p) || *p == '.')
+                ++p;
+            if((*p == 'e' || *p == 'E') && (
+                std::isdigit((unsigned char)p[1]) || (
+                    (p[1] == '+' || p[1] == '-') &&
+                    std::isdigit((unsigned char)p[2])
+                )
+            )){
+                p += 2;
+                while(std::isdigit((unsigned char)*p))
+                    ++p;
+            }
+            emit('?');
+            continue;
+        }
+        
+        emit((char)std::tolower((unsigned char)c));
+        ++p;
+    }
+}
+
+std::string normalize_sql(const char* sql)
+{
+    std::string out;
+    normalize_sql(sql, out);
+    return out;
+}
+
+uint64_t sql_fingerprint(const char* sql)
+{
+    thread_local std::string norm;
+    norm.clear();
+    normalize_sql(sql, norm);
+    return fingerprint_hash(norm);
+}
+
+
+uint64_t statement_stat::percentile_ns(double p) const
+{
+    if(calls == 0)
+        return 0;
+    
+    uint64_t target = (uint64_t)(p * (double)calls);
+    if(target == 0)
+        target = 1;
+    uint64_t seen = 0;
+    for(size_t i = 0; i < PQ_ASYNC_STATEMENT_STATS_BUCKETS -1; ++i){
+        seen += histogram[i];
+        if(seen >= target)
+            return std::min<uint64_t>(1000ULL << i, max_ns);
+    }
+    return max_ns;
+}
+
+void enable_statement_stats(bool enabled)
+{
+    if(enabled)
+        stat_table();
+    _statement_stats_flag().store(enabled, std::memory_order_release);
+}
+
+void statement_stats_record(
+    const char* sql, bool error, uint64_t rows, uint64_t bytes,
+    int64_t latency_ns)
+{
+    thread_local std::string norm;
+    norm.clear();
+    normalize_sql(sql, norm);
+    
+    stat_table_t& t = stat_table();
+    stat_slot_t* s = t.find(fingerprint_hash(norm), norm);
+    if(!s){
+        t.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    uint64_t ns = latency_ns > 0 ? (uint64_t)latency_ns : 0;
+    s->calls.fetch_add(1, std::memory_order_relaxed);
+    if(error)
+        s->errors.fetch_add(1, std::memory_order_relaxed);
+    s->rows.fetch_add(rows, std::memory_order_relaxed);
+    s->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    s->total_ns.fetch_add(ns, std::memory_order_relaxed);
+    s->histogram[latency_bucket(latency_ns)].fetch_add(
+        1, std::memory_order_relaxed
+    );
+    
+    uint64_t cur = s->max_ns.load(std::memory_order_relaxed);
+    while(cur < ns && !s->max_ns.compare_exchange_weak(
+        cur, ns, std::memory_order_relaxed
+    ));
+}
+
+std::vector<statement_stat> statement_stats_snapshot()
+{
+    stat_table_t& t = stat_table();
+    std::vector<statement_stat> stats;
+    for(size_t i = 0; i < PQ_ASYNC_STATEMENT_STATS_CAPACITY; ++i){
+        stat_slot_t& s = t.slots[i];
+        uint64_t key = s.key.load(std::memory_order_acquire);
+        uint64_t calls = s.calls.load(std::memory_order_relaxed);
+        if(key == 0 || calls == 0)
+            continue;
+        
+        statement_stat st;
+        st.fingerprint = key;
+        // the text is published right after the key is claimed
+        if(std::string* sql = s.sql.load(std::memory_order_acquire))
+            st.sql = *sql;
+        st.calls = calls;
+        st.errors = s.errors.load(std::memory_order_relaxed);
+        st.rows = s.rows.load(std::memory_order_relaxed);
+        st.bytes = s.bytes.load(std::memory_order_relaxed);
+        st.total_ns = s.total_ns.load(std::memory_order_relaxed);
+        st.max_ns = s.max_ns.load(std::memory_order_relaxed);
+        for(size_t b = 0; b < PQ_ASYNC_STATEMENT_STATS_BUCKETS; ++b)
+            st.histogram[b] = s.histogram[b].load(std::memory_order_relaxed);
+        stats.emplace_back(std::move(st));
+    }
+    return stats;
+}
+
+void statement_stats_reset()
+{
+    stat_table_t& t = stat_table();
+    for(size_t i = 0; i < PQ_ASYNC_STATEMENT_STATS_CAPACITY; ++i){
+        stat_slot_t& s = t.slots[i];
+        s.calls.store(0, std::memory_order_relaxed);
+        s.errors.store(0, std::memory_order_relaxed);
+        s.rows.store(0, std::memory_order_relaxed);
+        s.bytes.store(0, std::memory_order_relaxed);
+        s.total_ns.store(0, std::memory_order_relaxed);
+        s.max_ns.store(0, std::memory_order_relaxed);
+        for(size_t b = 0; b < PQ_ASYNC_STATEMENT_STATS_BUCKETS; ++b)
+            s.histogram[b].store(0, std::memory_order_relaxed);
+    }
+    t.dropped.store(0, std::memory_order_relaxed);
+}
+
+uint64_t statement_stats_dropped()
+{
+    return stat_table().dropped.load(std::memory_order_relaxed);
+}
+
+} //namespace pq_async
@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_trace.h"
+#include "exceptions.h"
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+namespace pq_async{
+
+static std::mutex& trace_sink_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+static trace_sink& trace_sink_slot()
+{
+    static trace_sink sink;
+    return sink;
+}
+
+const char* trace_phase_name(trace_phase phase)
+{
+    switch(phase){
+        case trace_phase::pool_wait:
+            return "pool_wait";
+        case trace_phase::connect:
+            return "connect";
+        case trace_phase::queue:
+            return "queue";
+        case trace_phase::send:
+            return "send";
+        case trace_phase::execute:
+            return "execute";
+        case trace_phase::process:
+            return "process";
+    }
+    return "unknown";
+}
+
+void set_trace_sink(trace_sink sink)
+{
+    std::lock_guard<std::mutex> lock(trace_sink_mutex());
+    trace_sink_slot() = sink;
+    _trace_flag().store(sink != nullptr);
+}
+
+trace_sink default_trace_sink()
+{
+    std::lock_guard<std::mutex> lock(trace_sink_mutex());
+    return trace_sink_slot();
+}
+
+uint64_t trace_next_id()
+{
+    static std::atomic<uint64_t> next_id(0);
+    return ++next_id;
+}
+
+void trace_record(
+    uint64_t query_id, trace_phase phase, int64_t begin_ns, int64_t end_ns)
+{
+    trace_sink sink = default_trace_sink();
+    if(sink)
+        sink->record(trace_event{query_id, phase, begin_ns, end_ns});
+}
+
+
+ring_trace_sink open_ring_trace_sink(size_t capacity)
+{
+    return ring_trace_sink(new ring_trace_sink_t(capacity));
+}
+
+ring_trace_sink_t::ring_trace_sink_t(size_t capacity)
+    : _slots(), _mask(0), _head(0)
+{
+    size_t size = 1;
+    while(size < capacity)
+        size <<= 1;
+    _slots.reset(new slot_t[size]);
+    for(size_t i = 0; i < size; ++i)
+        _slots[i].seq.store(0);
+    _mask = size -1;
+}
+
+void ring_trace_sink_t::record(const trace_event& ev)
+{
+    // each slot is a seqlock, odd while written, 2 * (n +1) once
+    // holding the nth event
+    uint64_t n = _head.fetch_add(1, std::memory_order_relaxed);
+    slot_t& s = _slots[n & _mask];
+    s.seq.store(n * 2 +1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.ev = ev;
+    s.seq.store(n * 2 +2, std::memory_order_release);
+}
+
+std::vector<trace_event> ring_trace_sink_t::snapshot() const
+{
+    uint64_t head = _head.load(std::memory_order_acquire);
+    uint64_t first = head > _mask +1 ? head - (_mask +1) : 0;
+    
+    std::vector<trace_event> events;
+    events.reserve(head - first);
+    for(uint64_t n = first; n < head; ++n){
+        const slot_t& s = _slots[n & _mask];
+        uint64_t before = s.seq.load(std::memory_order_acquire);
+        trace_event ev = s.ev;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = s.seq.load(std::memory_order_relaxed);
+        // skip the slots being written or already overwritten
+        if(before != n * 2 +2 || after != before)
+            continue;
+        events.emplace_back(ev);
+    }
+    return events;
+}
+
+void ring_trace_sink_t::dump_chrome_trace(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if(!out)
+        throw pq_async::exception("Unable to open trace file: " + path);
+    
+    auto events = this->snapshot();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    for(size_t i = 0; i < events.size(); ++i){
+        const trace_event& ev = events[i];
+        if(i > 0)
+            out << ",";
+        out << "\n{\"name\":\"" << trace_phase_name(ev.phase) << "\""
+            << ",\"cat\":\"pq_async\",\"ph\":\"X\""
+            << ",\"ts\":" << ev.begin_ns / 1000.0
+            << ",\"dur\":" << (ev.end_ns - ev.begin_ns) / 1000.0
+            << ",\"pid\":1,\"tid\":" << ev.query_id << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    
+    if(!out)
+        throw pq_async::exception("Unable to write trace file: " + path);
+}
+
+} //namespace pq_async
@@ -0,0 +1,306 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "data_write_buffer.h"
+#include "data_bulk.h"
+
+namespace pq_async{
+
+write_buffer open_write_buffer(
+    const std::string& connection_string,
+    const std::string& table,
+    const std::vector<std::string>& columns,
+    size_t max_rows,
+    size_t max_bytes,
+    int32_t max_delay_ms,
+    size_t max_pending_bytes,
+    md::log::logger log)
+{
+    if(columns.empty())
+        throw pq_async::exception("At least one column is required!");
+    if(columns.size() > PQ_ASYNC_MAX_STATEMENT_PARAMETERS)
+        throw pq_async::exception("Too many columns!");
+    if(max_rows == 0 || max_bytes == 0 || max_pending_bytes == 0)
+        throw pq_async::exception("Invalid write buffer size!");
+    if(max_delay_ms <= 0)
+        throw pq_async::exception("Invalid write buffer delay!");
+    
+    // a batch is one statement, bound by the parameters count
+    size_t stmt_rows = PQ_ASYNC_MAX_STATEMENT_PARAMETERS / columns.size();
+    if(max_rows > stmt_rows)
+        max_rows = stmt_rows;
+    
+    return write_buffer(new write_buffer_t(
+        connection_string, table, columns,
+        max_rows, max_bytes, max_delay_ms, max_pending_bytes, log
+    ));
+}
+
+
+write_buffer_t::write_buffer_t(
+    const std::string& connection_string,
+    const std::string& table,
+    const std::vector<std::string>& columns,
+    size_t max_rows,
+    size_t max_bytes,
+    int32_t max_delay_ms,
+    size_t max_pending_bytes,
+    md::log::logger log)
+    : _table(table), _columns(columns),
+    _insert_sql("insert into " + quote_table(table) + "("),
+    _max_rows(max_rows), _max_bytes(max_bytes),
+    _max_delay_ms(max_delay_ms), _max_pending_bytes(max_pending_bytes),
+    _log(log ? log : pq_async::default_logger()),
+    _db(pq_async::open(connection_string, _log)),
+    _strand(md::event_queue_t::get_default()->new_strand<int>()),
+    _timer(nullptr), _timer_armed(false),
+    _row_count(0), _bytes(0), _pending_bytes(0), _in_flight(0),
+    _rows_added(0), _rows_written(0), _rows_failed(0),
+    _flushes(0), _rejected(0)
+{
+    for(size_t i = 0; i < _columns.size(); ++i){
+        if(i > 0)
+            _insert_sql.append(", ");
+        _insert_sql.append(quote_ident(_columns[i]));
+    }
+    _insert_sql.append(") values ");
+    
+    _timer = evtimer_new(
+        _strand->ev_base(),
+        [](evutil_socket_t fd, short events, void* arg){
+            auto self = (write_buffer_t*)arg;
+            std::lock_guard<std::recursive_mutex> lock(self->_mutex);
+            self->_timer_armed = false;
+            self->_send();
+        },
+        this
+    );
+}
+
+write_buffer_t::~write_buffer_t()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(_timer){
+        event_free(_timer);
+        _timer = nullptr;
+    }
+    if(_row_count > 0 || !_waiting.empty())
+        log_async(_log, log_level::warn,
+            "write buffer on \"{}\" released with {} unwritten rows",
+            _table, _row_count + _waiting.size()
+        );
+}
+
+bool write_buffer_t::try_add(const parameters_t& row)
+{
+    if((size_t)row.size() != _columns.size())
+        throw pq_async::exception("The row and column counts differ!");
+    
+    size_t bytes = _row_bytes(row);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(!_waiting.empty() || !this->_fits(bytes)){
+        ++_rejected;
+        return false;
+    }
+    this->_append(row, bytes);
+    return true;
+}
+
+void write_buffer_t::on_flush(const write_flush_cb& cb)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    _on_flush = cb;
+}
+
+write_buffer_stats write_buffer_t::stats() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return write_buffer_stats{
+        _rows_added, _rows_written, _rows_failed, _flushes, _rejected,
+        _row_count, _pending_bytes
+    };
+}
+
+size_t write_buffer_t::_row_bytes(const parameters_t& row)
+{
+    size_t bytes = 0;
+    for(int i = 0; i < row.size(); ++i){
+        const parameter* p = row.get_parameter(i);
+        bytes += sizeof(parameter);
+        if(p->get_value())
+            bytes += (size_t)p->get_length();
+    }
+    return bytes;
+}
+
+void write_buffer_t::_add(
+    const parameters_t& row, const md::callback::async_cb& cb)
+{
+    if((size_t)row.size() != _columns.size()){
+        md::event_queue_t::get_default()->push_back(std::bind(cb,
+            md::callback::cb_error(
+                pq_async::exception("The row and column counts differ!")
+            )
+        ));
+        return;
+    }
+    
+    size_t bytes = _row_bytes(row);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(!_waiting.empty() || !this->_fits(bytes)){
+        _waiting.emplace_back(waiting_t{row, bytes, cb});
+        return;
+    }
+    this->_append(row, bytes);
+    md::event_queue_t::get_default()->push_back(std::bind(cb, nullptr));
+}
+
+void write_buffer_t::_flush(const md::callback::async_cb& cb)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if(this->_drained()){
+        md::event_queue_t::get_default()->push_back(std::bind(cb, nullptr));
+        return;
+    }
+    _drain.emplace_back(cb, nullptr);
+    this->_send();
+}
+
+bool write_buffer_t::_fits(size_t bytes) const
+{
+    // a single row larger than the bound is accepted once idle
+    return _pending_bytes == 0 ||
+        _pending_bytes + bytes <= _max_pending_bytes;
+}
+
+void write_buffer_t::_append(const parameters_t& row, size_t bytes)
+{
+    _rows.append(row);
+    ++_row_count;
+    ++_rows_added;
+    _bytes += bytes;
+    _pending_bytes += bytes;
+    
+    if(_row_count >= _max_rows || _bytes >= _max_bytes){
+        this->_send();
+        return;
+    }
+    
+    if(!_timer_armed){
+        timeval tv{ _max_delay_ms / 1000, (_max_delay_ms % 1000) * 1000 };
+        evtimer_add(_timer, &tv);
+        _timer_armed = true;
+    }
+}
+
+void write_buffer_t::_send()
+{
+    if(_timer_armed){
+        evtimer_del(_timer);
+        _timer_armed = false;
+    }
+    if(_row_count == 0)
+        return;
+    
+    std::string sql(_insert_sql);
+    size_t n = 0;
+    for(size_t r = 0; r < _row_count; ++r){
+        sql.append(r > 0 ? ", (" : "(");
+        for(size_t i = 0; i < _columns.size(); ++i){
+            if(i > 0)
+                sql.append(", ");
+            sql.append("$" + md::num_to_str(++n, false));
+        }
+        sql.push_back(')');
+    }
+    
+    parameters_t batch(std::move(_rows));
+    _rows = parameters_t();
+    size_t rows = _row_count;
+    size_t bytes = _bytes;
+    _row_count = 0;
+    _bytes = 0;
+    ++_in_flight;
+    
+    auto self = this->shared_from_this();
+    _db->execute(sql.c_str(), batch,
+    [self, rows, bytes](const md::callback::cb_error& err, int32_t count){
+        self->_on_sent(rows, bytes, err, count);
+    });
+}
+
+void write_buffer_t::_on_sent(
+    size_t rows, size_t bytes,
+    const md::callback::cb_error& err, int32_t count)
+{
+    write_flush_cb flush_cb;
+    std::vector<md::callback::async_cb> admitted;
+    std::vector<
+        std::pair<md::callback::async_cb, md::callback::cb_error>
+    > drained;
+    {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        --_in_flight;
+        _pending_bytes -= bytes;
+        ++_flushes;
+        if(err){
+            _rows_failed += (int64_t)rows;
+            log_async(_log, log_level::error,
+                "write buffer on \"{}\" failed to write {} rows",
+                _table, rows
+            );
+            for(auto& d : _drain)
+                if(!d.second)
+                    d.second = err;
+        }else
+            _rows_written += (int64_t)rows;
+        flush_cb = _on_flush;
+        
+        while(!_waiting.empty() && this->_fits(_waiting.front().bytes)){
+            waiting_t& w = _waiting.front();
+            this->_append(w.row, w.bytes);
+            admitted.emplace_back(w.cb);
+            _waiting.pop_front();
+        }
+        
+        if(this->_drained())
+            drained.swap(_drain);
+        else if(!_drain.empty())
+            this->_send();
+    }
+    
+    if(flush_cb)
+        flush_cb(err, rows);
+    for(auto& cb : admitted)
+        cb(nullptr);
+    for(auto& d : drained)
+        d.first(d.second);
+}
+
+bool write_buffer_t::_drained() const
+{
+    return _row_count == 0 && _in_flight == 0 && _waiting.empty();
+}
+
+} //namespace pq_async
@@ -21,6 +21,10 @@
 #include "data_large_object.h"
 #include "data_prepared.h"
 
+#include <poll.h>
+#include <random>
+#include <thread>
+
 namespace pq_async{
 
 database open(
@@ -56,7 +60,17 @@ database_t::database_t(
     _conn(NULL),
     _strand(strand),
     _lock(),
-    _log(log ? log : pq_async::default_logger())
+    _log(log ? log : pq_async::default_logger()),
+    _multiplexing(false),
+    _priority(connection_priority::normal),
+    _single_flight(false),
+    _slow_query_ms(-1),
+    _cache(),
+    _cache_tags(),
+    _listener(),
+    _last_sqlstate(),
+    _tx_attempts(0), _tx_retries(0), _tx_commits(0), _tx_failures(0),
+    _sync_mutex(), _sync_cv(), _loop_thread()
 {
     PQ_ASYNC_DEF_TRACE("ptr: {:p}", (void*)this);
     strand->enable_activate_on_requeue(false);
@@ -65,9 +79,75 @@ database_t::database_t(
 database_t::~database_t()
 {
     PQ_ASYNC_DEF_TRACE("ptr: {:p}", (void*)this);
+    connection_pool::cancel_pending(this);
     this->close();
 }
 
+/*!
+ * \brief the databases whose strand was driven by the calling thread
+ */
+struct database_t::loop_thread_dbs_t
+{
+    std::vector< std::weak_ptr<database_t> > dbs;
+    
+    ~loop_thread_dbs_t()
+    {
+        for(auto& w : dbs)
+            if(auto db = w.lock())
+                db->_loop_thread_exited(std::this_thread::get_id());
+    }
+};
+
+void database_t::_watch_loop_thread()
+{
+    static thread_local loop_thread_dbs_t lst;
+    lst.dbs.erase(
+        std::remove_if(lst.dbs.begin(), lst.dbs.end(),
+        [](const std::weak_ptr<database_t>& w){ return w.expired();}),
+        lst.dbs.end()
+    );
+    lst.dbs.emplace_back(this->weak_from_this());
+}
+
+void database_t::_loop_thread_exited(std::thread::id id)
+{
+    // another thread may already drive the strand
+    if(!_loop_thread.compare_exchange_strong(id, std::thread::id()))
+        return;
+    this->_notify_sync();
+}
+
+void database_t::wait_for_sync()
+{
+    while(this->working() && this->_strand->size() > 0){
+        std::thread::id loop_thread = _loop_thread.load();
+        if(loop_thread != std::thread::id() &&
+            loop_thread != std::this_thread::get_id()
+        ){
+            // the loop thread completes the work, sleep until a
+            // connection lock is released or the loop thread exits
+            std::unique_lock<std::mutex> lock(_sync_mutex);
+            _sync_cv.wait(lock, [this, loop_thread](){
+                return !this->working() ||
+                    _loop_thread.load() != loop_thread;
+            });
+            continue;
+        }
+        
+        this->_strand->run_n();
+        if(!this->working() || this->_strand->size() == 0)
+            break;
+        
+        // wait for the server instead of spinning on the strand
+        connection* conn = this->_conn;
+        pollfd pfd;
+        pfd.fd = conn && conn->conn() ? PQsocket(conn->conn()) : -1;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, pfd.fd < 0 ? 0 : 1, PQ_ASYNC_SYNC_POLL_MS);
+    }
+}
+
 void database_t::exec_queries(
     const std::string& sql, const md::callback::async_cb& cb)
 {
@@ -417,9 +497,7 @@ int database_t::_process_execute_result(PGresult* res)
         return 0;
     
     } else {
-        std::string errMsg = PQerrorMessage(_conn->conn());
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw this->_result_error(res);
     }
 }
 
@@ -439,9 +517,7 @@ data_table database_t::_process_query_result(PGresult* res)
         result_status != PGRES_SINGLE_TUPLE &&
         result_status != PGRES_TUPLES_OK
     ){
-        std::string errMsg = PQerrorMessage(_conn->conn());
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw this->_result_error(res);
     }
     
     data_table table(new pq_async::data_table_t());
@@ -484,9 +560,7 @@ data_row database_t::_process_query_single_result(PGresult* res)
         result_status != PGRES_TUPLES_OK &&
         result_status != PGRES_SINGLE_TUPLE
     ){
-        std::string errMsg = PQerrorMessage(_conn->conn());
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw this->_result_error(res);
     }
 
     data_table table(new pq_async::data_table_t());
@@ -517,7 +591,8 @@ data_row database_t::_process_query_single_result(PGresult* res)
 }
 
 data_prepared database_t::_process_send_prepare_result(
-    const std::string& name, bool auto_deallocate,
+    const std::string& name, const std::string& sql,
+    const std::vector<data_type>& types, bool auto_deallocate,
     connection_lock lock, PGresult* res)
 {
     PQ_ASYNC_DEF_TRACE("ptr: {:p}", (void*)this);
@@ -529,27 +604,75 @@ data_prepared database_t::_process_send_prepare_result(
     int result_status = PQresultStatus(res);
     
     if(result_status != PGRES_COMMAND_OK){
-        std::string errMsg = PQerrorMessage(_conn->conn());
-        PQclear(res);
-        throw pq_async::exception(errMsg);
+        throw this->_result_error(res);
     }
     
     PQclear(res);
-    return data_prepared(
-        new data_prepared_t(
-            this->shared_from_this(), name, auto_deallocate, lock
-        )
-    );
+    _conn->set_prepared(name, sql);
+    return _new_prepared(name, sql, types, auto_deallocate, lock);
+}
+
+void database_t::prepare(
+    const char* name, const char* sql, bool auto_deallocate,
+    const std::vector<data_type>& types,
+    md::callback::value_cb<data_prepared> cb)
+{
+    struct prepare_def_t
+    {
+        std::string name;
+        std::string sql;
+        std::vector<data_type> types;
+        bool auto_deallocate;
+        md::callback::value_cb<data_prepared> cb;
+    };
+    // the definition is shared so the task callback fits inline
+    auto def = std::make_shared<prepare_def_t>(prepare_def_t{
+        name, sql, types, auto_deallocate, cb
+    });
+    
+    this->open_connection(
+    [self=this->shared_from_this(), def]
+    (const md::callback::cb_error& err, connection_lock lock){
+        if(err){
+            def->cb(err, data_prepared());
+            return;
+        }
+        
+        try{
+            auto prep = self->_new_prepared(
+                def->name, def->sql, def->types, def->auto_deallocate,
+                lock
+            );
+            // the session may already hold that name, like the
+            // synchronous prepare it is then replaced
+            prep->_prepare_session(lock,
+            [prep, def](const md::callback::cb_error& err){
+                if(err){
+                    // not prepared by this instance
+                    prep->_auto_deallocate = false;
+                    def->cb(err, data_prepared());
+                    return;
+                }
+                def->cb(nullptr, prep);
+            });
+            
+        }catch(const std::exception& err){
+            def->cb(md::callback::cb_error(err), data_prepared());
+        }
+    });
 }
 
 data_prepared database_t::_new_prepared(
-    const char* name, bool auto_deallocate,
+    const std::string& name, const std::string& sql,
+    const std::vector<data_type>& types, bool auto_deallocate,
     connection_lock lock)
 {
+    // a multiplexed statement must not pin the connection, it will be
+    // prepared again on the connection used to execute it when needed.
     return data_prepared(
         new data_prepared_t(
-            this->shared_from_this(), name, auto_deallocate,
-            lock
+            this->shared_from_this(), name, sql, types, auto_deallocate,
+            _multiplexing ? connection_lock() : lock
         )
     );
 }
@@ -574,4 +697,190 @@ data_large_object database_t::get_lo(const pq_async::oid& lo_oid)
 }
 
 
+int32_t transaction_policy::delay(int32_t attempt) const
+{
+    int64_t cap = base_delay_ms;
+    for(int32_t i = 1; i < attempt && cap < max_delay_ms; ++i)
+        cap *= 2;
+    if(cap > max_delay_ms)
+        cap = max_delay_ms;
+    if(cap <= 0)
+        return 0;
+    
+    // full jitter, the contending transactions must not replay in step
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<int32_t> dist(0, (int32_t)cap);
+    return dist(gen);
+}
+
+void database_t::run_transaction(
+    const transaction_fn& fn, const transaction_policy& policy)
+{
+    if(this->in_transaction())
+        throw pq_async::exception("Already in a transaction!");
+    
+    // the connection is held across the attempts, commit and rollback
+    // only release _lock
+    this->wait_for_sync();
+    connection_lock held = this->open_connection();
+    for(int32_t attempt = 1;; ++attempt){
+        ++_tx_attempts;
+        _lock = held;
+        try{
+            this->begin();
+            fn(this->shared_from_this());
+            this->commit();
+            ++_tx_commits;
+            return;
+            
+        }catch(const std::exception& err){
+            if(this->in_transaction()){
+                try{
+                    this->rollback();
+                }catch(const std::exception& rb_err){
+                    log_async(_log, log_level::error,
+                        "transaction rollback failed: {}", rb_err.what()
+                    );
+                    ++_tx_failures;
+                    throw;
+                }
+            }
+            
+            auto sql_err = dynamic_cast<const sql_exception*>(&err);
+            if(!sql_err || attempt >= policy.max_attempts ||
+                !policy.retryable(sql_err->sqlstate())
+            ){
+                ++_tx_failures;
+                throw;
+            }
+            
+            ++_tx_retries;
+            PQ_ASYNC_DBG(_log,
+                "replaying transaction after {}, attempt {}",
+                sql_err->sqlstate(), attempt +1
+            );
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(policy.delay(attempt))
+            );
+        }
+    }
+}
+
+void database_t::_run_transaction(std::shared_ptr<transaction_state_t> st)
+{
+    ++st->attempt;
+    ++_tx_attempts;
+    // the connection of the first attempt is reused by the replays
+    if(st->lock)
+        _lock = st->lock;
+    
+    auto self = this->shared_from_this();
+    this->begin([self, st](const md::callback::cb_error& err){
+        if(err){
+            self->_replay_transaction(st, err);
+            return;
+        }
+        
+        st->lock = self->_lock;
+        self->_conn->set_last_sqlstate(std::string());
+        try{
+            st->fn(self, [self, st](const md::callback::cb_error& err){
+                if(err){
+                    self->_replay_transaction(st, err);
+                    return;
+                }
+                self->commit([self, st](const md::callback::cb_error& err){
+                    if(err){
+                        self->_replay_transaction(st, err);
+                        return;
+                    }
+                    ++self->_tx_commits;
+                    st->lock.reset();
+                    st->cb(nullptr);
+                });
+            });
+        }catch(const std::exception& fn_err){
+            self->_replay_transaction(st, md::callback::cb_error(fn_err));
+        }
+    });
+}
+
+void database_t::_replay_transaction(
+    std::shared_ptr<transaction_state_t> st,
+    const md::callback::cb_error& err)
+{
+    auto self = this->shared_from_this();
+    // the state of the failed statement, other statements of that
+    // database_t may run on other connections meanwhile
+    std::string state = st->lock ? st->lock->conn()->last_sqlstate() : "";
+    auto next = [self, st, err, state](){
+        if(st->attempt >= st->policy.max_attempts ||
+            !st->policy.retryable(state)
+        ){
+            ++self->_tx_failures;
+            st->lock.reset();
+            st->cb(err);
+            return;
+        }
+        
+        ++self->_tx_retries;
+        PQ_ASYNC_DBG(self->_log,
+            "replaying transaction after {}, attempt {}",
+            state, st->attempt +1
+        );
+        int32_t delay = st->policy.delay(st->attempt);
+        if(reactor r = default_reactor()){
+            r->add_timer(delay, [self, st](){
+                self->_run_transaction(st);
+            });
+            return;
+        }
+        timeval tv{ delay / 1000, (delay % 1000) * 1000 };
+        std::unique_ptr<std::function<void()>> replay(
+            new std::function<void()>([self, st](){
+                self->_run_transaction(st);
+            })
+        );
+        if(event_base_once(
+            self->_strand->ev_base(), -1, EV_TIMEOUT,
+            [](evutil_socket_t fd, short events, void* arg){
+                std::unique_ptr<std::function<void()>> fn(
+                    (std::function<void()>*)arg
+                );
+                (*fn)();
+            },
+            replay.get(), &tv
+        ) == 0){
+            // owned by the event base until the callback runs
+            replay.release();
+            return;
+        }
+        
+        log_async(self->_log, log_level::error,
+            "unable to schedule the transaction replay"
+        );
+        ++self->_tx_failures;
+        st->lock.reset();
+        st->cb(err);
+    };
+    
+    if(!this->in_transaction()){
+        next();
+        return;
+    }
+    this->rollback([self, st, next](const md::callback::cb_error& rb_err){
+        if(rb_err){
+            log_async(self->_log, log_level::error,
+                "transaction rollback failed"
+            );
+            ++self->_tx_failures;
+            st->lock.reset();
+            st->cb(rb_err);
+            return;
+        }
+        next();
+    });
+}
+
+
 } //ns: pq_async
\ No newline at end of file
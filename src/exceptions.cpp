@@ -42,6 +42,20 @@ namespace pq_async{
     
     connection_pool_assign_exception::~connection_pool_assign_exception(){}
     
+    connection_pool_admission_exception::connection_pool_admission_exception(const std::string& message)
+        : pq_async::exception(message) { }
+
+    connection_pool_admission_exception::connection_pool_admission_exception(const char* message)
+        : pq_async::exception(message) { }
+    
+    connection_pool_admission_exception::~connection_pool_admission_exception(){}
+    
+    sql_exception::sql_exception(
+        const std::string& message, const std::string& sqlstate)
+        : pq_async::exception(message), _sqlstate(sqlstate) { }
+    
+    sql_exception::~sql_exception(){}
+    
     
     //cb_error md::callback::cb_error::no_err;
 
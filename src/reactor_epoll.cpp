@@ -0,0 +1,206 @@
+/*
+MIT License
+
+Copyright (c) 2011-2019 Michel Dénommée
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "reactor_epoll.h"
+
+#ifdef __linux__
+
+#include "exceptions.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#define PQ_ASYNC_EPOLL_MAX_EVENTS 64
+
+namespace pq_async{
+
+epoll_reactor open_epoll_reactor()
+{
+    return epoll_reactor(new epoll_reactor_t());
+}
+
+epoll_reactor_t::epoll_reactor_t()
+    : _epfd(epoll_create1(EPOLL_CLOEXEC)), _tfd(-1)
+{
+    if(_epfd < 0)
+        throw pq_async::exception(
+            std::string("Unable to create the epoll instance: ") +
+            strerror(errno)
+        );
+    
+    // the timers expire through a timerfd so that the epoll descriptor
+    // becomes readable for a host loop nesting it
+    _tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = _tfd;
+    if(_tfd < 0 || epoll_ctl(_epfd, EPOLL_CTL_ADD, _tfd, &ev)){
+        std::string err = strerror(errno);
+        if(_tfd >= 0)
+            ::close(_tfd);
+        ::close(_epfd);
+        throw pq_async::exception("Unable to create the timer: " + err);
+    }
+}
+
+epoll_reactor_t::~epoll_reactor_t()
+{
+    if(_tfd >= 0)
+        ::close(_tfd);
+    _tfd = -1;
+    if(_epfd >= 0)
+        ::close(_epfd);
+    _epfd = -1;
+}
+
+void epoll_reactor_t::watch(
+    int fd, bool want_read, bool want_write, handler_t on_ready)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool known = _watched.find(fd) != _watched.end();
+    if(epoll_ctl(_epfd, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev))
+        throw pq_async::exception(
+            std::string("Unable to watch the socket: ") + strerror(errno)
+        );
+    _watched[fd] = on_ready;
+}
+
+void epoll_reactor_t::unwatch(int fd)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _watched.find(fd);
+    if(it == _watched.end())
+        return;
+    _watched.erase(it);
+    // the socket may already be closed, nothing to report then
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void epoll_reactor_t::add_timer(int32_t timeout_ms, handler_t on_timeout)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _timers.emplace(
+        clock_t::now() + std::chrono::milliseconds(timeout_ms), on_timeout
+    );
+    // a new earliest timer wakes a run_once blocked in epoll_wait
+    if(it == _timers.begin())
+        _arm_timer();
+}
+
+void epoll_reactor_t::_arm_timer()
+{
+    itimerspec ts;
+    memset(&ts, 0, sizeof(ts));
+    if(!_timers.empty()){
+        // steady_clock is CLOCK_MONOTONIC, an expired deadline fires now
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            _timers.begin()->first.time_since_epoch()
+        ).count();
+        if(ns <= 0)
+            ns = 1;
+        ts.it_value.tv_sec = ns / 1000000000;
+        ts.it_value.tv_nsec = ns % 1000000000;
+    }
+    if(timerfd_settime(_tfd, TFD_TIMER_ABSTIME, &ts, nullptr))
+        throw pq_async::exception(
+            std::string("Unable to arm the timer: ") + strerror(errno)
+        );
+}
+
+size_t epoll_reactor_t::run_once(int32_t timeout_ms)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!_timers.empty()){
+            auto next = std::chrono::duration_cast<std::chrono::milliseconds>(
+                _timers.begin()->first - clock_t::now()
+            ).count();
+            if(next < 0)
+                next = 0;
+            if(timeout_ms < 0 || next < timeout_ms)
+                timeout_ms = (int32_t)next;
+        }
+    }
+    
+    epoll_event events[PQ_ASYNC_EPOLL_MAX_EVENTS];
+    int n = epoll_wait(_epfd, events, PQ_ASYNC_EPOLL_MAX_EVENTS, timeout_ms);
+    if(n < 0 && errno != EINTR)
+        throw pq_async::exception(
+            std::string("epoll_wait failed: ") + strerror(errno)
+        );
+    
+    // the handlers run unlocked, they may watch or unwatch sockets
+    std::vector<handler_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool expired = false;
+        for(int i = 0; i < n; ++i){
+            if(events[i].data.fd == _tfd){
+                expired = true;
+                continue;
+            }
+            auto it = _watched.find(events[i].data.fd);
+            if(it != _watched.end())
+                ready.emplace_back(it->second);
+        }
+        
+        auto now = clock_t::now();
+        bool fired = false;
+        while(!_timers.empty() && _timers.begin()->first <= now){
+            ready.emplace_back(std::move(_timers.begin()->second));
+            _timers.erase(_timers.begin());
+            fired = true;
+        }
+        if(expired){
+            uint64_t count;
+            while(::read(_tfd, &count, sizeof(count)) > 0){}
+        }
+        if(expired || fired)
+            _arm_timer();
+    }
+    
+    for(auto& h : ready)
+        h();
+    return ready.size();
+}
+
+size_t epoll_reactor_t::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _watched.size() + _timers.size();
+}
+
+} //namespace pq_async
+
+#endif //__linux__
@@ -67,4 +67,17 @@ void swap8(const int64_t* inp, int64_t* outp, bool to_network)
     memcpy(outp, out, 8);
 }
 
+uint64_t hash_bytes(const char* data, size_t len, uint64_t seed)
+{
+    uint64_t h = 14695981039346656037ULL ^ seed;
+    for(size_t i = 0; i < len; ++i){
+        h ^= (uint64_t)(unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
 } //namespace ps_async